@@ -46,6 +46,7 @@ VALIDATIONS = [
     ('server!keepalive_max_requests', validations.is_positive_int),
     ("server!keepalive$",             validations.is_boolean),
     ("server!thread_number",          validations.is_positive_int),
+    ("server!reuseport",              validations.is_boolean),
     ("server!nonces_cleanup_lapse",   validations.is_positive_int),
     ("server!iocache$",               validations.is_boolean),
     ("server!iocache!max_size",       validations.is_positive_int_4_multiple),
@@ -53,6 +54,9 @@ VALIDATIONS = [
     ("server!iocache!max_file_size",  validations.is_positive_int),
     ("server!iocache!lasting_stat",   validations.is_positive_int),
     ("server!iocache!lasting_mmap",   validations.is_positive_int),
+    ("server!iocache!inotify",        validations.is_boolean),
+    ("server!iocache!lasting_watched", validations.is_positive_int),
+    ("server!iocache!max_fds",        validations.is_positive_int),
     ("server!tls!protocol!SSLv2",     validations.is_boolean),
     ("server!tls!timeout_handshake",  validations.is_positive_int),
     ("server!tls!dh_param512",        validations.is_local_file_exists),
@@ -75,6 +79,7 @@ NOTE_SENDFILE_MAX = N_('Maximum size of a file to use sendfile(). Default: 2 GB.
 NOTE_PANIC_ACTION = N_('Name a program that will be called if, by some reason, the server fails. Default: <em>cherokee-panic</em>.')
 NOTE_PID_FILE     = N_('Path of the PID file. If empty, the file will not be created.')
 NOTE_LISTEN_Q     = N_('Max. length of the incoming connection queue.')
+NOTE_REUSEPORT    = N_('Each thread accepts connections through its own listening socket (SO_REUSEPORT). Default: No.')
 NOTE_REUSE_CONNS  = N_('Set the number of how many internal connections can be held for reuse by each thread. Default: 20.')
 NOTE_FLUSH_TIME   = N_('Sets the number of seconds between log consolidations (flushes). Default: 10 seconds.')
 NOTE_NONCES_TIME  = N_('Time lapse (in seconds) between Nonce cache clean ups.')
@@ -87,6 +92,9 @@ NOTE_IO_MIN_SIZE  = N_('Files under this size (in bytes) will not be cached.')
 NOTE_IO_MAX_SIZE  = N_('Files over this size (in bytes) will not be cached.')
 NOTE_IO_LAST_STAT = N_('How long (in seconds) the file information should last cached without refreshing it.')
 NOTE_IO_LAST_MMAP = N_('How long (in seconds) the file content should last cached.')
+NOTE_IO_MAX_FDS   = N_('Number of file descriptors that can be kept open for files sent with sendfile(). Default: 0 (disabled).')
+NOTE_IO_INOTIFY   = N_('Keep the cached files until the system reports a change on them, instead of expiring them. Linux only. Default: No.')
+NOTE_IO_LAST_WATCH = N_('How long (in seconds) the watched files can last cached at most, in case a change is not reported. Default: 3600.')
 NOTE_DH512        = N_('Path to a Diffie Hellman (DH) parameters PEM file: 512 bits.')
 NOTE_DH1024       = N_('Path to a Diffie Hellman (DH) parameters PEM file: 1024 bits.')
 NOTE_DH2048       = N_('Path to a Diffie Hellman (DH) parameters PEM file: 2048 bits.')
@@ -137,6 +145,7 @@ class ResourcesWidget (CTK.Container):
         table.Add (_('Thread Policy'),          CTK.ComboCfg('server!thread_policy', trans_options(THREAD_POLICY)), _(NOTE_THREAD))
         table.Add (_('File descriptors'),       CTK.TextCfg('server!fdlimit',              True), _(NOTE_FD_NUM))
         table.Add (_('Listening queue length'), CTK.TextCfg('server!listen_queue',         True), _(NOTE_LISTEN_Q))
+        table.Add (_('Per-thread listeners'),   CTK.CheckCfgText('server!reuseport', False, _('Enabled')), _(NOTE_REUSEPORT))
         table.Add (_('Reuse connections'),      CTK.TextCfg('server!max_connection_reuse', True), _(NOTE_REUSE_CONNS))
         table.Add (_('Log flush time'),         CTK.TextCfg('server!log_flush_lapse',      True), _(NOTE_FLUSH_TIME))
         table.Add (_('Nonces clean up time'),   CTK.TextCfg('server!nonces_cleanup_lapse', True), _(NOTE_NONCES_TIME))
@@ -155,6 +164,9 @@ class IOCacheWidget (CTK.Container):
         table.Add (_('File Max Size'), CTK.TextCfg('server!iocache!max_file_size', True), _(NOTE_IO_MAX_SIZE))
         table.Add (_('Lasting: stat'), CTK.TextCfg('server!iocache!lasting_stat',  True), _(NOTE_IO_LAST_STAT))
         table.Add (_('Lasting: mmap'), CTK.TextCfg('server!iocache!lasting_mmap',  True), _(NOTE_IO_LAST_MMAP))
+        table.Add (_('Descriptors'),   CTK.TextCfg('server!iocache!max_fds',       True), _(NOTE_IO_MAX_FDS))
+        table.Add (_('Watch changes'), CTK.CheckCfgText('server!iocache!inotify', False, _('Enabled')), _(NOTE_IO_INOTIFY))
+        table.Add (_('Lasting: watched'), CTK.TextCfg('server!iocache!lasting_watched', True), _(NOTE_IO_LAST_WATCH))
 
         self += CTK.RawHTML ("<h2>%s</h2>" %(_('I/O cache')))
         self += CTK.Indenter(table)
@@ -33,6 +33,8 @@ from consts import *
 
 HELPS = CgiBase.HELPS + [('modules_handlers_fcgi', "FastCGI")]
 
+NOTE_REUSE_MAX = N_("Maximum number of idle connections per server that can be kept opened for reuse. Keep it under the number of server processes. (Default: 0, disabled)")
+
 class Plugin_fcgi (CgiBase.PluginHandlerCGI):
     def __init__ (self, key, **kwargs):
         kwargs['show_script_alias']  = True
@@ -47,6 +49,7 @@ class Plugin_fcgi (CgiBase.PluginHandlerCGI):
         modul = CTK.PluginSelector('%s!balancer'%(key), trans_options(Cherokee.support.filter_available (BALANCERS)))
         table = CTK.PropsTable()
         table.Add (_("Balancer"), modul.selector_widget, _(Balancer.NOTE_BALANCER))
+        table.Add (_("Reuse connections"), CTK.TextCfg ('%s!reuse_max'%(key), True), _(NOTE_REUSE_MAX))
 
         self += CTK.RawHTML ('<h2>%s</h2>' %(_('FastCGI Specific')))
         self += CTK.Indenter (table)
@@ -28,7 +28,12 @@ import Handler
 URL_APPLY = '/plugin/file/apply'
 HELPS     = [('modules_handlers_file', _("Static Content"))]
 
-NOTE_IO_CACHE = N_('Enables an internal I/O cache that improves performance.')
+NOTE_IO_CACHE    = N_('Enables an internal I/O cache that improves performance.')
+NOTE_GZIP_STATIC = N_('Send the precompressed file.gz copy of a file, when it exists and it is up to date, to clients accepting the gzip encoding.')
+NOTE_GZIP_CACHE  = N_('Compress each file once and reuse the compressed copy for all the clients accepting the gzip encoding.')
+NOTE_GZIP_LEVEL  = N_('Compression level of the cached copies, from 1 to 9. Default: 9.')
+NOTE_GZIP_MAX    = N_('Files bigger than this are not compressed in advance. Default: 4194304 bytes.')
+NOTE_GZIP_DIR    = N_('Total size of the cached copies. The oldest ones are removed beyond it. Default: 67108864 bytes.')
 
 
 class Plugin_file (Handler.PluginHandler):
@@ -38,6 +43,11 @@ class Plugin_file (Handler.PluginHandler):
 
         table = CTK.PropsTable()
         table.Add (_("Use I/O cache"), CTK.CheckCfgText("%s!iocache"%(self.key), True, _('Enabled')), _(NOTE_IO_CACHE))
+        table.Add (_("Precompressed files"), CTK.CheckCfgText("%s!gzip_static"%(self.key), False, _('Enabled')), _(NOTE_GZIP_STATIC))
+        table.Add (_("Cache compressed copies"), CTK.CheckCfgText("%s!gzip_cache"%(self.key), False, _('Enabled')), _(NOTE_GZIP_CACHE))
+        table.Add (_("Compression level"), CTK.TextCfg("%s!gzip_cache_level"%(self.key), True), _(NOTE_GZIP_LEVEL))
+        table.Add (_("Max. compressed file size"), CTK.TextCfg("%s!gzip_cache_max_size"%(self.key), True), _(NOTE_GZIP_MAX))
+        table.Add (_("Max. cache size"), CTK.TextCfg("%s!gzip_cache_dir_size"%(self.key), True), _(NOTE_GZIP_DIR))
 
         submit = CTK.Submitter (URL_APPLY)
         submit += table
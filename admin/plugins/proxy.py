@@ -35,6 +35,7 @@ URL_APPLY = '/plugin/proxy/apply'
 HELPS     = [('modules_handlers_proxy', N_("Reverse Proxy"))]
 
 NOTE_REUSE_MAX       = N_("Maximum number of connections per server that the proxy can try to keep opened.")
+NOTE_REUSE_MIN       = N_("Number of idle connections per server that the proxy opens in advance. (Default: 0)")
 NOTE_ALLOW_KEEPALIVE = N_("Allow the server to use Keep-alive connections with the back-end servers.")
 NOTE_PRESERVE_HOST   = N_("Preserve the original \"Host:\" header sent by the client. (Default: No)")
 NOTE_PRESERVE_SERVER = N_("Preserve the \"Server:\" header sent by the back-end server. (Default: No)")
@@ -42,6 +43,7 @@ NOTE_ERROR_HANDLER   = N_("Use the VServer error handler, whenever an error resp
 
 VALS = [
     ('.+?!reuse_max', validations.is_number_gt_0),
+    ('.+?!reuse_min', validations.is_number),
 ]
 
 
@@ -237,6 +239,7 @@ class Plugin_proxy (Handler.PluginHandler):
         # Properties
         table = CTK.PropsTable()
         table.Add (_('Reuse connections'),         CTK.TextCfg ('%s!reuse_max'%(key), True), _(NOTE_REUSE_MAX))
+        table.Add (_('Pre-opened connections'),    CTK.TextCfg ('%s!reuse_min'%(key), True), _(NOTE_REUSE_MIN))
         table.Add (_('Allow Keepalive'),           CTK.CheckCfgText('%s!in_allow_keepalive'%(key),  True,  _('Allow')),    _(NOTE_ALLOW_KEEPALIVE))
         table.Add (_('Preserve Host Header'),      CTK.CheckCfgText('%s!in_preserve_host'%(key),    False, _('Preserve')), _(NOTE_PRESERVE_HOST))
         table.Add (_('Preserve Server Header'),    CTK.CheckCfgText('%s!out_preserve_server'%(key), False, _('Preserve')), _(NOTE_PRESERVE_SERVER))
@@ -341,16 +341,17 @@ cherokee_access_add_domain (cherokee_access_t *entry, char *domain)
 	addr = addr_info;
 	while (addr != NULL) {
 		ret = cherokee_ntop (addr->ai_family, addr->ai_addr, ip, sizeof(ip));
-		if (unlikely(ret!=ret_ok)) return ret;
+		if (unlikely(ret!=ret_ok)) break;
 
 		TRACE (ENTRIES, "Access: domain '%s' -> IP: %s\n", domain, ip);
 		ret = cherokee_access_add_ip (entry, (char *)ip);
-		if (unlikely(ret!=ret_ok)) return ret;
+		if (unlikely(ret!=ret_ok)) break;
 
 		addr = addr->ai_next;
 	}
 
-	return ret_ok;
+	cherokee_resolv_cache_release_addrinfo (resolv, addr_info);
+	return ret;
 }
 
 
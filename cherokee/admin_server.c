@@ -369,6 +369,15 @@ sources_while (cherokee_buffer_t *key, void *value, void *param)
 	cherokee_dwriter_cstring (dwriter, "bind");
 	cherokee_dwriter_bstring (dwriter, &source->original);
 
+	cherokee_dwriter_cstring (dwriter, "pool_hits");
+	cherokee_dwriter_integer (dwriter, source->pool.hits);
+
+	cherokee_dwriter_cstring (dwriter, "pool_misses");
+	cherokee_dwriter_integer (dwriter, source->pool.misses);
+
+	cherokee_dwriter_cstring (dwriter, "pool_evictions");
+	cherokee_dwriter_integer (dwriter, source->pool.evictions);
+
 	if (source->type == source_interpreter) {
 		cherokee_source_interpreter_t *source_int = SOURCE_INT(source);
 
@@ -402,6 +411,39 @@ cherokee_admin_server_reply_get_sources (cherokee_handler_t *hdl,
 	return ret_ok;
 }
 
+ret_t
+cherokee_admin_server_reply_get_tls (cherokee_handler_t *hdl,
+				     cherokee_dwriter_t *dwriter)
+{
+	cherokee_server_t  *srv  = HANDLER_SRV(hdl);
+	cherokee_cryptor_t *cryp = srv->cryptor;
+
+	cherokee_dwriter_dict_open (dwriter);
+
+	cherokee_dwriter_cstring (dwriter, "enabled");
+	cherokee_dwriter_bool    (dwriter, (cryp != NULL));
+
+	if (cryp != NULL) {
+		cherokee_dwriter_cstring (dwriter, "full_handshakes");
+		cherokee_dwriter_integer (dwriter, cryp->stats.full_handshakes);
+
+		cherokee_dwriter_cstring (dwriter, "resumed");
+		cherokee_dwriter_integer (dwriter, cryp->stats.resumed);
+
+		cherokee_dwriter_cstring (dwriter, "session_cache_hits");
+		cherokee_dwriter_integer (dwriter, cryp->stats.cache_hits);
+
+		cherokee_dwriter_cstring (dwriter, "session_cache_misses");
+		cherokee_dwriter_integer (dwriter, cryp->stats.cache_misses);
+
+		cherokee_dwriter_cstring (dwriter, "ticket_hits");
+		cherokee_dwriter_integer (dwriter, cryp->stats.ticket_hits);
+	}
+
+	cherokee_dwriter_dict_close (dwriter);
+	return ret_ok;
+}
+
 ret_t
 cherokee_admin_server_reply_kill_source (cherokee_handler_t *hdl,
 					 cherokee_dwriter_t *dwriter,
@@ -29,16 +29,44 @@
 #include "list.h"
 #include "util.h"
 #include "bogotime.h"
+#include "crc32.h"
 
 #define ENTRIES "avl,flcache"
 
 
+static crc_t
+hash_request (cherokee_buffer_t *request,
+	      cherokee_buffer_t *query_string)
+{
+	crc_t crc;
+
+	/* Keys are compared case insensitively
+	 */
+	crc = crc32_case_partial_sz (0, request->buf, request->len);
+	return crc32_case_partial_sz (crc, query_string->buf, query_string->len);
+}
+
+static crc_t
+hash_conn (cherokee_connection_t *conn)
+{
+	cherokee_buffer_t *request      = &conn->request;
+	cherokee_buffer_t *query_string = &conn->query_string;
+
+	if (conn->request_original.len > 0) {
+		request = &conn->request_original;
+	}
+
+	if (conn->query_string_original.len > 0) {
+		query_string = &conn->query_string_original;
+	}
+
+	return hash_request (request, query_string);
+}
+
 static ret_t
 conn_to_node (cherokee_connection_t       *conn,
 	      cherokee_avl_flcache_node_t *node)
 {
-	cherokee_avl_generic_node_init (AVL_GENERIC_NODE(node));
-
 	/* Request */
 	cherokee_buffer_init (&node->request);
 
@@ -57,6 +85,7 @@ conn_to_node (cherokee_connection_t       *conn,
 	 */
 	cherokee_buffer_init (&node->content_encoding);
 
+	node->hash = hash_request (&node->request, &node->query_string);
 	return ret_ok;
 }
 
@@ -69,12 +98,21 @@ node_new (cherokee_avl_flcache_node_t **node,
 
 	INIT_LIST_HEAD (&n->to_del);
 	cherokee_buffer_init (&n->file);
+	cherokee_buffer_init (&n->header);
+	cherokee_buffer_init (&n->body);
 	CHEROKEE_MUTEX_INIT (&n->ref_count_mutex, CHEROKEE_MUTEX_FAST);
 
 	n->conn_ref    = NULL;
 	n->status      = flcache_status_undef;
 	n->ref_count   = 0;
 	n->file_size   = 0;
+	n->in_memory   = false;
+	n->memory_size = 0;
+	n->revalidating = false;
+	n->replaces    = NULL;
+	n->notify[0]   = -1;
+	n->notify[1]   = -1;
+	n->storing_done = false;
 	n->valid_until = TIME_MAX;
 	n->created_at  = cherokee_bogonow_now;
 
@@ -89,10 +127,17 @@ node_mrproper (cherokee_avl_flcache_node_t *node)
 {
 	CHEROKEE_MUTEX_DESTROY (&node->ref_count_mutex);
 
+	if (node->notify[0] != -1) {
+		cherokee_fd_close (node->notify[0]);
+		cherokee_fd_close (node->notify[1]);
+	}
+
 	cherokee_buffer_mrproper (&node->request);
 	cherokee_buffer_mrproper (&node->query_string);
 	cherokee_buffer_mrproper (&node->content_encoding);
 	cherokee_buffer_mrproper (&node->file);
+	cherokee_buffer_mrproper (&node->header);
+	cherokee_buffer_mrproper (&node->body);
 
 	return ret_ok;
 }
@@ -276,13 +321,10 @@ cmp_encoding (cherokee_avl_flcache_node_t *A,
 
 static int
 node_cmp (cherokee_avl_flcache_node_t *A,
-	  cherokee_avl_flcache_node_t *B,
-	  cherokee_avl_flcache_t      *avl)
+	  cherokee_avl_flcache_node_t *B)
 {
 	int re;
 
-	UNUSED (avl);
-
 	/* Comparing with itself
 	 */
 	if (A == B)
@@ -313,41 +355,48 @@ node_cmp (cherokee_avl_flcache_node_t *A,
 }
 
 static int
-node_is_empty (cherokee_avl_flcache_node_t *key)
+node_match (cherokee_avl_flcache_node_t *node,
+	    cherokee_avl_flcache_node_t *key)
 {
 	/* The key object can be either be:
 	 * 1.- A reference to a cherokee_connection_t object
 	 * 2.- An object storing information
 	 */
-	if (key->conn_ref)
-		return false;
-
-	return cherokee_buffer_is_empty (&key->request);
+	return (node_cmp (key, node) == 0);
 }
 
 
 ret_t
 cherokee_avl_flcache_init (cherokee_avl_flcache_t *avl)
 {
-	cherokee_avl_generic_t *gen = AVL_GENERIC(avl);
+	ret_t ret;
 
-	cherokee_avl_generic_init (gen);
-	CHEROKEE_RWLOCK_INIT (&avl->base_rwlock, NULL);
+	ret = cherokee_hashtable_init (&avl->table);
+	if (unlikely (ret != ret_ok))
+		return ret;
 
-	gen->node_mrproper = (avl_gen_node_mrproper_t) node_mrproper;
-	gen->node_cmp      = (avl_gen_node_cmp_t) node_cmp;
-	gen->node_is_empty = (avl_gen_node_is_empty_t) node_is_empty;
+	CHEROKEE_RWLOCK_INIT (&avl->base_rwlock, NULL);
+	INIT_LIST_HEAD (&avl->retired);
+	avl->memory_used = 0;
 
 	return ret_ok;
 }
 
 
 ret_t
-cherokee_avl_flcache_mrproper (cherokee_avl_flcache_t *avl,
-			       cherokee_func_free_t    free_value)
+cherokee_avl_flcache_mrproper (cherokee_avl_flcache_t *avl)
 {
+	cherokee_list_t *i, *j;
+
+	/* The entries are the values: they are freed along with
+	 * the table.
+	 */
+	list_for_each_safe (i, j, &avl->retired) {
+		node_free (list_entry (i, cherokee_avl_flcache_node_t, to_del));
+	}
+
 	CHEROKEE_RWLOCK_DESTROY (&avl->base_rwlock);
-	cherokee_avl_mrproper (AVL_GENERIC(avl), free_value);
+	cherokee_hashtable_mrproper (&avl->table, (cherokee_func_free_t) node_free);
 	return ret_ok;
 }
 
@@ -367,11 +416,25 @@ cherokee_avl_flcache_add (cherokee_avl_flcache_t       *avl,
 	}
 
 	CHEROKEE_RWLOCK_WRITER (&avl->base_rwlock);
-	ret = cherokee_avl_generic_add (AVL_GENERIC(avl), AVL_GENERIC_NODE(n), n);
+
+	/* Do not duplicate entries
+	 */
+	ret = cherokee_hashtable_get (&avl->table, n->hash,
+				      (cherokee_hashtable_match_func_t) node_match, n, NULL);
+	if (ret == ret_ok) {
+		ret = ret_error;
+	} else {
+		/* It comes referenced, so a cleanup cannot take
+		 * it away before the caller starts storing it.
+		 */
+		n->ref_count = 1;
+		ret = cherokee_hashtable_add (&avl->table, n->hash, n);
+	}
+
 	CHEROKEE_RWLOCK_UNLOCK (&avl->base_rwlock);
 
 	if (ret != ret_ok) {
-		/* n was already freed by add() */
+		node_free (n);
 		return ret;
 	}
 
@@ -390,10 +453,198 @@ cherokee_avl_flcache_get (cherokee_avl_flcache_t       *avl,
 
 	tmp.conn_ref = conn;
 
+	/* The node is referenced while the table is locked, so
+	 * it cannot be removed in the meanwhile.
+	 */
 	CHEROKEE_RWLOCK_READER (&avl->base_rwlock);
-	ret = cherokee_avl_generic_get (AVL_GENERIC(avl), AVL_GENERIC_NODE(&tmp), (void **)node);
+	ret = cherokee_hashtable_get (&avl->table, hash_conn (conn),
+				      (cherokee_hashtable_match_func_t) node_match, &tmp, (void **)node);
+	if (ret == ret_ok) {
+		CHEROKEE_MUTEX_LOCK (&(*node)->ref_count_mutex);
+		(*node)->ref_count += 1;
+		CHEROKEE_MUTEX_UNLOCK (&(*node)->ref_count_mutex);
+	}
+	CHEROKEE_RWLOCK_UNLOCK (&avl->base_rwlock);
+
+	return ret;
+}
+
+
+ret_t
+cherokee_avl_flcache_unref (cherokee_avl_flcache_node_t *node)
+{
+	CHEROKEE_MUTEX_LOCK (&node->ref_count_mutex);
+	node->ref_count -= 1;
+	CHEROKEE_MUTEX_UNLOCK (&node->ref_count_mutex);
+
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_avl_flcache_node_wait (cherokee_avl_flcache_node_t *node,
+				int                         *fd)
+{
+	CHEROKEE_MUTEX_LOCK (&node->ref_count_mutex);
+
+	/* It is done already: nothing to wait for
+	 */
+	if (node->storing_done) {
+		CHEROKEE_MUTEX_UNLOCK (&node->ref_count_mutex);
+		return ret_ok;
+	}
+
+	/* The pipe is created along with the first waiter
+	 */
+	if (node->notify[0] == -1) {
+		if (cherokee_pipe (node->notify) != 0) {
+			node->notify[0] = -1;
+			node->notify[1] = -1;
+
+			CHEROKEE_MUTEX_UNLOCK (&node->ref_count_mutex);
+			return ret_error;
+		}
+
+		cherokee_fd_set_nonblocking (node->notify[0], true);
+		cherokee_fd_set_nonblocking (node->notify[1], true);
+		cherokee_fd_set_closexec (node->notify[0]);
+		cherokee_fd_set_closexec (node->notify[1]);
+	}
+
+	*fd = node->notify[0];
+
+	CHEROKEE_MUTEX_UNLOCK (&node->ref_count_mutex);
+	return ret_eagain;
+}
+
+
+ret_t
+cherokee_avl_flcache_node_wake (cherokee_avl_flcache_node_t *node)
+{
+	ssize_t re;
+
+	CHEROKEE_MUTEX_LOCK (&node->ref_count_mutex);
+
+	node->storing_done = true;
+
+	/* The byte is not read back, so the pipe stays readable
+	 * for every waiter, in every thread.
+	 */
+	if (node->notify[1] != -1) {
+		do {
+			re = write (node->notify[1], "", 1);
+		} while ((re < 0) && (errno == EINTR));
+	}
+
+	CHEROKEE_MUTEX_UNLOCK (&node->ref_count_mutex);
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_avl_flcache_add_replacement (cherokee_avl_flcache_t       *avl,
+				      cherokee_connection_t        *conn,
+				      cherokee_avl_flcache_node_t  *stale,
+				      cherokee_avl_flcache_node_t **node)
+{
+	ret_t                        ret;
+	cherokee_avl_flcache_node_t *n    = NULL;
+
+	UNUSED (avl);
+
+	ret = node_new (&n, conn);
+	if ((ret != ret_ok) || (n == NULL)) {
+		node_free (n);
+		return ret;
+	}
+
+	/* The stale entry reference is handed over to the
+	 * replacement. It is released once it is swapped.
+	 */
+	n->replaces  = stale;
+	n->ref_count = 1;
+
+	*node = n;
+	return ret_ok;
+}
+
+
+static ret_t
+node_remove (cherokee_avl_flcache_t      *avl,
+	     cherokee_avl_flcache_node_t *node)
+{
+	ret_t ret;
+
+	ret = cherokee_hashtable_del (&avl->table, node->hash, node);
+	if (unlikely (ret != ret_ok)) {
+		return ret;
+	}
+
+	cherokee_avl_flcache_node_release (avl, node);
+	node_free (node);
+	return ret_ok;
+}
+
+
+static ret_t
+node_discard (cherokee_avl_flcache_t      *avl,
+	      cherokee_avl_flcache_node_t *node)
+{
+	/* Free an entry that is no longer in the table
+	 */
+	if (! cherokee_buffer_is_empty (&node->file)) {
+		cherokee_unlink (node->file.buf);
+	}
+
+	cherokee_avl_flcache_node_release (avl, node);
+	node_free (node);
+
+	return ret_ok;
+}
+
+
+static void
+node_retire (cherokee_avl_flcache_t      *avl,
+	     cherokee_avl_flcache_node_t *node)
+{
+	/* Entries that are still being served are freed by a
+	 * later cleanup.
+	 */
+	if (node->ref_count > 0) {
+		cherokee_list_add (&node->to_del, &avl->retired);
+		return;
+	}
+
+	node_discard (avl, node);
+}
+
+
+ret_t
+cherokee_avl_flcache_replace (cherokee_avl_flcache_t      *avl,
+			      cherokee_avl_flcache_node_t *node)
+{
+	ret_t                        ret;
+	cherokee_avl_flcache_node_t *stale = node->replaces;
+
+	CHEROKEE_RWLOCK_WRITER (&avl->base_rwlock);
+
+	node->replaces = NULL;
+	cherokee_avl_flcache_unref (stale);
+
+	/* The reference held by the replacement prevented the stale
+	 * entry from being removed in the meanwhile.
+	 */
+	cherokee_hashtable_del (&avl->table, stale->hash, stale);
+	node_retire (avl, stale);
+
+	ret = cherokee_hashtable_add (&avl->table, node->hash, node);
+	if (unlikely (ret != ret_ok)) {
+		node_retire (avl, node);
+	}
+
 	CHEROKEE_RWLOCK_UNLOCK (&avl->base_rwlock);
 
+	TRACE (ENTRIES, "Replaced stale entry: '%s'\n", node->request.buf);
 	return ret;
 }
 
@@ -419,8 +670,8 @@ del_list_of_entries (cherokee_avl_flcache_t *avl,
 			cherokee_unlink (node->file.buf);
 		}
 
-		/* Delete try from the AVL tree*/
-		ret = cherokee_avl_generic_del (AVL_GENERIC(avl), AVL_GENERIC_NODE(node), NULL);
+		/* Delete it from the table */
+		ret = node_remove (avl, node);
 		if (unlikely (ret != ret_ok)) {
 			error = true;
 		}
@@ -431,14 +682,16 @@ del_list_of_entries (cherokee_avl_flcache_t *avl,
 
 
 static ret_t
-cleanup_while_func (cherokee_avl_generic_node_t *node_generic, void *value, void *param)
+cleanup_while_func (cherokee_avl_flcache_node_t *node, void **params)
 {
-	cherokee_list_t             *to_delete = LIST(param);
-	cherokee_avl_flcache_node_t *node      = AVL_FLCACHE_NODE(node_generic);
-
-	UNUSED(value);
+	cherokee_list_t *to_delete = (cherokee_list_t *) (params[0]);
+	time_t           grace     = *((time_t *)       (params[1]));
 
-	if (node->valid_until >= cherokee_bogonow_now)
+	/* Stale entries are kept during the grace period. Cancelled
+	 * ones are of no use anymore.
+	 */
+	if ((node->status != flcache_status_undef) &&
+	    (node->valid_until >= cherokee_bogonow_now - grace))
 		return ret_ok;
 
 	if (node->ref_count > 0)
@@ -450,20 +703,37 @@ cleanup_while_func (cherokee_avl_generic_node_t *node_generic, void *value, void
 
 
 ret_t
-cherokee_avl_flcache_cleanup (cherokee_avl_flcache_t *avl)
+cherokee_avl_flcache_cleanup (cherokee_avl_flcache_t *avl,
+			      time_t                  grace)
 {
+	cherokee_list_t *i, *j;
 	cherokee_list_t  to_delete = LIST_HEAD_INIT(to_delete);
+	void            *params[]  = {&to_delete, &grace};
 
 	CHEROKEE_RWLOCK_WRITER (&avl->base_rwlock);
 
 	/* Add expired entries to 'to_delete'
 	 */
-	cherokee_avl_generic_while (AVL_GENERIC(avl), cleanup_while_func, &to_delete, NULL, NULL);
+	cherokee_hashtable_while (&avl->table,
+				  (cherokee_hashtable_while_func_t) cleanup_while_func,
+				  params);
 
 	/* Delete entries
 	 */
 	del_list_of_entries (avl, &to_delete);
 
+	/* Replaced entries that are no longer served
+	 */
+	list_for_each_safe (i, j, &avl->retired) {
+		cherokee_avl_flcache_node_t *node = list_entry (i, cherokee_avl_flcache_node_t, to_del);
+
+		if (node->ref_count > 0)
+			continue;
+
+		cherokee_list_del (&node->to_del);
+		node_discard (avl, node);
+	}
+
 	CHEROKEE_RWLOCK_UNLOCK (&avl->base_rwlock);
 
 	return ret_ok;
@@ -477,9 +747,24 @@ cherokee_avl_flcache_del (cherokee_avl_flcache_t      *avl,
 	ret_t ret = ret_ok;
 
 	CHEROKEE_RWLOCK_WRITER (&avl->base_rwlock);
-	if (node->ref_count == 0) {
-		ret = cherokee_avl_generic_del (AVL_GENERIC(avl), AVL_GENERIC_NODE(node), NULL);
+
+	if (node->replaces != NULL) {
+		/* A discarded replacement: not in the table */
+		node->replaces->revalidating = false;
+		cherokee_avl_flcache_unref (node->replaces);
+		node->replaces = NULL;
+	} else {
+		ret = cherokee_hashtable_del (&avl->table, node->hash, node);
+	}
+
+	/* It is unhashed even if it is still referenced (i.e. by
+	 * the requests parked on it), so the same request can be
+	 * cached again. It is freed once it has been released.
+	 */
+	if (ret == ret_ok) {
+		node_retire (avl, node);
 	}
+
 	CHEROKEE_RWLOCK_UNLOCK (&avl->base_rwlock);
 
 	return ret;
@@ -487,15 +772,12 @@ cherokee_avl_flcache_del (cherokee_avl_flcache_t      *avl,
 
 
 static ret_t
-purge_while_func (cherokee_avl_generic_node_t *node_generic, void *value, void **params)
+purge_while_func (cherokee_avl_flcache_node_t *node, void **params)
 {
-	cherokee_avl_flcache_node_t *node       = AVL_FLCACHE_NODE(node_generic);
 	cherokee_buffer_t           *path       = (cherokee_buffer_t *)  (params[0]);
 	cuint_t                     *purged_num = (cuint_t *)            (params[1]);
 	cherokee_list_t             *to_delete  = (cherokee_list_t *)    (params[2]);
 
-	UNUSED(value);
-
 	/* Expire entries that match the path
 	 */
 	if (cherokee_buffer_cmp_buf (path, &node->request) == 0) {
@@ -522,13 +804,14 @@ cherokee_avl_flcache_purge_path (cherokee_avl_flcache_t *avl,
 	cherokee_list_t  to_delete  = LIST_HEAD_INIT(to_delete);
 	void            *params[]   = {path, &purged_num, &to_delete};
 
-	/* FIXME: O(N) function. This is clearly sub-optimal.
+	/* Entries of every query string and encoding have to be
+	 * expired, so it walks the whole table: O(N).
 	 */
 	CHEROKEE_RWLOCK_WRITER (&avl->base_rwlock);
 
-	ret = cherokee_avl_generic_while (AVL_GENERIC(avl),
-					  (cherokee_avl_generic_while_func_t) purge_while_func,
-					  params, NULL, NULL);
+	ret = cherokee_hashtable_while (&avl->table,
+					(cherokee_hashtable_while_func_t) purge_while_func,
+					params);
 
 	del_list_of_entries (avl, &to_delete);
 	TRACE (ENTRIES, "Purging '%s' - %d objects were expired\n", path->buf, purged_num);
@@ -541,3 +824,40 @@ cherokee_avl_flcache_purge_path (cherokee_avl_flcache_t *avl,
 
 	return ret;
 }
+
+
+ret_t
+cherokee_avl_flcache_node_reserve (cherokee_avl_flcache_t      *avl,
+				   cherokee_avl_flcache_node_t *node,
+				   culong_t                     size,
+				   culong_t                     limit)
+{
+	/* Account 'size' more bytes of in-memory copy for the node,
+	 * unless the whole cache would go beyond 'limit'.
+	 */
+	if (CHEROKEE_ATOMIC_ADD (&avl->memory_used, size) > limit) {
+		CHEROKEE_ATOMIC_ADD (&avl->memory_used, -size);
+		return ret_deny;
+	}
+
+	node->memory_size += size;
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_avl_flcache_node_release (cherokee_avl_flcache_t      *avl,
+				   cherokee_avl_flcache_node_t *node)
+{
+	if (node->memory_size > 0) {
+		CHEROKEE_ATOMIC_ADD (&avl->memory_used, -node->memory_size);
+	}
+
+	node->in_memory   = false;
+	node->memory_size = 0;
+
+	cherokee_buffer_mrproper (&node->header);
+	cherokee_buffer_mrproper (&node->body);
+
+	return ret_ok;
+}
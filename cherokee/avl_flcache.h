@@ -30,7 +30,7 @@
 #define CHEROKEE_FLCACHE_AVL_H
 
 #include <cherokee/common.h>
-#include <cherokee/avl_generic.h>
+#include <cherokee/hashtable.h>
 #include <cherokee/connection.h>
 
 CHEROKEE_BEGIN_DECLS
@@ -41,10 +41,10 @@ typedef enum {
 	flcache_status_ready
 } cherokee_flcache_status_t;
 
-/* AVL Tree Node
+/* Cache entry
  */
-typedef struct {
-	cherokee_avl_generic_node_t  base;
+typedef struct cherokee_avl_flcache_node {
+	crc_t                        hash;
 	cherokee_list_t              to_del;
 
 	cint_t                       ref_count;
@@ -60,16 +60,36 @@ typedef struct {
 	cherokee_buffer_t            file;
 	cullong_t                    file_size;
 
+	/* In-memory copy */
+	cherokee_boolean_t           in_memory;
+	cherokee_buffer_t            header;
+	cherokee_buffer_t            body;
+	culong_t                     memory_size;
+
+	/* Stale-while-revalidate */
+	cherokee_boolean_t           revalidating;
+	struct cherokee_avl_flcache_node *replaces;
+
+	/* Request coalescing: the connections waiting for it to be
+	 * stored poll on this pipe.
+	 */
+	int                          notify[2];
+	cherokee_boolean_t           storing_done;
+
 	time_t                       created_at;
 	time_t                       valid_until;
 } cherokee_avl_flcache_node_t;
 
 
-/* AVL Tree
+/* Entries are indexed by the hash of their request and query
+ * string. Variants with different encodings share the same hash.
+ * It used to be an AVL tree, hence the name of the type.
  */
 typedef struct {
-	cherokee_avl_generic_t  base;
+	cherokee_hashtable_t    table;
 	CHEROKEE_RWLOCK_T      (base_rwlock);
+	culong_t                memory_used;
+	cherokee_list_t         retired;
 } cherokee_avl_flcache_t;
 
 
@@ -78,8 +98,8 @@ typedef struct {
 
 
 ret_t cherokee_avl_flcache_init     (cherokee_avl_flcache_t *avl);
-ret_t cherokee_avl_flcache_mrproper (cherokee_avl_flcache_t *avl, cherokee_func_free_t free_value);
-ret_t cherokee_avl_flcache_cleanup  (cherokee_avl_flcache_t *avl);
+ret_t cherokee_avl_flcache_mrproper (cherokee_avl_flcache_t *avl);
+ret_t cherokee_avl_flcache_cleanup  (cherokee_avl_flcache_t *avl, time_t grace);
 
 ret_t cherokee_avl_flcache_add        (cherokee_avl_flcache_t       *avl,
 				       cherokee_connection_t        *conn,
@@ -89,12 +109,38 @@ ret_t cherokee_avl_flcache_get        (cherokee_avl_flcache_t       *avl,
 				       cherokee_connection_t        *conn,
 				       cherokee_avl_flcache_node_t **node);
 
+ret_t cherokee_avl_flcache_unref      (cherokee_avl_flcache_node_t  *node);
+
+/* Stale-while-revalidate: the replacement is kept out of the table
+ * until it has been completely stored.
+ */
+ret_t cherokee_avl_flcache_add_replacement (cherokee_avl_flcache_t       *avl,
+					    cherokee_connection_t        *conn,
+					    cherokee_avl_flcache_node_t  *stale,
+					    cherokee_avl_flcache_node_t **node);
+
+ret_t cherokee_avl_flcache_replace    (cherokee_avl_flcache_t       *avl,
+				       cherokee_avl_flcache_node_t  *node);
+
 ret_t cherokee_avl_flcache_del        (cherokee_avl_flcache_t       *avl,
 				       cherokee_avl_flcache_node_t  *node);
 
 ret_t cherokee_avl_flcache_purge_path (cherokee_avl_flcache_t       *avl,
 				       cherokee_buffer_t            *path);
 
+/* Request coalescing */
+ret_t cherokee_avl_flcache_node_wait (cherokee_avl_flcache_node_t *node, int *fd);
+ret_t cherokee_avl_flcache_node_wake (cherokee_avl_flcache_node_t *node);
+
+/* In-memory copies accounting */
+ret_t cherokee_avl_flcache_node_reserve (cherokee_avl_flcache_t      *avl,
+					 cherokee_avl_flcache_node_t *node,
+					 culong_t                     size,
+					 culong_t                     limit);
+
+ret_t cherokee_avl_flcache_node_release (cherokee_avl_flcache_t      *avl,
+					 cherokee_avl_flcache_node_t *node);
+
 CHEROKEE_END_DECLS
 
 #endif /* CHEROKEE_FLCACHE_AVL_H */
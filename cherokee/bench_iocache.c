@@ -0,0 +1,270 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/* Cherokee
+ *
+ * Authors:
+ *      Alvaro Lopez Ortega <alvaro@alobbs.com>
+ *
+ * Copyright (C) 2001-2011 Alvaro Lopez Ortega
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+
+/* I/O cache hit throughput benchmark.
+ *
+ * It populates the cache with a set of small files, and then it
+ * measures how many cache hits per second are served with an
+ * increasing number of threads hammering it. The "Local" column is
+ * the share of the hits served from the per-thread entry tables,
+ * which write no memory shared with the other threads:
+ *
+ *   $ make bench_iocache
+ *   $ ./bench_iocache -f 256 -n 500000 -t 16
+ */
+
+#include "common-internal.h"
+#include "init.h"
+#include "iocache.h"
+#include "bogotime.h"
+#include "util.h"
+
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+
+#define DEFAULT_FILES       64
+#define DEFAULT_ITERATIONS  500000
+#define DEFAULT_THREADS     8
+
+static cherokee_iocache_t *iocache;
+static cherokee_buffer_t  *files;
+static cuint_t             files_created = 0;
+static cuint_t             files_num     = DEFAULT_FILES;
+static cuint_t             iterations    = DEFAULT_ITERATIONS;
+static cherokee_buffer_t   files_dir     = CHEROKEE_BUF_INIT;
+
+static void *
+worker (void *param)
+{
+	ret_t                     ret;
+	cuint_t                   n;
+	cuint_t                   seed  = POINTER_TO_INT(param);
+	cherokee_iocache_entry_t *entry;
+
+	for (n = 0; n < iterations; n++) {
+		entry = NULL;
+		seed  = seed * 1103515245 + 12345;
+
+		ret = cherokee_iocache_autoget (iocache, &files[(seed >> 16) % files_num],
+						iocache_stat | iocache_mmap, &entry);
+		if (unlikely (ret != ret_ok)) {
+			fprintf (stderr, "iocache_autoget() failed: ret=%d\n", ret);
+			exit (EXIT_ERROR);
+		}
+
+		cherokee_iocache_entry_unref (&entry);
+	}
+
+	return NULL;
+}
+
+static double
+run (cuint_t threads_num)
+{
+	cuint_t         n;
+	struct timeval  start;
+	struct timeval  end;
+	pthread_t      *threads;
+
+	threads = malloc (threads_num * sizeof(pthread_t));
+
+	gettimeofday (&start, NULL);
+
+	for (n = 0; n < threads_num; n++) {
+		pthread_create (&threads[n], NULL, worker, INT_TO_POINTER(n + 1));
+	}
+
+	for (n = 0; n < threads_num; n++) {
+		pthread_join (threads[n], NULL);
+	}
+
+	gettimeofday (&end, NULL);
+	free (threads);
+
+	return ((end.tv_sec - start.tv_sec) +
+		(end.tv_usec - start.tv_usec) / 1000000.0);
+}
+
+static ret_t
+create_files (const char *tmp_dir)
+{
+	int     fd;
+	ssize_t written;
+	cuint_t n;
+
+	/* A directory of its own, so the cleanup does not
+	 * touch anything it did not create.
+	 */
+	cherokee_buffer_add_va (&files_dir, "%s/bench_iocache.%d", tmp_dir, getpid());
+
+	if (mkdir (files_dir.buf, 0700) != 0)
+		return ret_error;
+
+	files = calloc (files_num, sizeof(cherokee_buffer_t));
+	if (files == NULL)
+		return ret_nomem;
+
+	for (n = 0; n < files_num; n++) {
+		cherokee_buffer_add_va (&files[n], "%s/file-%u", files_dir.buf, n);
+
+		fd = open (files[n].buf, O_WRONLY | O_CREAT | O_EXCL, 0600);
+		if (fd < 0)
+			return ret_error;
+
+		files_created++;
+
+		written = write (fd, files[n].buf, files[n].len);
+		close (fd);
+
+		if (written != (ssize_t) files[n].len)
+			return ret_error;
+	}
+
+	return ret_ok;
+}
+
+static void
+remove_files (void)
+{
+	cuint_t n;
+
+	if (files != NULL) {
+		for (n = 0; n < files_num; n++) {
+			if (n < files_created) {
+				unlink (files[n].buf);
+			}
+			cherokee_buffer_mrproper (&files[n]);
+		}
+
+		free (files);
+		files = NULL;
+	}
+
+	if (! cherokee_buffer_is_empty (&files_dir)) {
+		rmdir (files_dir.buf);
+	}
+
+	cherokee_buffer_mrproper (&files_dir);
+}
+
+int
+main (int argc, char *argv[])
+{
+	ret_t                   ret;
+	int                     c;
+	cuint_t                 n;
+	double                  secs;
+	double                  base        = 0;
+	cuint_t                 max_threads = DEFAULT_THREADS;
+	cuint_t                 total;
+	cuint_t                 hit;
+	cuint_t                 hit_local;
+	cuint_t                 prev_hit;
+	cuint_t                 prev_local;
+	cherokee_buffer_t       max_size    = CHEROKEE_BUF_INIT;
+	cherokee_config_node_t  conf;
+
+	while ((c = getopt (argc, argv, "f:n:t:h")) != -1) {
+		switch (c) {
+		case 'f':
+			files_num = atoi (optarg);
+			break;
+		case 'n':
+			iterations = atoi (optarg);
+			break;
+		case 't':
+			max_threads = atoi (optarg);
+			break;
+		default:
+			fprintf (stderr, "Usage: %s [-f files] [-n iterations] [-t max_threads]\n", argv[0]);
+			return EXIT_ERROR;
+		}
+	}
+
+	if ((files_num < 1) || (iterations < 1) || (max_threads < 1)) {
+		fprintf (stderr, "Invalid parameters\n");
+		return EXIT_ERROR;
+	}
+
+	cherokee_init();
+
+	ret = create_files (cherokee_tmp_dir.buf);
+	if (ret != ret_ok) {
+		fprintf (stderr, "Could not create the test files in %s\n", files_dir.buf);
+		remove_files();
+		return EXIT_ERROR;
+	}
+
+	/* Big enough to hold every file
+	 */
+	cherokee_buffer_add_va (&max_size, "%u", files_num * 2);
+
+	cherokee_config_node_init (&conf);
+	cherokee_config_node_add (&conf, "max_size", &max_size);
+
+	cherokee_iocache_new (&iocache);
+	cherokee_iocache_configure (iocache, &conf);
+
+	/* Warm it up
+	 */
+	total      = iterations;
+	iterations = files_num * 4;
+	worker (INT_TO_POINTER(0));
+	iterations = total;
+
+	printf ("Files: %u, Shards: %u, Iterations per thread: %u\n\n",
+		files_num, CACHE(iocache)->shards_num, iterations);
+	printf ("%8s %14s %14s %9s %7s\n", "Threads", "Hits/s", "Hits/s/thread", "Speedup", "Local");
+
+	for (n = 1; n <= max_threads; n *= 2) {
+		cherokee_cache_get_counters (CACHE(iocache), NULL, &prev_hit, NULL);
+		cherokee_cache_get_thread_hits (CACHE(iocache), &prev_local);
+
+		secs = run (n);
+
+		cherokee_cache_get_counters (CACHE(iocache), NULL, &hit, NULL);
+		cherokee_cache_get_thread_hits (CACHE(iocache), &hit_local);
+
+		if (base == 0) {
+			base = (iterations / secs);
+		}
+
+		printf ("%8u %14.0f %14.0f %8.2fx %6.1f%%\n", n,
+			(n * iterations) / secs,
+			iterations / secs,
+			((n * iterations) / secs) / base,
+			(hit > prev_hit) ? (100.0 * (hit_local - prev_local)) / (hit - prev_hit) : 0.0);
+	}
+
+	cherokee_iocache_free (iocache);
+	cherokee_config_node_mrproper (&conf);
+	cherokee_buffer_mrproper (&max_size);
+
+	remove_files();
+	cherokee_mrproper();
+
+	return EXIT_OK;
+}
@@ -0,0 +1,223 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/* Cherokee
+ *
+ * Authors:
+ *      Alvaro Lopez Ortega <alvaro@alobbs.com>
+ *
+ * Copyright (C) 2001-2011 Alvaro Lopez Ortega
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+
+
+/* Regular expression rule matching benchmark.
+ *
+ * It evaluates a set of rewrite-like rules against a few request
+ * paths, the way the rule list does: in order, until one matches.
+ * The rules are compiled twice, without and with the study / JIT
+ * step, and the matching throughput of both is reported. The JIT
+ * mode is skipped when the PCRE library cannot JIT compile (the
+ * bundled PCRE, for instance):
+ *
+ *   $ make bench_regex
+ *   $ ./bench_regex -n 1000000
+ */
+
+#include "common-internal.h"
+#include "init.h"
+#include "regex.h"
+#include "util.h"
+
+#include <sys/time.h>
+
+#define DEFAULT_ITERATIONS  200000
+
+static const char *rules[] = {
+	"^/(favicon\\.ico|robots\\.txt)$",
+	"^/static/(css|js|img)/[^/]+\\.(css|js|png|gif|jpe?g)(\\?.*)?$",
+	"^/media/([0-9]{4})/([0-9]{2})/([a-z0-9_-]+)\\.(mp4|flv|webm)$",
+	"^/blog/([0-9]{4})/([0-9]{2})/([0-9]{2})/([a-z0-9-]+)/?$",
+	"^/users/([a-zA-Z0-9_.]+)/(profile|settings|friends)(/.*)?$",
+	"^/api/v[0-9]+/([a-z]+)/([0-9]+)(\\.json|\\.xml)?(\\?.*)?$",
+	"^/(wp-admin|phpmyadmin|cgi-bin)/.*$",
+	"\\.(php|php5|phtml)(\\?.*)?$",
+	"^/(.*)$",
+	NULL
+};
+
+static const char *paths[] = {
+	"/robots.txt",
+	"/static/js/application.min.js?v=20110412",
+	"/media/2011/05/launch_keynote-final.webm",
+	"/blog/2011/05/12/an-example-article-with-a-rather-long-slug/",
+	"/users/john.doe_83/settings/notifications",
+	"/api/v2/orders/918273.json?fields=id,total,items",
+	"/index.php?option=com_content&view=article&id=42",
+	"/articles/2011/05/an-example-article.html",
+	NULL
+};
+
+typedef struct {
+	const char        *name;
+	cherokee_boolean_t jit;
+	cherokee_regex_t  *compiled[sizeof(rules) / sizeof(rules[0])];
+	int                matched[sizeof(paths) / sizeof(paths[0])];
+} bench_mode_t;
+
+static bench_mode_t modes[] = {
+	{"plain", false, {NULL}, {0}},
+	{"jit",   true,  {NULL}, {0}},
+	{NULL,    false, {NULL}, {0}}
+};
+
+
+static int
+match (cherokee_regex_t **compiled, const char *path, cuint_t path_len, cint_t *ovector)
+{
+	int     re;
+	cuint_t i;
+
+	for (i = 0; compiled[i] != NULL; i++) {
+		re = cherokee_regex_exec (compiled[i], path, path_len, ovector, OVECTOR_LEN);
+		if (re >= 0)
+			return i;
+	}
+
+	return -1;
+}
+
+
+static double
+run (cherokee_regex_t **compiled, cuint_t iterations, cuint_t *evaluated)
+{
+	cuint_t        n, j;
+	int            rule;
+	cint_t         ovector[OVECTOR_LEN];
+	struct timeval start;
+	struct timeval end;
+
+	*evaluated = 0;
+	gettimeofday (&start, NULL);
+
+	for (n = 0; n < iterations; n++) {
+		for (j = 0; paths[j] != NULL; j++) {
+			rule = match (compiled, paths[j], strlen(paths[j]), ovector);
+			*evaluated += (rule < 0) ? 1 : rule + 1;
+		}
+	}
+
+	gettimeofday (&end, NULL);
+
+	return ((end.tv_sec - start.tv_sec) +
+		(end.tv_usec - start.tv_usec) / 1000000.0);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+	ret_t     ret;
+	int       c;
+	cuint_t   i, j;
+	cuint_t   evaluated;
+	cint_t    ovector[OVECTOR_LEN];
+	double    secs;
+	cuint_t   iterations = DEFAULT_ITERATIONS;
+
+	while ((c = getopt (argc, argv, "n:h")) != -1) {
+		switch (c) {
+		case 'n':
+			iterations = atoi (optarg);
+			break;
+		default:
+			fprintf (stderr, "Usage: %s [-n iterations]\n", argv[0]);
+			return EXIT_ERROR;
+		}
+	}
+
+	if (iterations < 1) {
+		fprintf (stderr, "Invalid parameters\n");
+		return EXIT_ERROR;
+	}
+
+	cherokee_init();
+
+	/* Skip the JIT mode if the library is unable to do it
+	 */
+	if (! cherokee_regex_jit_available()) {
+		printf ("PCRE: JIT compilation not available, skipping the 'jit' mode\n");
+
+		for (i = 0, j = 0; modes[i].name != NULL; i++) {
+			if (! modes[i].jit)
+				modes[j++] = modes[i];
+		}
+		modes[j].name = NULL;
+	}
+
+	/* Compile the rules in every mode
+	 */
+	for (i = 0; modes[i].name != NULL; i++) {
+		cherokee_regex_set_jit (modes[i].jit);
+
+		for (j = 0; rules[j] != NULL; j++) {
+			ret = cherokee_regex_new (&modes[i].compiled[j], rules[j], NULL, NULL);
+			if (ret != ret_ok) {
+				fprintf (stderr, "Could not compile: %s\n", rules[j]);
+				return EXIT_ERROR;
+			}
+		}
+
+		for (j = 0; paths[j] != NULL; j++) {
+			modes[i].matched[j] = match (modes[i].compiled, paths[j], strlen(paths[j]), ovector);
+		}
+	}
+
+	/* Every mode must pick the same rules
+	 */
+	for (i = 1; modes[i].name != NULL; i++) {
+		for (j = 0; paths[j] != NULL; j++) {
+			if (modes[i].matched[j] != modes[0].matched[j]) {
+				fprintf (stderr, "Mode '%s' mismatch on %s\n", modes[i].name, paths[j]);
+				return EXIT_ERROR;
+			}
+		}
+	}
+
+	printf ("Rules: %d, Paths: %d, Iterations: %d\n",
+		(int)(sizeof(rules) / sizeof(rules[0])) - 1,
+		(int)(sizeof(paths) / sizeof(paths[0])) - 1,
+		iterations);
+
+	printf ("\n%-8s %14s %14s\n", "Mode", "Requests/s", "Matches/s");
+
+	for (i = 0; modes[i].name != NULL; i++) {
+		run (modes[i].compiled, iterations / 10, &evaluated);
+		secs = run (modes[i].compiled, iterations, &evaluated);
+
+		printf ("%-8s %14.0f %14.0f\n", modes[i].name,
+			(iterations * (double) (sizeof(paths) / sizeof(paths[0]) - 1)) / secs,
+			evaluated / secs);
+
+		for (j = 0; modes[i].compiled[j] != NULL; j++) {
+			cherokee_regex_free (modes[i].compiled[j]);
+		}
+	}
+
+	cherokee_mrproper();
+
+	return EXIT_OK;
+}
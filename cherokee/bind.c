@@ -47,6 +47,9 @@ cherokee_bind_new (cherokee_bind_t **listener)
 	n->accept_continuous_max = 0;
 	n->accept_recalculate    = 0;
 
+	n->parent = NULL;
+	INIT_LIST_HEAD (&n->reuseport);
+
 	*listener = n;
 	return ret_ok;
 }
@@ -55,6 +58,8 @@ cherokee_bind_new (cherokee_bind_t **listener)
 ret_t
 cherokee_bind_free (cherokee_bind_t *listener)
 {
+	cherokee_bind_free_reuseport (listener);
+
 	cherokee_socket_close (&listener->socket);
 	cherokee_socket_mrproper (&listener->socket);
 
@@ -144,7 +149,7 @@ cherokee_bind_set_default (cherokee_bind_t *listener)
 
 
 static ret_t
-set_socket_opts (int socket)
+set_socket_opts (int socket, cherokee_boolean_t reuseport)
 {
 	ret_t                    ret;
 #ifdef SO_ACCEPTFILTER
@@ -164,6 +169,15 @@ set_socket_opts (int socket)
 	if (ret != ret_ok)
 		return ret;
 
+	/* SO_REUSEPORT: Several sockets can be bound to the same
+	 * address, so the kernel balances the incoming connections
+	 * among them. It is harmless if it fails; binding the
+	 * per-thread listeners will fail afterwards.
+	 */
+	if (reuseport) {
+		cherokee_fd_set_reuseport (socket);
+	}
+
 	/* Set no-delay mode:
 	 * If no clients are waiting, accept() will return -1 immediately
 	 */
@@ -221,7 +235,7 @@ set_socket_opts (int socket)
 
 
 static ret_t
-init_socket (cherokee_bind_t *listener, int family)
+init_socket (cherokee_bind_t *listener, int family, cherokee_boolean_t reuseport)
 {
 	ret_t ret;
 
@@ -234,7 +248,7 @@ init_socket (cherokee_bind_t *listener, int family)
 
 	/* Set the socket properties
 	 */
-	ret = set_socket_opts (SOCKET_FD(&listener->socket));
+	ret = set_socket_opts (SOCKET_FD(&listener->socket), reuseport);
 	if (ret != ret_ok) {
 		goto error;
 	}
@@ -260,6 +274,7 @@ ret_t
 cherokee_bind_init_port (cherokee_bind_t         *listener,
 			 cuint_t                  listen_queue,
 			 cherokee_boolean_t       ipv6,
+			 cherokee_boolean_t       reuseport,
 			 cherokee_server_token_t  token)
 {
 	ret_t ret;
@@ -268,7 +283,7 @@ cherokee_bind_init_port (cherokee_bind_t         *listener,
 	 */
 #ifdef HAVE_IPV6
 	if (ipv6) {
-		ret = init_socket (listener, AF_INET6);
+		ret = init_socket (listener, AF_INET6, reuseport);
 	} else
 #endif
 	{
@@ -276,7 +291,7 @@ cherokee_bind_init_port (cherokee_bind_t         *listener,
 	}
 
 	if (ret != ret_ok) {
-		ret = init_socket (listener, AF_INET);
+		ret = init_socket (listener, AF_INET, reuseport);
 
 		if (ret != ret_ok) {
 			LOG_CRITICAL (CHEROKEE_ERROR_BIND_COULDNT_BIND_PORT,
@@ -340,3 +355,111 @@ cherokee_bind_accept_more (cherokee_bind_t *listener,
 	listener->accept_continuous = 0;
 	return ret_deny;
 }
+
+
+static ret_t
+new_reuseport (cherokee_bind_t  *listener,
+	       cuint_t           listen_queue,
+	       cherokee_bind_t **clone)
+{
+	ret_t            ret;
+	cherokee_bind_t *n    = NULL;
+
+	ret = cherokee_bind_new (&n);
+	if (unlikely (ret != ret_ok))
+		return ret;
+
+	/* It shares the configuration of the main listener
+	 */
+	n->parent        = listener;
+	n->id            = listener->id;
+	n->port          = listener->port;
+	n->socket.is_tls = listener->socket.is_tls;
+
+	cherokee_buffer_add_buffer (&n->ip, &listener->ip);
+
+	/* Same address, same family, but a different socket
+	 */
+	ret = init_socket (n, SOCKET_AF(&listener->socket), true);
+	if (ret != ret_ok) {
+		goto error;
+	}
+
+	ret = cherokee_socket_listen (&n->socket, listen_queue);
+	if (ret != ret_ok) {
+		goto error;
+	}
+
+	*clone = n;
+	return ret_ok;
+
+error:
+	cherokee_bind_free (n);
+	return ret_error;
+}
+
+
+ret_t
+cherokee_bind_init_reuseport (cherokee_bind_t *listener,
+			      cuint_t          num,
+			      cuint_t          listen_queue)
+{
+	ret_t            ret;
+	cuint_t          i;
+	cherokee_bind_t *clone;
+
+	switch (SOCKET_AF(&listener->socket)) {
+	case AF_INET:
+#ifdef HAVE_IPV6
+	case AF_INET6:
+#endif
+		break;
+	default:
+		return ret_not_found;
+	}
+
+	for (i=0; i<num; i++) {
+		ret = new_reuseport (listener, listen_queue, &clone);
+		if (ret != ret_ok) {
+			cherokee_bind_free_reuseport (listener);
+			return ret_error;
+		}
+
+		cherokee_list_add_tail (&clone->listed, &listener->reuseport);
+	}
+
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_bind_get_reuseport (cherokee_bind_t  *listener,
+			     cherokee_bind_t **clone)
+{
+	cherokee_list_t *i;
+
+	if (cherokee_list_empty (&listener->reuseport)) {
+		return ret_not_found;
+	}
+
+	i = listener->reuseport.next;
+	cherokee_list_del (i);
+	INIT_LIST_HEAD (i);
+
+	*clone = BIND(i);
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_bind_free_reuseport (cherokee_bind_t *listener)
+{
+	cherokee_list_t *i, *tmp;
+
+	list_for_each_safe (i, tmp, &listener->reuseport) {
+		cherokee_list_del (i);
+		cherokee_bind_free (BIND(i));
+	}
+
+	return ret_ok;
+}
@@ -54,10 +54,15 @@ typedef struct {
 	cuint_t            accept_continuous;
 	cuint_t            accept_continuous_max;
 	cuint_t            accept_recalculate;
+
+	/* SO_REUSEPORT: per-thread listeners */
+	void              *parent;
+	cherokee_list_t    reuseport;
 } cherokee_bind_t;
 
 #define BIND(b)        ((cherokee_bind_t *)(b))
 #define BIND_IS_TLS(b) (BIND(b)->socket.is_tls == TLS)
+#define BIND_MAIN(b)   ((BIND(b)->parent != NULL) ? BIND(BIND(b)->parent) : BIND(b))
 
 
 ret_t cherokee_bind_new  (cherokee_bind_t **listener);
@@ -70,6 +75,12 @@ ret_t cherokee_bind_accept_more (cherokee_bind_t *listener, ret_t prev_ret);
 ret_t cherokee_bind_init_port   (cherokee_bind_t         *listener,
 				 cuint_t                  listen_queue,
 				 cherokee_boolean_t       ipv6,
+				 cherokee_boolean_t       reuseport,
 				 cherokee_server_token_t  token);
 
+/* SO_REUSEPORT */
+ret_t cherokee_bind_init_reuseport  (cherokee_bind_t  *listener, cuint_t num, cuint_t listen_queue);
+ret_t cherokee_bind_get_reuseport   (cherokee_bind_t  *listener, cherokee_bind_t **clone);
+ret_t cherokee_bind_free_reuseport  (cherokee_bind_t  *listener);
+
 #endif /* CHEROKEE_BIND_H */
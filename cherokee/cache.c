@@ -22,26 +22,111 @@
  * 02110-1301, USA.
  */
 
+
 #include "common-internal.h"
 #include "cache.h"
 #include "util.h"
+#include "hashtable.h"
 
 #define ENTRIES "cache"
 
 /* must be multiple of 4 */
 #define DEFAULT_MAX_SIZE 4 * 10
 
+/* Minimum number of entries per shard */
+#define SHARD_MIN_SIZE   4
+
+/* Entries each thread keeps at hand. Must be a power of two */
+#define THREAD_LOCALS    64
+
+/* Every shard runs its own CAR (Clock with Adaptive Replacement)
+ * instance. T1 and T2 are clocks: the hand points to the LRU end,
+ * and a hit only sets the entry's reference bit. Therefore, hits on
+ * resident entries do not have to reorder any list, and they can be
+ * served while holding the shard lock as a reader.
+ */
+typedef struct {
+	CHEROKEE_RWLOCK_T (lock);
+
+	/* Lookup table */
+	cherokee_hashtable_t map;
+
+	/* Recency */
+	cherokee_list_t _t1;
+	cherokee_list_t _b1;
+	cint_t          len_t1;
+	cint_t          len_b1;
+
+	/* Frequency */
+	cherokee_list_t _t2;
+	cherokee_list_t _b2;
+	cint_t          len_t2;
+	cint_t          len_b2;
+
+	/* Configuration */
+	cint_t          max_size;
+	cint_t          target_t1;
+
+	/* Stats: the hits of the fast paths are counted per thread */
+	cuint_t         count_hit;
+	cuint_t         count_miss;
+} cherokee_cache_shard_t;
+
+/* Each thread keeps the entries it has looked up lately in a small
+ * table of its own, indexed by hash. A slot holds one reference to
+ * its entry, and counts the references it has handed out on top of
+ * it. Hence, hits on these entries do not take the shard lock, nor
+ * touch the entry's reference counter: only the memory of the
+ * thread is written. The hit counters are kept in there as well,
+ * and summed when the stats are requested.
+ */
+typedef struct {
+	cherokee_cache_entry_t *entry;
+	cuint_t                 refs;
+} cherokee_cache_local_t;
+
+typedef struct {
+	cherokee_list_t         listed;
+	cherokee_cache_t       *cache;
+	cuint_t                 count_hit;
+	cuint_t                 count_hit_local;
+	cherokee_cache_local_t  locals[THREAD_LOCALS];
+} cherokee_cache_thread_t;
+
+/* Shards and thread tables are padded to a cache line, so that the
+ * threads do not false-share them.
+ */
+#define CACHE_LINE_ROUND(n) \
+	(((n) + CPU_CACHE_LINE - 1) & ~(CPU_CACHE_LINE - 1))
+
+typedef union {
+	cherokee_cache_shard_t   shard;
+	char                     _pad[CACHE_LINE_ROUND(sizeof(cherokee_cache_shard_t))];
+} cherokee_cache_shard_slot_t;
+
+typedef union {
+	cherokee_cache_thread_t  thread;
+	char                     _pad[CACHE_LINE_ROUND(sizeof(cherokee_cache_thread_t))];
+} cherokee_cache_thread_slot_t;
+
 struct cherokee_cache_priv {
+	cherokee_cache_shard_slot_t shards[CHEROKEE_CACHE_SHARDS];
+
+	/* Per thread tables */
+	cherokee_list_t             threads;
+	CHEROKEE_MUTEX_T           (threads_mutex);
 #ifdef HAVE_PTHREAD
-	pthread_mutex_t mutex;
+	pthread_key_t               threads_key;
 #endif
-	int foo;
 };
 
+#define CACHE_SHARD(cache,hash) \
+	(&(cache)->priv->shards[(hash) % (cache)->shards_num].shard)
+
 #define cache_list_add(list,entry)					\
 	do  {								\
-		cherokee_list_add (LIST(entry), &cache->_ ## list);	\
- 		cache->len_ ## list += 1;				\
+		cherokee_list_add (LIST(entry), &shard->_ ## list);	\
+ 		shard->len_ ## list += 1;				\
 		CACHE_ENTRY(entry)->in_list = cache_ ## list;		\
 	} while (false)
 
@@ -49,28 +134,20 @@ struct cherokee_cache_priv {
 	do {							\
 		CACHE_ENTRY(entry)->in_list = cache_no_list;	\
 		cherokee_list_del (LIST(entry));		\
-		cache->len_ ## list -= 1;			\
+		shard->len_ ## list -= 1;			\
 	} while (false)
 
 #define cache_list_get_lru(list,ret_entry)				\
 	do {								\
-		if (! cherokee_list_empty (&cache->_## list)) {		\
-			ret_entry = CACHE_ENTRY((cache->_## list).prev);\
-		}							\
-	} while (false)
-
-#define cache_list_del_lru(list,ret_entry)				\
-	do {								\
-		if (! cherokee_list_empty (&cache->_## list)) {		\
-			ret_entry = CACHE_ENTRY((cache->_## list).prev);\
-			cache_list_del (list,ret_entry);		\
+		if (! cherokee_list_empty (&shard->_## list)) {		\
+			ret_entry = CACHE_ENTRY((shard->_## list).prev);\
 		}							\
 	} while (false)
 
 #define cache_list_make_first(list,entry)				\
 	do {								\
 		cherokee_list_del (LIST(entry));			\
-		cherokee_list_add (LIST(entry), &cache->_ ## list);	\
+		cherokee_list_add (LIST(entry), &shard->_ ## list);	\
 	} while (false)
 
 #define cache_list_swap(from,to,entry)		\
@@ -88,17 +165,20 @@ cherokee_cache_entry_init (cherokee_cache_entry_t *entry,
 			   cherokee_cache_t       *cache,
                            void                   *mutex)
 {
-	entry->in_list   = cache_no_list;
-	entry->ref_count = 0;
+	entry->in_list    = cache_no_list;
+	entry->referenced = 0;
+	entry->ref_count  = 0;
 
-	entry->cache     = cache;
-	entry->mutex     = mutex;
+	entry->cache      = cache;
+	entry->mutex      = mutex;
 
 	INIT_LIST_HEAD(&entry->listed);
 
 	cherokee_buffer_init (&entry->key);
 	cherokee_buffer_add_buffer (&entry->key, key);
 
+	entry->key_hash   = cherokee_buffer_crc32 (&entry->key);
+
 	return ret_ok;
 }
 
@@ -120,7 +200,8 @@ entry_free (cherokee_cache_entry_t *entry)
 static ret_t
 entry_parent_info_clean (cherokee_cache_entry_t *entry)
 {
-	/* entry->mutex       is LOCKED
+	/* entry->ref_count is 0, or
+	 * shard->lock      is LOCKED (writer)
 	 */
 	ret_t ret;
 
@@ -136,8 +217,7 @@ entry_parent_info_clean (cherokee_cache_entry_t *entry)
 static ret_t
 entry_parent_info_fetch (cherokee_cache_entry_t *entry)
 {
-	/* cache->priv->mutex is LOCKED
-	 * entry->mutex       is LOCKED
+	/* shard->lock is LOCKED (writer)
 	 */
 	if (entry->fetch_cb == NULL)
 		return ret_error;
@@ -145,55 +225,46 @@ entry_parent_info_fetch (cherokee_cache_entry_t *entry)
 	return entry->fetch_cb (entry);
 }
 
+static int
+entry_match_key (cherokee_cache_entry_t *entry,
+		 cherokee_buffer_t      *key)
+{
+	return (cherokee_buffer_cmp_buf (&entry->key, key) == 0);
+}
+
 static void
 entry_ref (cherokee_cache_entry_t *entry)
 {
-	/* cache->priv->mutex is LOCKED
-	 * entry->mutex       is LOCKED
+	/* shard->lock is LOCKED (reader or writer)
 	 */
-	entry->ref_count++;
+	CHEROKEE_ATOMIC_ADD (&entry->ref_count, 1);
 }
 
 
 static ret_t
-entry_unref_guts (cherokee_cache_entry_t **entry_p,
-		  cherokee_boolean_t       lock_object)
+entry_unref_guts (cherokee_cache_shard_t  *shard,
+		  cherokee_cache_entry_t **entry_p)
 {
-	cherokee_cache_t       *cache;
 	cherokee_cache_entry_t *entry;
 
-	/* Sanity check
+	/* shard->lock is LOCKED (writer)
 	 */
 	if (*entry_p == NULL)
 		return ret_ok;
 
 	entry = (*entry_p);
 
-	/* Lock the cache entry object
-	 */
-	if (lock_object) {
-		CHEROKEE_MUTEX_LOCK (entry->mutex);
-	}
-
-	entry->ref_count--;
-
 	/* The entry is still being used
 	 */
-	if (entry->ref_count > 0) {
-		if (lock_object) {
-			CHEROKEE_MUTEX_UNLOCK (entry->mutex);
-		}
-
+	if (CHEROKEE_ATOMIC_ADD (&entry->ref_count, -1) > 0) {
 		*entry_p = NULL;
 		return ret_eagain;
 	}
 
-	/* Clean cache references
+	/* Nobody else can reach it from now on: the last reference
+	 * is always dropped with the shard locked as a writer.
 	 */
-	cache = (*entry_p)->cache;
-
-	/* Is it in the AVL? */
-	cherokee_avl_del (&cache->map, &entry->key, NULL);
+	cherokee_hashtable_del (&shard->map, entry->key_hash, entry);
 
 	/* Is it listed? */
 	switch (entry->in_list) {
@@ -217,10 +288,6 @@ entry_unref_guts (cherokee_cache_entry_t **entry_p,
 	 */
 	entry_parent_info_clean (entry);
 
-	if (lock_object) {
-		CHEROKEE_MUTEX_UNLOCK (entry->mutex);
-	}
-
 	entry_free (entry);
 	*entry_p = NULL;
 
@@ -228,20 +295,69 @@ entry_unref_guts (cherokee_cache_entry_t **entry_p,
 }
 
 
+static cherokee_cache_thread_t *
+thread_current (cherokee_cache_t *cache)
+{
+	cherokee_cache_priv_t *priv = cache->priv;
+
+#ifdef HAVE_PTHREAD
+	return pthread_getspecific (priv->threads_key);
+#else
+	return cherokee_list_empty (&priv->threads) ? NULL :
+		(cherokee_cache_thread_t *) priv->threads.next;
+#endif
+}
+
+
 ret_t
 cherokee_cache_entry_unref (cherokee_cache_entry_t **entry)
 {
-	ret_t             ret;
-	cherokee_cache_t *cache;
+	ret_t                    ret;
+	cint_t                   refs;
+	cherokee_cache_shard_t  *shard;
+	cherokee_cache_thread_t *thread;
+	cherokee_cache_local_t  *local;
 
 	if (*entry == NULL)
 		return ret_ok;
 
-	cache = (*entry)->cache;
+	/* Fastest path: the reference was handed out by the
+	 * table of the thread. The slot still holds one.
+	 */
+	thread = thread_current ((*entry)->cache);
+	if (thread != NULL) {
+		local = &thread->locals[(*entry)->key_hash & (THREAD_LOCALS - 1)];
+
+		if ((local->entry == *entry) &&
+		    (local->refs > 0))
+		{
+			local->refs -= 1;
+			*entry = NULL;
+			return ret_eagain;
+		}
+	}
+
+	/* Fast path: it is not the last reference, so the entry
+	 * cannot go away. No lock is needed.
+	 */
+	while (true) {
+		refs = (*entry)->ref_count;
+		if (refs <= 1)
+			break;
+
+		if (CHEROKEE_ATOMIC_CAS (&(*entry)->ref_count, refs, refs - 1)) {
+			*entry = NULL;
+			return ret_eagain;
+		}
+	}
 
-	CHEROKEE_MUTEX_LOCK (&cache->priv->mutex);
-	ret = entry_unref_guts (entry, true);
-	CHEROKEE_MUTEX_UNLOCK (&cache->priv->mutex);
+	/* It might be the last one
+	 */
+	shard = CACHE_SHARD ((*entry)->cache, (*entry)->key_hash);
+
+	CHEROKEE_RWLOCK_WRITER (&shard->lock);
+	ret = entry_unref_guts (shard, entry);
+	CHEROKEE_RWLOCK_UNLOCK (&shard->lock);
 
 	return ret;
 }
@@ -250,6 +366,149 @@ cherokee_cache_entry_unref (cherokee_cache_entry_t **entry)
 /* Cache
  */
 
+static void *
+aligned_malloc (size_t size)
+{
+#ifdef HAVE_POSIX_MEMALIGN
+	void *p = NULL;
+
+	if (posix_memalign (&p, CPU_CACHE_LINE, size) != 0)
+		return NULL;
+
+	return p;
+#else
+	return malloc (size);
+#endif
+}
+
+static void
+thread_exit (void *param)
+{
+	cuint_t                  n;
+	cherokee_cache_entry_t  *entry;
+	cherokee_cache_thread_t *thread = param;
+
+	/* Release the entries of the slots. Those still in use by
+	 * the thread are left behind: nobody else can release them.
+	 */
+	for (n = 0; n < THREAD_LOCALS; n++) {
+		if ((thread->locals[n].entry == NULL) ||
+		    (thread->locals[n].refs > 0))
+			continue;
+
+		entry = thread->locals[n].entry;
+		thread->locals[n].entry = NULL;
+
+		cherokee_cache_entry_unref (&entry);
+	}
+}
+
+static cherokee_cache_thread_t *
+thread_get (cherokee_cache_t *cache)
+{
+	cherokee_cache_thread_slot_t *slot;
+	cherokee_cache_priv_t        *priv = cache->priv;
+
+	slot = (cherokee_cache_thread_slot_t *) thread_current (cache);
+	if (likely (slot != NULL)) {
+		return &slot->thread;
+	}
+
+	/* First look-up of the thread. The table is kept after the
+	 * thread is gone: its hits still have to be summed.
+	 */
+	slot = aligned_malloc (sizeof (cherokee_cache_thread_slot_t));
+	if (unlikely (slot == NULL)) {
+		return NULL;
+	}
+
+	memset (slot, 0, sizeof (cherokee_cache_thread_slot_t));
+	slot->thread.cache = cache;
+
+	CHEROKEE_MUTEX_LOCK (&priv->threads_mutex);
+	cherokee_list_add (&slot->thread.listed, &priv->threads);
+	CHEROKEE_MUTEX_UNLOCK (&priv->threads_mutex);
+
+#ifdef HAVE_PTHREAD
+	pthread_setspecific (priv->threads_key, slot);
+#endif
+	return &slot->thread;
+}
+
+static void
+thread_keep (cherokee_cache_thread_t *thread,
+	     cherokee_cache_entry_t  *entry)
+{
+	cherokee_cache_entry_t *prev;
+	cherokee_cache_local_t *local = &thread->locals[entry->key_hash & (THREAD_LOCALS - 1)];
+
+	/* The slot is not replaced while its references are in use
+	 */
+	if ((local->entry == entry) ||
+	    (local->refs > 0))
+	{
+		return;
+	}
+
+	/* The caller holds a reference, so the entry cannot go
+	 * away meanwhile: the slot's one can be taken lock-free.
+	 */
+	entry_ref (entry);
+
+	prev = local->entry;
+	local->entry = entry;
+
+	if (prev != NULL) {
+		cherokee_cache_entry_unref (&prev);
+	}
+}
+
+static cuint_t
+threads_count_hit (cherokee_cache_t *cache,
+		   cuint_t          *hit_local)
+{
+	cherokee_list_t *i;
+	cuint_t          hit   = 0;
+	cuint_t          local = 0;
+
+	CHEROKEE_MUTEX_LOCK (&cache->priv->threads_mutex);
+	list_for_each (i, &cache->priv->threads) {
+		hit   += ((cherokee_cache_thread_t *) i)->count_hit;
+		local += ((cherokee_cache_thread_t *) i)->count_hit_local;
+	}
+	CHEROKEE_MUTEX_UNLOCK (&cache->priv->threads_mutex);
+
+	if (hit_local != NULL) {
+		*hit_local = local;
+	}
+
+	return hit + local;
+}
+
+static void
+shards_setup (cherokee_cache_t *cache)
+{
+	cuint_t n;
+	cuint_t num = CHEROKEE_CACHE_SHARDS;
+
+	/* Small caches get fewer shards, so that the replacement
+	 * policy has some room to work in each one of them.
+	 */
+	while ((num > 1) && (cache->max_size / num < SHARD_MIN_SIZE))
+		num /= 2;
+
+	cache->shards_num = num;
+
+	for (n = 0; n < num; n++) {
+		cache->priv->shards[n].shard.max_size  = cache->max_size / num;
+		cache->priv->shards[n].shard.target_t1 = 0;
+
+		if (n < (cuint_t)(cache->max_size % num)) {
+			cache->priv->shards[n].shard.max_size += 1;
+		}
+	}
+}
+
 ret_t
 cherokee_cache_configure (cherokee_cache_t       *cache,
 			  cherokee_config_node_t *conf)
@@ -273,46 +532,66 @@ cherokee_cache_configure (cherokee_cache_t       *cache,
 	while (cache->max_size % 4 != 0)
 		cache->max_size++;
 
+	/* Split it among the shards
+	 */
+	shards_setup (cache);
+
 	return ret_ok;
 }
 
 ret_t
 cherokee_cache_init (cherokee_cache_t *cache)
 {
+	cuint_t                 n;
+	cherokee_cache_shard_t *shard;
+
 	/* Private
 	 */
-	cache->priv = malloc (sizeof(cherokee_cache_priv_t));
+	cache->priv = aligned_malloc (sizeof(cherokee_cache_priv_t));
 	if (cache->priv == NULL)
 		return ret_nomem;
 
-	CHEROKEE_MUTEX_INIT (&cache->priv->mutex, CHEROKEE_MUTEX_FAST);
-	CHEROKEE_MUTEX_LOCK (&cache->priv->mutex);
+	INIT_LIST_HEAD (&cache->priv->threads);
+	CHEROKEE_MUTEX_INIT (&cache->priv->threads_mutex, CHEROKEE_MUTEX_FAST);
+#ifdef HAVE_PTHREAD
+	if (pthread_key_create (&cache->priv->threads_key, thread_exit) != 0) {
+		CHEROKEE_MUTEX_DESTROY (&cache->priv->threads_mutex);
+		free (cache->priv);
+		cache->priv = NULL;
+		return ret_error;
+	}
+#endif
 
-	/* Public
-	 */
-	INIT_LIST_HEAD (&cache->_t1);
-	INIT_LIST_HEAD (&cache->_t2);
-	INIT_LIST_HEAD (&cache->_b1);
-	INIT_LIST_HEAD (&cache->_b2);
+	for (n = 0; n < CHEROKEE_CACHE_SHARDS; n++) {
+		shard = &cache->priv->shards[n].shard;
 
-	cherokee_avl_init (&cache->map);
+		CHEROKEE_RWLOCK_INIT (&shard->lock, NULL);
 
-	cache->len_t1       = 0;
-	cache->len_t2       = 0;
-	cache->len_b1       = 0;
-	cache->len_b2       = 0;
+		INIT_LIST_HEAD (&shard->_t1);
+		INIT_LIST_HEAD (&shard->_t2);
+		INIT_LIST_HEAD (&shard->_b1);
+		INIT_LIST_HEAD (&shard->_b2);
 
-	cache->count        = 0;
-	cache->count_hit    = 0;
-	cache->count_miss   = 0;
+		cherokee_hashtable_init (&shard->map);
 
+		shard->len_t1     = 0;
+		shard->len_t2     = 0;
+		shard->len_b1     = 0;
+		shard->len_b2     = 0;
+
+		shard->count_hit  = 0;
+		shard->count_miss = 0;
+	}
+
+	/* Public
+	 */
 	cache->max_size     = DEFAULT_MAX_SIZE;
-	cache->target_t1    = 0;
 
 	cache->new_cb       = NULL;
 	cache->new_cb_param = NULL;
+	cache->stats_cb     = NULL;
 
-	CHEROKEE_MUTEX_UNLOCK (&cache->priv->mutex);
+	shards_setup (cache);
 	return ret_ok;
 }
 
@@ -320,165 +599,172 @@ cherokee_cache_init (cherokee_cache_t *cache)
 ret_t
 cherokee_cache_mrproper (cherokee_cache_t *cache)
 {
-	if (cache->priv) {
-		CHEROKEE_MUTEX_DESTROY (&cache->priv->mutex);
-		free (cache->priv);
-		cache->priv = NULL;
+	cuint_t                 n;
+	cherokee_list_t        *i, *j;
+	cherokee_cache_shard_t *shard;
+
+	if (cache->priv == NULL)
+		return ret_ok;
+
+	for (n = 0; n < CHEROKEE_CACHE_SHARDS; n++) {
+		shard = &cache->priv->shards[n].shard;
+
+		cherokee_hashtable_mrproper (&shard->map, (cherokee_func_free_t)entry_free);
+		CHEROKEE_RWLOCK_DESTROY (&shard->lock);
 	}
 
-	cherokee_avl_mrproper (&cache->map, (cherokee_func_free_t)entry_free);
+	/* The entries have been freed: the thread tables only
+	 * pointed to them.
+	 */
+#ifdef HAVE_PTHREAD
+	pthread_key_delete (cache->priv->threads_key);
+#endif
+	list_for_each_safe (i, j, &cache->priv->threads) {
+		free (i);
+	}
+
+	CHEROKEE_MUTEX_DESTROY (&cache->priv->threads_mutex);
+
+	free (cache->priv);
+	cache->priv = NULL;
+
 	return ret_ok;
 }
 
 
-static ret_t
-replace (cherokee_cache_t       *cache,
-	 cherokee_cache_entry_t *x)
+static void
+demote (cherokee_cache_shard_t *shard,
+	cherokee_cache_entry_t *entry)
 {
-	/* cache->priv->mutex is LOCKED
-	 * x->mutex           is LOCKED
+	/* shard->lock is LOCKED (writer)
 	 */
-	cint_t                  p   = cache->target_t1;
-	cherokee_cache_entry_t *tmp = NULL;
+	CHEROKEE_MUTEX_LOCK (entry->mutex);
 
-	if ((cache->len_t1 >= 1) &&
-	    ((cache->len_t1  > p) ||
-	     (cache->len_t1 == p  && (x && x->in_list == cache_b2))))
-	{
-		cache_list_get_lru (t1, tmp);
-
-		if (tmp) {
-			CHEROKEE_MUTEX_LOCK (tmp->mutex);
-			cache_list_del (t1, tmp);
-			entry_parent_info_clean (tmp);
-			cache_list_add (b1, tmp);
-			CHEROKEE_MUTEX_UNLOCK (tmp->mutex);
-		}
+	if (entry->in_list == cache_t1) {
+		cache_list_swap (t1, b1, entry);
 	} else {
-		cache_list_get_lru (t2, tmp);
-
-		if (tmp) {
-			CHEROKEE_MUTEX_LOCK (tmp->mutex);
-			cache_list_del (t2, tmp);
-			entry_parent_info_clean (tmp);
-			cache_list_add (b2, tmp);
-			CHEROKEE_MUTEX_UNLOCK (tmp->mutex);
-		}
+		cache_list_swap (t2, b2, entry);
 	}
 
-	return ret_ok;
+	entry_parent_info_clean (entry);
+	CHEROKEE_MUTEX_UNLOCK (entry->mutex);
 }
 
-static ret_t
-on_new_added (cherokee_cache_t *cache)
+static void
+replace (cherokee_cache_shard_t *shard)
 {
-	/* cache->priv->mutex is LOCKED */
+	/* shard->lock is LOCKED (writer)
+	 */
+	cherokee_cache_entry_t *tmp;
 
-	cuint_t                 c         = cache->max_size;
-	cuint_t                 len_l1    = cache->len_t1 + cache->len_b1;
-	cuint_t                 len_l2    = cache->len_t2 + cache->len_b2;
-	cuint_t                 total_len = len_l1 + len_l2;
-	cherokee_cache_entry_t *tmp       = NULL;
+	while ((shard->len_t1 > 0) || (shard->len_t2 > 0)) {
+		tmp = NULL;
 
-	cache->count_miss += 1;
+		if ((shard->len_t1 >= MAX (1, shard->target_t1)) ||
+		    (shard->len_t2 == 0))
+		{
+			/* T1 hand: referenced entries are promoted to T2
+			 */
+			cache_list_get_lru (t1, tmp);
 
-	/* Free some room for the new obj that is about to be added to T1
-	 */
-	if (len_l1 >= c) {
-		if (cache->len_t1 < c) {
-			/* Remove LRU from B1 */
-			cache_list_get_lru (b1, tmp);
-			cache_list_del (b1, tmp);
-			entry_unref_guts (&tmp, true);
+			if (! tmp->referenced) {
+				demote (shard, tmp);
+				return;
+			}
+
+			tmp->referenced = 0;
+			cache_list_swap (t1, t2, tmp);
 
-			replace (cache, NULL);
 		} else {
-			/* Evict T1  */
-			cache_list_get_lru (t1, tmp);
-			cache_list_del (t1, tmp);
-			entry_unref_guts (&tmp, true);
-		}
+			/* T2 hand: referenced entries get a second chance
+			 */
+			cache_list_get_lru (t2, tmp);
 
-	} else if ((len_l1 < c) && (total_len >= c)) {
-		if (total_len >= (2 * c)) {
-			/* The cache is full: Remove from B2 */
-			cache_list_get_lru (b2, tmp);
-			cache_list_del (b2, tmp);
-			entry_unref_guts (&tmp, true);
+			if (! tmp->referenced) {
+				demote (shard, tmp);
+				return;
+			}
+
+			tmp->referenced = 0;
+			cache_list_make_first (t2, tmp);
 		}
-		replace (cache, NULL);
 	}
-
-	return ret_ok;
 }
 
-static ret_t
-update_ghost_b1 (cherokee_cache_t       *cache,
-		 cherokee_cache_entry_t *entry)
+static void
+make_room (cherokee_cache_shard_t *shard,
+	   cherokee_boolean_t      is_ghost)
 {
-	/* cache->priv->mutex is LOCKED
-	 * entry->mutex       is LOCKED
+	/* shard->lock is LOCKED (writer)
 	 */
-	ret_t ret;
+	cint_t                  c   = shard->max_size;
+	cherokee_cache_entry_t *tmp = NULL;
 
-	/* B1 hit: favour recency
-	 */
-	cache->target_t1 = MIN (cache->max_size,
-				(cache->target_t1 + MAX (1, (cache->len_b2 / cache->len_b1))));
+	if (shard->len_t1 + shard->len_t2 < c)
+		return;
 
-	/* Replace a page if needed
+	/* The cache is full: move a page to the history
 	 */
-	replace (cache, entry);
+	replace (shard);
 
-	/* Re-fetch the information
-	 */
-	ret = entry_parent_info_fetch (entry);
-	switch (ret) {
-	case ret_ok:
-	case ret_deny:
-	case ret_ok_and_sent:
-		break;
-	case ret_error:
-	case ret_no_sys:
-	case ret_not_found:
-		return ret;
-	default:
-		RET_UNKNOWN(ret);
-		return ret_error;
-	}
+	if (is_ghost)
+		return;
 
-	/* Move 'entry' to the top of T2, and place it in the cache
+	/* History replacement
 	 */
-	cache_list_swap (b1, t2, entry);
-	return ret_ok;
+	if (shard->len_t1 + shard->len_b1 >= c) {
+		cache_list_get_lru (b1, tmp);
+		if (tmp != NULL) {
+			cache_list_del (b1, tmp);
+			entry_unref_guts (shard, &tmp);
+		}
+
+	} else if (shard->len_t1 + shard->len_t2 + shard->len_b1 + shard->len_b2 >= 2 * c) {
+		cache_list_get_lru (b2, tmp);
+		if (tmp != NULL) {
+			cache_list_del (b2, tmp);
+			entry_unref_guts (shard, &tmp);
+		}
+	}
 }
 
 static ret_t
-update_ghost_b2 (cherokee_cache_t       *cache,
-		 cherokee_cache_entry_t *entry)
+update_ghost (cherokee_cache_shard_t *shard,
+	      cherokee_cache_entry_t *entry)
 {
-	/* cache->priv->mutex is LOCKED
-	 * entry->mutex       is LOCKED
+	/* shard->lock is LOCKED (writer)
 	 */
 	ret_t ret;
 
 	/* Adapt the target size
 	 */
-	cache->target_t1 = MAX (0, (cache->target_t1 - MAX(1, (cache->len_b1 / cache->len_b2))));
+	if (entry->in_list == cache_b1) {
+		/* B1 hit: favour recency */
+		shard->target_t1 = MIN (shard->max_size,
+					(shard->target_t1 + MAX (1, (shard->len_b2 / shard->len_b1))));
+	} else {
+		/* B2 hit: favour frequency */
+		shard->target_t1 = MAX (0, (shard->target_t1 - MAX (1, (shard->len_b1 / shard->len_b2))));
+	}
 
 	/* Replace a page if needed
 	 */
-	replace (cache, entry);
+	make_room (shard, true);
 
 	/* Re-fetch the information
 	 */
+	CHEROKEE_MUTEX_LOCK (entry->mutex);
 	ret = entry_parent_info_fetch (entry);
+	CHEROKEE_MUTEX_UNLOCK (entry->mutex);
+
 	switch (ret) {
 	case ret_ok:
 	case ret_deny:
+	case ret_ok_and_sent:
 		break;
 	case ret_error:
 	case ret_no_sys:
+	case ret_not_found:
 		return ret;
 	default:
 		RET_UNKNOWN(ret);
@@ -487,90 +773,179 @@ update_ghost_b2 (cherokee_cache_t       *cache,
 
 	/* Move 'entry' to the top of T2, and place it in the cache
 	 */
-	cache_list_swap (b2, t2, entry);
+	if (entry->in_list == cache_b1) {
+		cache_list_swap (b1, t2, entry);
+	} else {
+		cache_list_swap (b2, t2, entry);
+	}
+
+	entry->referenced = 0;
 	return ret_ok;
 }
 
-static ret_t
-update_cache (cherokee_cache_t       *cache,
-	      cherokee_cache_entry_t *entry)
+
+ret_t
+cherokee_cache_get (cherokee_cache_t        *cache,
+		    cherokee_buffer_t       *key,
+		    cherokee_cache_entry_t **ret_entry)
 {
-	/* cache->priv->mutex is LOCKED
-	 * entry->mutex       is LOCKED
+	ret_t                    ret;
+	cherokee_cache_local_t  *local;
+	cherokee_cache_entry_t  *entry  = NULL;
+	crc_t                    hash   = cherokee_buffer_crc32 (key);
+	cherokee_cache_shard_t  *shard  = CACHE_SHARD (cache, hash);
+	cherokee_cache_thread_t *thread = thread_get (cache);
+
+	/* Fastest path: the thread keeps the entry. It holds a
+	 * reference, so the entry is alive. The reference bit is
+	 * only written when it was cleared by the clock hand.
 	 */
-	ret_t ret;
+	if (likely (thread != NULL)) {
+		local = &thread->locals[hash & (THREAD_LOCALS - 1)];
+		entry = local->entry;
+
+		if ((entry != NULL) &&
+		    (entry->key_hash == hash) &&
+		    ((entry->in_list == cache_t1) ||
+		     (entry->in_list == cache_t2)) &&
+		    (entry_match_key (entry, key)))
+		{
+			if (! entry->referenced) {
+				entry->referenced = 1;
+			}
 
-	cache->count_hit += 1;
+			local->refs             += 1;
+			thread->count_hit_local += 1;
 
-	switch (entry->in_list) {
-	case cache_t1:
-		/* LRU (Least Recently Used) cache hit
-		 */
-		TRACE(ENTRIES, "T1 hit: '%s'\n", entry->key.buf);
+			TRACE(ENTRIES, "Thread hit: '%s'\n", key->buf);
 
-		cache_list_swap (t1, t2, entry);
-		break;
+			*ret_entry = entry;
+			return ret_ok;
+		}
 
-	case cache_t2:
-		/* LFU (Least Frequently Used)
-		 */
-		TRACE(ENTRIES, "T2 hit: '%s'\n", entry->key.buf);
+		entry = NULL;
+	}
 
-		cache_list_make_first (t2, entry);
-		break;
+	/* Fast path: resident entry. Only the reference bit and the
+	 * reference counter are touched.
+	 */
+	CHEROKEE_RWLOCK_READER (&shard->lock);
+
+	ret = cherokee_hashtable_get (&shard->map, hash, (cherokee_hashtable_match_func_t) entry_match_key, key, (void **)&entry);
+	if ((ret == ret_ok) &&
+	    ((entry->in_list == cache_t1) ||
+	     (entry->in_list == cache_t2)))
+	{
+		if (! entry->referenced) {
+			entry->referenced = 1;
+		}
+
+		entry_ref (entry);
+		CHEROKEE_RWLOCK_UNLOCK (&shard->lock);
+
+		TRACE(ENTRIES, "%s hit: '%s'\n",
+		      (entry->in_list == cache_t1) ? "T1" : "T2", key->buf);
+
+		if (likely (thread != NULL)) {
+			thread->count_hit += 1;
+			thread_keep (thread, entry);
+		}
+
+		*ret_entry = entry;
+		return ret_ok;
+	}
+
+	CHEROKEE_RWLOCK_UNLOCK (&shard->lock);
+
+	/* Slow path: the shard has to be modified
+	 */
+	CHEROKEE_RWLOCK_WRITER (&shard->lock);
+
+	ret = cherokee_hashtable_get (&shard->map, hash, (cherokee_hashtable_match_func_t) entry_match_key, key, (void **)&entry);
+	switch (ret) {
+	case ret_ok:
+		switch (entry->in_list) {
+		case cache_t1:
+		case cache_t2:
+			/* Somebody else brought it in meanwhile
+			 */
+			entry->referenced = 1;
+			shard->count_hit += 1;
+			break;
+
+		case cache_b1:
+		case cache_b2:
+			/* Ghost hit
+			 */
+			TRACE(ENTRIES, "%s ghost hit: '%s' (refs=%d)\n",
+			      (entry->in_list == cache_b1) ? "B1" : "B2",
+			      key->buf, entry->ref_count);
+
+			ret = update_ghost (shard, entry);
+			if (ret != ret_ok) {
+				*ret_entry = NULL;
+				goto out;
+			}
+
+			shard->count_hit += 1;
+			break;
 
-	case cache_b1:
-		/* Ghost 'Recently' hit
-		 */
-		TRACE(ENTRIES, "B1 ghost hit: '%s' (refs=%d)\n",
-		      entry->key.buf, entry->ref_count);
-
-		ret = update_ghost_b1 (cache, entry);
-		switch (ret) {
-		case ret_ok:
-		case ret_no_sys:
-			return ret;
 		default:
-			return ret_error;
+			/* Lingering object: evinced, but still in use
+			 */
+			TRACE(ENTRIES, "Found in map, not listed: '%s'\n", key->buf);
+
+			make_room (shard, false);
+			entry_ref (entry); /* cache */
+
+			cache_list_add (t1, entry);
+			shard->count_miss += 1;
+			break;
 		}
 		break;
 
-	case cache_b2:
-		/* Ghost 'Frequently' hit
+	case ret_not_found:
+		/* Might need to free some room for the new page
 		 */
-		TRACE(ENTRIES, "B2 ghost hit: '%s' (refs=%d)\n",
-		      entry->key.buf, entry->ref_count);
-
-		ret = update_ghost_b2 (cache, entry);
-		switch (ret) {
-		case ret_ok:
-		case ret_no_sys:
-			return ret;
-		default:
-			return ret_error;
+		make_room (shard, false);
+
+		/* Instance new page and add it to the map
+		 */
+		cache->new_cb (cache, key, cache->new_cb_param, &entry);
+		if (entry == NULL) {
+			SHOULDNT_HAPPEN;
+			ret = ret_error;
+			goto out;
 		}
+
+		TRACE(ENTRIES, "Miss (adding): '%s'\n", key->buf);
+
+		cherokee_hashtable_add (&shard->map, hash, entry);
+		entry_ref (entry); /* cache */
+
+		cache_list_add (t1, entry);
+		shard->count_miss += 1;
 		break;
 
 	default:
-		return ret_error;
+		SHOULDNT_HAPPEN;
+		ret = ret_error;
+		goto out;
 	}
 
-	return ret_ok;
-}
-
+	entry_ref (entry); /* client */
+	*ret_entry = entry;
+	ret = ret_ok;
 
-ret_t
-cherokee_cache_get (cherokee_cache_t        *cache,
-		    cherokee_buffer_t       *key,
-		    cherokee_cache_entry_t **ret_entry)
-{
-	ret_t ret;
+out:
+	CHEROKEE_RWLOCK_UNLOCK (&shard->lock);
 
-	CHEROKEE_MUTEX_LOCK (&cache->priv->mutex);
-	cache->count += 1;
+	if ((ret == ret_ok) && (likely (thread != NULL))) {
+		thread_keep (thread, entry);
+	}
 
 #ifdef TRACE_ENABLED
-	if (cache->count % 100 == 0) {
+	if ((ret == ret_ok) && (shard->count_miss % 100 == 0)) {
 		cherokee_buffer_t tmp = CHEROKEE_BUF_INIT;
 
 		cherokee_cache_get_stats (cache, &tmp);
@@ -579,103 +954,175 @@ cherokee_cache_get (cherokee_cache_t        *cache,
 	}
 #endif
 
-	/* Find inside the cache
-	 */
-	ret = cherokee_avl_get (&cache->map, key, (void **)ret_entry);
-	switch (ret) {
-	case ret_ok:
-		CHEROKEE_MUTEX_LOCK ((*ret_entry)->mutex);
+	return ret;
+}
 
-		/* Lingering object: evinced, but already in the AVL
-		 */
-		if ((*ret_entry)->in_list == cache_no_list) {
-			TRACE(ENTRIES, "Found in AVL, not listed: '%s'\n", key->buf);
-			entry_ref (*ret_entry);
-			goto add_list;
-		}
 
-		/* It's in the cache; update it
-		 */
-		ret = update_cache (cache, *ret_entry);
-		entry_ref (*ret_entry);
+ret_t
+cherokee_cache_find (cherokee_cache_t        *cache,
+		     cherokee_buffer_t       *key,
+		     cherokee_cache_entry_t **ret_entry)
+{
+	ret_t                   ret;
+	cherokee_cache_entry_t *entry = NULL;
+	crc_t                   hash  = cherokee_buffer_crc32 (key);
+	cherokee_cache_shard_t *shard = CACHE_SHARD (cache, hash);
 
-		CHEROKEE_MUTEX_UNLOCK ((*ret_entry)->mutex);
-		goto out;
+	/* Look up a resident entry. Unlike cherokee_cache_get(),
+	 * it neither brings new entries in, nor counts as a hit.
+	 */
+	CHEROKEE_RWLOCK_READER (&shard->lock);
 
-	case ret_not_found:
-		break;
+	ret = cherokee_hashtable_get (&shard->map, hash, (cherokee_hashtable_match_func_t) entry_match_key, key, (void **)&entry);
+	if ((ret == ret_ok) &&
+	    ((entry->in_list == cache_t1) ||
+	     (entry->in_list == cache_t2)))
+	{
+		entry_ref (entry);
+		CHEROKEE_RWLOCK_UNLOCK (&shard->lock);
 
-	default:
-		SHOULDNT_HAPPEN;
-		ret = ret_error;
-		goto out;
+		*ret_entry = entry;
+		return ret_ok;
 	}
 
-	/* Might need to free some room for the new page
-	 */
-	on_new_added (cache);
+	CHEROKEE_RWLOCK_UNLOCK (&shard->lock);
+	return ret_not_found;
+}
+
+
+ret_t
+cherokee_cache_foreach (cherokee_cache_t              *cache,
+			cherokee_cache_foreach_func_t  func,
+			void                          *param)
+{
+	ret_t                   ret;
+	cuint_t                 n;
+	cherokee_list_t        *i;
+	cherokee_cache_shard_t *shard;
 
-	/* Instance new page and add it to the AVL
+	/* Walk the resident entries (T1 and T2)
 	 */
-	cache->new_cb (cache, key, cache->new_cb_param, ret_entry);
-	if (*ret_entry == NULL) {
-		SHOULDNT_HAPPEN;
-		CHEROKEE_MUTEX_UNLOCK (&cache->priv->mutex);
-		return ret_error;
-	}
+	for (n = 0; n < cache->shards_num; n++) {
+		shard = &cache->priv->shards[n].shard;
 
-	TRACE(ENTRIES, "Miss (adding): '%s'\n", key->buf);
-	CHEROKEE_MUTEX_LOCK ((*ret_entry)->mutex);
+		CHEROKEE_RWLOCK_READER (&shard->lock);
 
-	cherokee_avl_add (&cache->map, key, *ret_entry);
-	entry_ref (*ret_entry); /* cache */
+		list_for_each (i, &shard->_t1) {
+			ret = func (CACHE_ENTRY(i), param);
+			if (ret != ret_ok) goto out;
+		}
 
-	/* Add the new object to T1
-	 */
-add_list:
-	cache_list_add (t1, *ret_entry);
-	entry_ref (*ret_entry); /* client */
+		list_for_each (i, &shard->_t2) {
+			ret = func (CACHE_ENTRY(i), param);
+			if (ret != ret_ok) goto out;
+		}
+
+		CHEROKEE_RWLOCK_UNLOCK (&shard->lock);
+	}
+
+	return ret_ok;
 
-	CHEROKEE_MUTEX_UNLOCK ((*ret_entry)->mutex);
-	ret = ret_ok;
 out:
-	CHEROKEE_MUTEX_UNLOCK (&cache->priv->mutex);
+	CHEROKEE_RWLOCK_UNLOCK (&shard->lock);
 	return ret;
 }
 
 
 ret_t
-cherokee_cache_get_stats (cherokee_cache_t  *cache,
-			  cherokee_buffer_t *info)
+cherokee_cache_get_counters (cherokee_cache_t *cache,
+			     cuint_t          *count,
+			     cuint_t          *count_hit,
+			     cuint_t          *count_miss)
 {
-	size_t len  = 0;
-	float  rate = 0;
+	cuint_t n;
+	cuint_t hit  = 0;
+	cuint_t miss = 0;
+
+	for (n = 0; n < cache->shards_num; n++) {
+		hit  += cache->priv->shards[n].shard.count_hit;
+		miss += cache->priv->shards[n].shard.count_miss;
+	}
+
+	hit += threads_count_hit (cache, NULL);
+
+	if (count)      *count      = hit + miss;
+	if (count_hit)  *count_hit  = hit;
+	if (count_miss) *count_miss = miss;
+
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_cache_get_thread_hits (cherokee_cache_t *cache,
+				cuint_t          *count_hit)
+{
+	threads_count_hit (cache, count_hit);
+	return ret_ok;
+}
 
-	cherokee_list_get_len (&cache->_t1, &len);
-	cherokee_buffer_add_va (info, "T1 size: %d (real=%d)\n", cache->len_t1, len);
 
-	cherokee_list_get_len (&cache->_b1, &len);
-	cherokee_buffer_add_va (info, "B1 size: %d (real=%d)\n", cache->len_b1, len);
+ret_t
+cherokee_cache_get_stats (cherokee_cache_t  *cache,
+			  cherokee_buffer_t *info)
+{
+	cuint_t                 n;
+	size_t                  len;
+	cherokee_cache_shard_t *shard;
+	cuint_t                 hit       = 0;
+	cuint_t                 miss      = 0;
+	cuint_t                 hit_local = 0;
+	float                   rate      = 0;
+	cint_t                  lens[4]   = {0, 0, 0, 0};
+	size_t                  reals[4]  = {0, 0, 0, 0};
+	size_t                  map_len   = 0;
+	cint_t                  target    = 0;
+
+	for (n = 0; n < cache->shards_num; n++) {
+		shard = &cache->priv->shards[n].shard;
+
+		CHEROKEE_RWLOCK_READER (&shard->lock);
+
+		lens[0] += shard->len_t1;
+		lens[1] += shard->len_b1;
+		lens[2] += shard->len_t2;
+		lens[3] += shard->len_b2;
+
+		cherokee_list_get_len (&shard->_t1, &len); reals[0] += len;
+		cherokee_list_get_len (&shard->_b1, &len); reals[1] += len;
+		cherokee_list_get_len (&shard->_t2, &len); reals[2] += len;
+		cherokee_list_get_len (&shard->_b2, &len); reals[3] += len;
+
+		cherokee_hashtable_len (&shard->map, &len);
+		map_len += len;
+
+		target += shard->target_t1;
+		hit    += shard->count_hit;
+		miss   += shard->count_miss;
+
+		CHEROKEE_RWLOCK_UNLOCK (&shard->lock);
+	}
 
-	cherokee_list_get_len (&cache->_t2, &len);
-	cherokee_buffer_add_va (info, "T2 size: %d (real=%d)\n", cache->len_t2, len);
+	hit += threads_count_hit (cache, &hit_local);
 
-	cherokee_list_get_len (&cache->_b2, &len);
-	cherokee_buffer_add_va (info, "B2 size: %d (real=%d)\n", cache->len_b2, len);
+	cherokee_buffer_add_va (info, "T1 size: %d (real=%d)\n", lens[0], reals[0]);
+	cherokee_buffer_add_va (info, "B1 size: %d (real=%d)\n", lens[1], reals[1]);
+	cherokee_buffer_add_va (info, "T2 size: %d (real=%d)\n", lens[2], reals[2]);
+	cherokee_buffer_add_va (info, "B2 size: %d (real=%d)\n", lens[3], reals[3]);
 
 	cherokee_buffer_add_va (info, "Max size: %d\n", cache->max_size);
-	cherokee_buffer_add_va (info, "Target T1 size: %d\n", cache->target_t1);
+	cherokee_buffer_add_va (info, "Shards: %d\n", cache->shards_num);
+	cherokee_buffer_add_va (info, "Target T1 size: %d\n", target);
 
-	cherokee_avl_len (&cache->map, &len);
-	cherokee_buffer_add_va (info, "AVL size: %d\n", len);
+	cherokee_buffer_add_va (info, "Map size: %d\n", map_len);
 
-	cherokee_buffer_add_va (info, "Total count: %d\n", cache->count);
-	cherokee_buffer_add_va (info, "Hit count: %d\n", cache->count_hit);
-	cherokee_buffer_add_va (info, "Miss count: %d\n", cache->count_miss);
+	cherokee_buffer_add_va (info, "Total count: %d\n", hit + miss);
+	cherokee_buffer_add_va (info, "Hit count: %d\n", hit);
+	cherokee_buffer_add_va (info, "Thread hit count: %d\n", hit_local);
+	cherokee_buffer_add_va (info, "Miss count: %d\n", miss);
 
-	if (cache->count_hit + cache->count_miss > 0) {
-		rate = (float) ((cache->count_hit * 100) /
-				(cache->count_hit + cache->count_miss));
+	if (hit + miss > 0) {
+		rate = (float) ((hit * 100) / (hit + miss));
 	}
 	cherokee_buffer_add_va (info, "Hit Rate: %.2f%%\n", rate);
 
@@ -685,5 +1132,3 @@ cherokee_cache_get_stats (cherokee_cache_t  *cache,
 
 	return ret_ok;
 }
-
-
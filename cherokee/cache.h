@@ -31,7 +31,6 @@
 
 #include <cherokee/common.h>
 #include <cherokee/list.h>
-#include <cherokee/avl.h>
 #include <cherokee/config_node.h>
 
 /* Forward declaration */
@@ -61,38 +60,23 @@ typedef enum {
 	cache_b2
 } cherokee_cache_list_t;
 
+/* The cache is split in shards: each one has its own lock, lookup
+ * table and CAR lists. Keys are distributed by their hash.
+ */
+#define CHEROKEE_CACHE_SHARDS 16
+
 /* Classes */
 struct cherokee_cache {
-	/* Lookup table */
-	cherokee_avl_t  map;
-
-	/* LRU (Least Recently Used)   */
-	cherokee_list_t _t1;
-	cherokee_list_t _b1;
-	cint_t          len_t1;
-	cint_t          len_b1;
-
-	/* LFU (Least Frequently Used) */
-	cherokee_list_t _t2;
-	cherokee_list_t _b2;
-	cint_t          len_t2;
-	cint_t          len_b2;
-
 	/* Configuration */
 	cint_t          max_size;
-	cint_t          target_t1;
-
-	/* Stats */
-	cuint_t         count;
-	cuint_t         count_hit;
-	cuint_t         count_miss;
+	cuint_t         shards_num;
 
 	/* Callbacks */
 	cherokee_cache_new_func_t  new_cb;
 	void                      *new_cb_param;
 	cherokee_cache_get_stats_t stats_cb;
 
-	/* Private properties */
+	/* Private properties: shards */
 	cherokee_cache_priv_t     *priv;
 };
 
@@ -100,7 +84,9 @@ struct cherokee_cache_entry {
 	/* Internal stuff */
 	cherokee_list_t              listed;
 	cherokee_buffer_t            key;
+	crc_t                        key_hash;
 	cherokee_cache_list_t        in_list;
+	cint_t                       referenced;
 
 	cint_t                       ref_count;
 	void                        *mutex;
@@ -112,6 +98,9 @@ struct cherokee_cache_entry {
 	cherokee_cache_entry_free_t  free_cb;
 };
 
+typedef ret_t (* cherokee_cache_foreach_func_t) (struct cherokee_cache_entry *entry,
+						 void                        *param);
+
 /* Castings */
 #define CACHE(x)       ((cherokee_cache_t *)(x))
 #define CACHE_ENTRY(x) ((cherokee_cache_entry_t *)(x))
@@ -140,7 +129,23 @@ ret_t cherokee_cache_get       (cherokee_cache_t        *cache,
 				cherokee_buffer_t       *key,
 				cherokee_cache_entry_t **entry);
 
+ret_t cherokee_cache_find      (cherokee_cache_t        *cache,
+				cherokee_buffer_t       *key,
+				cherokee_cache_entry_t **entry);
+
 ret_t cherokee_cache_get_stats (cherokee_cache_t        *cache,
 				cherokee_buffer_t       *info);
 
+ret_t cherokee_cache_get_counters (cherokee_cache_t     *cache,
+				   cuint_t              *count,
+				   cuint_t              *count_hit,
+				   cuint_t              *count_miss);
+
+ret_t cherokee_cache_get_thread_hits (cherokee_cache_t  *cache,
+				      cuint_t           *count_hit);
+
+ret_t cherokee_cache_foreach   (cherokee_cache_t              *cache,
+				cherokee_cache_foreach_func_t  func,
+				void                          *param);
+
 #endif /* CHEROKEE_CACHE_H */
@@ -154,6 +154,16 @@
 # define CHEROKEE_RWLOCK_DESTROY(m)
 #endif
 
+#ifdef HAVE_SYNC_BUILTINS
+# define CHEROKEE_ATOMIC_ADD(p,n)      __sync_add_and_fetch(p,n)
+# define CHEROKEE_ATOMIC_CAS(p,o,n)    __sync_bool_compare_and_swap(p,o,n)
+# define CHEROKEE_MEMORY_BARRIER       __sync_synchronize()
+#else
+# define CHEROKEE_ATOMIC_ADD(p,n)      (*(p) += (n))
+# define CHEROKEE_ATOMIC_CAS(p,o,n)    ((*(p) == (o)) ? ((*(p) = (n)), 1) : 0)
+# define CHEROKEE_MEMORY_BARRIER
+#endif
+
 #ifdef HAVE_SCHED_YIELD
 # define CHEROKEE_THREAD_YIELD         sched_yield()
 #else
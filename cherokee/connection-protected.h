@@ -67,6 +67,7 @@
 #include "regex.h"
 #include "bind.h"
 #include "bogotime.h"
+#include "timer_wheel.h"
 #include "config_entry.h"
 
 typedef enum {
@@ -99,6 +100,7 @@ typedef cuint_t cherokee_connection_options_t;
 
 struct cherokee_connection {
 	cherokee_list_t               list_node;
+	cherokee_list_t               ready_node;
 
 	/* References
 	 */
@@ -189,6 +191,7 @@ struct cherokee_connection {
 	time_t                        timeout;
 	time_t                        timeout_lapse;
 	cherokee_buffer_t            *timeout_header;
+	cherokee_timer_t              timer;
 
 	/* Polling
 	 */
@@ -239,6 +242,7 @@ struct cherokee_connection {
 	cherokee_boolean_t            limit_rate;
 	cuint_t                       limit_bps;
 	cherokee_msec_t               limit_blocked_until;
+	cherokee_boolean_t            in_limiter;
 };
 
 #define CONN_SRV(c)    (SRV(CONN(c)->server))
@@ -90,6 +90,8 @@ cherokee_connection_new  (cherokee_connection_t **conn)
 	CHEROKEE_NEW_STRUCT(n, connection);
 
 	INIT_LIST_HEAD (&n->list_node);
+	INIT_LIST_HEAD (&n->ready_node);
+	cherokee_timer_init (&n->timer);
 
 	n->error_code                = http_ok;
 	n->phase                     = phase_reading_header;
@@ -130,6 +132,7 @@ cherokee_connection_new  (cherokee_connection_t **conn)
 	n->limit_rate                = false;
 	n->limit_bps                 = 0;
 	n->limit_blocked_until       = 0;
+	n->in_limiter                = false;
 
 	cherokee_buffer_init (&n->buffer);
 	cherokee_buffer_init (&n->header_buffer);
@@ -327,6 +330,7 @@ cherokee_connection_clean (cherokee_connection_t *conn)
 	conn->limit_rate           = false;
 	conn->limit_bps            = 0;
 	conn->limit_blocked_until  = 0;
+	conn->in_limiter           = false;
 
 	memset (conn->regex_ovector, 0, OVECTOR_LEN * sizeof(int));
 	conn->regex_ovecsize = 0;
@@ -674,6 +678,7 @@ cherokee_connection_add_expiration_header (cherokee_connection_t *conn,
 	char               bufstr[DTM_SIZE_GMTTM_STR + 2];
 	size_t             szlen               = 0;
 	cherokee_boolean_t first_prop          = true;
+	cherokee_thread_t *thread              = CONN_THREAD(conn);
 
 	/* Expires, and Cache-Control: max-age
 	 */
@@ -693,11 +698,29 @@ cherokee_connection_add_expiration_header (cherokee_connection_t *conn,
 
 	case cherokee_expiration_time:
 		exp_time = (cherokee_bogonow_now + conn->expiration_time);
-		cherokee_gmtime (&exp_time, &exp_tm);
-		szlen = cherokee_dtm_gmttm2str (bufstr, sizeof(bufstr), &exp_tm);
 
 		cherokee_buffer_add_str (buffer, "Expires: ");
-		cherokee_buffer_add (buffer, bufstr, szlen);
+
+		/* Most of the responses sharing a max-age expire at
+		 * the same second: reuse the last rendered date.
+		 */
+		if ((thread != NULL) &&
+		    (thread->expires_time == exp_time) &&
+		    (! cherokee_buffer_is_empty (&thread->expires_strgmt)))
+		{
+			cherokee_buffer_add_buffer (buffer, &thread->expires_strgmt);
+		} else {
+			cherokee_gmtime (&exp_time, &exp_tm);
+			szlen = cherokee_dtm_gmttm2str (bufstr, sizeof(bufstr), &exp_tm);
+			cherokee_buffer_add (buffer, bufstr, szlen);
+
+			if (thread != NULL) {
+				thread->expires_time = exp_time;
+				cherokee_buffer_clean (&thread->expires_strgmt);
+				cherokee_buffer_add (&thread->expires_strgmt, bufstr, szlen);
+			}
+		}
+
 		cherokee_buffer_add_str (buffer, CRLF);
 
 		if (use_maxage) {
@@ -5,6 +5,7 @@
 
 #include <sys/types.h>
 #include <stdio.h>
+#include <ctype.h>
 #include <sys/types.h>
 
 /*
@@ -109,3 +110,16 @@ crc32_partial_sz (crc_t crc_in, char *buf, int size)
 	return ~crc;
 }
 
+
+crc_t
+crc32_case_partial_sz (crc_t crc_in, char *buf, int size)
+{
+	unsigned int crc = ~crc_in;
+	char	*p;
+	int		nr;
+
+	for (nr = size, p = buf; nr--; ++p)
+		_CRC32_(crc, tolower((unsigned char) *p));
+
+	return ~crc;
+}
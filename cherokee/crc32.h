@@ -7,6 +7,9 @@
 crc_t crc32_sz(char *buf, int size);
 crc_t crc32_partial_sz (crc_t crc_in, char *buf, int size);
 
+/* Case insensitive version */
+crc_t crc32_case_partial_sz (crc_t crc_in, char *buf, int size);
+
 /* Returns crc32 of null-terminated string
 #define crc32(buf) crc32_sz((buf),strlen(buf))
 */
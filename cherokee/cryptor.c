@@ -49,6 +49,9 @@ cherokee_cryptor_init_base (cherokee_cryptor_t      *cryp,
 	 */
 	cryp->timeout_handshake = TIMEOUT_DEFAULT;
 	cryp->allow_SSLv2       = false;
+	cryp->lazy_certs        = false;
+
+	memset (&cryp->stats, 0, sizeof(cherokee_cryptor_stats_t));
 
 	return ret_ok;
 }
@@ -83,6 +86,7 @@ cherokee_cryptor_configure (cherokee_cryptor_t     *cryp,
 	 */
 	cherokee_config_node_read_int  (conf, "timeout_handshake", &cryp->timeout_handshake);
 	cherokee_config_node_read_bool (conf, "protocol!SSLv2",    &cryp->allow_SSLv2);
+	cherokee_config_node_read_bool (conf, "lazy_certs",        &cryp->lazy_certs);
 
 	/* Call the its virtual method
 	 */
@@ -63,10 +63,22 @@ typedef ret_t (* cryptor_client_func_init_t)    (void  *cryp, void *host, void *
 
 /* Data types
  */
+typedef struct {
+	culong_t                   full_handshakes;
+	culong_t                   resumed;
+	culong_t                   cache_hits;
+	culong_t                   cache_misses;
+	culong_t                   ticket_hits;
+} cherokee_cryptor_stats_t;
+
 typedef struct {
 	cherokee_module_t          module;
 	cint_t                     timeout_handshake;
 	cherokee_boolean_t         allow_SSLv2;
+	cherokee_boolean_t         lazy_certs;
+
+	/* Session resumption */
+	cherokee_cryptor_stats_t   stats;
 
 	/* Methods */
 	cryptor_func_configure_t   configure;
@@ -44,8 +44,16 @@
 #include "virtual_server.h"
 #include "socket.h"
 #include "util.h"
+#include "bogotime.h"
 #include "server-protected.h"
 
+#include <fcntl.h>
+#include <openssl/hmac.h>
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+# include <openssl/core_names.h>
+#endif
+
 #define ENTRIES "crypto,ssl"
 
 static DH *dh_param_512  = NULL;
@@ -68,6 +76,518 @@ static DH *dh_param_4096 = NULL;
 	} while(0)
 
 
+#define SESSION_CACHE_SIZE_DEFAULT   20480
+#define SESSION_TIMEOUT_DEFAULT      300
+#define TICKET_ROTATION_DEFAULT      3600
+#define TICKET_KEYS_VALID            2
+#define SNI_NAMES_MAX                4096
+#define SNI_UNKNOWN_MAX              256
+#define SNI_LOAD_RETRY               60
+#define SNI_NO_TLS                   ((void *) 1)
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+# define SESSION_ID_CONST const
+#else
+# define SESSION_ID_CONST
+#endif
+
+
+/* Session cache
+ *
+ * OpenSSL keeps a separate cache per SSL_CTX, that is to say, per
+ * virtual server. Sessions are stored here instead, serialized, in
+ * a table split into stripes so the threads seldom contend.
+ */
+
+typedef struct {
+	cherokee_list_t    lru;
+	cherokee_buffer_t  key;
+	time_t             expiration;
+	int                der_len;
+	unsigned char     *der;
+} session_entry_t;
+
+#define SESSION_ENTRY(e) ((session_entry_t *)(e))
+
+static void
+session_entry_free (session_entry_t *entry)
+{
+	cherokee_buffer_mrproper (&entry->key);
+	free (entry->der);
+	free (entry);
+}
+
+static ret_t
+session_cache_init (cherokee_cryptor_libssl_t *cryp)
+{
+	cuint_t i;
+
+	cryp->session_cache = (cherokee_cryptor_libssl_stripe_t *)
+		malloc (sizeof(cherokee_cryptor_libssl_stripe_t) * SESSION_CACHE_STRIPES);
+	if (unlikely (cryp->session_cache == NULL)) {
+		return ret_nomem;
+	}
+
+	for (i = 0; i < SESSION_CACHE_STRIPES; i++) {
+		cherokee_avl_init (&cryp->session_cache[i].table);
+		INIT_LIST_HEAD (&cryp->session_cache[i].lru);
+		CHEROKEE_MUTEX_INIT (&cryp->session_cache[i].mutex, CHEROKEE_MUTEX_FAST);
+		cryp->session_cache[i].len = 0;
+	}
+
+	return ret_ok;
+}
+
+static void
+session_cache_mrproper (cherokee_cryptor_libssl_t *cryp)
+{
+	cuint_t          i;
+	cherokee_list_t *l, *tmp;
+
+	if (cryp->session_cache == NULL) {
+		return;
+	}
+
+	for (i = 0; i < SESSION_CACHE_STRIPES; i++) {
+		cherokee_avl_mrproper (AVL_GENERIC(&cryp->session_cache[i].table), NULL);
+
+		list_for_each_safe (l, tmp, &cryp->session_cache[i].lru) {
+			session_entry_free (SESSION_ENTRY(l));
+		}
+
+		CHEROKEE_MUTEX_DESTROY (&cryp->session_cache[i].mutex);
+	}
+
+	free (cryp->session_cache);
+	cryp->session_cache = NULL;
+}
+
+static cherokee_cryptor_libssl_stripe_t *
+session_cache_stripe (cherokee_cryptor_libssl_t *cryp,
+		      const unsigned char       *id,
+		      unsigned int               id_len,
+		      cherokee_buffer_t         *key)
+{
+	cherokee_buffer_t raw;
+
+	/* The table keys are strings
+	 */
+	cherokee_buffer_fake (&raw, (const char *)id, id_len);
+	cherokee_buffer_encode_hex (&raw, key);
+
+	/* Session IDs are random, any byte would do
+	 */
+	return &cryp->session_cache[(id_len > 0) ? id[0] % SESSION_CACHE_STRIPES : 0];
+}
+
+static void
+session_cache_unlink (cherokee_cryptor_libssl_stripe_t *stripe,
+		      session_entry_t                  *entry)
+{
+	cherokee_avl_del (&stripe->table, &entry->key, NULL);
+	cherokee_list_del (&entry->lru);
+	stripe->len -= 1;
+
+	session_entry_free (entry);
+}
+
+static int
+session_new_cb (SSL *ssl, SSL_SESSION *session)
+{
+	ret_t                             ret;
+	unsigned char                    *p;
+	const unsigned char              *id;
+	unsigned int                      id_len;
+	session_entry_t                  *entry  = NULL;
+	session_entry_t                  *prev   = NULL;
+	cherokee_cryptor_libssl_stripe_t *stripe;
+	cherokee_cryptor_libssl_t        *cryp   = SSL_CTX_get_app_data (SSL_get_SSL_CTX (ssl));
+
+	/* Serialize the session
+	 */
+	entry = (session_entry_t *) malloc (sizeof(session_entry_t));
+	if (unlikely (entry == NULL)) {
+		return 0;
+	}
+
+	cherokee_buffer_init (&entry->key);
+	entry->expiration = cherokee_bogonow_now + SSL_SESSION_get_timeout (session);
+	entry->der_len    = i2d_SSL_SESSION (session, NULL);
+	entry->der        = NULL;
+
+	if (entry->der_len > 0) {
+		entry->der = (unsigned char *) malloc (entry->der_len);
+	}
+
+	if (entry->der == NULL) {
+		session_entry_free (entry);
+		return 0;
+	}
+
+	p = entry->der;
+	i2d_SSL_SESSION (session, &p);
+
+	/* Store it
+	 */
+	id     = SSL_SESSION_get_id (session, &id_len);
+	stripe = session_cache_stripe (cryp, id, id_len, &entry->key);
+
+	CHEROKEE_MUTEX_LOCK (&stripe->mutex);
+
+	ret = cherokee_avl_get (&stripe->table, &entry->key, (void **)&prev);
+	if (ret == ret_ok) {
+		session_cache_unlink (stripe, prev);
+	}
+
+	while ((stripe->len > 0) &&
+	       (stripe->len >= (cryp->session_cache_size / SESSION_CACHE_STRIPES) + 1))
+	{
+		session_cache_unlink (stripe, SESSION_ENTRY(stripe->lru.prev));
+	}
+
+	cherokee_avl_add (&stripe->table, &entry->key, entry);
+	cherokee_list_add (&entry->lru, &stripe->lru);
+	stripe->len += 1;
+
+	CHEROKEE_MUTEX_UNLOCK (&stripe->mutex);
+
+	TRACE (ENTRIES, "Stored TLS session %s (%d bytes)\n", entry->key.buf, entry->der_len);
+
+	/* The session object is not referenced
+	 */
+	return 0;
+}
+
+static SSL_SESSION *
+session_get_cb (SSL *ssl, SESSION_ID_CONST unsigned char *id, int id_len, int *copy)
+{
+	ret_t                             ret;
+	const unsigned char              *p;
+	session_entry_t                  *entry   = NULL;
+	SSL_SESSION                      *session = NULL;
+	cherokee_buffer_t                 key     = CHEROKEE_BUF_INIT;
+	cherokee_cryptor_libssl_stripe_t *stripe;
+	cherokee_cryptor_libssl_t        *cryp    = SSL_CTX_get_app_data (SSL_get_SSL_CTX (ssl));
+
+	*copy  = 0;
+	stripe = session_cache_stripe (cryp, id, id_len, &key);
+
+	CHEROKEE_MUTEX_LOCK (&stripe->mutex);
+
+	ret = cherokee_avl_get (&stripe->table, &key, (void **)&entry);
+	if (ret == ret_ok) {
+		if (entry->expiration < cherokee_bogonow_now) {
+			session_cache_unlink (stripe, entry);
+
+		} else {
+			p = entry->der;
+			session = d2i_SSL_SESSION (NULL, &p, entry->der_len);
+
+			cherokee_list_del (&entry->lru);
+			cherokee_list_add (&entry->lru, &stripe->lru);
+		}
+	}
+
+	CHEROKEE_MUTEX_UNLOCK (&stripe->mutex);
+
+	if (session != NULL) {
+		CHEROKEE_ATOMIC_ADD (&CRYPTOR(cryp)->stats.cache_hits, 1);
+	} else {
+		CHEROKEE_ATOMIC_ADD (&CRYPTOR(cryp)->stats.cache_misses, 1);
+	}
+
+	TRACE (ENTRIES, "TLS session %s: %s\n", key.buf, session ? "hit" : "miss");
+
+	cherokee_buffer_mrproper (&key);
+	return session;
+}
+
+static void
+session_remove_cb (SSL_CTX *ctx, SSL_SESSION *session)
+{
+	ret_t                             ret;
+	const unsigned char              *id;
+	unsigned int                      id_len;
+	session_entry_t                  *entry = NULL;
+	cherokee_buffer_t                 key   = CHEROKEE_BUF_INIT;
+	cherokee_cryptor_libssl_stripe_t *stripe;
+	cherokee_cryptor_libssl_t        *cryp  = SSL_CTX_get_app_data (ctx);
+
+	id     = SSL_SESSION_get_id (session, &id_len);
+	stripe = session_cache_stripe (cryp, id, id_len, &key);
+
+	CHEROKEE_MUTEX_LOCK (&stripe->mutex);
+
+	ret = cherokee_avl_get (&stripe->table, &key, (void **)&entry);
+	if (ret == ret_ok) {
+		session_cache_unlink (stripe, entry);
+	}
+
+	CHEROKEE_MUTEX_UNLOCK (&stripe->mutex);
+
+	cherokee_buffer_mrproper (&key);
+}
+
+
+/* Session tickets
+ *
+ * The ticket keys are derived from a secret and the current time
+ * period, so they rotate by themselves, and every worker process
+ * sharing the secret file agrees on them.
+ */
+
+typedef struct {
+	unsigned char name[16];
+	unsigned char aes[16];
+	unsigned char hmac[32];
+} ticket_key_t;
+
+/* OpenSSL 3 deprecated HMAC_CTX in favour of EVP_MAC
+ */
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+typedef EVP_MAC_CTX ticket_hmac_ctx_t;
+#else
+typedef HMAC_CTX    ticket_hmac_ctx_t;
+#endif
+
+static ret_t
+ticket_secret_load (cherokee_cryptor_libssl_t *cryp)
+{
+	int      fd;
+	ssize_t  re;
+	char    *path = cryp->ticket_key_file.buf;
+
+	/* No file: the keys only last for this process
+	 */
+	if (cherokee_buffer_is_empty (&cryp->ticket_key_file)) {
+		if (RAND_bytes (cryp->ticket_secret, TICKET_SECRET_LEN) != 1) {
+			return ret_error;
+		}
+		return ret_ok;
+	}
+
+	/* Read the secret
+	 */
+	fd = cherokee_open (path, O_RDONLY | O_NOFOLLOW, 0);
+	if (fd >= 0) {
+		re = read (fd, cryp->ticket_secret, TICKET_SECRET_LEN);
+		cherokee_fd_close (fd);
+
+		if (re != TICKET_SECRET_LEN) {
+			LOG_CRITICAL (CHEROKEE_ERROR_SSL_TICKET_KEY_LEN, path, TICKET_SECRET_LEN);
+			return ret_error;
+		}
+
+		TRACE (ENTRIES, "Read the session ticket secret from %s\n", path);
+		return ret_ok;
+	}
+
+	if (errno != ENOENT) {
+		LOG_ERRNO (errno, cherokee_err_critical, CHEROKEE_ERROR_SSL_TICKET_KEY_READ, path);
+		return ret_error;
+	}
+
+	/* Create a new one
+	 */
+	if (RAND_bytes (cryp->ticket_secret, TICKET_SECRET_LEN) != 1) {
+		return ret_error;
+	}
+
+	fd = cherokee_open (path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+	if (fd < 0) {
+		LOG_ERRNO (errno, cherokee_err_critical, CHEROKEE_ERROR_SSL_TICKET_KEY_CREATE, path);
+		return ret_error;
+	}
+
+	re = write (fd, cryp->ticket_secret, TICKET_SECRET_LEN);
+	cherokee_fd_close (fd);
+
+	if (re != TICKET_SECRET_LEN) {
+		LOG_ERRNO (errno, cherokee_err_critical, CHEROKEE_ERROR_SSL_TICKET_KEY_CREATE, path);
+		unlink (path);
+		return ret_error;
+	}
+
+	TRACE (ENTRIES, "Created a new session ticket secret in %s\n", path);
+	return ret_ok;
+}
+
+static void
+ticket_key_derive (cherokee_cryptor_libssl_t *cryp,
+		   time_t                     period,
+		   ticket_key_t              *key)
+{
+	int           len;
+	unsigned int  md_len;
+	char          label[32];
+	unsigned char md[EVP_MAX_MD_SIZE];
+
+	len = snprintf (label, sizeof(label), "cherokee ticket %lu", (unsigned long) period);
+
+	HMAC (EVP_sha512(), cryp->ticket_secret, TICKET_SECRET_LEN,
+	      (unsigned char *) label, len, md, &md_len);
+
+	memcpy (key->name, md,      sizeof(key->name));
+	memcpy (key->aes,  md + 16, sizeof(key->aes));
+	memcpy (key->hmac, md + 32, sizeof(key->hmac));
+
+	OPENSSL_cleanse (md, sizeof(md));
+}
+
+static int
+ticket_hmac_init (ticket_hmac_ctx_t *hmac_ctx,
+		  ticket_key_t      *key)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	OSSL_PARAM params[3];
+
+	params[0] = OSSL_PARAM_construct_octet_string (OSSL_MAC_PARAM_KEY, key->hmac, sizeof(key->hmac));
+	params[1] = OSSL_PARAM_construct_utf8_string (OSSL_MAC_PARAM_DIGEST, (char *) "SHA256", 0);
+	params[2] = OSSL_PARAM_construct_end();
+
+	return EVP_MAC_CTX_set_params (hmac_ctx, params);
+#else
+	return HMAC_Init_ex (hmac_ctx, key->hmac, sizeof(key->hmac), EVP_sha256(), NULL);
+#endif
+}
+
+static int
+ticket_key_cb (SSL               *ssl,
+	       unsigned char     *key_name,
+	       unsigned char     *iv,
+	       EVP_CIPHER_CTX    *cipher_ctx,
+	       ticket_hmac_ctx_t *hmac_ctx,
+	       int                encrypt)
+{
+	int                        i;
+	ticket_key_t               key;
+	time_t                     period;
+	cherokee_cryptor_libssl_t *cryp = SSL_CTX_get_app_data (SSL_get_SSL_CTX (ssl));
+
+	period = cherokee_bogonow_now / cryp->ticket_rotation;
+
+	/* New ticket: current key
+	 */
+	if (encrypt) {
+		if (RAND_bytes (iv, EVP_CIPHER_iv_length (EVP_aes_128_cbc())) != 1) {
+			return -1;
+		}
+
+		ticket_key_derive (cryp, period, &key);
+		memcpy (key_name, key.name, sizeof(key.name));
+
+		if ((EVP_EncryptInit_ex (cipher_ctx, EVP_aes_128_cbc(), NULL, key.aes, iv) != 1) ||
+		    (ticket_hmac_init (hmac_ctx, &key) != 1))
+		{
+			OPENSSL_cleanse (&key, sizeof(key));
+			return -1;
+		}
+
+		OPENSSL_cleanse (&key, sizeof(key));
+		return 1;
+	}
+
+	/* Presented ticket: the current key or a former one
+	 */
+	for (i = 0; i < TICKET_KEYS_VALID; i++) {
+		ticket_key_derive (cryp, period - i, &key);
+
+		if (memcmp (key_name, key.name, sizeof(key.name)) == 0) {
+			if ((ticket_hmac_init (hmac_ctx, &key) != 1) ||
+			    (EVP_DecryptInit_ex (cipher_ctx, EVP_aes_128_cbc(), NULL, key.aes, iv) != 1))
+			{
+				OPENSSL_cleanse (&key, sizeof(key));
+				return -1;
+			}
+
+			OPENSSL_cleanse (&key, sizeof(key));
+			CHEROKEE_ATOMIC_ADD (&CRYPTOR(cryp)->stats.ticket_hits, 1);
+
+			/* Tickets of a former key are renewed
+			 */
+			return (i == 0) ? 1 : 2;
+		}
+	}
+
+	OPENSSL_cleanse (&key, sizeof(key));
+	TRACE (ENTRIES, "Unknown session ticket key%s\n", "");
+	return 0;
+}
+
+
+/* SNI
+ *
+ * The server names of the handshakes are remembered along with the
+ * virtual server they were matched to, or SNI_NO_TLS if it did not
+ * support TLS. Names that matched no virtual server are kept in a
+ * smaller table of their own, so a client sending random names
+ * cannot evict the known ones. Each table is emptied when it gets
+ * full.
+ */
+
+static void
+sni_init (cherokee_cryptor_libssl_sni_t *sni,
+	  cuint_t                        max)
+{
+	cherokee_avl_init (&sni->names);
+	sni->len = 0;
+	sni->max = max;
+	CHEROKEE_RWLOCK_INIT (&sni->lock, NULL);
+}
+
+static void
+sni_mrproper (cherokee_cryptor_libssl_sni_t *sni)
+{
+	cherokee_avl_mrproper (AVL_GENERIC(&sni->names), NULL);
+	CHEROKEE_RWLOCK_DESTROY (&sni->lock);
+}
+
+static ret_t
+sni_names_get (cherokee_cryptor_libssl_sni_t *sni,
+	       cherokee_buffer_t             *servername,
+	       void                         **vsrv)
+{
+	ret_t ret;
+
+	CHEROKEE_RWLOCK_READER (&sni->lock);
+	ret = cherokee_avl_get (&sni->names, servername, vsrv);
+	CHEROKEE_RWLOCK_UNLOCK (&sni->lock);
+
+	return ret;
+}
+
+static void
+sni_names_add (cherokee_cryptor_libssl_sni_t *sni,
+	       cherokee_buffer_t             *servername,
+	       void                          *vsrv)
+{
+	ret_t  ret;
+	void  *tmp;
+
+	CHEROKEE_RWLOCK_WRITER (&sni->lock);
+
+	ret = cherokee_avl_get (&sni->names, servername, &tmp);
+	if (ret == ret_ok) {
+		goto out;
+	}
+
+	if (sni->len >= sni->max) {
+		TRACE (ENTRIES, "SNI table full (%d names), emptying it\n", sni->len);
+
+		cherokee_avl_mrproper (AVL_GENERIC(&sni->names), NULL);
+		cherokee_avl_init (&sni->names);
+		sni->len = 0;
+	}
+
+	ret = cherokee_avl_add (&sni->names, servername, vsrv);
+	if (ret == ret_ok) {
+		sni->len += 1;
+	}
+
+out:
+	CHEROKEE_RWLOCK_UNLOCK (&sni->lock);
+}
+
 static ret_t
 _free (cherokee_cryptor_libssl_t *cryp)
 {
@@ -93,6 +613,19 @@ _free (cherokee_cryptor_libssl_t *cryp)
 		dh_param_4096 = NULL;
 	}
 
+	/* Session cache
+	 */
+	session_cache_mrproper (cryp);
+
+	OPENSSL_cleanse (cryp->ticket_secret, TICKET_SECRET_LEN);
+	cherokee_buffer_mrproper (&cryp->ticket_key_file);
+
+	/* SNI
+	 */
+	sni_mrproper (&cryp->sni_names);
+	sni_mrproper (&cryp->sni_unknown);
+	CHEROKEE_MUTEX_DESTROY (&cryp->vservers_mutex);
+
 	/* Free loaded error strings
 	 */
 	ERR_free_strings();
@@ -157,13 +690,13 @@ out:
 }
 
 static ret_t
-_configure (cherokee_cryptor_t     *cryp,
-	    cherokee_config_node_t *conf,
-	    cherokee_server_t      *srv)
+_configure (cherokee_cryptor_libssl_t *cryp,
+	    cherokee_config_node_t    *conf,
+	    cherokee_server_t         *srv)
 {
-	ret_t ret;
+	ret_t              ret;
+	cherokee_buffer_t *buf;
 
-	UNUSED(cryp);
 	UNUSED(srv);
 
 	ret = try_read_dh_param (conf, &dh_param_512, 512);
@@ -182,6 +715,41 @@ _configure (cherokee_cryptor_t     *cryp,
 	if (ret != ret_ok)
 		return ret;
 
+	/* Session cache
+	 */
+	cherokee_config_node_read_int (conf, "session_cache_size", &cryp->session_cache_size);
+	cherokee_config_node_read_int (conf, "session_timeout",    &cryp->session_timeout);
+
+	if (cryp->session_timeout <= 0) {
+		cryp->session_timeout = SESSION_TIMEOUT_DEFAULT;
+	}
+
+	if (cryp->session_cache_size > 0) {
+		ret = session_cache_init (cryp);
+		if (ret != ret_ok)
+			return ret;
+	}
+
+	/* Session tickets
+	 */
+	cherokee_config_node_read_bool (conf, "tickets",             &cryp->tickets);
+	cherokee_config_node_read_int  (conf, "ticket_key_rotation", &cryp->ticket_rotation);
+
+	if (cryp->ticket_rotation <= 0) {
+		cryp->ticket_rotation = TICKET_ROTATION_DEFAULT;
+	}
+
+	ret = cherokee_config_node_read (conf, "ticket_key_file", &buf);
+	if (ret == ret_ok) {
+		cherokee_buffer_add_buffer (&cryp->ticket_key_file, buf);
+	}
+
+	if (cryp->tickets) {
+		ret = ticket_secret_load (cryp);
+		if (ret != ret_ok)
+			return ret;
+	}
+
 	return ret_ok;
 }
 
@@ -197,37 +765,113 @@ _vserver_free (cherokee_cryptor_vserver_libssl_t *cryp_vsrv)
 	return ret_ok;
 }
 
+static ret_t
+sni_load_vserver (cherokee_cryptor_libssl_t *cryp,
+		  cherokee_virtual_server_t *vsrv)
+{
+	ret_t ret = ret_ok;
+
+	/* With server!tls!lazy_certs the certificates are
+	 * loaded the first time the virtual server is requested
+	 */
+	CHEROKEE_MUTEX_LOCK (&cryp->vservers_mutex);
+
+	if (vsrv->cryptor == NULL) {
+		/* It failed recently: do not read and parse the
+		 * files again on every handshake
+		 */
+		if (vsrv->tls_load_failed + SNI_LOAD_RETRY > cherokee_bogonow_now) {
+			CHEROKEE_MUTEX_UNLOCK (&cryp->vservers_mutex);
+			return ret_error;
+		}
+
+		ret = cherokee_virtual_server_init_tls (vsrv);
+		if (ret == ret_ok) {
+			TRACE (ENTRIES, "Loaded the certificate of virtual server '%s'\n", vsrv->name.buf);
+		} else if (ret != ret_not_found) {
+			LOG_ERROR (CHEROKEE_ERROR_SSL_VSERVER_LOAD, vsrv->name.buf);
+			vsrv->tls_load_failed = cherokee_bogonow_now;
+		}
+	}
+
+	if ((ret == ret_ok) &&
+	    (CRYPTOR_VSRV_SSL(vsrv->cryptor)->context == NULL))
+	{
+		ret = ret_not_found;
+	}
+
+	CHEROKEE_MUTEX_UNLOCK (&cryp->vservers_mutex);
+	return ret;
+}
+
 ret_t
 cherokee_cryptor_libssl_find_vserver (SSL *ssl,
 				      cherokee_server_t     *srv,
 				      cherokee_buffer_t     *servername,
 				      cherokee_connection_t *conn)
 {
-	ret_t                      ret;
-	cherokee_virtual_server_t *vsrv = NULL;
-	SSL_CTX                   *ctx;
+	ret_t                          ret;
+	void                          *val       = NULL;
+	cherokee_boolean_t             cacheable = false;
+	cherokee_virtual_server_t     *vsrv      = NULL;
+	cherokee_cryptor_libssl_t     *cryp      = CRYPTOR_SSL(srv->cryptor);
+	cherokee_cryptor_libssl_sni_t *sni       = &cryp->sni_names;
+	SSL_CTX                       *ctx;
+
+	/* Server names seen before
+	 */
+	ret = sni_names_get (&cryp->sni_names, servername, &val);
+	if (ret != ret_ok) {
+		ret = sni_names_get (&cryp->sni_unknown, servername, &val);
+	}
+
+	if (ret == ret_ok) {
+		TRACE (ENTRIES, "SNI: '%s' found in the table\n", servername->buf);
+		goto found;
+	}
 
 	/* Try to match the connection to a server
 	 */
+	ret = cherokee_vserver_index_get (&srv->vservers_index, NULL, servername,
+					  conn, &val, &cacheable);
+	if (ret != ret_ok) {
+		if (unlikely (cherokee_list_empty (&srv->vservers))) {
+			LOG_ERROR (CHEROKEE_ERROR_SSL_SRV_MATCH, servername->buf);
+			return ret_error;
+		}
 
-	ret = cherokee_server_get_vserver(srv, servername, conn, &vsrv);
-	if ((ret != ret_ok) || (vsrv == NULL)) {
-		LOG_ERROR (CHEROKEE_ERROR_SSL_SRV_MATCH, servername->buf);
-		return ret_error;
+		val = VSERVER(srv->vservers.prev);
+		sni = &cryp->sni_unknown;
 	}
 
-	TRACE (ENTRIES, "Setting new TLS context. Virtual host='%s'\n",
-	       vsrv->name.buf);
+	/* Only virtual servers without TLS are remembered as such.
+	 * A certificate that failed to load is retried later on.
+	 */
+	ret = sni_load_vserver (cryp, VSERVER(val));
+	if (ret == ret_not_found) {
+		val = SNI_NO_TLS;
+	} else if (ret != ret_ok) {
+		val       = SNI_NO_TLS;
+		cacheable = false;
+	}
 
+	if (cacheable) {
+		sni_names_add (sni, servername, val);
+	}
+
+found:
 	/* Check whether the Virtual Server supports TLS
 	 */
-	if ((vsrv->cryptor == NULL) ||
-	    (CRYPTOR_VSRV_SSL(vsrv->cryptor)->context == NULL))
-	{
+	if (val == SNI_NO_TLS) {
 		TRACE (ENTRIES, "Virtual server '%s' does not support SSL\n", servername->buf);
 		return ret_error;
 	}
 
+	vsrv = VSERVER(val);
+
+	TRACE (ENTRIES, "Setting new TLS context. Virtual host='%s'\n",
+	       vsrv->name.buf);
+
 	/* Set the new SSL context
 	 */
 	ctx = SSL_set_SSL_CTX (ssl, CRYPTOR_VSRV_SSL(vsrv->cryptor)->context);
@@ -388,8 +1032,18 @@ _vserver_new (cherokee_cryptor_t          *cryp,
 		options |= SSL_OP_NO_SSLv2;
 	}
 
+#ifdef SSL_OP_NO_TICKET
+	if (! CRYPTOR_SSL(cryp)->tickets) {
+		options |= SSL_OP_NO_TICKET;
+	}
+#endif
+
 	SSL_CTX_set_options (n->context, options);
 
+	/* The callbacks reach the cryptor through the context
+	 */
+	SSL_CTX_set_app_data (n->context, cryp);
+
 	/* Set cipher list that vserver will accept.
 	 */
 	if (! cherokee_buffer_is_empty (&vsrv->ciphers)) {
@@ -490,8 +1144,28 @@ _vserver_new (cherokee_cryptor_t          *cryp,
 		LOG_ERROR (CHEROKEE_ERROR_SSL_SESSION_ID, vsrv->name.buf, error);
 	}
 
-	SSL_CTX_set_session_cache_mode (n->context, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_set_timeout (n->context, CRYPTOR_SSL(cryp)->session_timeout);
 
+	if (CRYPTOR_SSL(cryp)->session_cache != NULL) {
+		SSL_CTX_set_session_cache_mode (n->context, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+		SSL_CTX_sess_set_new_cb    (n->context, session_new_cb);
+		SSL_CTX_sess_set_get_cb    (n->context, session_get_cb);
+		SSL_CTX_sess_set_remove_cb (n->context, session_remove_cb);
+	} else {
+		SSL_CTX_set_session_cache_mode (n->context, SSL_SESS_CACHE_SERVER);
+	}
+
+	/* Session ticket keys shared by all the virtual servers
+	 */
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	if (CRYPTOR_SSL(cryp)->tickets) {
+		SSL_CTX_set_tlsext_ticket_key_evp_cb (n->context, ticket_key_cb);
+	}
+#elif defined(SSL_CTX_set_tlsext_ticket_key_cb)
+	if (CRYPTOR_SSL(cryp)->tickets) {
+		SSL_CTX_set_tlsext_ticket_key_cb (n->context, ticket_key_cb);
+	}
+#endif
 
 #ifndef OPENSSL_NO_TLSEXT
 	/* Enable SNI
@@ -657,6 +1331,14 @@ _socket_init_tls (cherokee_cryptor_socket_libssl_t *cryp,
 		}
 	}
 
+	/* Session resumption statistics
+	 */
+	if (SSL_session_reused (cryp->session)) {
+		CHEROKEE_ATOMIC_ADD (&VSERVER_SRV(vsrv)->cryptor->stats.resumed, 1);
+	} else {
+		CHEROKEE_ATOMIC_ADD (&VSERVER_SRV(vsrv)->cryptor->stats.full_handshakes, 1);
+	}
+
 	/* Report the connection details
 	 */
 #ifdef TRACE_ENABLED
@@ -1155,6 +1837,18 @@ cherokee_cryptor_libssl_new (cherokee_cryptor_libssl_t **cryp)
 	if (ret != ret_ok)
 		return ret;
 
+	n->session_cache_size = SESSION_CACHE_SIZE_DEFAULT;
+	n->session_timeout    = SESSION_TIMEOUT_DEFAULT;
+	n->session_cache      = NULL;
+	n->tickets            = true;
+	n->ticket_rotation    = TICKET_ROTATION_DEFAULT;
+
+	cherokee_buffer_init (&n->ticket_key_file);
+
+	sni_init (&n->sni_names,   SNI_NAMES_MAX);
+	sni_init (&n->sni_unknown, SNI_UNKNOWN_MAX);
+	CHEROKEE_MUTEX_INIT (&n->vservers_mutex, CHEROKEE_MUTEX_FAST);
+
 	MODULE(n)->free         = (module_func_free_t) _free;
 	CRYPTOR(n)->configure   = (cryptor_func_configure_t) _configure;
 	CRYPTOR(n)->vserver_new = (cryptor_func_vserver_new_t) _vserver_new;
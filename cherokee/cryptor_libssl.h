@@ -44,6 +44,7 @@
 
 #include "common.h"
 #include "avl_r.h"
+#include "list.h"
 #include "module.h"
 #include "cryptor.h"
 #include "plugin_loader.h"
@@ -64,11 +65,43 @@
 # endif
 #endif
 
+#define SESSION_CACHE_STRIPES  16
+#define TICKET_SECRET_LEN      48
+
 /* Data types
  */
 typedef struct {
-	cherokee_cryptor_t          base;
-	int                         foo;
+	cherokee_avl_t              table;
+	cherokee_list_t             lru;
+	cuint_t                     len;
+	CHEROKEE_MUTEX_T           (mutex);
+} cherokee_cryptor_libssl_stripe_t;
+
+typedef struct {
+	cherokee_avl_t              names;
+	cuint_t                     len;
+	cuint_t                     max;
+	CHEROKEE_RWLOCK_T          (lock);
+} cherokee_cryptor_libssl_sni_t;
+
+typedef struct {
+	cherokee_cryptor_t                base;
+
+	/* Session cache: shared by all the virtual servers */
+	cint_t                            session_cache_size;
+	cint_t                            session_timeout;
+	cherokee_cryptor_libssl_stripe_t *session_cache;
+
+	/* Session tickets */
+	cherokee_boolean_t                tickets;
+	cint_t                            ticket_rotation;
+	cherokee_buffer_t                 ticket_key_file;
+	unsigned char                     ticket_secret[TICKET_SECRET_LEN];
+
+	/* SNI: server names to virtual servers */
+	cherokee_cryptor_libssl_sni_t     sni_names;
+	cherokee_cryptor_libssl_sni_t     sni_unknown;
+	CHEROKEE_MUTEX_T                 (vservers_mutex);
 } cherokee_cryptor_libssl_t;
 
 typedef struct {
@@ -99,6 +99,10 @@ e('RESOLVE_TIMEOUT',
   title = "Timed out while resolving '%s'",
   desc  = "For some reason, Cherokee could not resolve the hostname.")
 
+e('RESOLVE_CONFIG',
+  title = "Invalid resolver setting '%s': '%s'",
+  desc  = "The 'ttl' and 'threads' resolver properties must be positive integers, and 'negative_ttl' must not be negative.")
+
 
 # cherokee/validator_authlist.c
 #
@@ -221,6 +225,14 @@ e('HANDLER_SRV_INFO_TYPE',
 e('HANDLER_FILE_TIME_PARSE',
   title = "Unparseable time '%s'")
 
+e('HANDLER_FILE_GZIP_CACHE_DIR',
+  title = "Could not use '%s' as the directory of the compressed files cache",
+  desc  = SYSTEM_ISSUE)
+
+e('HANDLER_FILE_GZIP_CACHE_WRITE',
+  title = "Could not write the compressed copy '%s': ${errno}",
+  desc  = SYSTEM_ISSUE)
+
 
 # cherokee/handler_ssi.c
 #
@@ -409,6 +421,14 @@ e('LOGGER_WRITER_FORK',
   title = "Could not fork (errno=%d): ${errno}",
   desc  = SYSTEM_ISSUE)
 
+e('LOGGER_WRITER_OVERFLOW',
+  title = "Unknown logger writer overflow policy '%s'",
+  desc  = "The overflow policy of a log writer must be either 'drop' or 'block'.")
+
+e('LOGGER_WRITER_DROPPED',
+  title = "%llu log lines were dropped: the log rings were full",
+  desc  = "The server produced log lines faster than they could be written. Consider raising the ring size of the log writer, or choosing the 'block' overflow policy.")
+
 e('LOGGER_X_REAL_IP_PARSE',
   title = "Could not parse X-Real-IP access list",
   desc  = "You must define an access list in order to activate the X-Real-IP support.")
@@ -563,6 +583,18 @@ e('RULE_BIND_PORT',
   desc  = BROKEN_CONFIG)
 
 
+# cherokee/iocache.c
+#
+e('IOCACHE_INOTIFY_INIT',
+  title = "Could not initialize inotify: ${errno}",
+  desc  = "The I/O cache will expire its entries after the 'lasting' periods instead. You might have hit the inotify instances limit of your system.")
+
+e('IOCACHE_NO_INOTIFY',
+  title = "The I/O cache cannot use inotify on this platform",
+  desc  = "The I/O cache will expire its entries after the 'lasting' periods instead.",
+  admin = "/advanced#I/O cache-3")
+
+
 # cherokee/server.c
 #
 e('SERVER_GROUP_NOT_FOUND',
@@ -616,10 +648,20 @@ e('SERVER_IGNORE_TLS',
   admin   = "/general#Network-1",
   show_bt = False)
 
+e('SERVER_REUSEPORT',
+  title   = "Could not create per-thread listeners for port %d",
+  desc    = "The SO_REUSEPORT accept mode is either not supported by the system or could not be set up for this port. The server is falling back to the shared listeners accept mode.",
+  admin   = "/advanced#Resources-2",
+  show_bt = False)
+
 e('SERVER_TLS_DEFAULT',
   title = "TLS/SSL support required for 'default' Virtual Server.",
   desc  = "TLS/SSL support must be set up in the 'default' Virtual Server. Its certificate will be used by the server in case TLS SNI information is not provided by the client.")
 
+e('SERVER_TLS_LAZY_PRIVS',
+  title = "Ignoring server!tls!lazy_certs: the server changes its user, group or root directory",
+  desc  = "Certificates cannot be loaded on demand once the server has dropped its privileges, since their key files are usually readable by the original user only. All of them are being loaded at start-up instead. Either disable lazy_certs, or do not change the execution user, group or root directory.")
+
 e('SERVER_NO_CRYPTOR',
   title = "Virtual Server '%s' is trying to use SSL/TLS, but no Crypto engine is active.",
   desc  = "For a Virtual Server to use SSL/TLS, a Crypto engine must be available server-wide.")
@@ -777,6 +819,25 @@ e('TEMPLATE_NO_TOKEN',
   desc  = "It seems that the template uses an undefined token.")
 
 
+# cherokee/fork_server.c
+#
+e('FORK_SERVER_SOCKET',
+  title = "Could not create the fork-server socket: ${errno}",
+  desc  = "The CGIs will be forked by the worker process itself. The issue seems to be related to your system.")
+
+e('FORK_SERVER_FORK',
+  title = "Could not start the fork-server: ${errno}",
+  desc  = "The CGIs will be forked by the worker process itself. The issue seems to be related to your system.")
+
+e('FORK_SERVER_LOST',
+  title = "Lost the connection with the fork-server",
+  desc  = "The process that spawns the CGIs is gone. From now on, the CGIs will be forked by the worker process itself.")
+
+e('FORK_SERVER_SPAWN',
+  title = "The fork-server could not spawn '%s': ${errno}",
+  desc  = SYSTEM_ISSUE)
+
+
 # cherokee/spawner.c
 #
 e('SPAWNER_TMP_INIT',
@@ -1246,6 +1307,10 @@ e('SSL_SRV_MATCH',
   title = "Servername did not match: '%s'",
   desc  = "A TLS negotiation using SNI is sending a domain name that does not match any of the available ones. This makes it impossible to present a certificate with a correct CA. Check the list of TLS enabled Virtual Servers if you expect otherwise.")
 
+e('SSL_VSERVER_LOAD',
+  title = "Could not load the TLS certificate of the '%s' virtual server",
+  desc  = "The certificate of this virtual server was going to be loaded for the first time, because server!tls!lazy_certs is enabled, but it failed. The clients requesting it will not be able to establish a TLS connection.")
+
 e('SSL_CHANGE_CTX',
   title = "Could not change the SSL context: servername='%s'",
   desc  = SYSTEM_ISSUE)
@@ -1342,6 +1407,18 @@ e('SSL_DEFAULTS',
   title = "Could not set all defaults",
   desc  = SYSTEM_ISSUE)
 
+e('SSL_TICKET_KEY_READ',
+  title = "Could not read the TLS session ticket key file '%s': ${errno}",
+  desc  = "The file holding the secret from which the session ticket keys are derived could not be opened.")
+
+e('SSL_TICKET_KEY_CREATE',
+  title = "Could not create the TLS session ticket key file '%s': ${errno}",
+  desc  = "The server tried to create a new secret for the session ticket keys, but the file could not be written. Check that its directory exists and is writable by the user the server is launched as.")
+
+e('SSL_TICKET_KEY_LEN',
+  title = "The TLS session ticket key file '%s' must contain %d bytes",
+  desc  = "The file is either truncated or it is not a session ticket key file. Remove it so the server creates a new one.")
+
 # Front-line cache
 #
 e('FLCACHE_MKDIR',
@@ -99,8 +99,8 @@ report_error (cherokee_buffer_t *buf)
 
 		cherokee_logger_writer_get_buf (writer, &writer_log);
 		cherokee_buffer_add_buffer (writer_log, buf);
-		cherokee_logger_writer_flush (writer, true);
 		cherokee_logger_writer_release_buf (writer);
+		cherokee_logger_writer_flush (writer, false);
 
 		return ret_ok;
 	}
@@ -48,15 +48,27 @@
 /*                                                                     */
 /***********************************************************************/
 
+/* Each event carries a pointer to the slot of its file descriptor,
+ * so the fd, its last event index and the user data (usually the
+ * connection) are reached without any lookup.
+ */
+typedef struct {
+	void                  *data;
+	int                    idx;
+} cherokee_fdpoll_epoll_slot_t;
+
 typedef struct {
 	struct cherokee_fdpoll poll;
 
-	int                    ep_fd;
-	struct epoll_event    *ep_events;
-	int                    ep_nrevents;
-	int                   *epoll_fd2idx;
+	int                           ep_fd;
+	struct epoll_event           *ep_events;
+	int                           ep_nrevents;
+	cherokee_fdpoll_epoll_slot_t *ep_slots;
 } cherokee_fdpoll_epoll_t;
 
+#define SLOT_FD(fdp,slot) \
+	((int)((cherokee_fdpoll_epoll_slot_t *)(slot) - (fdp)->ep_slots))
+
 
 static ret_t
 _free (cherokee_fdpoll_epoll_t *fdp)
@@ -70,7 +82,7 @@ _free (cherokee_fdpoll_epoll_t *fdp)
 	/* ANSI C required, so that free() can handle NULL pointers
 	 */
 	free (fdp->ep_events);
-	free (fdp->epoll_fd2idx);
+	free (fdp->ep_slots);
 
 	/* Caller has to set this pointer to NULL.
 	 */
@@ -94,7 +106,7 @@ _add (cherokee_fdpoll_epoll_t *fdp, int fd, int rw)
 	/* Add the new descriptor
 	 */
 	ev.data.u64 = 0;
-	ev.data.fd = fd;
+	ev.data.ptr = &fdp->ep_slots[fd];
 	switch (rw) {
 	case FDPOLL_MODE_READ:
 		ev.events = EPOLLIN | EPOLLERR | EPOLLHUP;
@@ -114,6 +126,8 @@ _add (cherokee_fdpoll_epoll_t *fdp, int fd, int rw)
 		return ret_error;
 	}
 
+	fdp->ep_slots[fd].data = NULL;
+
 	FDPOLL(fdp)->npollfds++;
 	return ret_ok;
 }
@@ -125,8 +139,8 @@ _del (cherokee_fdpoll_epoll_t *fdp, int fd)
 	struct epoll_event ev;
 
 	ev.events   = 0;
-	ev.data.u64 = 0;  /* <- I just wanna be sure there aren't */
-	ev.data.fd  = fd; /* <- 4 bytes uninitialized */
+	ev.data.u64 = 0;
+	ev.data.ptr = &fdp->ep_slots[fd];
 
 	/* Check the fd limit
 	 */
@@ -141,6 +155,9 @@ _del (cherokee_fdpoll_epoll_t *fdp, int fd)
 		return ret_error;
 	}
 
+	fdp->ep_slots[fd].data = NULL;
+	fdp->ep_slots[fd].idx  = -1;
+
 	FDPOLL(fdp)->npollfds--;
 	return ret_ok;
 }
@@ -159,7 +176,7 @@ _check (cherokee_fdpoll_epoll_t *fdp, int fd, int rw)
 
 	/* If fdidx is -1, it is not valid, ignore it.
 	 */
-	fdidx = fdp->epoll_fd2idx[fd];
+	fdidx = fdp->ep_slots[fd].idx;
 	if (fdidx < 0 || fdidx >= fdp->ep_nrevents)
 		return 0;
 
@@ -173,7 +190,7 @@ _check (cherokee_fdpoll_epoll_t *fdp, int fd, int rw)
 
 	/* Sanity check
 	 */
-	if (fdp->ep_events[fdidx].data.fd != fd)
+	if (fdp->ep_events[fdidx].data.ptr != &fdp->ep_slots[fd])
 		return 0;
 	/*	return -1; */
 
@@ -200,7 +217,7 @@ _reset (cherokee_fdpoll_epoll_t *fdp, int fd)
 	if (fd < 0 || fd >= FDPOLL(fdp)->system_nfiles)
 		return ret_error;
 
-	fdp->epoll_fd2idx[fd] = -1;
+	fdp->ep_slots[fd].idx = -1;
 
 	return ret_ok;
 }
@@ -212,7 +229,7 @@ _set_mode (cherokee_fdpoll_epoll_t *fdp, int fd, int rw)
 	struct epoll_event ev;
 
 	ev.data.u64 = 0;
-	ev.data.fd  = fd;
+	ev.data.ptr = &fdp->ep_slots[fd];
 
 	switch (rw) {
 	case FDPOLL_MODE_READ:
@@ -235,6 +252,35 @@ _set_mode (cherokee_fdpoll_epoll_t *fdp, int fd, int rw)
 }
 
 
+static ret_t
+_set_data (cherokee_fdpoll_epoll_t *fdp, int fd, void *data)
+{
+	/* Sanity check: is it a wrong fd?
+	 */
+	if (fd < 0 || fd >= FDPOLL(fdp)->system_nfiles)
+		return ret_error;
+
+	fdp->ep_slots[fd].data = data;
+	return ret_ok;
+}
+
+
+static ret_t
+_get_event (cherokee_fdpoll_epoll_t *fdp, int n, int *fd, void **data)
+{
+	cherokee_fdpoll_epoll_slot_t *slot;
+
+	if ((n < 0) || (n >= fdp->ep_nrevents))
+		return ret_not_found;
+
+	slot  = fdp->ep_events[n].data.ptr;
+	*fd   = SLOT_FD(fdp, slot);
+	*data = slot->data;
+
+	return ret_ok;
+}
+
+
 static int
 _watch (cherokee_fdpoll_epoll_t *fdp, int timeout_msecs)
 {
@@ -245,7 +291,7 @@ _watch (cherokee_fdpoll_epoll_t *fdp, int timeout_msecs)
 		return fdp->ep_nrevents;
 
 	for (i = 0; i < fdp->ep_nrevents; ++i) {
-		fdp->epoll_fd2idx[fdp->ep_events[i].data.fd] = i;
+		((cherokee_fdpoll_epoll_slot_t *) fdp->ep_events[i].data.ptr)->idx = i;
 	}
 
 	return fdp->ep_nrevents;
@@ -287,23 +333,25 @@ fdpoll_epoll_new (cherokee_fdpoll_t **fdp, int sys_fd_limit, int fd_limit)
 	nfd->set_mode      = (fdpoll_func_set_mode_t) _set_mode;
 	nfd->check         = (fdpoll_func_check_t) _check;
 	nfd->watch         = (fdpoll_func_watch_t) _watch;
+	nfd->set_data      = (fdpoll_func_set_data_t) _set_data;
+	nfd->get_event     = (fdpoll_func_get_event_t) _get_event;
 
 	/* Look for max fd limit
 	 */
 	n->ep_fd = -1;
 	n->ep_nrevents  = 0;
 	n->ep_events    = (struct epoll_event *) calloc (nfd->nfiles, sizeof(struct epoll_event));
-	n->epoll_fd2idx = (int *) calloc (nfd->system_nfiles, sizeof(int));
+	n->ep_slots     = (cherokee_fdpoll_epoll_slot_t *) calloc (nfd->system_nfiles, sizeof(cherokee_fdpoll_epoll_slot_t));
 
 	/* If anyone fails free all and return ret_nomem
 	 */
-	if (n->ep_events == NULL || n->epoll_fd2idx == NULL) {
+	if (n->ep_events == NULL || n->ep_slots == NULL) {
 		_free(n);
 		return ret_nomem;
 	}
 
 	for (re = 0; re < nfd->system_nfiles; re++) {
-		n->epoll_fd2idx[re] = -1;
+		n->ep_slots[re].idx = -1;
 	}
 
 	n->ep_fd = epoll_create (nfd->nfiles);
@@ -36,6 +36,8 @@ typedef ret_t (* fdpoll_func_set_mode_t) (void  *fdpoll, int fd, int rw);
 typedef int   (* fdpoll_func_check_t)    (void  *fdpoll, int fd, int rw);
 typedef int   (* fdpoll_func_watch_t)    (void  *fdpoll, int timeout_msecs);
 typedef ret_t (* fdpoll_func_is_full_t)  (void  *fdpoll);
+typedef ret_t (* fdpoll_func_set_data_t) (void  *fdpoll, int fd, void *data);
+typedef ret_t (* fdpoll_func_get_event_t)(void  *fdpoll, int n, int *fd, void **data);
 
 ret_t fdpoll_epoll_get_fdlimits  (cuint_t *sys_fd_limit, cuint_t *fd_limit);
 ret_t fdpoll_kqueue_get_fdlimits (cuint_t *sys_fd_limit, cuint_t *fd_limit);
@@ -70,6 +72,11 @@ struct cherokee_fdpoll {
 	fdpoll_func_set_mode_t   set_mode;
 	fdpoll_func_check_t      check;
 	fdpoll_func_watch_t      watch;
+
+	/* Optional: readiness events with user data
+	 */
+	fdpoll_func_set_data_t   set_data;
+	fdpoll_func_get_event_t  get_event;
 };
 
 #endif /* CHEROKEE_FDPOLL_PROTECTED_H */
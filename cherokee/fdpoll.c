@@ -363,3 +363,28 @@ cherokee_fdpoll_watch (cherokee_fdpoll_t *fdp, int timeout_msecs)
 	return fdp->watch (fdp, timeout_msecs);
 }
 
+
+/* Readiness events: Not every method supports them. The ones that
+ * do not return ret_no_sys, and the caller has to fall back to
+ * cherokee_fdpoll_check() on each one of its file descriptors.
+ */
+
+ret_t
+cherokee_fdpoll_set_data (cherokee_fdpoll_t *fdp, int fd, void *data)
+{
+	if (fdp->set_data == NULL)
+		return ret_no_sys;
+
+	return fdp->set_data (fdp, fd, data);
+}
+
+
+ret_t
+cherokee_fdpoll_get_event (cherokee_fdpoll_t *fdp, int n, int *fd, void **data)
+{
+	if (fdp->get_event == NULL)
+		return ret_no_sys;
+
+	return fdp->get_event (fdp, n, fd, data);
+}
+
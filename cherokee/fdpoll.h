@@ -68,6 +68,8 @@ ret_t cherokee_fdpoll_reset      (cherokee_fdpoll_t *fdp, int fd);
 ret_t cherokee_fdpoll_set_mode   (cherokee_fdpoll_t *fdp, int fd, int rw);
 int   cherokee_fdpoll_check      (cherokee_fdpoll_t *fdp, int fd, int rw);
 int   cherokee_fdpoll_watch      (cherokee_fdpoll_t *fdp, int timeout_msecs);
+ret_t cherokee_fdpoll_set_data   (cherokee_fdpoll_t *fdp, int fd, void *data);
+ret_t cherokee_fdpoll_get_event  (cherokee_fdpoll_t *fdp, int n, int *fd, void **data);
 ret_t cherokee_fdpoll_is_full    (cherokee_fdpoll_t *fdp);
 int   cherokee_fdpoll_is_empty   (cherokee_fdpoll_t *fdp);
 
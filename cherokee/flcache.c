@@ -25,6 +25,7 @@
 #include "common-internal.h"
 #include "flcache.h"
 #include "connection-protected.h"
+#include "thread.h"
 #include "handler_file.h"
 #include "server-protected.h"
 #include "plugin_loader.h"
@@ -50,7 +51,11 @@ cherokee_flcache_new (cherokee_flcache_t **flcache)
 	ret = cherokee_avl_flcache_init (&n->request_map);
 	if (ret != ret_ok) return ret;
 
-	n->last_file_id = 0;
+	n->last_file_id         = 0;
+	n->memory_max_size      = FLCACHE_MEMORY_MAX_SIZE;
+	n->memory_max_file_size = FLCACHE_MEMORY_MAX_FILE_SIZE;
+	n->stale_grace          = 0;
+	n->coalesce_timeout     = FLCACHE_COALESCE_TIMEOUT;
 	cherokee_buffer_init (&n->local_directory);
 
 	*flcache = n;
@@ -105,7 +110,7 @@ cherokee_flcache_free (cherokee_flcache_t *flcache)
 	}
 
 	cherokee_buffer_mrproper (&flcache->local_directory);
-	cherokee_avl_flcache_mrproper (&flcache->request_map, NULL);
+	cherokee_avl_flcache_mrproper (&flcache->request_map);
 
 	free (flcache);
 	return ret_ok;
@@ -137,10 +142,32 @@ cherokee_flcache_configure (cherokee_flcache_t     *flcache,
 			    void                   *vsrv)
 {
 	ret_t                      ret;
+	int                        val;
 	cherokee_virtual_server_t *vserver = vsrv;
 
-	/* Beware: conf might be NULL */
-	UNUSED (conf);
+	/* Memory tier and stale entries. Beware: conf might be NULL
+	 */
+	if (conf != NULL) {
+		ret = cherokee_config_node_read_int (conf, "memory_max_size", &val);
+		if (ret == ret_ok) {
+			flcache->memory_max_size = MAX (val, 0);
+		}
+
+		ret = cherokee_config_node_read_int (conf, "memory_max_file_size", &val);
+		if (ret == ret_ok) {
+			flcache->memory_max_file_size = MAX (val, 0);
+		}
+
+		ret = cherokee_config_node_read_int (conf, "stale_grace", &val);
+		if (ret == ret_ok) {
+			flcache->stale_grace = MAX (val, 0);
+		}
+
+		ret = cherokee_config_node_read_int (conf, "coalesce_timeout", &val);
+		if (ret == ret_ok) {
+			flcache->coalesce_timeout = MAX (val, 0);
+		}
+	}
 
 	ret = mkdir_flcache_directory (flcache, vserver, CHEROKEE_FLCACHE);
 	if (ret != ret_ok) {
@@ -177,9 +204,19 @@ cherokee_flcache_req_get_cached (cherokee_flcache_t    *flcache,
 				 cherokee_connection_t *conn)
 {
 	ret_t                        ret;
-	cherokee_avl_flcache_node_t *entry = NULL;
+	int                          fd;
+	cherokee_boolean_t           revalidate;
+	cherokee_avl_flcache_node_t *entry      = NULL;
 
-	/* Check the cache
+	/* It was parked waiting for the entry to be stored
+	 */
+	if (conn->flcache.wait_ref != NULL) {
+		cherokee_avl_flcache_unref (conn->flcache.wait_ref);
+		conn->flcache.wait_ref = NULL;
+	}
+
+again:
+	/* Check the cache. The entry comes referenced.
 	 */
 	ret = cherokee_avl_flcache_get (&flcache->request_map, conn, &entry);
 	if ((ret != ret_ok) || (entry == NULL)) {
@@ -188,12 +225,53 @@ cherokee_flcache_req_get_cached (cherokee_flcache_t    *flcache,
 		return ret_not_found;
 	}
 
-	/* Is it being stored?
+	/* Is it being stored? Wait for it rather than hitting the
+	 * back-end with the very same request.
 	 */
 	if (entry->status != flcache_status_ready) {
 		TRACE (ENTRIES, "Front Line Cache: almost-hit; '%s' being cached (%d refs)\n",
 		       conn->request.buf, entry->ref_count);
-		return ret_deny;
+
+		if ((entry->status != flcache_status_storing) ||
+		    (flcache->coalesce_timeout <= 0))
+		{
+			cherokee_avl_flcache_unref (entry);
+			return ret_deny;
+		}
+
+		if (conn->flcache.wait_until == 0) {
+			conn->flcache.wait_until = cherokee_bogonow_now + flcache->coalesce_timeout;
+		} else if (conn->flcache.wait_until < cherokee_bogonow_now) {
+			TRACE (ENTRIES, "Front Line Cache: gave up waiting for '%s'\n", conn->request.buf);
+			cherokee_avl_flcache_unref (entry);
+			return ret_deny;
+		}
+
+		/* Park the connection on the entry until the storing
+		 * connection completes or aborts it. The reference is
+		 * kept meanwhile, so its pipe outlives the wait.
+		 */
+		ret = cherokee_avl_flcache_node_wait (entry, &fd);
+		switch (ret) {
+		case ret_eagain:
+			break;
+		case ret_ok:
+			cherokee_avl_flcache_unref (entry);
+			goto again;
+		default:
+			cherokee_avl_flcache_unref (entry);
+			return ret_deny;
+		}
+
+		ret = cherokee_thread_deactive_to_polling (CONN_THREAD(conn), conn, fd,
+							   FDPOLL_MODE_READ, true);
+		if (unlikely (ret != ret_ok)) {
+			cherokee_avl_flcache_unref (entry);
+			return ret_deny;
+		}
+
+		conn->flcache.wait_ref = entry;
+		return ret_eagain;
 	}
 
 	/* Is it fresh enough?
@@ -202,30 +280,50 @@ cherokee_flcache_req_get_cached (cherokee_flcache_t    *flcache,
 		TRACE (ENTRIES, "Front Line Cache: almost-hit; '%s' expired already (%d refs)\n",
 		       conn->request.buf, entry->ref_count);
 
-		if (entry->ref_count == 0) {
+		/* Past the grace period
+		 */
+		if (entry->valid_until + flcache->stale_grace < cherokee_bogonow_now) {
 			cherokee_flcache_del_entry (flcache, entry);
+			cherokee_avl_flcache_unref (entry);
+
+			return ret_deny;
 		}
 
-		return ret_deny;
+		/* Stale: a single request revalidates it, the rest
+		 * are served the stale copy in the meanwhile.
+		 */
+		CHEROKEE_MUTEX_LOCK (&entry->ref_count_mutex);
+		revalidate = (! entry->revalidating);
+		entry->revalidating = true;
+		CHEROKEE_MUTEX_UNLOCK (&entry->ref_count_mutex);
+
+		if (revalidate) {
+			TRACE (ENTRIES, "Front Line Cache: revalidating '%s'\n", conn->request.buf);
+
+			conn->flcache.stale_ref = entry;
+			return ret_deny;
+		}
 	}
 
-	/* Cache hit: Open the cached file
+	/* Cache hit: Open the cached file, unless it is served
+	 * straight from its in-memory copy.
 	 */
-	conn->flcache.fd = cherokee_open (entry->file.buf, O_RDONLY | O_NOFOLLOW, 0);
-	if (unlikely (conn->flcache.fd == -1)) {
-		return ret_error;
+	if (! entry->in_memory) {
+		conn->flcache.fd = cherokee_open (entry->file.buf, O_RDONLY | O_NOFOLLOW, 0);
+		if (unlikely (conn->flcache.fd == -1)) {
+			cherokee_avl_flcache_unref (entry);
+			return ret_error;
+		}
 	}
 
-	TRACE (ENTRIES, "Front Line Cache: hit; '%s' -> '%s' (%d refs)\n",
-	       conn->request.buf, entry->file.buf, entry->ref_count);
+	TRACE (ENTRIES, "Front Line Cache: hit; '%s' -> '%s' (%d refs, %s)\n",
+	       conn->request.buf, entry->file.buf, entry->ref_count,
+	       entry->in_memory ? "memory" : "file");
 
-	/* Store the reference to the object
+	/* Keep the reference to the object
 	 */
-	CHEROKEE_MUTEX_LOCK (&entry->ref_count_mutex);
-	entry->ref_count += 1;
-	CHEROKEE_MUTEX_UNLOCK (&entry->ref_count_mutex);
-
 	conn->flcache.avl_node_ref = entry;
+	conn->flcache.flcache_ref  = flcache;
 	conn->flcache.mode         = flcache_mode_out;
 
 	return ret_ok;
@@ -308,8 +406,14 @@ cherokee_flcache_conn_init (cherokee_flcache_conn_t *flcache_conn)
 	flcache_conn->header_sent   = 0;
 	flcache_conn->response_sent = 0;
 	flcache_conn->avl_node_ref  = NULL;
-	flcache_conn->mode          = flcache_mode_undef;
-	flcache_conn->fd            = -1;
+	flcache_conn->mode           = flcache_mode_undef;
+	flcache_conn->fd             = -1;
+	flcache_conn->offset         = 0;
+	flcache_conn->using_sendfile = false;
+	flcache_conn->flcache_ref    = NULL;
+	flcache_conn->stale_ref      = NULL;
+	flcache_conn->wait_ref       = NULL;
+	flcache_conn->wait_until     = 0;
 
 	cherokee_buffer_init (&flcache_conn->header);
 
@@ -326,19 +430,25 @@ cherokee_flcache_req_set_store (cherokee_flcache_t    *flcache,
 	int                          file;
 	cherokee_avl_flcache_node_t *entry = NULL;
 
-	/* Add it to the tree
+	/* Add it to the table, or replace a stale entry once
+	 * it has been stored.
 	 */
-	ret = cherokee_avl_flcache_add (&flcache->request_map, conn, &entry);
+	if (conn->flcache.stale_ref != NULL) {
+		ret = cherokee_avl_flcache_add_replacement (&flcache->request_map, conn,
+							    conn->flcache.stale_ref, &entry);
+		if (ret == ret_ok) {
+			conn->flcache.stale_ref = NULL;
+		}
+	} else {
+		ret = cherokee_avl_flcache_add (&flcache->request_map, conn, &entry);
+	}
+
 	if ((ret != ret_ok) || (entry == NULL)) {
 		return ret;
 	}
 
-	/* Set mode, ref count
+	/* Set mode. The entry comes referenced.
 	 */
-	CHEROKEE_MUTEX_LOCK (&entry->ref_count_mutex);
-	entry->ref_count += 1;
-	CHEROKEE_MUTEX_UNLOCK (&entry->ref_count_mutex);
-
 	entry->status = flcache_status_storing;
 
 	/* Filename
@@ -358,6 +468,7 @@ cherokee_flcache_req_set_store (cherokee_flcache_t    *flcache,
 	 */
 	conn->flcache.mode         = flcache_mode_in;
 	conn->flcache.avl_node_ref = entry;
+	conn->flcache.flcache_ref  = flcache;
 
 	return ret_ok;
 }
@@ -497,14 +608,14 @@ inspect_header (cherokee_flcache_conn_t *flcache_conn,
 		else if (strncasecmp (begin, "Set-cookie:", 11) == 0) {
 			if (conn->config_entry.flcache_cookies_disregard) {
 				int                 re;
-				void               *pcre;
+				cherokee_regex_t   *regex;
 				cherokee_list_t    *i;
 				cherokee_boolean_t  matched = false;
 
 				list_for_each (i, conn->config_entry.flcache_cookies_disregard) {
-					pcre = LIST_ITEM_INFO(i);
+					regex = LIST_ITEM_INFO(i);
 
-					re = pcre_exec (pcre, NULL, begin, end-begin, 0, 0, NULL, 0);
+					re = cherokee_regex_exec (regex, begin, end-begin, NULL, 0);
 					if (re >= 0) {
 						matched = true;
 						break;
@@ -655,8 +766,9 @@ cherokee_flcache_conn_commit_header (cherokee_flcache_conn_t *flcache_conn,
 	if (conn->error_code != http_ok) {
 		TRACE (ENTRIES, "Front Line Cache: Non %d response. Cache object cancelled.\n", 200);
 
-		cherokee_flcache_conn_clean (flcache_conn);
+		entry->status = flcache_status_undef;
 		cherokee_flcache_del_entry (CONN_VSRV(conn)->flcache, entry);
+		cherokee_flcache_conn_clean (flcache_conn);
 
 		return ret_deny;
 	}
@@ -665,8 +777,9 @@ cherokee_flcache_conn_commit_header (cherokee_flcache_conn_t *flcache_conn,
 	 */
 	ret = inspect_header (flcache_conn, &flcache_conn->header, conn);
 	if (ret == ret_deny) {
-		cherokee_flcache_conn_clean (flcache_conn);
+		entry->status = flcache_status_undef;
 		cherokee_flcache_del_entry (CONN_VSRV(conn)->flcache, entry);
+		cherokee_flcache_conn_clean (flcache_conn);
 
 		return ret_ok;
 	}
@@ -703,8 +816,18 @@ cherokee_flcache_conn_commit_header (cherokee_flcache_conn_t *flcache_conn,
 		return ret_error;
 	}
 
-	return ret_ok;
+	/* In-memory copy: it is kept while the object remains small
+	 */
+	if (CONN_VSRV(conn)->flcache->memory_max_file_size > 0) {
+		ret = cherokee_avl_flcache_node_reserve (&CONN_VSRV(conn)->flcache->request_map, entry,
+							 flcache_conn->header.len,
+							 CONN_VSRV(conn)->flcache->memory_max_size);
+		if (ret == ret_ok) {
+			cherokee_buffer_add_buffer (&entry->header, &flcache_conn->header);
+		}
+	}
 
+	return ret_ok;
 }
 
 
@@ -712,7 +835,10 @@ ret_t
 cherokee_flcache_conn_write_body (cherokee_flcache_conn_t *flcache_conn,
 				  cherokee_connection_t   *conn)
 {
-	ssize_t written;
+	ret_t                        ret;
+	ssize_t                      written;
+	cherokee_flcache_t          *flcache = CONN_VSRV(conn)->flcache;
+	cherokee_avl_flcache_node_t *entry   = flcache_conn->avl_node_ref;
 
 	do {
 		written = write (flcache_conn->fd, conn->buffer.buf, conn->buffer.len);
@@ -726,6 +852,26 @@ cherokee_flcache_conn_write_body (cherokee_flcache_conn_t *flcache_conn,
 	}
 
 	flcache_conn->avl_node_ref->file_size += written;
+
+	/* Keep the in-memory copy up to date
+	 */
+	if (! cherokee_buffer_is_empty (&entry->header)) {
+		ret = ret_deny;
+
+		if (entry->file_size <= flcache->memory_max_file_size) {
+			ret = cherokee_avl_flcache_node_reserve (&flcache->request_map, entry,
+								 conn->buffer.len, flcache->memory_max_size);
+		}
+
+		if (ret == ret_ok) {
+			cherokee_buffer_add_buffer (&entry->body, &conn->buffer);
+		} else {
+			TRACE (ENTRIES, "Dropping in-memory copy of '%s': %llu bytes\n",
+			       entry->request.buf, entry->file_size);
+			cherokee_avl_flcache_node_release (&flcache->request_map, entry);
+		}
+	}
+
 	return ret_ok;
 }
 
@@ -734,10 +880,27 @@ ret_t
 cherokee_flcache_conn_send_header (cherokee_flcache_conn_t *flcache_conn,
 				   cherokee_connection_t   *conn)
 {
-	ret_t   ret;
-	ssize_t got;
-	size_t  got2 = 0;
-	int     len  = -1;
+	ret_t                        ret;
+	ssize_t                      got;
+	size_t                       got2  = 0;
+	int                          len   = -1;
+	cherokee_avl_flcache_node_t *entry = flcache_conn->avl_node_ref;
+
+	/* In-memory copy: the body is written along with the header
+	 */
+	if (entry->in_memory) {
+		TRACE (ENTRIES, "Serving from memory: header %d, body %d bytes\n",
+		       entry->header.len, entry->body.len);
+
+		cherokee_buffer_add_buffer (&conn->header_buffer, &entry->header);
+
+		if (http_method_with_body (conn->header.method)) {
+			conn->mmaped     = entry->body.buf;
+			conn->mmaped_len = entry->body.len;
+		}
+
+		goto extra_headers;
+	}
 
 	/* Add cached headers
 	 */
@@ -760,6 +923,22 @@ cherokee_flcache_conn_send_header (cherokee_flcache_conn_t *flcache_conn,
 		return ret_error;
 	}
 
+	flcache_conn->offset = sizeof(int) + len;
+
+	/* Maybe use sendfile
+	 */
+#ifdef WITH_SENDFILE
+	flcache_conn->using_sendfile = ((conn->socket.is_tls == non_TLS) &&
+					(entry->file_size >= (cullong_t) CONN_SRV(conn)->sendfile.min) &&
+					(entry->file_size <  (cullong_t) CONN_SRV(conn)->sendfile.max));
+
+	if (flcache_conn->using_sendfile) {
+		cherokee_connection_set_cork (conn, true);
+		BIT_SET (conn->options, conn_op_tcp_cork);
+	}
+#endif
+
+extra_headers:
 	/* Add Content-Length
 	 */
 	cherokee_buffer_add_str      (&conn->header_buffer, "Content-Length: ");
@@ -778,6 +957,12 @@ cherokee_flcache_conn_send_header (cherokee_flcache_conn_t *flcache_conn,
 	cherokee_buffer_add_long10 (&conn->header_buffer, cherokee_bogonow_now - flcache_conn->avl_node_ref->created_at);
 	cherokee_buffer_add_str    (&conn->header_buffer, CRLF);
 
+	/* Served while being revalidated (RFC5861, section 3)
+	 */
+	if (entry->valid_until < cherokee_bogonow_now) {
+		cherokee_buffer_add_str (&conn->header_buffer, "Warning: 110 - \"Response is Stale\"" CRLF);
+	}
+
 	return ret_ok;
 }
 
@@ -790,6 +975,51 @@ cherokee_flcache_conn_send_body (cherokee_flcache_conn_t *flcache_conn,
 	size_t             got = 0;
 	cherokee_boolean_t eof = false;
 
+#ifdef WITH_SENDFILE
+	if (flcache_conn->using_sendfile) {
+		ssize_t sent;
+		off_t   to_send;
+
+		to_send = flcache_conn->avl_node_ref->file_size - flcache_conn->response_sent;
+		if ((conn->limit_bps > 0) &&
+		    (conn->limit_bps < to_send))
+		{
+			to_send = conn->limit_bps;
+		}
+
+		ret = cherokee_socket_sendfile (&conn->socket, flcache_conn->fd,
+						to_send, &flcache_conn->offset, &sent);
+
+		/* The TCP_CORK flag was set along with the header.
+		 * Turn it off after the first chunk of the body.
+		 */
+		if (conn->options & conn_op_tcp_cork) {
+			cherokee_connection_set_cork (conn, false);
+			BIT_UNSET (conn->options, conn_op_tcp_cork);
+		}
+
+		if (ret == ret_no_sys) {
+			flcache_conn->using_sendfile = false;
+			lseek (flcache_conn->fd, flcache_conn->offset, SEEK_SET);
+			goto exit_sendfile;
+		}
+
+		if (ret != ret_ok) {
+			return ret;
+		}
+
+		cherokee_connection_tx_add (conn, sent);
+		flcache_conn->response_sent += sent;
+
+		if (flcache_conn->response_sent >= flcache_conn->avl_node_ref->file_size) {
+			return ret_eof;
+		}
+
+		return ret_ok_and_sent;
+	}
+
+exit_sendfile:
+#endif
 	TRACE (ENTRIES, "Reading body from fd=%d\n", flcache_conn->fd);
 
 	ret = cherokee_buffer_read_from_fd (&conn->buffer, flcache_conn->fd, DEFAULT_READ_SIZE, &got);
@@ -823,7 +1053,7 @@ cherokee_flcache_cleanup (cherokee_flcache_t *flcache)
 
 	TRACE (ENTRIES, "Cleaning up vserver cache '%s'\n", flcache->local_directory.buf);
 
-	ret = cherokee_avl_flcache_cleanup (&flcache->request_map);
+	ret = cherokee_avl_flcache_cleanup (&flcache->request_map, flcache->stale_grace);
 	if (unlikely (ret != ret_ok)) {
 		return ret_error;
 	}
@@ -841,7 +1071,7 @@ cherokee_flcache_del_entry (cherokee_flcache_t          *flcache,
 	TRACE (ENTRIES, "Removing expired Front-line cache entry '%s'\n",
 	       entry->file.buf ? entry->file.buf : "");
 
-	/* Remove item. 'entry' is freed afterwards.
+	/* Remove item. 'entry' is freed once it is released.
 	 */
 	ret = cherokee_avl_flcache_del (&flcache->request_map, entry);
 
@@ -861,22 +1091,51 @@ cherokee_flcache_conn_clean (cherokee_flcache_conn_t *flcache_conn)
 
 		/* The storage has finished */
 		if (entry->status == flcache_status_storing) {
+			entry->in_memory = ((! cherokee_buffer_is_empty (&entry->header)) &&
+					    (! cherokee_buffer_is_empty (&entry->body)) &&
+					    (entry->body.len == entry->file_size));
 			entry->status = flcache_status_ready;
+
+			/* It takes over the stale entry */
+			if (entry->replaces != NULL) {
+				cherokee_avl_flcache_replace (&flcache_conn->flcache_ref->request_map, entry);
+			}
 		}
 
-		/* Reference countring */
-		CHEROKEE_MUTEX_LOCK (&entry->ref_count_mutex);
-		entry->ref_count -= 1;
-		CHEROKEE_MUTEX_UNLOCK (&entry->ref_count_mutex);
+		/* Completed or aborted: wake the coalesced requests up */
+		if (flcache_conn->mode != flcache_mode_out) {
+			cherokee_avl_flcache_node_wake (entry);
+		}
 
+		/* Reference countring */
+		cherokee_avl_flcache_unref (entry);
 		flcache_conn->avl_node_ref = NULL;
 	}
 
+	/* It was waiting for an entry to be stored
+	 */
+	if (flcache_conn->wait_ref != NULL) {
+		cherokee_avl_flcache_unref (flcache_conn->wait_ref);
+		flcache_conn->wait_ref = NULL;
+	}
+
+	/* The stale entry was not revalidated after all
+	 */
+	if (flcache_conn->stale_ref != NULL) {
+		flcache_conn->stale_ref->revalidating = false;
+		cherokee_avl_flcache_unref (flcache_conn->stale_ref);
+		flcache_conn->stale_ref = NULL;
+	}
+
 	/* Front-line connection: clean up
 	 */
 	flcache_conn->header_sent   = 0;
 	flcache_conn->response_sent = 0;
-	flcache_conn->mode          = flcache_mode_undef;
+	flcache_conn->mode           = flcache_mode_undef;
+	flcache_conn->offset         = 0;
+	flcache_conn->using_sendfile = false;
+	flcache_conn->flcache_ref    = NULL;
+	flcache_conn->wait_until     = 0;
 
 	if (flcache_conn->fd != -1) {
 		TRACE (ENTRIES, "Front Line Cache: Closing fd=%d (%d refs)\n",
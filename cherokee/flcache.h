@@ -35,6 +35,8 @@
 #include <cherokee/connection.h>
 #include <cherokee/config_node.h>
 
+#include <sys/types.h>
+
 CHEROKEE_BEGIN_DECLS
 
 /* Forward declaration */
@@ -62,6 +64,10 @@ struct cherokee_flcache {
 	cherokee_avl_flcache_t    request_map;
 	cherokee_buffer_t         local_directory;
 	culong_t                  last_file_id;
+	culong_t                  memory_max_size;
+	culong_t                  memory_max_file_size;
+	time_t                    stale_grace;
+	time_t                    coalesce_timeout;
 };
 
 struct cherokee_flcache_conn {
@@ -73,6 +79,14 @@ struct cherokee_flcache_conn {
 	clong_t                      response_sent;
 	cherokee_avl_flcache_node_t *avl_node_ref;
 	cherokee_buffer_t            header;
+	off_t                        offset;
+	cherokee_boolean_t           using_sendfile;
+
+	/* Coalescing and revalidation */
+	cherokee_flcache_t          *flcache_ref;
+	cherokee_avl_flcache_node_t *stale_ref;
+	cherokee_avl_flcache_node_t *wait_ref;
+	time_t                       wait_until;
 };
 
 
@@ -0,0 +1,912 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/* Cherokee
+ *
+ * Authors:
+ *      Alvaro Lopez Ortega <alvaro@alobbs.com>
+ *
+ * Copyright (C) 2001-2011 Alvaro Lopez Ortega
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "common-internal.h"
+#include "fork_server.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_SYS_WAIT_H
+# include <sys/wait.h>
+#endif
+
+#ifdef HAVE_POLL_H
+# include <poll.h>
+#elif defined(HAVE_SYS_POLL_H)
+# include <sys/poll.h>
+#endif
+
+#define ENTRIES "fork_server"
+
+#define FORK_SERVER_MAX_PAYLOAD  (512 * 1024)  /* bytes */
+#define FORK_SERVER_REAP_LAPSE   1000          /* msecs */
+#define FORK_SERVER_KILL_GRACE   2             /* secs  */
+#define FORK_SERVER_KILL_PENDING 256
+
+#ifndef MSG_CMSG_CLOEXEC
+# define MSG_CMSG_CLOEXEC 0
+#endif
+
+/* Protocol: every request is followed by a payload with the path,
+ * the working directory and the environment of the new process, as
+ * NUL terminated strings. The descriptors of the new process are
+ * attached to the request. Spawn requests are replied with the PID.
+ */
+typedef enum {
+	fork_server_req_spawn = 1,
+	fork_server_req_kill
+} fork_server_req_type_t;
+
+typedef struct {
+	cuint_t  type;
+	cuint_t  len;
+	cuint_t  envc;
+	cuint_t  fdc;
+	cuint_t  change_user;
+	pid_t    pid;
+} fork_server_req_t;
+
+typedef struct {
+	pid_t    pid;
+	int      err;
+} fork_server_reply_t;
+
+typedef union {
+	struct cmsghdr align;
+	char           buf[CMSG_SPACE(sizeof(int) * 3)];
+} fork_server_cmsg_t;
+
+/* Process groups that were sent a SIGTERM, and will get a SIGKILL
+ * once the grace period is over. Fork-server process only.
+ */
+typedef struct {
+	pid_t    pgid;
+	time_t   deadline;
+} fork_server_kill_t;
+
+static fork_server_kill_t kills[FORK_SERVER_KILL_PENDING];
+static cuint_t            kills_num = 0;
+
+/* Spawned children that have not been reaped yet. Their process
+ * IDs, and so their group IDs, cannot be recycled meanwhile.
+ */
+static pid_t             *children      = NULL;
+static cuint_t            children_num  = 0;
+static cuint_t            children_size = 0;
+
+
+ret_t
+cherokee_fork_server_init (cherokee_fork_server_t *fs)
+{
+	fs->enabled = true;
+	fs->pid     = -1;
+	fs->fd      = -1;
+
+	CHEROKEE_MUTEX_INIT (&fs->mutex, CHEROKEE_MUTEX_FAST);
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_fork_server_mrproper (cherokee_fork_server_t *fs)
+{
+	pid_t re;
+
+	/* It exits as soon as it reads EOF
+	 */
+	if (fs->fd != -1) {
+		cherokee_fd_close (fs->fd);
+		fs->fd = -1;
+	}
+
+	if (fs->pid > 0) {
+		do {
+			re = waitpid (fs->pid, NULL, 0);
+		} while ((re < 0) && (errno == EINTR));
+
+		fs->pid = -1;
+	}
+
+	CHEROKEE_MUTEX_DESTROY (&fs->mutex);
+	return ret_ok;
+}
+
+
+int
+cherokee_fork_server_is_active (cherokee_fork_server_t *fs)
+{
+	return (fs->fd != -1);
+}
+
+
+/* I/O
+ */
+
+static ret_t
+do_write (int fd, const void *buf, size_t len)
+{
+	ssize_t     re;
+	const char *p = buf;
+
+	while (len > 0) {
+		re = write (fd, p, len);
+		if (re < 0) {
+			if (errno == EINTR)
+				continue;
+			return ret_error;
+		}
+
+		p   += re;
+		len -= re;
+	}
+
+	return ret_ok;
+}
+
+static ret_t
+do_read (int fd, void *buf, size_t len)
+{
+	ssize_t  re;
+	char    *p = buf;
+
+	while (len > 0) {
+		re = read (fd, p, len);
+		if (re < 0) {
+			if (errno == EINTR)
+				continue;
+			return ret_error;
+		} else if (re == 0) {
+			return ret_eof;
+		}
+
+		p   += re;
+		len -= re;
+	}
+
+	return ret_ok;
+}
+
+static ret_t
+send_with_fds (int fd, void *buf, size_t len, int *fds, cuint_t fdc)
+{
+	ssize_t             re;
+	struct iovec        iov;
+	struct msghdr       msg;
+	struct cmsghdr     *cmsg;
+	fork_server_cmsg_t  ctrl;
+
+	iov.iov_base = buf;
+	iov.iov_len  = len;
+
+	memset (&msg, 0, sizeof(msg));
+	msg.msg_iov        = &iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = ctrl.buf;
+	msg.msg_controllen = CMSG_SPACE(sizeof(int) * fdc);
+
+	cmsg = CMSG_FIRSTHDR (&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type  = SCM_RIGHTS;
+	cmsg->cmsg_len   = CMSG_LEN(sizeof(int) * fdc);
+	memcpy (CMSG_DATA(cmsg), fds, sizeof(int) * fdc);
+
+	do {
+		re = sendmsg (fd, &msg, 0);
+	} while ((re < 0) && (errno == EINTR));
+
+	if (re <= 0) {
+		return ret_error;
+	}
+
+	/* The descriptors went along with the first byte
+	 */
+	return do_write (fd, (char *)buf + re, len - re);
+}
+
+static ret_t
+recv_with_fds (int fd, void *buf, size_t len, int *fds, cuint_t *fdc)
+{
+	ssize_t             re;
+	struct iovec        iov;
+	struct msghdr       msg;
+	struct cmsghdr     *cmsg;
+	fork_server_cmsg_t  ctrl;
+
+	iov.iov_base = buf;
+	iov.iov_len  = len;
+
+	memset (&msg, 0, sizeof(msg));
+	msg.msg_iov        = &iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = ctrl.buf;
+	msg.msg_controllen = sizeof(ctrl.buf);
+
+	do {
+		re = recvmsg (fd, &msg, MSG_CMSG_CLOEXEC);
+	} while ((re < 0) && (errno == EINTR));
+
+	if (re < 0) {
+		return ret_error;
+	} else if (re == 0) {
+		return ret_eof;
+	}
+
+	*fdc = 0;
+
+	for (cmsg = CMSG_FIRSTHDR (&msg); cmsg != NULL; cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+		if ((cmsg->cmsg_level != SOL_SOCKET) ||
+		    (cmsg->cmsg_type  != SCM_RIGHTS))
+			continue;
+
+		*fdc = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		memcpy (fds, CMSG_DATA(cmsg), sizeof(int) * (*fdc));
+		break;
+	}
+
+	return do_read (fd, (char *)buf + re, len - re);
+}
+
+
+/* Fork-server process
+ */
+
+static void
+write_status (int fd, const char *status)
+{
+	ret_t ret;
+
+	ret = do_write (fd, status, strlen(status));
+	UNUSED(ret);
+}
+
+static void
+report_exec_error (int fd, const char *path, int err)
+{
+	char buf[ERROR_MAX_BUFSIZE];
+
+	switch (err) {
+	case ENODEV:
+	case ENOTDIR:
+	case ENOENT:
+		write_status (fd, "Status: 404" CRLF_CRLF);
+		return;
+	case EPERM:
+	case EACCES:
+	case ENOEXEC:
+		write_status (fd, "Status: 403" CRLF_CRLF);
+		return;
+	default:
+		write_status (fd, "Status: 500" CRLF_CRLF);
+	}
+
+	LOG_ERROR (CHEROKEE_ERROR_HANDLER_CGI_EXECUTE,
+		   path, cherokee_strerror_r(err, buf, sizeof(buf)));
+}
+
+static int
+child_exec (fork_server_req_t *req,
+	    int               *fds,
+	    char              *path,
+	    char              *cwd,
+	    char             **envp)
+{
+	int          re;
+	int          n;
+	struct stat  info;
+	char        *argv[2] = { path, NULL };
+
+	/* A process group of its own: whatever it spawns is
+	 * terminated along with it.
+	 */
+	setsid();
+
+	/* Standard descriptors, in blocking mode. This runs after
+	 * vfork() too, so it must stick to plain system calls.
+	 */
+	for (n = 0; n < (int) req->fdc; n++) {
+		re = dup2 (fds[n], n);
+		if (unlikely (re != n)) {
+			write_status (fds[1], "Status: 500" CRLF_CRLF);
+			_exit(1);
+		}
+
+		re = fcntl (n, F_GETFL, 0);
+		fcntl (n, F_SETFL, re & ~O_NONBLOCK);
+	}
+
+	re = chdir (cwd);
+	if (re < 0) {
+		write_status (STDOUT_FILENO, "Status: 500" CRLF_CRLF);
+		_exit(1);
+	}
+
+	/* Change the execution user: fork() only
+	 */
+	if (req->change_user) {
+		re = cherokee_stat (path, &info);
+		if (re >= 0) {
+			re = setuid (info.st_uid);
+			if (re != 0) {
+				LOG_ERROR (CHEROKEE_ERROR_HANDLER_CGI_SETID, path, info.st_uid);
+			}
+		}
+	}
+
+	do {
+		re = execve (path, argv, envp);
+	} while ((re == -1) && (errno == EINTR));
+
+	return errno;
+}
+
+static pid_t
+spawn (fork_server_req_t *req,
+       int               *fds,
+       char              *path,
+       char              *cwd,
+       char             **envp,
+       int               *err)
+{
+	pid_t        pid;
+	volatile int exec_err = 0;
+
+#ifdef HAVE_WORKING_VFORK
+	/* The fast path: the child borrows the address space until
+	 * it calls execve(). Switching the user has to fork though.
+	 */
+	if (! req->change_user) {
+		pid = vfork();
+		if (pid == 0) {
+			exec_err = child_exec (req, fds, path, cwd, envp);
+			_exit(1);
+		} else if (pid < 0) {
+			*err = errno;
+			return -1;
+		}
+
+		if (exec_err != 0) {
+			report_exec_error (fds[1], path, exec_err);
+		}
+
+		return pid;
+	}
+#endif
+
+	pid = fork();
+	if (pid == 0) {
+		exec_err = child_exec (req, fds, path, cwd, envp);
+		report_exec_error (STDOUT_FILENO, path, exec_err);
+		_exit(1);
+	} else if (pid < 0) {
+		*err = errno;
+		return -1;
+	}
+
+	return pid;
+}
+
+static void
+child_add (pid_t pid)
+{
+	pid_t *tmp;
+
+	if (children_num >= children_size) {
+		tmp = (pid_t *) realloc (children, sizeof(pid_t) * (children_size + 32));
+		if (unlikely (tmp == NULL)) {
+			return;
+		}
+
+		children       = tmp;
+		children_size += 32;
+	}
+
+	children[children_num++] = pid;
+}
+
+static cherokee_boolean_t
+child_exists (pid_t pid)
+{
+	cuint_t n;
+
+	for (n = 0; n < children_num; n++) {
+		if (children[n] == pid)
+			return true;
+	}
+
+	return false;
+}
+
+static void
+child_del (pid_t pid)
+{
+	cuint_t n;
+
+	for (n = 0; n < children_num; n++) {
+		if (children[n] == pid) {
+			children[n] = children[--children_num];
+			break;
+		}
+	}
+
+	for (n = 0; n < kills_num; n++) {
+		if (kills[n].pgid == pid) {
+			kills[n] = kills[--kills_num];
+			break;
+		}
+	}
+}
+
+static cherokee_boolean_t
+kill_pending (pid_t pid)
+{
+	cuint_t n;
+
+	for (n = 0; n < kills_num; n++) {
+		if (kills[n].pgid == pid)
+			return true;
+	}
+
+	return false;
+}
+
+static void
+handle_kill (pid_t pid)
+{
+	int re;
+
+	/* Only the groups led by a child that has not been reaped:
+	 * otherwise the ID might belong to somebody else by now.
+	 */
+	if ((pid <= 1) ||
+	    (! child_exists (pid)) ||
+	    (kill_pending (pid)))
+	{
+		return;
+	}
+
+	/* A CGI that exited by itself might have left processes
+	 * behind on purpose: reap it and leave its group alone.
+	 */
+	do {
+		re = waitpid (pid, NULL, WNOHANG);
+	} while ((re < 0) && (errno == EINTR));
+
+	if ((re == pid) ||
+	    ((re < 0) && (errno == ECHILD)))
+	{
+		child_del (pid);
+		return;
+	}
+
+	/* The whole process group: the CGI might have children of
+	 * its own (a shell script, for instance). Those that ignore
+	 * the SIGTERM get a SIGKILL after the grace period.
+	 */
+	TRACE (ENTRIES, "Terminating process group %d\n", pid);
+
+	re = kill (-pid, SIGTERM);
+	if (re != 0) {
+		kill (pid, SIGTERM);
+		return;
+	}
+
+	if (kills_num >= FORK_SERVER_KILL_PENDING) {
+		kill (-pid, SIGKILL);
+		return;
+	}
+
+	kills[kills_num].pgid     = pid;
+	kills[kills_num].deadline = time(NULL) + FORK_SERVER_KILL_GRACE;
+	kills_num++;
+}
+
+static void
+kill_expired (void)
+{
+	cuint_t n   = 0;
+	time_t  now = time(NULL);
+
+	/* The group leaders are not reaped while their kill is
+	 * pending (see reap_children), so the IDs are still theirs.
+	 */
+	while (n < kills_num) {
+		if (kills[n].deadline > now) {
+			n++;
+			continue;
+		}
+
+		TRACE (ENTRIES, "Killing process group %d\n", kills[n].pgid);
+		kill (-kills[n].pgid, SIGKILL);
+
+		kills[n] = kills[--kills_num];
+	}
+}
+
+static ret_t
+handle_spawn (int fd, fork_server_req_t *req, int *fds)
+{
+	ret_t                ret;
+	cuint_t              n;
+	char                *p;
+	char                *end;
+	char                *path;
+	char                *cwd;
+	char               **envp    = NULL;
+	char                *payload = NULL;
+	fork_server_reply_t  reply;
+
+	reply.pid = -1;
+	reply.err = EINVAL;
+
+	if ((req->len == 0) ||
+	    (req->len > FORK_SERVER_MAX_PAYLOAD) ||
+	    (req->fdc < 2) || (req->fdc > 3))
+	{
+		return ret_error;
+	}
+
+	/* Read the payload
+	 */
+	payload = (char *) malloc (req->len);
+	envp    = (char **) malloc (sizeof(char *) * (req->envc + 1));
+
+	if ((payload == NULL) || (envp == NULL)) {
+		ret = ret_nomem;
+		goto out;
+	}
+
+	ret = do_read (fd, payload, req->len);
+	if (ret != ret_ok) {
+		goto out;
+	}
+
+	/* Split it
+	 */
+	p   = payload;
+	end = payload + req->len;
+
+	if (end[-1] != '\0') {
+		goto reply;
+	}
+
+	path = p;
+	p += strlen(p) + 1;
+	if (p >= end) {
+		goto reply;
+	}
+
+	cwd = p;
+	p += strlen(p) + 1;
+
+	for (n = 0; n < req->envc; n++) {
+		if (p >= end) {
+			goto reply;
+		}
+
+		envp[n] = p;
+		p += strlen(p) + 1;
+	}
+
+	envp[n] = NULL;
+
+	/* Spawn it
+	 */
+	reply.err = 0;
+	reply.pid = spawn (req, fds, path, cwd, envp, &reply.err);
+	if (reply.pid > 0) {
+		child_add (reply.pid);
+	}
+
+	TRACE (ENTRIES, "Spawned '%s', pid=%d\n", path, reply.pid);
+
+reply:
+	ret = do_write (fd, &reply, sizeof(reply));
+
+out:
+	free (payload);
+	free (envp);
+	return ret;
+}
+
+static void
+reap_children (void)
+{
+	pid_t   re;
+	pid_t   pid;
+	cuint_t n   = 0;
+
+	if (kills_num == 0) {
+		do {
+			re = waitpid (-1, NULL, WNOHANG);
+			if (re > 0) {
+				child_del (re);
+			}
+		} while ((re > 0) || ((re < 0) && (errno == EINTR)));
+
+		return;
+	}
+
+	/* The leaders of the groups about to be killed are left
+	 * unreaped until then
+	 */
+	while (n < children_num) {
+		pid = children[n];
+
+		if (kill_pending (pid)) {
+			n++;
+			continue;
+		}
+
+		do {
+			re = waitpid (pid, NULL, WNOHANG);
+		} while ((re < 0) && (errno == EINTR));
+
+		if ((re == pid) ||
+		    ((re < 0) && (errno == ECHILD)))
+		{
+			child_del (pid);
+			continue;
+		}
+
+		n++;
+	}
+}
+
+static NORETURN void
+fork_server_routine (int fd)
+{
+	ret_t              ret;
+	int                re;
+	cuint_t            n;
+	cuint_t            fdc;
+	int                fds[3];
+	sigset_t           mask;
+	struct pollfd      pfd;
+	fork_server_req_t  req;
+
+	/* The children inherit the signal settings
+	 */
+	cherokee_reset_signals();
+
+	sigemptyset (&mask);
+	sigprocmask (SIG_SETMASK, &mask, NULL);
+
+	/* The received descriptors must not take the place of the
+	 * standard ones, they would be overwritten by dup2()
+	 */
+	for (n = 0; n < 3; n++) {
+		if (fcntl (n, F_GETFD) < 0) {
+			re = open ("/dev/null", O_RDWR);
+			UNUSED(re);
+		}
+	}
+
+	while (true) {
+		reap_children();
+		kill_expired();
+
+		pfd.fd      = fd;
+		pfd.events  = POLLIN;
+		pfd.revents = 0;
+
+		re = poll (&pfd, 1, FORK_SERVER_REAP_LAPSE);
+		if (re <= 0) {
+			continue;
+		}
+
+		fdc = 0;
+		ret = recv_with_fds (fd, &req, sizeof(req), fds, &fdc);
+		if (ret != ret_ok) {
+			break;
+		}
+
+		switch (req.type) {
+		case fork_server_req_spawn:
+			if (fdc == req.fdc) {
+				ret = handle_spawn (fd, &req, fds);
+			} else {
+				ret = ret_error;
+			}
+			break;
+		case fork_server_req_kill:
+			handle_kill (req.pid);
+			break;
+		default:
+			ret = ret_error;
+		}
+
+		for (n = 0; n < fdc; n++) {
+			cherokee_fd_close (fds[n]);
+		}
+
+		if (ret != ret_ok) {
+			break;
+		}
+	}
+
+	TRACE (ENTRIES, "Exiting, ret=%d\n", ret);
+	_exit(0);
+}
+
+
+/* Worker side
+ */
+
+ret_t
+cherokee_fork_server_start (cherokee_fork_server_t *fs)
+{
+	int   re;
+	pid_t pid;
+	int   fds[2];
+
+	if (! fs->enabled) {
+		return ret_ok;
+	}
+
+	re = socketpair (AF_UNIX, SOCK_STREAM, 0, fds);
+	if (re != 0) {
+		LOG_ERRNO (errno, cherokee_err_warning,
+			   CHEROKEE_ERROR_FORK_SERVER_SOCKET);
+		return ret_error;
+	}
+
+	cherokee_fd_set_closexec (fds[0]);
+	cherokee_fd_set_closexec (fds[1]);
+
+	pid = fork();
+	if (pid == 0) {
+		cherokee_fd_close (fds[0]);
+		fork_server_routine (fds[1]);
+
+	} else if (pid < 0) {
+		LOG_ERRNO (errno, cherokee_err_warning,
+			   CHEROKEE_ERROR_FORK_SERVER_FORK);
+
+		cherokee_fd_close (fds[0]);
+		cherokee_fd_close (fds[1]);
+		return ret_error;
+	}
+
+	cherokee_fd_close (fds[1]);
+
+	fs->pid = pid;
+	fs->fd  = fds[0];
+
+	TRACE (ENTRIES, "Fork-server started, pid=%d\n", pid);
+	return ret_ok;
+}
+
+
+static void
+lost (cherokee_fork_server_t *fs)
+{
+	LOG_ERROR_S (CHEROKEE_ERROR_FORK_SERVER_LOST);
+
+	cherokee_fd_close (fs->fd);
+	fs->fd = -1;
+}
+
+
+ret_t
+cherokee_fork_server_spawn (cherokee_fork_server_t *fs,
+			    cherokee_buffer_t      *path,
+			    cherokee_buffer_t      *cwd,
+			    char                  **envp,
+			    cherokee_boolean_t      change_user,
+			    int                     fds[3],
+			    pid_t                  *pid)
+{
+	ret_t                ret;
+	cuint_t              n;
+	fork_server_req_t    req;
+	fork_server_reply_t  reply;
+	cherokee_buffer_t    payload = CHEROKEE_BUF_INIT;
+
+	/* Build the request
+	 */
+	cherokee_buffer_add_buffer (&payload, path);
+	cherokee_buffer_add (&payload, "\0", 1);
+	cherokee_buffer_add_buffer (&payload, cwd);
+	cherokee_buffer_add (&payload, "\0", 1);
+
+	for (n = 0; envp[n] != NULL; n++) {
+		cherokee_buffer_add (&payload, envp[n], strlen(envp[n]));
+		cherokee_buffer_add (&payload, "\0", 1);
+	}
+
+	memset (&req, 0, sizeof(req));
+	req.type        = fork_server_req_spawn;
+	req.len         = payload.len;
+	req.envc        = n;
+	req.fdc         = (fds[2] != -1) ? 3 : 2;
+	req.change_user = change_user;
+
+	/* Requests and replies go one at a time
+	 */
+	CHEROKEE_MUTEX_LOCK (&fs->mutex);
+
+	if (fs->fd == -1) {
+		ret = ret_not_found;
+		goto out;
+	}
+
+	ret = send_with_fds (fs->fd, &req, sizeof(req), fds, req.fdc);
+	if (ret == ret_ok) {
+		ret = do_write (fs->fd, payload.buf, payload.len);
+	}
+	if (ret == ret_ok) {
+		ret = do_read (fs->fd, &reply, sizeof(reply));
+	}
+
+	if (ret != ret_ok) {
+		lost (fs);
+		ret = ret_error;
+		goto out;
+	}
+
+	if (reply.pid <= 0) {
+		LOG_ERRNO (reply.err, cherokee_err_error,
+			   CHEROKEE_ERROR_FORK_SERVER_SPAWN, path->buf);
+		ret = ret_error;
+		goto out;
+	}
+
+	*pid = reply.pid;
+	ret  = ret_ok;
+
+out:
+	CHEROKEE_MUTEX_UNLOCK (&fs->mutex);
+	cherokee_buffer_mrproper (&payload);
+	return ret;
+}
+
+
+ret_t
+cherokee_fork_server_kill (cherokee_fork_server_t *fs,
+			   pid_t                   pid)
+{
+	ret_t             ret = ret_ok;
+	fork_server_req_t req;
+
+	memset (&req, 0, sizeof(req));
+	req.type = fork_server_req_kill;
+	req.pid  = pid;
+
+	CHEROKEE_MUTEX_LOCK (&fs->mutex);
+
+	if (fs->fd != -1) {
+		ret = do_write (fs->fd, &req, sizeof(req));
+		if (ret != ret_ok) {
+			lost (fs);
+		}
+	}
+
+	CHEROKEE_MUTEX_UNLOCK (&fs->mutex);
+	return ret;
+}
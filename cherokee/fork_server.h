@@ -0,0 +1,69 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/* Cherokee
+ *
+ * Authors:
+ *      Alvaro Lopez Ortega <alvaro@alobbs.com>
+ *
+ * Copyright (C) 2001-2011 Alvaro Lopez Ortega
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef CHEROKEE_FORK_SERVER_H
+#define CHEROKEE_FORK_SERVER_H
+
+#include "common-internal.h"
+#include "buffer.h"
+
+#ifdef HAVE_SYS_TYPES_H
+# include <sys/types.h>
+#endif
+
+/* Fork-server: a small process, forked before the worker grows,
+ * that spawns the CGIs on its behalf. Requests and the standard
+ * file descriptors of the new process travel through a Unix
+ * socket.
+ */
+typedef struct {
+	cherokee_boolean_t  enabled;
+	pid_t               pid;
+	int                 fd;
+	CHEROKEE_MUTEX_T   (mutex);
+} cherokee_fork_server_t;
+
+#define FORK_SERVER(x) ((cherokee_fork_server_t *)(x))
+
+ret_t cherokee_fork_server_init      (cherokee_fork_server_t *fs);
+ret_t cherokee_fork_server_mrproper  (cherokee_fork_server_t *fs);
+ret_t cherokee_fork_server_start     (cherokee_fork_server_t *fs);
+
+int   cherokee_fork_server_is_active (cherokee_fork_server_t *fs);
+
+/* fds: standard input, output and error of the new process. The
+ * error one can be -1, the process will inherit the server's.
+ */
+ret_t cherokee_fork_server_spawn     (cherokee_fork_server_t *fs,
+				      cherokee_buffer_t      *path,
+				      cherokee_buffer_t      *cwd,
+				      char                  **envp,
+				      cherokee_boolean_t      change_user,
+				      int                     fds[3],
+				      pid_t                  *pid);
+
+ret_t cherokee_fork_server_kill      (cherokee_fork_server_t *fs,
+				      pid_t                   pid);
+
+#endif /* CHEROKEE_FORK_SERVER_H */
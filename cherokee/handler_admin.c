@@ -116,6 +116,9 @@ process_request_line (cherokee_handler_admin_t *hdl, cherokee_buffer_t *line)
 	} else if (COMP (line->buf, "kill server.source")) {
 		return cherokee_admin_server_reply_kill_source (HANDLER(hdl), &hdl->dwriter, line);
 
+	} else if (COMP (line->buf, "get server.tls")) {
+		return cherokee_admin_server_reply_get_tls (HANDLER(hdl), &hdl->dwriter);
+
 	} else if (COMP (line->buf, "set server.backup_mode")) {
 		return cherokee_admin_server_reply_set_backup_mode (HANDLER(hdl), &hdl->dwriter, line);
 
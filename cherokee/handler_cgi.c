@@ -151,8 +151,9 @@ cherokee_handler_cgi_new (cherokee_handler_t **hdl, void *cnt, cherokee_module_p
 
 	cherokee_buffer_init (&n->envp);
 #else
-	n->pid       = -1;
-	n->envp_last =  0;
+	n->pid         = -1;
+	n->envp_last   =  0;
+	n->fork_server = false;
 
 	for (i=0; i<ENV_VAR_NUM; i++)
 		n->envp[i] = NULL;
@@ -221,7 +222,12 @@ cherokee_handler_cgi_free (cherokee_handler_cgi_t *cgi)
         /* Kill the CGI
 	 */
 #ifndef _WIN32
-	if (cgi->pid > 0) {
+	if ((cgi->pid > 0) && (cgi->fork_server)) {
+		/* It is not a child of this process
+		 */
+		cherokee_fork_server_kill (&HANDLER_SRV(cgi)->fork_server, cgi->pid);
+
+	} else if (cgi->pid > 0) {
 		pid_t  pid;
 		cint_t tries = 2;
 
@@ -658,11 +664,73 @@ manage_child_cgi_process (cherokee_handler_cgi_t *cgi, int pipe_cgi[2], int pipe
 	exit(2);
 }
 
+static ret_t
+execute_cgi_fork_server (cherokee_handler_cgi_t *cgi, int pipe_cgi[2], int pipe_server[2], pid_t *pid)
+{
+	ret_t                        ret;
+	char                        *file;
+	int                          fds[3];
+	cherokee_connection_t       *conn     = HANDLER_CONN(cgi);
+	cherokee_handler_cgi_base_t *cgi_base = HDL_CGI_BASE(cgi);
+	cherokee_fork_server_t      *fs       = &HANDLER_SRV(cgi)->fork_server;
+	cherokee_buffer_t           *cwd      = THREAD_TMP_BUF1(CONN_THREAD(conn));
+
+	if (! cherokee_fork_server_is_active (fs)) {
+		return ret_not_found;
+	}
+
+	/* Environment
+	 */
+	ret = add_environment (cgi, conn);
+	if (unlikely (ret != ret_ok)) {
+		return ret_error;
+	}
+
+	/* Working directory
+	 */
+	cherokee_buffer_clean (cwd);
+
+	if (! cherokee_buffer_is_empty (&conn->effective_directory)) {
+		cherokee_buffer_add_buffer (cwd, &conn->effective_directory);
+	} else {
+		file = strrchr (cgi_base->executable.buf, '/');
+		if (file != NULL) {
+			cherokee_buffer_add (cwd, cgi_base->executable.buf,
+					     file - cgi_base->executable.buf);
+		}
+	}
+
+	/* Standard input, output and error
+	 */
+	fds[0] = pipe_server[0];
+	fds[1] = pipe_cgi[1];
+	fds[2] = -1;
+
+	if (CONN_VSRV(conn)->error_writer != NULL) {
+		fds[2] = CONN_VSRV(conn)->error_writer->fd;
+	}
+
+	TRACE (ENTRIES, "Spawning through the fork-server: '%s'\n", cgi_base->executable.buf);
+
+	ret = cherokee_fork_server_spawn (fs, &cgi_base->executable, cwd, cgi->envp,
+					  HANDLER_CGI_PROPS(cgi_base)->change_user,
+					  fds, pid);
+
+	/* The environment is already built: it cannot fall back
+	 */
+	if (ret != ret_ok) {
+		return ret_error;
+	}
+
+	return ret_ok;
+}
+
 static ret_t
 fork_and_execute_cgi_unix (cherokee_handler_cgi_t *cgi)
 {
 	int                    re;
-	int                    pid;
+	ret_t                  ret;
+	pid_t                  pid  = -1;
 	cherokee_connection_t *conn = HANDLER_CONN(cgi);
 
 	struct {
@@ -680,15 +748,24 @@ fork_and_execute_cgi_unix (cherokee_handler_cgi_t *cgi)
 		return ret_error;
 	}
 
-	/* .. and fork the process
+	/* .. hand them to the fork-server
 	 */
-	pid = fork();
-	if (pid == 0) {
-		/* CGI process
+	ret = execute_cgi_fork_server (cgi, pipes.cgi, pipes.server, &pid);
+	if (ret == ret_ok) {
+		cgi->fork_server = true;
+
+	} else if (ret == ret_not_found) {
+		/* .. or fork the process
 		 */
-		manage_child_cgi_process (cgi, pipes.cgi, pipes.server);
+		pid = fork();
+		if (pid == 0) {
+			/* CGI process
+			 */
+			manage_child_cgi_process (cgi, pipes.cgi, pipes.server);
+		}
+	}
 
-	} else if (pid < 0) {
+	if (pid < 0) {
 		/* Error
 		 */
 		cherokee_fd_close (pipes.cgi[0]);
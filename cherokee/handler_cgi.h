@@ -59,6 +59,7 @@ typedef struct {
 	char             *envp[ENV_VAR_NUM]; /* Environ variables for execve() */
 	int               envp_last;
 	pid_t             pid;               /* CGI pid */
+	cherokee_boolean_t fork_server;      /* spawned by the fork-server */
 #endif
 } cherokee_handler_cgi_t;
 
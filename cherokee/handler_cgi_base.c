@@ -1171,6 +1171,12 @@ cherokee_handler_cgi_base_add_headers (cherokee_handler_cgi_base_t *cgi,
 	 */
 	cherokee_buffer_move_to_begin (inbuf, len + end_len);
 
+	/* The back-end answered: the connection gets its regular
+	 * timeout back, the spawning one might still be in place if
+	 * the whole reply header was read at once.
+	 */
+	cherokee_connection_update_timeout (conn);
+
 	/* From this moment, it can handle errors
 	 */
 	if (HANDLER_CGI_BASE_PROPS(cgi)->is_error_handler) {
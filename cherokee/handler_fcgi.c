@@ -25,6 +25,8 @@
 #include "common-internal.h"
 
 #include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
 
 #include "handler_fcgi.h"
 #include "header.h"
@@ -129,6 +131,14 @@ process_package (cherokee_handler_fcgi_t *hdl, cherokee_buffer_t *inbuf, cheroke
 	case FCGI_END_REQUEST:
 /*		printf ("READ:END"); */
 		HDL_CGI_BASE(hdl)->got_eof = true;
+
+		/* The connection can only be reused if the
+		 * application completed the request normally.
+		 */
+		if (len >= sizeof(FCGI_EndRequestBody)) {
+			FCGI_EndRequestBody *end = (FCGI_EndRequestBody *)data;
+			hdl->ended = (end->protocolStatus == FCGI_REQUEST_COMPLETE);
+		}
 		break;
 
 	default:
@@ -201,9 +211,182 @@ read_from_fcgi (cherokee_handler_cgi_base_t *cgi, cherokee_buffer_t *buffer)
 }
 
 
+/* Kept-alive connections
+ */
+
+static void
+pconn_free (cherokee_handler_fcgi_pconn_t *pconn)
+{
+	cherokee_socket_close (&pconn->socket);
+	cherokee_socket_mrproper (&pconn->socket);
+	free (pconn);
+}
+
+
+static cherokee_boolean_t
+pconn_is_alive (cherokee_handler_fcgi_pconn_t *pconn)
+{
+	int  re;
+	char tmp;
+
+	/* An idle FastCGI connection must not have anything to
+	 * read. EOF means the application closed it, whereas any
+	 * data would be out of sync with the next request.
+	 */
+	do {
+		re = recv (pconn->socket.socket, &tmp, 1, MSG_PEEK | MSG_DONTWAIT);
+	} while ((re < 0) && (errno == EINTR));
+
+	if (re < 0) {
+		return ((errno == EAGAIN) || (errno == EWOULDBLOCK));
+	}
+
+	return false;
+}
+
+
+static cherokee_handler_fcgi_poll_t *
+poll_find (cherokee_handler_fcgi_props_t *props,
+	   cherokee_source_t             *src,
+	   cherokee_boolean_t             create)
+{
+	cherokee_list_t              *i;
+	cherokee_handler_fcgi_poll_t *poll;
+
+	list_for_each (i, &props->polls) {
+		if (FCGI_POLL(i)->src_ref == src)
+			return FCGI_POLL(i);
+	}
+
+	if (! create)
+		return NULL;
+
+	poll = (cherokee_handler_fcgi_poll_t *) malloc (sizeof(cherokee_handler_fcgi_poll_t));
+	if (unlikely (poll == NULL))
+		return NULL;
+
+	INIT_LIST_HEAD (&poll->listed);
+	INIT_LIST_HEAD (&poll->reuse);
+	poll->src_ref   = src;
+	poll->reuse_len = 0;
+
+	cherokee_list_add (&poll->listed, &props->polls);
+	return poll;
+}
+
+
+static ret_t
+poll_get (cherokee_handler_fcgi_props_t *props,
+	  cherokee_source_t             *src,
+	  cherokee_socket_t             *socket)
+{
+	cherokee_handler_fcgi_poll_t  *poll;
+	cherokee_handler_fcgi_pconn_t *pconn;
+
+	CHEROKEE_MUTEX_LOCK (&props->polls_mutex);
+
+	poll = poll_find (props, src, false);
+	if (poll == NULL)
+		goto out;
+
+	/* Take the most recently released connection first, and
+	 * drop the ones the application has closed meanwhile.
+	 */
+	while (poll->reuse_len > 0) {
+		pconn = FCGI_PCONN(poll->reuse.next);
+		cherokee_list_del (&pconn->listed);
+		poll->reuse_len -= 1;
+
+		if (! pconn_is_alive (pconn)) {
+			TRACE (ENTRIES, "Discarding closed kept-alive fd=%d\n", pconn->socket.socket);
+			CHEROKEE_ATOMIC_ADD (&src->pool.evictions, 1);
+			pconn_free (pconn);
+			continue;
+		}
+
+		CHEROKEE_MUTEX_UNLOCK (&props->polls_mutex);
+
+		*socket = pconn->socket;
+		free (pconn);
+
+		CHEROKEE_ATOMIC_ADD (&src->pool.hits, 1);
+
+		TRACE (ENTRIES, "Reusing kept-alive fd=%d\n", socket->socket);
+		return ret_ok;
+	}
+
+out:
+	CHEROKEE_MUTEX_UNLOCK (&props->polls_mutex);
+
+	CHEROKEE_ATOMIC_ADD (&src->pool.misses, 1);
+	return ret_not_found;
+}
+
+
+static ret_t
+poll_release (cherokee_handler_fcgi_props_t *props,
+	      cherokee_source_t             *src,
+	      cherokee_socket_t             *socket)
+{
+	cherokee_handler_fcgi_poll_t  *poll;
+	cherokee_handler_fcgi_pconn_t *pconn;
+
+	pconn = (cherokee_handler_fcgi_pconn_t *) malloc (sizeof(cherokee_handler_fcgi_pconn_t));
+	if (unlikely (pconn == NULL))
+		return ret_nomem;
+
+	INIT_LIST_HEAD (&pconn->listed);
+	pconn->socket = *socket;
+
+	CHEROKEE_MUTEX_LOCK (&props->polls_mutex);
+
+	poll = poll_find (props, src, true);
+	if (unlikely (poll == NULL)) {
+		CHEROKEE_MUTEX_UNLOCK (&props->polls_mutex);
+		free (pconn);
+		return ret_nomem;
+	}
+
+	/* If the reuse-list is full, dispose the oldest obj
+	 */
+	if (poll->reuse_len >= props->reuse_max) {
+		cherokee_handler_fcgi_pconn_t *oldest;
+
+		oldest = FCGI_PCONN(poll->reuse.prev);
+		cherokee_list_del (&oldest->listed);
+		poll->reuse_len -= 1;
+
+		CHEROKEE_ATOMIC_ADD (&src->pool.evictions, 1);
+		pconn_free (oldest);
+	}
+
+	poll->reuse_len += 1;
+	cherokee_list_add (&pconn->listed, &poll->reuse);
+
+	CHEROKEE_MUTEX_UNLOCK (&props->polls_mutex);
+
+	/* The socket belongs to the poll now
+	 */
+	cherokee_socket_init (socket);
+	return ret_ok;
+}
+
+
 static ret_t
 props_free (cherokee_handler_fcgi_props_t *props)
 {
+	cherokee_list_t *i, *j;
+	cherokee_list_t *k, *l;
+
+	list_for_each_safe (i, j, &props->polls) {
+		list_for_each_safe (k, l, &FCGI_POLL(i)->reuse) {
+			pconn_free (FCGI_PCONN(k));
+		}
+		free (i);
+	}
+
+	CHEROKEE_MUTEX_DESTROY (&props->polls_mutex);
+
 	if (props->balancer != NULL)
 		cherokee_balancer_free (props->balancer);
 
@@ -218,6 +401,7 @@ cherokee_handler_fcgi_configure (cherokee_config_node_t   *conf,
 {
 	ret_t                          ret;
 	cherokee_list_t               *i;
+	int                            val;
 	cherokee_handler_fcgi_props_t *props;
 
 	/* Instance a new property object
@@ -229,7 +413,11 @@ cherokee_handler_fcgi_configure (cherokee_config_node_t   *conf,
 							   MODULE_PROPS_FREE(props_free));
 
 		INIT_LIST_HEAD (&n->server_list);
-		n->balancer = NULL;
+		INIT_LIST_HEAD (&n->polls);
+		CHEROKEE_MUTEX_INIT (&n->polls_mutex, CHEROKEE_MUTEX_FAST);
+
+		n->balancer  = NULL;
+		n->reuse_max = 0;
 
 		*_props = MODULE_PROPS(n);
 	}
@@ -244,6 +432,11 @@ cherokee_handler_fcgi_configure (cherokee_config_node_t   *conf,
 		if (equal_buf_str (&subconf->key, "balancer")) {
 			ret = cherokee_balancer_instance (&subconf->val, subconf, srv, &props->balancer);
 			if (ret != ret_ok) return ret;
+
+		} else if (equal_buf_str (&subconf->key, "reuse_max")) {
+			ret = cherokee_atoi (subconf->val.buf, &val);
+			if (ret != ret_ok) return ret;
+			props->reuse_max = val;
 		}
 	}
 
@@ -288,6 +481,8 @@ cherokee_handler_fcgi_new (cherokee_handler_t **hdl, void *cnt, cherokee_module_
 	 */
 	n->post_phase = fcgi_post_phase_read;
 	n->src_ref    = NULL;
+	n->reused     = false;
+	n->ended      = false;
 
 	cherokee_socket_init (&n->socket);
 	cherokee_buffer_init (&n->write_buffer);
@@ -303,8 +498,24 @@ cherokee_handler_fcgi_new (cherokee_handler_t **hdl, void *cnt, cherokee_module_
 ret_t
 cherokee_handler_fcgi_free (cherokee_handler_fcgi_t *hdl)
 {
+	cherokee_handler_fcgi_props_t *props = HANDLER_FCGI_PROPS(hdl);
+	cherokee_connection_t         *conn  = HANDLER_CONN(hdl);
+
 	TRACE (ENTRIES, "fcgi handler free: %p\n", hdl);
 
+	/* Keep the connection to the application if the request
+	 * was fully completed: nothing else can arrive on it.
+	 */
+	if ((props->reuse_max > 0) &&
+	    (hdl->ended) &&
+	    (hdl->socket.socket >= 0) &&
+	    (cherokee_buffer_is_empty (&hdl->write_buffer)) &&
+	    ((! http_method_with_input (conn->header.method)) ||
+	     (cherokee_post_read_finished (&conn->post))))
+	{
+		poll_release (props, hdl->src_ref, &hdl->socket);
+	}
+
 	cherokee_socket_close (&hdl->socket);
 	cherokee_socket_mrproper (&hdl->socket);
 
@@ -328,11 +539,11 @@ fcgi_build_header (FCGI_Header *hdr, cuchar_t type, cushort_t request_id, cuint_
 }
 
 static void
-fcgi_build_request_body (FCGI_BeginRequestRecord *request)
+fcgi_build_request_body (FCGI_BeginRequestRecord *request, cherokee_boolean_t keep_conn)
 {
 	request->body.roleB0      = FCGI_RESPONDER;
 	request->body.roleB1      = 0;
-	request->body.flags       = 0;
+	request->body.flags       = (keep_conn) ? FCGI_KEEP_CONN : 0;
 	request->body.reserved[0] = 0;
 	request->body.reserved[1] = 0;
 	request->body.reserved[2] = 0;
@@ -498,7 +709,7 @@ build_header (cherokee_handler_fcgi_t *hdl, cherokee_buffer_t *buffer)
 	/* FCGI_BEGIN_REQUEST
 	 */
 	fcgi_build_header (&request.header, FCGI_BEGIN_REQUEST, 1, sizeof(request.body), 0);
-	fcgi_build_request_body (&request);
+	fcgi_build_request_body (&request, (HANDLER_FCGI_PROPS(hdl)->reuse_max > 0));
 
 	cherokee_buffer_add (buffer, (void *)&request, sizeof(FCGI_BeginRequestRecord));
 	TRACE (ENTRIES, "Added FCGI_BEGIN_REQUEST, len=%d\n", buffer->len);
@@ -541,6 +752,18 @@ connect_to_server (cherokee_handler_fcgi_t *hdl)
 			return ret;
 	}
 
+	/* Reuse a kept-alive connection
+	 */
+	if ((props->reuse_max > 0) &&
+	    (hdl->socket.socket < 0))
+	{
+		ret = poll_get (props, hdl->src_ref, &hdl->socket);
+		if (ret == ret_ok) {
+			hdl->reused = true;
+			return ret_ok;
+		}
+	}
+
 	/* Try to connect
 	 */
 	if (hdl->src_ref->type == source_host) {
@@ -742,10 +965,25 @@ cherokee_handler_fcgi_init (cherokee_handler_fcgi_t *hdl)
 		/* Send the header
 		 */
 		ret = do_send (hdl, &hdl->write_buffer);
+		if ((ret == ret_error) && (hdl->reused)) {
+			/* The application closed the kept-alive
+			 * connection before anything was sent on it.
+			 */
+			TRACE (ENTRIES, "Kept-alive fd=%d failed, reconnecting\n", hdl->socket.socket);
+
+			cherokee_socket_close (&hdl->socket);
+			hdl->reused      = false;
+			conn->error_code = http_ok;
+
+			HDL_CGI_BASE(hdl)->init_phase = hcgi_phase_connect;
+			return ret_eagain;
+		}
 		if (ret != ret_ok) {
 			return ret;
 		}
 
+		hdl->reused = false;
+
 		if (! cherokee_buffer_is_empty (&hdl->write_buffer)) {
 			return ret_eagain;
 		}
@@ -48,17 +48,40 @@ typedef struct {
 	cherokee_socket_t             socket;
 	cherokee_handler_fcgi_post_t  post_phase;
 	cherokee_buffer_t             write_buffer;
+	cherokee_boolean_t            reused;
+	cherokee_boolean_t            ended;
 } cherokee_handler_fcgi_t;
 
 #define HDL_FCGI(x)  ((cherokee_handler_fcgi_t *)(x))
 
 
+/* Kept-alive connections
+ */
+typedef struct {
+	cherokee_list_t              listed;
+	cherokee_source_t           *src_ref;
+	cherokee_list_t              reuse;
+	cuint_t                      reuse_len;
+} cherokee_handler_fcgi_poll_t;
+
+typedef struct {
+	cherokee_list_t              listed;
+	cherokee_socket_t            socket;
+} cherokee_handler_fcgi_pconn_t;
+
+#define FCGI_POLL(x)  ((cherokee_handler_fcgi_poll_t *)(x))
+#define FCGI_PCONN(x) ((cherokee_handler_fcgi_pconn_t *)(x))
+
+
 /* Properties
  */
 typedef struct {
 	cherokee_handler_cgi_base_t  base;
 	cherokee_list_t              server_list;
 	cherokee_balancer_t         *balancer;
+	cherokee_list_t              polls;
+	CHEROKEE_MUTEX_T            (polls_mutex);
+	cuint_t                      reuse_max;
 } cherokee_handler_fcgi_props_t;
 
 #define PROP_FCGI(x)          ((cherokee_handler_fcgi_props_t *)(x))
@@ -29,6 +29,8 @@
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
+#include <sys/time.h>
+#include <signal.h>
 
 #include "server.h"
 #include "server-protected.h"
@@ -43,21 +45,38 @@
 #include "iocache.h"
 #include "util.h"
 #include "handler_dirlist.h"
+#include "encoder_gzip.h"
+#include "crc32.h"
+#include "init.h"
 #include "error_log.h"
 
 #define ENTRIES "handler,file"
 
+#define GZIP_CACHE_LEVEL     Z_BEST_COMPRESSION
+#define GZIP_CACHE_MAX_SIZE  (4 * 1024 * 1024)
+#define GZIP_CACHE_DIR_SIZE  (64 * 1024 * 1024)
+#define GZIP_CACHE_BUILD_TIMEOUT  60  /* secs */
+#define GZIP_CACHE_QUEUE_MAX      64
+
 
 /* Plug-in initialization
  */
 PLUGIN_INFO_HANDLER_EASIEST_INIT (file, http_get | http_head | http_options);
 
+static void gzip_builder_get (void);
+static void gzip_builder_put (void);
+
 
 /* Methods implementation
  */
 ret_t
 cherokee_handler_file_props_free (cherokee_handler_file_props_t *props)
 {
+	if (props->gzip_cache) {
+		gzip_builder_put();
+	}
+
+	cherokee_buffer_mrproper (&props->gzip_cache_dir);
 	return cherokee_handler_props_free_base (HANDLER_PROPS(props));
 }
 
@@ -71,15 +90,20 @@ cherokee_handler_file_configure (cherokee_config_node_t   *conf,
 	cherokee_list_t               *i;
 	cherokee_handler_file_props_t *props;
 
-	UNUSED(srv);
-
 	if (*_props == NULL) {
 		CHEROKEE_NEW_STRUCT (n, handler_file_props);
 
 		cherokee_handler_props_init_base (HANDLER_PROPS(n),
 						  MODULE_PROPS_FREE(cherokee_handler_file_props_free));
 
-		n->use_cache = true;
+		n->use_cache           = true;
+		n->gzip_static         = false;
+		n->gzip_cache          = false;
+		n->gzip_cache_level    = GZIP_CACHE_LEVEL;
+		n->gzip_cache_max_size = GZIP_CACHE_MAX_SIZE;
+		n->gzip_cache_dir_size = GZIP_CACHE_DIR_SIZE;
+		cherokee_buffer_init (&n->gzip_cache_dir);
+
 		*_props = MODULE_PROPS(n);
 	}
 
@@ -91,9 +115,69 @@ cherokee_handler_file_configure (cherokee_config_node_t   *conf,
 		if (equal_buf_str (&subconf->key, "iocache")) {
 			ret = cherokee_atob (subconf->val.buf, &props->use_cache);
 			if (ret != ret_ok) return ret;
+
+		} else if (equal_buf_str (&subconf->key, "gzip_static")) {
+			ret = cherokee_atob (subconf->val.buf, &props->gzip_static);
+			if (ret != ret_ok) return ret;
+
+		} else if (equal_buf_str (&subconf->key, "gzip_cache")) {
+			ret = cherokee_atob (subconf->val.buf, &props->gzip_cache);
+			if (ret != ret_ok) return ret;
+
+		} else if (equal_buf_str (&subconf->key, "gzip_cache_level")) {
+			ret = cherokee_atoi (subconf->val.buf, &props->gzip_cache_level);
+			if (ret != ret_ok) return ret;
+
+			props->gzip_cache_level = MIN (MAX (props->gzip_cache_level, Z_BEST_SPEED), Z_BEST_COMPRESSION);
+
+		} else if (equal_buf_str (&subconf->key, "gzip_cache_max_size")) {
+			cint_t val;
+
+			ret = cherokee_atoi (subconf->val.buf, &val);
+			if (ret != ret_ok) return ret;
+
+			props->gzip_cache_max_size = MAX (val, 0);
+
+		} else if (equal_buf_str (&subconf->key, "gzip_cache_dir_size")) {
+			cint_t val;
+
+			ret = cherokee_atoi (subconf->val.buf, &val);
+			if (ret != ret_ok) return ret;
+
+			props->gzip_cache_dir_size = MAX (val, 0);
+
+		} else if (equal_buf_str (&subconf->key, "gzip_cache_dir")) {
+			cherokee_buffer_clean      (&props->gzip_cache_dir);
+			cherokee_buffer_add_buffer (&props->gzip_cache_dir, &subconf->val);
+		}
+	}
+
+	/* Compressed variants cache directory
+	 */
+	if ((props->gzip_cache) &&
+	    (cherokee_buffer_is_empty (&props->gzip_cache_dir)))
+	{
+		cherokee_buffer_add_buffer (&props->gzip_cache_dir, &cherokee_tmp_dir);
+		cherokee_buffer_add_str    (&props->gzip_cache_dir, "/gzip");
+	}
+
+	if (props->gzip_cache) {
+		ret = cherokee_mkdir_p_perm (&props->gzip_cache_dir, 0700, W_OK);
+		if (ret != ret_ok) {
+			LOG_ERROR (CHEROKEE_ERROR_HANDLER_FILE_GZIP_CACHE_DIR, props->gzip_cache_dir.buf);
+			props->gzip_cache = false;
+		} else if (srv->user != srv->user_orig) {
+			if (chown (props->gzip_cache_dir.buf, srv->user, srv->group) != 0) {
+				LOG_ERRNO (errno, cherokee_err_warning,
+					   CHEROKEE_ERROR_HANDLER_FILE_GZIP_CACHE_DIR, props->gzip_cache_dir.buf);
+			}
 		}
 	}
 
+	if (props->gzip_cache) {
+		gzip_builder_get();
+	}
+
 	return ret_ok;
 }
 
@@ -124,10 +208,14 @@ cherokee_handler_file_new (cherokee_handler_t     **hdl,
 	 */
 	n->fd             = -1;
 	n->offset         = 0;
+	n->io_entry       = NULL;
+	n->fd_shared      = NULL;
 	n->mime           = NULL;
 	n->info           = NULL;
+	n->info_cached    = false;
 	n->using_sendfile = false;
 	n->not_modified   = false;
+	n->gzip_variant   = false;
 
 	/* Return the object
 	 */
@@ -139,6 +227,17 @@ cherokee_handler_file_new (cherokee_handler_t     **hdl,
 ret_t
 cherokee_handler_file_free (cherokee_handler_file_t *fhdl)
 {
+	/* The descriptor might belong to the I/O cache
+	 */
+	if (fhdl->fd_shared != NULL) {
+		cherokee_iocache_fd_unref (&fhdl->fd_shared);
+		fhdl->fd = -1;
+	}
+
+	if (fhdl->io_entry != NULL) {
+		cherokee_iocache_entry_unref (&fhdl->io_entry);
+	}
+
 	if (fhdl->fd != -1) {
 		cherokee_fd_close (fhdl->fd);
 		fhdl->fd = -1;
@@ -374,8 +473,17 @@ stat_local_directory (cherokee_handler_file_t   *fhdl,
 		switch (ret) {
 		case ret_ok:
 		case ret_ok_and_sent:
-			*info = &(*io_entry)->state;
-			return (*io_entry)->state_ret;
+			/* A copy of its own: the entry might be updated
+			 * by other threads in the meanwhile.
+			 */
+			CHEROKEE_MUTEX_LOCK (CACHE_ENTRY(*io_entry)->mutex);
+			memcpy (&fhdl->cache_info, &(*io_entry)->state, sizeof(struct stat));
+			ret = (*io_entry)->state_ret;
+			CHEROKEE_MUTEX_UNLOCK (CACHE_ENTRY(*io_entry)->mutex);
+
+			*info = &fhdl->cache_info;
+			fhdl->info_cached = true;
+			return ret;
 
 		case ret_no_sys:
 			goto without;
@@ -420,12 +528,1025 @@ without:
 }
 
 
+static void
+lookup_mime (cherokee_handler_file_t  *fhdl,
+	     cherokee_buffer_t        *local_file,
+	     cherokee_iocache_entry_t *io_entry)
+{
+	ret_t              ret;
+	char              *ext;
+	cherokee_server_t *srv = HANDLER_SRV(fhdl);
+
+	if (srv->mime == NULL)
+		return;
+
+	/* The I/O cache entry might remember it
+	 */
+	if (io_entry != NULL) {
+		CHEROKEE_MUTEX_LOCK (CACHE_ENTRY(io_entry)->mutex);
+
+		if (io_entry->headers.mime_known) {
+			fhdl->mime = io_entry->headers.mime;
+			CHEROKEE_MUTEX_UNLOCK (CACHE_ENTRY(io_entry)->mutex);
+			return;
+		}
+	}
+
+	ext = (local_file->buf + local_file->len) - 1;
+	while (ext > local_file->buf) {
+		if (*ext == '.') {
+			ret = cherokee_mime_get_by_suffix (srv->mime, ext+1, &fhdl->mime);
+			if (ret == ret_ok)
+				break;
+		}
+		ext--;
+	}
+
+	if (io_entry != NULL) {
+		io_entry->headers.mime       = fhdl->mime;
+		io_entry->headers.mime_known = true;
+
+		CHEROKEE_MUTEX_UNLOCK (CACHE_ENTRY(io_entry)->mutex);
+	}
+}
+
+
+static ret_t
+open_cached_fd (cherokee_handler_file_t   *fhdl,
+		cherokee_buffer_t         *local_file,
+		cherokee_iocache_entry_t **io_entry)
+{
+	ret_t                  ret;
+	cherokee_connection_t *conn = HANDLER_CONN(fhdl);
+	cherokee_server_t     *srv  = HANDLER_SRV(fhdl);
+
+	/* Files that will be sent through sendfile() share the file
+	 * descriptors kept open by the I/O cache. Transfers do not
+	 * depend on the file position: they use explicit offsets.
+	 */
+#ifdef WITH_SENDFILE
+	if ((srv->iocache == NULL) ||
+	    (srv->iocache->max_fds == 0) ||
+	    (! HDL_FILE_PROP(fhdl)->use_cache) ||
+	    (conn->encoder_new_func != NULL) ||
+	    (conn->socket.is_tls != non_TLS) ||
+	    (conn->flcache.mode != flcache_mode_undef) ||
+	    (fhdl->info->st_size < srv->sendfile.min) ||
+	    (fhdl->info->st_size >= srv->sendfile.max))
+	{
+		return ret_not_found;
+	}
+
+	ret = cherokee_iocache_autoget (srv->iocache, local_file, iocache_fd, io_entry);
+	TRACE (ENTRIES, "%s, cached fd lookup ret=%d\n", local_file->buf, ret);
+
+	if ((ret != ret_ok) && (ret != ret_ok_and_sent)) {
+		return ret_not_found;
+	}
+
+	/* It holds a reference until the handler is freed, along with
+	 * the information of the file it was opened for.
+	 */
+	ret = cherokee_iocache_entry_get_fd (*io_entry, &fhdl->fd_shared, &fhdl->cache_info);
+	if (ret != ret_ok) {
+		return ret_not_found;
+	}
+
+	fhdl->fd          = fhdl->fd_shared->fd;
+	fhdl->info        = &fhdl->cache_info;
+	fhdl->info_cached = true;
+
+	return ret_ok;
+#else
+	UNUSED(fhdl);
+	UNUSED(local_file);
+	UNUSED(io_entry);
+
+	return ret_not_found;
+#endif
+}
+
+
+/* Compressed variants
+ */
+static cherokee_boolean_t
+is_user_agent_IE_16 (cherokee_connection_t *conn)
+{
+	ret_t     ret;
+	char     *m;
+	char     *ref     = NULL;
+	cuint_t   ref_len = 0;
+
+	ret = cherokee_header_get_known (&conn->header, header_user_agent, &ref, &ref_len);
+	if ((ret != ret_ok) || (ref == NULL) || (ref_len <= 7)) {
+		return false;
+	}
+
+	m = strncasestrn_s (ref, ref_len, "MSIE ");
+	if (m == NULL) {
+		return false;
+	}
+
+	return ((m[5] >= '1') && (m[5] <= '6'));
+}
+
+
+static cherokee_boolean_t
+gzip_is_selected (cherokee_handler_file_t *fhdl)
+{
+	ret_t                  ret;
+	void                  *props = NULL;
+	cherokee_connection_t *conn  = HANDLER_CONN(fhdl);
+
+	/* The gzip encoder has to be the one picked for the request
+	 */
+	if ((conn->encoder_props == NULL) ||
+	    (conn->config_entry.encoders == NULL))
+	{
+		return false;
+	}
+
+	ret = cherokee_avl_get_ptr (conn->config_entry.encoders, "gzip", &props);
+	if ((ret != ret_ok) || (props != (void *) conn->encoder_props)) {
+		return false;
+	}
+
+	/* Same exception the encoder makes
+	 */
+	if ((PROP_GZIP(props)->disable_old_IE) &&
+	    (is_user_agent_IE_16 (conn)))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+static ret_t
+write_all (int fd, const char *buf, size_t len)
+{
+	ssize_t re;
+
+	while (len > 0) {
+		re = write (fd, buf, len);
+		if (re < 0) {
+			if (errno == EINTR)
+				continue;
+			return ret_error;
+		}
+
+		buf += re;
+		len -= re;
+	}
+
+	return ret_ok;
+}
+
+
+static ret_t
+gzip_compress_fd (int fd_in, int fd_out, int level)
+{
+	int       err;
+	ssize_t   got;
+	char      footer[8];
+	crc_t     crc       = 0;
+	uLong     size      = 0;
+	ret_t     ret       = ret_error;
+	void     *workspace = NULL;
+	char     *in        = NULL;
+	char     *out       = NULL;
+	z_stream  z;
+
+	static const unsigned char header[10] = {0x1F, 0x8B, Z_DEFLATED, 0, 0, 0, 0, 0, 0, 3};
+
+	workspace = malloc (zlib_deflate_workspacesize());
+	in        = malloc (DEFAULT_READ_SIZE);
+	out       = malloc (DEFAULT_READ_SIZE);
+
+	if (unlikely ((workspace == NULL) || (in == NULL) || (out == NULL))) {
+		goto out;
+	}
+
+	memset (&z, 0, sizeof(z_stream));
+	z.workspace = workspace;
+
+	err = zlib_deflateInit2 (&z, level, Z_DEFLATED, -MAX_WBITS, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+	if (err != Z_OK) {
+		goto out;
+	}
+
+	ret = write_all (fd_out, (const char *)header, sizeof(header));
+	if (ret != ret_ok) {
+		goto end;
+	}
+
+	/* Compress the whole file in a single stream: no
+	 * intermediate flushes, unlike the streaming encoder.
+	 */
+	do {
+		do {
+			got = read (fd_in, in, DEFAULT_READ_SIZE);
+		} while ((got < 0) && (errno == EINTR));
+
+		if (got < 0) {
+			ret = ret_error;
+			goto end;
+		}
+
+		crc   = crc32_partial_sz (crc, in, got);
+		size += got;
+
+		z.next_in  = (Byte *)in;
+		z.avail_in = got;
+
+		do {
+			z.next_out  = (Byte *)out;
+			z.avail_out = DEFAULT_READ_SIZE;
+
+			err = zlib_deflate (&z, (got > 0) ? Z_NO_FLUSH : Z_FINISH);
+			if ((err != Z_OK) && (err != Z_STREAM_END)) {
+				ret = ret_error;
+				goto end;
+			}
+
+			ret = write_all (fd_out, out, DEFAULT_READ_SIZE - z.avail_out);
+			if (ret != ret_ok) {
+				goto end;
+			}
+		} while (z.avail_out == 0);
+
+	} while (got > 0);
+
+	/* CRC32 and ISIZE
+	 */
+	footer[0] = (char)  crc        & 0xFF;
+	footer[1] = (char) (crc >> 8)  & 0xFF;
+	footer[2] = (char) (crc >> 16) & 0xFF;
+	footer[3] = (char) (crc >> 24) & 0xFF;
+	footer[4] = (char)  size       & 0xFF;
+	footer[5] = (char) (size >> 8) & 0xFF;
+	footer[6] = (char) (size >> 16)& 0xFF;
+	footer[7] = (char) (size >> 24)& 0xFF;
+
+	ret = write_all (fd_out, footer, 8);
+
+end:
+	zlib_deflateEnd (&z);
+out:
+	free (workspace);
+	free (in);
+	free (out);
+	return ret;
+}
+
+
+/* Compressed copies
+ *
+ * The copies are built by a thread of their own, away from the
+ * worker threads: requests are served by the streaming encoder
+ * until the copy is ready. The thread keeps track of the copies of
+ * each directory, oldest first, and of their total size, so the
+ * directory does not have to be scanned again after each build.
+ */
+
+typedef struct {
+	cherokee_list_t    listed;
+	cherokee_buffer_t  name;
+	off_t              size;
+} gzip_cache_file_t;
+
+typedef struct {
+	cherokee_list_t    listed;
+	cherokee_buffer_t  path;
+	cherokee_list_t    files;
+	cherokee_avl_t     names;
+	off_t              total;
+} gzip_cache_dir_t;
+
+typedef struct {
+	cherokee_list_t    listed;
+	cherokee_buffer_t  source;
+	cherokee_buffer_t  path;
+	cherokee_buffer_t  dir;
+	time_t             mtime;
+	off_t              size;
+	cint_t             level;
+	off_t              dir_size;
+} gzip_cache_job_t;
+
+static struct {
+	cherokee_list_t    queue;
+	cuint_t            queue_len;
+	cherokee_list_t    dirs;
+	cuint_t            users;
+	CHEROKEE_MUTEX_T  (mutex);
+#ifdef HAVE_PTHREAD
+	pthread_cond_t     cond;
+	pthread_t          thread;
+#endif
+	cherokee_boolean_t running;
+	pid_t              pid;
+	cherokee_boolean_t exiting;
+} gzip_builder;
+
+
+static cherokee_boolean_t
+gzip_cache_is_fresh (int          fd,
+		     struct stat *st,
+		     time_t       mtime,
+		     off_t        size)
+{
+	ssize_t       re;
+	unsigned char isize[4];
+	cuint_t       gz_size;
+
+	if ((fstat (fd, st) != 0) ||
+	    (st->st_mtime != mtime) ||
+	    (st->st_size  <  18))
+	{
+		return false;
+	}
+
+	/* The gzip trailer ends with the source size, modulo 2^32
+	 */
+	do {
+		re = pread (fd, isize, 4, st->st_size - 4);
+	} while ((re < 0) && (errno == EINTR));
+
+	if (re != 4) {
+		return false;
+	}
+
+	gz_size = ((cuint_t) isize[0])       |
+		  ((cuint_t) isize[1] << 8)  |
+		  ((cuint_t) isize[2] << 16) |
+		  ((cuint_t) isize[3] << 24);
+
+	return (gz_size == (cuint_t) (size & 0xFFFFFFFF));
+}
+
+
+static void
+gzip_cache_job_free (gzip_cache_job_t *job)
+{
+	cherokee_buffer_mrproper (&job->source);
+	cherokee_buffer_mrproper (&job->path);
+	cherokee_buffer_mrproper (&job->dir);
+	free (job);
+}
+
+
+static void
+gzip_cache_file_free (void *param)
+{
+	gzip_cache_file_t *file = param;
+
+	cherokee_buffer_mrproper (&file->name);
+	free (file);
+}
+
+
+static void
+gzip_cache_dir_free (gzip_cache_dir_t *dir)
+{
+	cherokee_list_t *i, *j;
+
+	list_for_each_safe (i, j, &dir->files) {
+		cherokee_list_del (i);
+		gzip_cache_file_free (i);
+	}
+
+	cherokee_avl_mrproper (AVL_GENERIC(&dir->names), NULL);
+	cherokee_buffer_mrproper (&dir->path);
+	free (dir);
+}
+
+
+static void
+gzip_cache_dir_account (gzip_cache_dir_t *dir,
+			const char       *name,
+			off_t             size)
+{
+	ret_t              ret;
+	gzip_cache_file_t *file = NULL;
+	cherokee_buffer_t  key  = CHEROKEE_BUF_INIT;
+
+	cherokee_buffer_fake (&key, name, strlen(name));
+
+	/* A newer copy of a file that was there already
+	 */
+	ret = cherokee_avl_get (&dir->names, &key, (void **)&file);
+	if (ret == ret_ok) {
+		dir->total -= file->size;
+		cherokee_list_del (&file->listed);
+	} else {
+		file = (gzip_cache_file_t *) malloc (sizeof(gzip_cache_file_t));
+		if (unlikely (file == NULL))
+			return;
+
+		cherokee_buffer_init (&file->name);
+		cherokee_buffer_add  (&file->name, name, key.len);
+		cherokee_avl_add (&dir->names, &file->name, file);
+	}
+
+	file->size  = size;
+	dir->total += size;
+	cherokee_list_add_tail (&file->listed, &dir->files);
+}
+
+
+typedef struct {
+	char   *name;
+	off_t   size;
+	time_t  ctime;
+} gzip_cache_scan_t;
+
+static int
+gzip_cache_scan_cmp (const void *a, const void *b)
+{
+	time_t ta = ((const gzip_cache_scan_t *)a)->ctime;
+	time_t tb = ((const gzip_cache_scan_t *)b)->ctime;
+
+	return (ta > tb) - (ta < tb);
+}
+
+static void
+gzip_cache_dir_scan (gzip_cache_dir_t *dir)
+{
+	int                re;
+	DIR               *dirp;
+	struct dirent     *entry;
+	char               entry_buf[512];
+	struct stat        st;
+	cuint_t            n;
+	cuint_t            num   = 0;
+	cuint_t            size  = 0;
+	gzip_cache_scan_t *files = NULL;
+	gzip_cache_scan_t *tmp;
+	cherokee_buffer_t  path  = CHEROKEE_BUF_INIT;
+
+	dirp = cherokee_opendir (dir->path.buf);
+	if (dirp == NULL)
+		return;
+
+	/* Copies left by former runs
+	 */
+	while (true) {
+		re = cherokee_readdir (dirp, (struct dirent *)entry_buf, &entry);
+		if ((re != 0) || (entry == NULL))
+			break;
+
+		n = strlen (entry->d_name);
+		if ((n < 4) || (strcmp (entry->d_name + n - 3, ".gz") != 0))
+			continue;
+
+		cherokee_buffer_clean      (&path);
+		cherokee_buffer_add_buffer (&path, &dir->path);
+		cherokee_buffer_add_char   (&path, '/');
+		cherokee_buffer_add        (&path, entry->d_name, n);
+
+		if ((cherokee_stat (path.buf, &st) != 0) || (! S_ISREG (st.st_mode)))
+			continue;
+
+		if (num >= size) {
+			size = (size == 0) ? 64 : size * 2;
+			tmp  = (gzip_cache_scan_t *) realloc (files, size * sizeof(gzip_cache_scan_t));
+			if (unlikely (tmp == NULL))
+				break;
+			files = tmp;
+		}
+
+		files[num].name  = strdup (entry->d_name);
+		files[num].size  = st.st_size;
+		files[num].ctime = st.st_ctime;
+
+		if (unlikely (files[num].name == NULL))
+			break;
+
+		num++;
+	}
+
+	cherokee_closedir (dirp);
+
+	/* Oldest first
+	 */
+	if (num > 0) {
+		qsort (files, num, sizeof(gzip_cache_scan_t), gzip_cache_scan_cmp);
+	}
+
+	for (n = 0; n < num; n++) {
+		gzip_cache_dir_account (dir, files[n].name, files[n].size);
+		free (files[n].name);
+	}
+
+	free (files);
+	cherokee_buffer_mrproper (&path);
+}
+
+
+static gzip_cache_dir_t *
+gzip_cache_dir_get (cherokee_buffer_t *path)
+{
+	cherokee_list_t  *i;
+	gzip_cache_dir_t *dir;
+
+	list_for_each (i, &gzip_builder.dirs) {
+		dir = (gzip_cache_dir_t *) i;
+		if (cherokee_buffer_cmp_buf (&dir->path, path) == 0)
+			return dir;
+	}
+
+	/* First copy stored in it
+	 */
+	dir = (gzip_cache_dir_t *) malloc (sizeof(gzip_cache_dir_t));
+	if (unlikely (dir == NULL))
+		return NULL;
+
+	INIT_LIST_HEAD (&dir->files);
+	cherokee_avl_init (&dir->names);
+	cherokee_buffer_init (&dir->path);
+	cherokee_buffer_add_buffer (&dir->path, path);
+	dir->total = 0;
+
+	gzip_cache_dir_scan (dir);
+
+	cherokee_list_add (&dir->listed, &gzip_builder.dirs);
+	return dir;
+}
+
+
+static void
+gzip_cache_trim (gzip_cache_job_t *job)
+{
+	gzip_cache_dir_t  *dir;
+	gzip_cache_file_t *file;
+	cherokee_buffer_t  path = CHEROKEE_BUF_INIT;
+
+	dir = gzip_cache_dir_get (&job->dir);
+	if (dir == NULL)
+		return;
+
+	/* Account the new copy, and remove the oldest ones until
+	 * they all fit
+	 */
+	gzip_cache_dir_account (dir, job->path.buf + job->dir.len + 1, job->size);
+
+	if (job->dir_size <= 0)
+		return;
+
+	while ((dir->total > job->dir_size) &&
+	       (dir->files.next != dir->files.prev))
+	{
+		file = (gzip_cache_file_t *) dir->files.next;
+
+		cherokee_buffer_clean      (&path);
+		cherokee_buffer_add_buffer (&path, &dir->path);
+		cherokee_buffer_add_char   (&path, '/');
+		cherokee_buffer_add_buffer (&path, &file->name);
+
+		TRACE (ENTRIES, "Trimming the compressed copies: %s\n", path.buf);
+		unlink (path.buf);
+
+		dir->total -= file->size;
+		cherokee_list_del (&file->listed);
+		cherokee_avl_del (&dir->names, &file->name, NULL);
+		gzip_cache_file_free (file);
+	}
+
+	cherokee_buffer_mrproper (&path);
+}
+
+
+static ret_t
+gzip_cache_build (gzip_cache_job_t *job)
+{
+	ret_t              ret;
+	int                fd_in  = -1;
+	int                fd_out = -1;
+	struct stat        st;
+	struct timeval     times[2];
+	cherokee_buffer_t  tmp    = CHEROKEE_BUF_INIT;
+
+	/* The source might have changed after it was queued, or the
+	 * copy might have been stored by a former job
+	 */
+	fd_in = cherokee_open (job->source.buf, O_RDONLY | O_BINARY, 0);
+	if (fd_in < 0) {
+		return ret_not_found;
+	}
+
+	if ((fstat (fd_in, &st) != 0) ||
+	    (st.st_mtime != job->mtime) ||
+	    (st.st_size  != job->size))
+	{
+		cherokee_fd_close (fd_in);
+		return ret_not_found;
+	}
+
+	fd_out = cherokee_open (job->path.buf, O_RDONLY | O_BINARY, 0);
+	if (fd_out >= 0) {
+		ret = gzip_cache_is_fresh (fd_out, &st, job->mtime, job->size) ? ret_ok : ret_not_found;
+		cherokee_fd_close (fd_out);
+
+		if (ret == ret_ok) {
+			cherokee_fd_close (fd_in);
+			return ret_ok;
+		}
+	}
+
+	/* The private copy is the build lock too: concurrent
+	 * builds, i.e. of other processes, do not compress it
+	 * again. Requests never see a partial file.
+	 */
+	cherokee_buffer_add_buffer (&tmp, &job->path);
+	cherokee_buffer_add_str    (&tmp, ".tmp");
+
+	fd_out = open (tmp.buf, O_WRONLY | O_CREAT | O_EXCL | O_BINARY, 0600);
+	if ((fd_out < 0) && (errno == EEXIST)) {
+		/* Left behind by a build that did not finish
+		 */
+		if ((cherokee_stat (tmp.buf, &st) == 0) &&
+		    (st.st_mtime + GZIP_CACHE_BUILD_TIMEOUT < cherokee_bogonow_now))
+		{
+			unlink (tmp.buf);
+			fd_out = open (tmp.buf, O_WRONLY | O_CREAT | O_EXCL | O_BINARY, 0600);
+		}
+
+		if (fd_out < 0) {
+			TRACE (ENTRIES, "Compressed copy being built: %s\n", job->path.buf);
+			cherokee_fd_close (fd_in);
+			cherokee_buffer_mrproper (&tmp);
+			return ret_eagain;
+		}
+	}
+
+	if (fd_out < 0) {
+		goto error;
+	}
+
+	ret = gzip_compress_fd (fd_in, fd_out, job->level);
+	cherokee_fd_close (fd_out);
+
+	if (ret != ret_ok) {
+		goto error;
+	}
+
+	/* The modification time identifies the source version
+	 */
+	times[0].tv_sec  = job->mtime;
+	times[0].tv_usec = 0;
+	times[1].tv_sec  = job->mtime;
+	times[1].tv_usec = 0;
+
+	if ((utimes (tmp.buf, times) != 0) ||
+	    (cherokee_stat (tmp.buf, &st) != 0) ||
+	    (rename (tmp.buf, job->path.buf) != 0))
+	{
+		goto error;
+	}
+
+	TRACE (ENTRIES, "Compressed copy stored: %s\n", job->path.buf);
+
+	cherokee_fd_close (fd_in);
+	cherokee_buffer_mrproper (&tmp);
+
+	/* Keep the directory within its size limit
+	 */
+	job->size = st.st_size;
+	gzip_cache_trim (job);
+
+	return ret_ok;
+
+error:
+	LOG_ERRNO (errno, cherokee_err_warning,
+		   CHEROKEE_ERROR_HANDLER_FILE_GZIP_CACHE_WRITE, tmp.buf);
+
+	unlink (tmp.buf);
+	cherokee_fd_close (fd_in);
+	cherokee_buffer_mrproper (&tmp);
+	return ret_error;
+}
+
+
+#ifdef HAVE_PTHREAD
+static NORETURN void *
+gzip_builder_routine (void *param)
+{
+	gzip_cache_job_t *job;
+
+	UNUSED (param);
+
+	CHEROKEE_MUTEX_LOCK (&gzip_builder.mutex);
+
+	while (! gzip_builder.exiting) {
+		if (cherokee_list_empty (&gzip_builder.queue)) {
+			pthread_cond_wait (&gzip_builder.cond, &gzip_builder.mutex);
+			continue;
+		}
+
+		job = (gzip_cache_job_t *) gzip_builder.queue.next;
+		cherokee_list_del (&job->listed);
+		gzip_builder.queue_len -= 1;
+		CHEROKEE_MUTEX_UNLOCK (&gzip_builder.mutex);
+
+		gzip_cache_build (job);
+		gzip_cache_job_free (job);
+
+		CHEROKEE_MUTEX_LOCK (&gzip_builder.mutex);
+	}
+
+	CHEROKEE_MUTEX_UNLOCK (&gzip_builder.mutex);
+	pthread_exit (NULL);
+}
+
+
+static ret_t
+gzip_builder_launch (void)
+{
+	ret_t ret;
+
+	ret = cherokee_thread_create_nosignals (&gzip_builder.thread, gzip_builder_routine, NULL);
+	if (ret != ret_ok) {
+		return ret_error;
+	}
+
+	gzip_builder.running = true;
+	gzip_builder.pid     = getpid();
+	return ret_ok;
+}
+#endif
+
+
+/* Hands the copy over to the builder thread. The request is served
+ * by the streaming encoder in the meanwhile.
+ */
+static void
+gzip_builder_queue (gzip_cache_job_t *job)
+{
+#ifdef HAVE_PTHREAD
+	ret_t            ret;
+	cherokee_list_t *i, *j;
+
+	CHEROKEE_MUTEX_LOCK (&gzip_builder.mutex);
+
+	/* The thread does not survive a fork()
+	 */
+	if ((gzip_builder.running) &&
+	    (gzip_builder.pid != getpid()))
+	{
+		gzip_builder.running = false;
+	}
+
+	if (! gzip_builder.running) {
+		ret = gzip_builder_launch();
+		if (ret != ret_ok) {
+			goto drop;
+		}
+	}
+
+	/* Queued already, or too busy
+	 */
+	if (gzip_builder.queue_len >= GZIP_CACHE_QUEUE_MAX) {
+		goto drop;
+	}
+
+	list_for_each_safe (i, j, &gzip_builder.queue) {
+		if (cherokee_buffer_cmp_buf (&((gzip_cache_job_t *) i)->path, &job->path) == 0) {
+			goto drop;
+		}
+	}
+
+	TRACE (ENTRIES, "Compressed copy queued: %s\n", job->path.buf);
+
+	cherokee_list_add_tail (&job->listed, &gzip_builder.queue);
+	gzip_builder.queue_len += 1;
+	pthread_cond_signal (&gzip_builder.cond);
+
+	CHEROKEE_MUTEX_UNLOCK (&gzip_builder.mutex);
+	return;
+
+drop:
+	CHEROKEE_MUTEX_UNLOCK (&gzip_builder.mutex);
+	gzip_cache_job_free (job);
+#else
+	/* No threads: it is built right away
+	 */
+	gzip_cache_build (job);
+	gzip_cache_job_free (job);
+#endif
+}
+
+
+static void
+gzip_builder_get (void)
+{
+	if (gzip_builder.users++ > 0)
+		return;
+
+	INIT_LIST_HEAD (&gzip_builder.queue);
+	INIT_LIST_HEAD (&gzip_builder.dirs);
+	CHEROKEE_MUTEX_INIT (&gzip_builder.mutex, CHEROKEE_MUTEX_FAST);
+#ifdef HAVE_PTHREAD
+	pthread_cond_init (&gzip_builder.cond, NULL);
+#endif
+
+	gzip_builder.queue_len = 0;
+	gzip_builder.running   = false;
+	gzip_builder.pid       = 0;
+	gzip_builder.exiting   = false;
+}
+
+
+static void
+gzip_builder_put (void)
+{
+	cherokee_list_t *i, *j;
+
+	if (--gzip_builder.users > 0)
+		return;
+
+#ifdef HAVE_PTHREAD
+	CHEROKEE_MUTEX_LOCK (&gzip_builder.mutex);
+	gzip_builder.exiting = true;
+	pthread_cond_broadcast (&gzip_builder.cond);
+	CHEROKEE_MUTEX_UNLOCK (&gzip_builder.mutex);
+
+	if ((gzip_builder.running) &&
+	    (gzip_builder.pid == getpid()))
+	{
+		pthread_join (gzip_builder.thread, NULL);
+	}
+
+	pthread_cond_destroy (&gzip_builder.cond);
+#endif
+	CHEROKEE_MUTEX_DESTROY (&gzip_builder.mutex);
+
+	list_for_each_safe (i, j, &gzip_builder.queue) {
+		cherokee_list_del (i);
+		gzip_cache_job_free ((gzip_cache_job_t *) i);
+	}
+
+	list_for_each_safe (i, j, &gzip_builder.dirs) {
+		cherokee_list_del (i);
+		gzip_cache_dir_free ((gzip_cache_dir_t *) i);
+	}
+}
+
+
+static int
+open_gzip_cache (cherokee_handler_file_t *fhdl,
+		 cherokee_buffer_t       *local_file,
+		 cherokee_buffer_t       *path,
+		 struct stat             *st)
+{
+	int                            fd;
+	gzip_cache_job_t              *job;
+	cherokee_buffer_t              key   = CHEROKEE_BUF_INIT;
+	cherokee_handler_file_props_t *props = HDL_FILE_PROP(fhdl);
+
+	/* Entry name: hash of path, encoder and level. The source
+	 * modification time is kept as the mtime of the entry, and
+	 * its size is in the gzip trailer.
+	 */
+	cherokee_buffer_add_buffer (&key, local_file);
+	cherokee_buffer_add_str    (&key, "\ngzip\n");
+	cherokee_buffer_add_long10 (&key, props->gzip_cache_level);
+	cherokee_buffer_encode_md5_digest (&key);
+
+	cherokee_buffer_clean      (path);
+	cherokee_buffer_add_buffer (path, &props->gzip_cache_dir);
+	cherokee_buffer_add_str    (path, "/");
+	cherokee_buffer_add_buffer (path, &key);
+	cherokee_buffer_add_str    (path, ".gz");
+	cherokee_buffer_mrproper   (&key);
+
+	fd = cherokee_open (path->buf, O_RDONLY | O_BINARY, 0);
+	if (fd >= 0) {
+		if (gzip_cache_is_fresh (fd, st, fhdl->info->st_mtime, fhdl->info->st_size)) {
+			return fd;
+		}
+		cherokee_fd_close (fd);
+	}
+
+	/* Have it compressed in the background
+	 */
+	job = (gzip_cache_job_t *) malloc (sizeof(gzip_cache_job_t));
+	if (unlikely (job == NULL)) {
+		return -1;
+	}
+
+	cherokee_buffer_init (&job->source);
+	cherokee_buffer_init (&job->path);
+	cherokee_buffer_init (&job->dir);
+
+	cherokee_buffer_add_buffer (&job->source, local_file);
+	cherokee_buffer_add_buffer (&job->path,   path);
+	cherokee_buffer_add_buffer (&job->dir,    &props->gzip_cache_dir);
+
+	job->mtime    = fhdl->info->st_mtime;
+	job->size     = fhdl->info->st_size;
+	job->level    = props->gzip_cache_level;
+	job->dir_size = props->gzip_cache_dir_size;
+
+	gzip_builder_queue (job);
+
+#ifdef HAVE_PTHREAD
+	return -1;
+#else
+	fd = cherokee_open (path->buf, O_RDONLY | O_BINARY, 0);
+	if ((fd >= 0) && (! gzip_cache_is_fresh (fd, st, fhdl->info->st_mtime, fhdl->info->st_size))) {
+		cherokee_fd_close (fd);
+		fd = -1;
+	}
+
+	return fd;
+#endif
+}
+
+
+static ret_t
+open_gzip_variant (cherokee_handler_file_t *fhdl,
+		   cherokee_buffer_t       *local_file)
+{
+	int                            fd    = -1;
+	struct stat                    st;
+	cherokee_buffer_t              path  = CHEROKEE_BUF_INIT;
+	cherokee_connection_t         *conn  = HANDLER_CONN(fhdl);
+	cherokee_handler_file_props_t *props = HDL_FILE_PROP(fhdl);
+
+	if ((! props->gzip_static) && (! props->gzip_cache))
+		return ret_not_found;
+
+	if ((conn->flcache.mode != flcache_mode_undef) ||
+	    (! S_ISREG (fhdl->info->st_mode)) ||
+	    (! gzip_is_selected (fhdl)))
+	{
+		return ret_not_found;
+	}
+
+	/* A precompressed sibling: file.gz, not older than file
+	 */
+	if (props->gzip_static) {
+		cherokee_buffer_add_buffer (&path, local_file);
+		cherokee_buffer_add_str    (&path, ".gz");
+
+		fd = cherokee_open (path.buf, O_RDONLY | O_BINARY, 0);
+		if (fd >= 0) {
+			if ((fstat (fd, &st) != 0) ||
+			    (! S_ISREG (st.st_mode)) ||
+			    (st.st_mtime < fhdl->info->st_mtime))
+			{
+				cherokee_fd_close (fd);
+				fd = -1;
+			}
+		}
+	}
+
+	/* Otherwise, a copy compressed by the server
+	 */
+	if ((fd < 0) &&
+	    (props->gzip_cache) &&
+	    (fhdl->info->st_size > 0) &&
+	    (fhdl->info->st_size <= props->gzip_cache_max_size) &&
+	    (http_method_with_body (conn->header.method)))
+	{
+		fd = open_gzip_cache (fhdl, local_file, &path, &st);
+	}
+
+	TRACE (ENTRIES, "%s, gzip variant: %s\n", local_file->buf, (fd >= 0) ? path.buf : "none");
+	cherokee_buffer_mrproper (&path);
+
+	if (fd < 0) {
+		return ret_not_found;
+	}
+
+	cherokee_fd_set_closexec (fd);
+
+	/* Serve the variant: its own size (and so, ETag), while
+	 * keeping the modification time of the source file.
+	 */
+	st.st_mtime        = fhdl->info->st_mtime;
+	fhdl->cache_info   = st;
+	fhdl->info         = &fhdl->cache_info;
+	fhdl->info_cached  = false;
+	fhdl->fd           = fd;
+	fhdl->gzip_variant = true;
+
+	/* No streaming compression
+	 */
+	conn->encoder_new_func = NULL;
+	conn->encoder_props    = NULL;
+
+	return ret_ok;
+}
+
+
 ret_t
 cherokee_handler_file_custom_init (cherokee_handler_file_t *fhdl,
 				   cherokee_buffer_t       *local_file)
 {
 	ret_t                     ret;
-	char                     *ext;
 	cherokee_iocache_entry_t *io_entry = NULL;
 	cherokee_boolean_t        use_io   = false;
 	cherokee_connection_t    *conn     = HANDLER_CONN(fhdl);
@@ -455,17 +1576,11 @@ cherokee_handler_file_custom_init (cherokee_handler_file_t *fhdl,
 
 	/* Look for the mime type
 	 */
-	if (srv->mime != NULL) {
-		ext = (local_file->buf + local_file->len) - 1;
-		while (ext > local_file->buf) {
-			if (*ext == '.') {
-				ret = cherokee_mime_get_by_suffix (srv->mime, ext+1, &fhdl->mime);
-				if (ret == ret_ok)
-					break;
-			}
-			ext--;
-		}
-	}
+	lookup_mime (fhdl, local_file, io_entry);
+
+	/* Maybe serve a compressed variant of the file
+	 */
+	open_gzip_variant (fhdl, local_file);
 
 	/* Is it cached on the client?
 	 */
@@ -481,6 +1596,7 @@ cherokee_handler_file_custom_init (cherokee_handler_file_t *fhdl,
 	/* Is this file cached in the io cache?
 	 */
 	use_io = ((srv->iocache != NULL) &&
+		  (! fhdl->gzip_variant) &&
 		  (conn->encoder_new_func == NULL) &&
 		  (HDL_FILE_PROP(fhdl)->use_cache) &&
 		  (conn->socket.is_tls == non_TLS) &&
@@ -528,10 +1644,13 @@ cherokee_handler_file_custom_init (cherokee_handler_file_t *fhdl,
 
 	/* Maybe open the file
 	 */
-	if (! use_io) {
-		ret = open_local_directory (fhdl, local_file);
+	if ((! use_io) && (! fhdl->gzip_variant)) {
+		ret = open_cached_fd (fhdl, local_file, &io_entry);
 		if (ret != ret_ok) {
-			goto out;
+			ret = open_local_directory (fhdl, local_file);
+			if (ret != ret_ok) {
+				goto out;
+			}
 		}
 	}
 
@@ -605,15 +1724,10 @@ cherokee_handler_file_custom_init (cherokee_handler_file_t *fhdl,
 		conn->mmaped     = ((char *)io_entry->mmaped) + conn->range_start;
 		conn->mmaped_len = len;
 	} else {
-		/* Does no longer care about the io_entry
-		 */
-		cherokee_iocache_entry_unref (&io_entry);
-
-		/* Seek the file if needed
+		/* Set the file offset if needed
 		 */
 		if ((conn->range_start != 0) && (conn->mmaped == NULL)) {
 			fhdl->offset = conn->range_start;
-			lseek (fhdl->fd, fhdl->offset, SEEK_SET);
 		}
 	}
 
@@ -634,10 +1748,28 @@ cherokee_handler_file_custom_init (cherokee_handler_file_t *fhdl,
 	}
 #endif
 
-	return ret_ok;
+	ret = ret_ok;
 
 out:
-	cherokee_iocache_entry_unref (&io_entry);
+	/* The handler holds the I/O cache entry until it is freed: the
+	 * response headers and the file descriptor might come from it.
+	 */
+	if ((ret == ret_ok) &&
+	    (io_entry != NULL) &&
+	    (conn->io_entry_ref != io_entry))
+	{
+		if (fhdl->io_entry != NULL) {
+			cherokee_iocache_entry_unref (&fhdl->io_entry);
+		}
+
+		fhdl->io_entry = io_entry;
+		return ret_ok;
+	}
+
+	if (conn->io_entry_ref != io_entry) {
+		cherokee_iocache_entry_unref (&io_entry);
+	}
+
 	return ret;
 }
 
@@ -666,32 +1798,21 @@ cherokee_handler_file_init (cherokee_handler_file_t *fhdl)
 }
 
 
-ret_t
-cherokee_handler_file_add_headers (cherokee_handler_file_t *fhdl,
-				   cherokee_buffer_t       *buffer)
+static void
+build_static_headers (cherokee_handler_file_t *fhdl,
+		      cherokee_boolean_t       with_etag,
+		      cherokee_buffer_t       *buffer,
+		      cuint_t                 *etag_len)
 {
-	ret_t                  ret;
 	char                   bufstr[DTM_SIZE_GMTTM_STR];
 	struct tm              modified_tm;
 	size_t                 szlen          = 0;
-	off_t                  content_length = 0;
-	cherokee_connection_t *conn           = HANDLER_CONN(fhdl);
-
-	/* OPTIONS request
-	 */
-	if (unlikely (HANDLER_CONN(fhdl)->header.method == http_options)) {
-		cherokee_buffer_add_str (buffer, "Content-Length: 0"CRLF);
-		cherokee_handler_add_header_options (HANDLER(fhdl), buffer);
-		return ret_ok;
-	}
 
-	/* Regular request
-	 */
 	memset (&modified_tm, 0, sizeof(struct tm));
 
 	/* ETag: "<etag>"
 	 */
-	if (conn->header.version >= http_version_11) {
+	if (with_etag) {
 		/* ETag: "%lx= FMT_OFFSET_HEX" CRLF
 		 */
 		cherokee_buffer_add_str     (buffer, "ETag: \"");
@@ -701,6 +1822,10 @@ cherokee_handler_file_add_headers (cherokee_handler_file_t *fhdl,
 		cherokee_buffer_add_str     (buffer, "\"" CRLF);
 	}
 
+	if (etag_len != NULL) {
+		*etag_len = buffer->len;
+	}
+
 	/* Last-Modified:
 	 */
 	cherokee_gmtime (&fhdl->info->st_mtime, &modified_tm);
@@ -711,17 +1836,98 @@ cherokee_handler_file_add_headers (cherokee_handler_file_t *fhdl,
 	cherokee_buffer_add    (buffer, bufstr, szlen);
 	cherokee_buffer_add_str(buffer, CRLF);
 
-	/* Add MIME related headers:
-	 * "Content-Type:" and "Cache-Control: max-age="
+	/* Content-Type:
 	 */
 	if (fhdl->mime != NULL) {
-		cuint_t            maxage;
-		cherokee_buffer_t *mime   = NULL;
+		cherokee_buffer_t *mime = NULL;
 
 		cherokee_mime_entry_get_type (fhdl->mime, &mime);
 		cherokee_buffer_add_str    (buffer, "Content-Type: ");
 		cherokee_buffer_add_buffer (buffer, mime);
 		cherokee_buffer_add_str    (buffer, CRLF);
+	}
+}
+
+static void
+add_static_headers (cherokee_handler_file_t *fhdl,
+		    cherokee_buffer_t       *buffer)
+{
+	cuint_t                   skip;
+	cherokee_connection_t    *conn     = HANDLER_CONN(fhdl);
+	cherokee_iocache_entry_t *io_entry = fhdl->io_entry;
+	cherokee_boolean_t        with_etag = (conn->header.version >= http_version_11);
+
+	if (io_entry == NULL) {
+		io_entry = conn->io_entry_ref;
+	}
+
+	/* The information did not come from the I/O cache
+	 */
+	if ((io_entry == NULL) ||
+	    (! fhdl->info_cached))
+	{
+		build_static_headers (fhdl, with_etag, buffer, NULL);
+		return;
+	}
+
+	/* Reuse the headers kept by the I/O cache entry, as long as
+	 * they were built for the same file version and MIME type.
+	 */
+	CHEROKEE_MUTEX_LOCK (CACHE_ENTRY(io_entry)->mutex);
+
+	if ((cherokee_buffer_is_empty (&io_entry->headers.buf)) ||
+	    (io_entry->headers.mime  != fhdl->mime)             ||
+	    (io_entry->headers.mtime != fhdl->info->st_mtime)   ||
+	    (io_entry->headers.size  != fhdl->info->st_size))
+	{
+		cherokee_buffer_clean (&io_entry->headers.buf);
+		build_static_headers (fhdl, true, &io_entry->headers.buf, &io_entry->headers.etag_len);
+
+		io_entry->headers.mime  = fhdl->mime;
+		io_entry->headers.mtime = fhdl->info->st_mtime;
+		io_entry->headers.size  = fhdl->info->st_size;
+	}
+
+	skip = (with_etag) ? 0 : io_entry->headers.etag_len;
+	cherokee_buffer_add (buffer,
+			     io_entry->headers.buf.buf + skip,
+			     io_entry->headers.buf.len - skip);
+
+	CHEROKEE_MUTEX_UNLOCK (CACHE_ENTRY(io_entry)->mutex);
+}
+
+
+ret_t
+cherokee_handler_file_add_headers (cherokee_handler_file_t *fhdl,
+				   cherokee_buffer_t       *buffer)
+{
+	ret_t                  ret;
+	off_t                  content_length = 0;
+	cherokee_connection_t *conn           = HANDLER_CONN(fhdl);
+
+	/* OPTIONS request
+	 */
+	if (unlikely (HANDLER_CONN(fhdl)->header.method == http_options)) {
+		cherokee_buffer_add_str (buffer, "Content-Length: 0"CRLF);
+		cherokee_handler_add_header_options (HANDLER(fhdl), buffer);
+		return ret_ok;
+	}
+
+	/* Regular request: ETag, Last-Modified and Content-Type
+	 */
+	add_static_headers (fhdl, buffer);
+
+	/* Compressed variant
+	 */
+	if (fhdl->gzip_variant) {
+		cherokee_buffer_add_str (buffer, "Content-Encoding: gzip"CRLF);
+		cherokee_buffer_add_str (buffer, "Vary: Accept-Encoding"CRLF);
+	}
+
+	/* Expiration: "Cache-Control: max-age="
+	 */
+	if (fhdl->mime != NULL) {
+		cuint_t maxage;
 
 		ret = cherokee_mime_entry_get_maxage (fhdl->mime, &maxage);
 		if (ret == ret_ok) {
@@ -857,10 +2063,11 @@ exit_sendfile:
 	 */
 	cherokee_buffer_ensure_size (buffer, size + 1);
 
-	/* Read
+	/* Read: the descriptor might be shared, so the offset is
+	 * always explicit.
 	 */
 	do {
-		total = read (fhdl->fd, buffer->buf, size);
+		total = pread (fhdl->fd, buffer->buf, size, fhdl->offset);
 	} while ((total == -1) && (errno == EINTR));
 
 	switch (total) {
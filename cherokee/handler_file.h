@@ -36,6 +36,7 @@
 #include "handler.h"
 #include "connection.h"
 #include "mime.h"
+#include "iocache.h"
 #include "plugin_loader.h"
 
 /* Data types
@@ -43,20 +44,30 @@
 typedef struct {
 	cherokee_handler_props_t base;
 	cherokee_boolean_t       use_cache;
+	cherokee_boolean_t       gzip_static;
+	cherokee_boolean_t       gzip_cache;
+	cint_t                   gzip_cache_level;
+	off_t                    gzip_cache_max_size;
+	off_t                    gzip_cache_dir_size;
+	cherokee_buffer_t        gzip_cache_dir;
 } cherokee_handler_file_props_t;
 
 
 typedef struct {
-	cherokee_handler_t     handler;
-
-	int                    fd;
-	off_t                  offset;
-	struct stat           *info;
-	cherokee_mime_entry_t *mime;
-	struct stat            cache_info;
-
-	cherokee_boolean_t     using_sendfile;
-	cherokee_boolean_t     not_modified;
+	cherokee_handler_t        handler;
+
+	int                       fd;
+	off_t                     offset;
+	cherokee_iocache_entry_t *io_entry;
+	cherokee_iocache_fd_t    *fd_shared;
+	struct stat              *info;
+	cherokee_boolean_t        info_cached;
+	cherokee_mime_entry_t    *mime;
+	struct stat               cache_info;
+
+	cherokee_boolean_t        using_sendfile;
+	cherokee_boolean_t        not_modified;
+	cherokee_boolean_t        gzip_variant;
 } cherokee_handler_file_t;
 
 
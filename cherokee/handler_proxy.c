@@ -34,6 +34,7 @@
 
 #define DEFAULT_BUF_SIZE  (64*1024)  /* 64Kb */
 #define DEFAULT_REUSE_MAX 16
+#define SPLICE_MIN_SIZE   (64*1024)  /* 64Kb */
 
 /* Plug-in initialization
  */
@@ -122,6 +123,7 @@ cherokee_handler_proxy_configure (cherokee_config_node_t   *conf,
 
 		n->balancer            = NULL;
 		n->reuse_max           = DEFAULT_REUSE_MAX;
+		n->reuse_min           = 0;
 		n->in_allow_keepalive  = true;
 		n->in_preserve_host    = false;
 		n->out_preserve_server = false;
@@ -160,6 +162,11 @@ cherokee_handler_proxy_configure (cherokee_config_node_t   *conf,
 			if (ret != ret_ok) return ret;
 			props->reuse_max = val;
 
+		} else if (equal_buf_str (&subconf->key, "reuse_min")) {
+			ret = cherokee_atoi (subconf->val.buf, &val);
+			if (ret != ret_ok) return ret;
+			props->reuse_min = val;
+
 		} else if (equal_buf_str (&subconf->key, "vserver_errors")) {
 			ret = cherokee_atob (subconf->val.buf, &props->vserver_errors);
 			if (ret != ret_ok) return ret;
@@ -245,6 +252,17 @@ cherokee_handler_proxy_configure (cherokee_config_node_t   *conf,
 		return ret_error;
 	}
 
+	/* Connection polls of the balanced sources
+	 */
+	list_for_each (i, &props->balancer->entries) {
+		ret = cherokee_handler_proxy_hosts_add (&props->hosts,
+							BAL_ENTRY(i)->source,
+							props->reuse_max,
+							props->reuse_min);
+		if (ret != ret_ok)
+			return ret;
+	}
+
 	return ret_ok;
 }
 
@@ -262,9 +280,9 @@ replace_againt_regex_list (cherokee_buffer_t *in_buf,
 	list_for_each (i, regexs) {
 		regex_entry = REGEX_ENTRY(i);
 
-		re = pcre_exec (regex_entry->re, NULL,
-				in_buf->buf, in_buf->len, 0, 0,
-				ovector, OVECTOR_LEN);
+		re = cherokee_regex_exec (regex_entry->re,
+					  in_buf->buf, in_buf->len,
+					  ovector, OVECTOR_LEN);
 		if (re == 0) {
 			LOG_ERROR_S (CHEROKEE_ERROR_HANDLER_REGEX_GROUPS);
 		}
@@ -684,6 +702,60 @@ send_post_reset (cherokee_handler_proxy_t *hdl)
 	return ret_ok;
 }
 
+static ret_t
+send_post_splice (cherokee_handler_proxy_t *hdl)
+{
+	ret_t                     ret;
+	cherokee_socket_status_t  blocking = socket_closed;
+	cherokee_boolean_t        did_IO   = false;
+	cherokee_connection_t    *conn     = HANDLER_CONN(hdl);
+
+	ret = cherokee_post_send_splice (&conn->post, &conn->socket,
+					 hdl->pconn->socket.socket,
+					 &hdl->pconn->post.buf_temp,
+					 &blocking, &did_IO);
+	if (did_IO) {
+		cherokee_connection_update_timeout (conn);
+	}
+
+	switch (ret) {
+	case ret_ok:
+		TRACE(ENTRIES, "POST has been spliced completely: %s\n", "ok");
+		return ret_ok;
+
+	case ret_eagain:
+		if (blocking == socket_reading) {
+			ret = cherokee_thread_deactive_to_polling (HANDLER_THREAD(hdl), conn,
+								   conn->socket.socket,
+								   FDPOLL_MODE_READ, false);
+		} else if (blocking == socket_writing) {
+			ret = cherokee_thread_deactive_to_polling (HANDLER_THREAD(hdl), conn,
+								   hdl->pconn->socket.socket,
+								   FDPOLL_MODE_WRITE, false);
+		} else {
+			return ret_eagain;
+		}
+
+		if (ret != ret_ok) {
+			hdl->pconn->keepalive_in = false;
+			conn->error_code = http_bad_gateway;
+			return ret_error;
+		}
+		return ret_eagain;
+
+	case ret_no_sys:
+		/* Whatever was in the pipe is in the buffer now
+		 */
+		if (! cherokee_buffer_is_empty (&hdl->pconn->post.buf_temp)) {
+			return ret_eagain;
+		}
+		return ret_no_sys;
+
+	default:
+		return ret;
+	}
+}
+
 static ret_t
 send_post (cherokee_handler_proxy_t *hdl)
 {
@@ -808,6 +880,18 @@ send_post (cherokee_handler_proxy_t *hdl)
 		/* fall down: read*/
 	}
 
+	/* Send: Spliced
+	 */
+	if ((! hdl->pconn->post.do_buf_sent) &&
+	    (cherokee_buffer_is_empty (buffer)) &&
+	    (hdl->pconn->socket.is_tls != TLS))
+	{
+		ret = send_post_splice (hdl);
+		if (ret != ret_no_sys) {
+			return ret;
+		}
+	}
+
 	/* Has it finished?
 	 */
 	if (cherokee_post_read_finished (&conn->post)) {
@@ -877,6 +961,7 @@ ret_t
 cherokee_handler_proxy_init (cherokee_handler_proxy_t *hdl)
 {
 	ret_t                           ret;
+	int                             fd    = -1;
 	cherokee_handler_proxy_poll_t  *poll;
 	cherokee_connection_t          *conn  = HANDLER_CONN(hdl);
 	cherokee_handler_proxy_props_t *props = HDL_PROXY_PROPS(hdl);
@@ -912,8 +997,7 @@ cherokee_handler_proxy_init (cherokee_handler_proxy_t *hdl)
 
 		/* Get the connection poll
 		 */
-		ret = cherokee_handler_proxy_hosts_get (&props->hosts, hdl->src_ref,
-							&poll, props->reuse_max);
+		ret = cherokee_handler_proxy_hosts_get (&props->hosts, hdl->src_ref, &poll);
 		if (unlikely (ret != ret_ok)) {
 			conn->error_code = http_service_unavailable;
 			return ret_error;
@@ -931,15 +1015,33 @@ cherokee_handler_proxy_init (cherokee_handler_proxy_t *hdl)
 		hdl->init_phase = proxy_init_preconnect;
 		TRACE(ENTRIES, "Entering phase '%s'\n", "preconnect");
 
-		/* Get the addrinfo object */
-		if (hdl->pconn->addr_info_ref == NULL) {
-			ret = cherokee_handler_proxy_conn_get_addrinfo (hdl->pconn, hdl->src_ref);
-			if (ret != ret_ok) {
+	case proxy_init_preconnect:
+		/* Get the addrinfo object. It is looked up again
+		 * whenever a new connection is about to be opened,
+		 * respins included. The current address is kept if
+		 * the list did not change.
+		 */
+		if ((hdl->pconn->addr_info_ref == NULL) ||
+		    (hdl->respinned) ||
+		    (! cherokee_socket_configured (&hdl->pconn->socket)))
+		{
+			ret = cherokee_handler_proxy_conn_get_addrinfo (hdl->pconn, hdl->src_ref, &fd);
+			switch (ret) {
+			case ret_ok:
+				break;
+			case ret_eagain:
+				ret = cherokee_thread_deactive_to_polling (HANDLER_THREAD(hdl), conn, fd,
+									   FDPOLL_MODE_READ, true);
+				if (ret != ret_ok) {
+					return ret_error;
+				}
+				return ret_eagain;
+			default:
+				conn->error_code = http_service_unavailable;
 				return ret_error;
 			}
 		}
 
-	case proxy_init_preconnect:
 		/* Configure if respinned
 		 */
 		if (hdl->respinned) {
@@ -1651,6 +1753,135 @@ check_chunked (cherokee_handler_proxy_t *hdl,
 }
 
 
+static void
+splice_init (cherokee_handler_proxy_t *hdl)
+{
+	int                    re;
+	cherokee_connection_t *conn = HANDLER_CONN(hdl);
+
+	hdl->splice = proxy_splice_off;
+
+	/* The body must reach the client untouched: no TLS, no
+	 * encoders, no chunked encoding and no front-line cache
+	 * storing a copy of it.
+	 */
+	if ((conn->socket.is_tls != non_TLS) ||
+	    (hdl->pconn->socket.is_tls != non_TLS) ||
+	    (conn->encoder != NULL) ||
+	    (conn->chunked_encoding) ||
+	    (conn->flcache.mode == flcache_mode_in))
+	{
+		return;
+	}
+
+	/* It is not worth it for small replies
+	 */
+	if ((hdl->pconn->enc == pconn_enc_known_size) &&
+	    (hdl->pconn->size_in - hdl->pconn->sent_out < SPLICE_MIN_SIZE))
+	{
+		return;
+	}
+
+	re = pipe (hdl->splice_pipe);
+	if (unlikely (re != 0)) {
+		hdl->splice_pipe[0] = -1;
+		hdl->splice_pipe[1] = -1;
+		return;
+	}
+
+	cherokee_fd_set_closexec (hdl->splice_pipe[0]);
+	cherokee_fd_set_closexec (hdl->splice_pipe[1]);
+
+	TRACE (ENTRIES, "Relaying body through splice(), pipe=%d,%d\n",
+	       hdl->splice_pipe[0], hdl->splice_pipe[1]);
+
+	hdl->splice = proxy_splice_on;
+}
+
+
+static ret_t
+splice_step (cherokee_handler_proxy_t *hdl)
+{
+	ret_t                  ret;
+	size_t                 size    = 0;
+	size_t                 to_read = DEFAULT_BUF_SIZE;
+	cherokee_connection_t *conn    = HANDLER_CONN(hdl);
+
+	/* Back-end to pipe
+	 */
+	if (hdl->splice_len == 0) {
+		if (hdl->pconn->enc == pconn_enc_known_size) {
+			to_read = MIN (to_read, hdl->pconn->size_in - hdl->pconn->sent_out);
+		}
+
+		if ((conn->limit_bps > 0) &&
+		    (conn->limit_bps < to_read))
+		{
+			to_read = conn->limit_bps;
+		}
+
+		ret = cherokee_socket_splice_in (&hdl->pconn->socket,
+						 hdl->splice_pipe[1], to_read, &size);
+		switch (ret) {
+		case ret_ok:
+			break;
+		case ret_no_sys:
+			/* Fall back to the buffered relay */
+			hdl->splice = proxy_splice_off;
+			return ret_no_sys;
+		case ret_eof:
+		case ret_error:
+			hdl->pconn->keepalive_in = false;
+			return ret;
+		case ret_eagain:
+			cherokee_thread_deactive_to_polling (HANDLER_THREAD(hdl),
+							     HANDLER_CONN(hdl),
+							     hdl->pconn->socket.socket,
+							     FDPOLL_MODE_READ, false);
+			return ret_eagain;
+		default:
+			RET_UNKNOWN(ret);
+			return ret_error;
+		}
+
+		hdl->pconn->sent_out += size;
+		hdl->splice_len       = size;
+	}
+
+	/* Pipe to client
+	 */
+	ret = cherokee_socket_splice_out (&conn->socket, hdl->splice_pipe[0],
+					  hdl->splice_len, &size);
+	switch (ret) {
+	case ret_ok:
+		break;
+	case ret_eagain:
+		return ret_eagain;
+	default:
+		/* The pipe content cannot be recovered */
+		hdl->pconn->keepalive_in = false;
+		return ret_error;
+	}
+
+	hdl->splice_len -= size;
+
+	/* This connection is not using cherokee_connection_send(),
+	 * so the traffic counter has to be updated here.
+	 */
+	cherokee_connection_tx_add (conn, size);
+
+	if ((hdl->splice_len == 0) &&
+	    (hdl->pconn->enc == pconn_enc_known_size) &&
+	    (hdl->pconn->sent_out >= hdl->pconn->size_in))
+	{
+		hdl->got_all = true;
+		return ret_eof;
+	}
+
+	return ret_ok_and_sent;
+}
+
+
 ret_t
 cherokee_handler_proxy_step (cherokee_handler_proxy_t *hdl,
 			     cherokee_buffer_t        *buf)
@@ -1690,6 +1921,19 @@ cherokee_handler_proxy_step (cherokee_handler_proxy_t *hdl,
 			return ret_eof;
 		}
 
+		/* Relay it straight from socket to socket
+		 */
+		if (hdl->splice == proxy_splice_undef) {
+			splice_init (hdl);
+		}
+
+		if (hdl->splice == proxy_splice_on) {
+			ret = splice_step (hdl);
+			if (ret != ret_no_sys) {
+				return ret;
+			}
+		}
+
 		/* Read
 		 */
 		ret = cherokee_socket_bufread (&hdl->pconn->socket, buf,
@@ -1859,6 +2103,10 @@ cherokee_handler_proxy_new (cherokee_handler_t     **hdl,
 	n->respinned      = false;
 	n->got_all        = false;
 	n->resending_post = false;
+	n->splice         = proxy_splice_undef;
+	n->splice_pipe[0] = -1;
+	n->splice_pipe[1] = -1;
+	n->splice_len     = 0;
 
 	cherokee_buffer_init (&n->tmp);
 	cherokee_buffer_init (&n->request);
@@ -1897,6 +2145,11 @@ cherokee_handler_proxy_free (cherokee_handler_proxy_t *hdl)
 	cherokee_buffer_mrproper (&hdl->buffer);
 	cherokee_buffer_mrproper (&hdl->request);
 
+	if (hdl->splice_pipe[0] != -1) {
+		cherokee_fd_close (hdl->splice_pipe[0]);
+		cherokee_fd_close (hdl->splice_pipe[1]);
+	}
+
 	if (hdl->pconn != NULL) {
 		if (! hdl->got_all) {
 			hdl->pconn->keepalive_in = false;
@@ -49,11 +49,18 @@ typedef enum {
 	proxy_init_read_header
 } cherokee_handler_proxy_init_phase_t;
 
+typedef enum {
+	proxy_splice_undef,
+	proxy_splice_on,
+	proxy_splice_off
+} cherokee_handler_proxy_splice_t;
+
 typedef struct {
 	cherokee_handler_props_t        base;
 	cherokee_balancer_t            *balancer;
 	cherokee_handler_proxy_hosts_t  hosts;
 	cuint_t                         reuse_max;
+	cuint_t                         reuse_min;
 	cherokee_boolean_t              vserver_errors;
 
 	/* Request processing */
@@ -82,6 +89,11 @@ typedef struct {
 	cherokee_boolean_t              got_all;
 	cherokee_boolean_t              resending_post;
 
+	/* Zero-copy relay of the reply body */
+	cherokee_handler_proxy_splice_t splice;
+	int                             splice_pipe[2];
+	size_t                          splice_len;
+
 	cherokee_handler_proxy_init_phase_t  init_phase;
 } cherokee_handler_proxy_t;
 
@@ -31,6 +31,7 @@
 #endif
 
 #include "util.h"
+#include "init.h"
 #include "connection.h"
 #include "connection-protected.h"
 #include "server.h"
@@ -174,7 +175,13 @@
 "      fetches: 'Fetches',"                                                                         CRLF\
 "      hits: 'Hits',"                                                                               CRLF\
 "      misses: 'Misses', "                                                                          CRLF\
-"      mmapped_formatted: 'Total Mapped' "                                                          CRLF\
+"      mmapped_formatted: 'Total Mapped', "                                                         CRLF\
+"      fds_max: 'Descriptors: Max',"                                                                CRLF\
+"      fds_open: 'Descriptors: Open',"                                                              CRLF\
+"      fds_hits: 'Descriptors: Hits',"                                                              CRLF\
+"      fds_misses: 'Descriptors: Misses',"                                                          CRLF\
+"      fds_evictions: 'Descriptors: Evictions',"                                                    CRLF\
+"      fds_pressure: 'Descriptors: System limit usage'"                                             CRLF\
 "    }"                                                                                             CRLF\
 "  }"                                                                                               CRLF\
 "}"                                                                                                 CRLF\
@@ -661,6 +668,9 @@ add_iocache (cherokee_dwriter_t *writer,
 	     cherokee_server_t  *srv)
 {
 	float               percent;
+	cuint_t             count;
+	cuint_t             count_hit;
+	cuint_t             count_miss;
 	size_t              mmaped  = 0;
 	cherokee_buffer_t   tmp_buf = CHEROKEE_BUF_INIT;
 	cherokee_iocache_t *iocache = srv->iocache;
@@ -696,22 +706,24 @@ add_iocache (cherokee_dwriter_t *writer,
 	cherokee_dwriter_cstring (writer, "size_max");
 	cherokee_dwriter_integer (writer, CACHE(iocache)->max_size);
 
+	cherokee_cache_get_counters (CACHE(iocache), &count, &count_hit, &count_miss);
+
 	cherokee_dwriter_cstring (writer, "fetches");
-	cherokee_dwriter_integer (writer, CACHE(iocache)->count);
+	cherokee_dwriter_integer (writer, count);
 
 	/* Fetches */
-	if (CACHE(iocache)->count == 0)
+	if (count == 0)
 		percent = 0;
 	else
-		percent = (CACHE(iocache)->count_hit * 100.0) / CACHE(iocache)->count;
+		percent = (count_hit * 100.0) / count;
 	cherokee_dwriter_cstring (writer, "hits");
 	cherokee_dwriter_double  (writer, percent);
 
 	/* Misses */
-	if (CACHE(iocache)->count == 0)
+	if (count == 0)
 		percent = 0;
 	else
-		percent = (CACHE(iocache)->count_miss * 100.0) / CACHE(iocache)->count;
+		percent = (count_miss * 100.0) / count;
 	cherokee_dwriter_cstring (writer, "misses");
 	cherokee_dwriter_double  (writer, percent);
 
@@ -725,6 +737,25 @@ add_iocache (cherokee_dwriter_t *writer,
 	cherokee_dwriter_cstring (writer, "mmaped_formatted");
 	cherokee_dwriter_bstring (writer, &tmp_buf);
 
+	/* Open file descriptors */
+	cherokee_dwriter_cstring (writer, "fds_max");
+	cherokee_dwriter_integer (writer, iocache->max_fds);
+	cherokee_dwriter_cstring (writer, "fds_open");
+	cherokee_dwriter_integer (writer, iocache->fds.open);
+	cherokee_dwriter_cstring (writer, "fds_hits");
+	cherokee_dwriter_integer (writer, iocache->fds.hits);
+	cherokee_dwriter_cstring (writer, "fds_misses");
+	cherokee_dwriter_integer (writer, iocache->fds.misses);
+	cherokee_dwriter_cstring (writer, "fds_evictions");
+	cherokee_dwriter_integer (writer, iocache->fds.evictions);
+
+	if (cherokee_fdlimit == 0)
+		percent = 0;
+	else
+		percent = (iocache->fds.open * 100.0) / cherokee_fdlimit;
+	cherokee_dwriter_cstring (writer, "fds_pressure");
+	cherokee_dwriter_double  (writer, percent);
+
 	cherokee_dwriter_dict_close (writer);
 	cherokee_buffer_mrproper (&tmp_buf);
 }
@@ -0,0 +1,260 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/* Cherokee
+ *
+ * Authors:
+ *      Alvaro Lopez Ortega <alvaro@alobbs.com>
+ *
+ * Copyright (C) 2001-2011 Alvaro Lopez Ortega
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+
+#include "common-internal.h"
+#include "hashtable.h"
+
+#define ENTRIES "hashtable"
+
+#define INITIAL_BITS  4
+
+/* Fibonacci hashing: the slot is taken from the top bits of the
+ * product, so it depends on every bit of the hash.
+ */
+#define HOME(ht,hash) \
+	((cuint_t)(((crc_t)(hash) * 2654435769U) >> (32 - (ht)->bits)))
+
+#define NEXT(ht,n)    (((n) + 1) & ((ht)->size - 1))
+
+
+static ret_t
+slots_alloc (cherokee_hashtable_t *ht, cuint_t bits)
+{
+	ht->slots = (cherokee_hashtable_slot_t *) calloc (1 << bits, sizeof(cherokee_hashtable_slot_t));
+	if (unlikely (ht->slots == NULL))
+		return ret_nomem;
+
+	ht->bits = bits;
+	ht->size = 1 << bits;
+	ht->len  = 0;
+
+	return ret_ok;
+}
+
+static void
+slot_set (cherokee_hashtable_t *ht, crc_t hash, void *value)
+{
+	cuint_t n = HOME (ht, hash);
+
+	while (ht->slots[n].value != NULL) {
+		n = NEXT (ht, n);
+	}
+
+	ht->slots[n].hash  = hash;
+	ht->slots[n].value = value;
+	ht->len           += 1;
+}
+
+static ret_t
+grow (cherokee_hashtable_t *ht)
+{
+	ret_t                      ret;
+	cuint_t                    n;
+	cuint_t                    old_size  = ht->size;
+	cherokee_hashtable_slot_t *old_slots = ht->slots;
+
+	ret = slots_alloc (ht, ht->bits + 1);
+	if (unlikely (ret != ret_ok)) {
+		ht->slots = old_slots;
+		return ret;
+	}
+
+	for (n = 0; n < old_size; n++) {
+		if (old_slots[n].value != NULL) {
+			slot_set (ht, old_slots[n].hash, old_slots[n].value);
+		}
+	}
+
+	free (old_slots);
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_hashtable_init (cherokee_hashtable_t *ht)
+{
+	return slots_alloc (ht, INITIAL_BITS);
+}
+
+
+ret_t
+cherokee_hashtable_mrproper (cherokee_hashtable_t *ht,
+			     cherokee_func_free_t  free_value)
+{
+	cuint_t n;
+
+	if (ht->slots == NULL)
+		return ret_ok;
+
+	if (free_value != NULL) {
+		for (n = 0; n < ht->size; n++) {
+			if (ht->slots[n].value != NULL) {
+				free_value (ht->slots[n].value);
+			}
+		}
+	}
+
+	free (ht->slots);
+	ht->slots = NULL;
+	ht->len   = 0;
+
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_hashtable_add (cherokee_hashtable_t *ht,
+			crc_t                 hash,
+			void                 *value)
+{
+	ret_t ret;
+
+	if (unlikely (value == NULL))
+		return ret_error;
+
+	/* Keep the load factor under 3/4
+	 */
+	if ((ht->len + 1) * 4 > ht->size * 3) {
+		ret = grow (ht);
+		if (unlikely (ret != ret_ok))
+			return ret;
+	}
+
+	slot_set (ht, hash, value);
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_hashtable_get (cherokee_hashtable_t            *ht,
+			crc_t                            hash,
+			cherokee_hashtable_match_func_t  match,
+			void                            *param,
+			void                           **value)
+{
+	cuint_t n = HOME (ht, hash);
+
+	while (ht->slots[n].value != NULL) {
+		if ((ht->slots[n].hash == hash) &&
+		    (match (ht->slots[n].value, param)))
+		{
+			if (value)
+				*value = ht->slots[n].value;
+			return ret_ok;
+		}
+
+		n = NEXT (ht, n);
+	}
+
+	return ret_not_found;
+}
+
+
+ret_t
+cherokee_hashtable_del (cherokee_hashtable_t *ht,
+			crc_t                 hash,
+			void                 *value)
+{
+	cuint_t i;
+	cuint_t j;
+	cuint_t home;
+
+	/* Find the slot
+	 */
+	i = HOME (ht, hash);
+
+	while (ht->slots[i].value != value) {
+		if (ht->slots[i].value == NULL)
+			return ret_not_found;
+
+		i = NEXT (ht, i);
+	}
+
+	/* Backward shift: pull back the entries of the probe
+	 * sequence that would become unreachable otherwise.
+	 */
+	j = i;
+	while (true) {
+		ht->slots[i].value = NULL;
+
+		while (true) {
+			j = NEXT (ht, j);
+			if (ht->slots[j].value == NULL) {
+				ht->len -= 1;
+				return ret_ok;
+			}
+
+			/* Can slot 'j' be moved to 'i'? It can unless
+			 * its home is cyclically within (i, j].
+			 */
+			home = HOME (ht, ht->slots[j].hash);
+
+			if (i <= j) {
+				if ((i < home) && (home <= j))
+					continue;
+			} else {
+				if ((i < home) || (home <= j))
+					continue;
+			}
+
+			break;
+		}
+
+		ht->slots[i] = ht->slots[j];
+		i = j;
+	}
+
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_hashtable_while (cherokee_hashtable_t            *ht,
+			  cherokee_hashtable_while_func_t  func,
+			  void                            *param)
+{
+	ret_t   ret;
+	cuint_t n;
+
+	for (n = 0; n < ht->size; n++) {
+		if (ht->slots[n].value == NULL)
+			continue;
+
+		ret = func (ht->slots[n].value, param);
+		if (ret != ret_ok)
+			return ret;
+	}
+
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_hashtable_len (cherokee_hashtable_t *ht,
+			size_t               *len)
+{
+	*len = ht->len;
+	return ret_ok;
+}
@@ -0,0 +1,77 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/* Cherokee
+ *
+ * Authors:
+ *      Alvaro Lopez Ortega <alvaro@alobbs.com>
+ *
+ * Copyright (C) 2001-2011 Alvaro Lopez Ortega
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#if !defined (CHEROKEE_INSIDE_CHEROKEE_H) && !defined (CHEROKEE_COMPILATION)
+# error "Only <cherokee/cherokee.h> can be included directly, this file may disappear or change contents."
+#endif
+
+#ifndef CHEROKEE_HASHTABLE_H
+#define CHEROKEE_HASHTABLE_H
+
+#include <cherokee/common.h>
+
+CHEROKEE_BEGIN_DECLS
+
+/* Open addressing (linear probing) hash table. It does not store
+ * keys: the callers provide the hash of the key, and a function to
+ * match the stored values against the key. Several values might be
+ * stored under the same key.
+ */
+typedef struct {
+	crc_t  hash;
+	void  *value;
+} cherokee_hashtable_slot_t;
+
+typedef struct {
+	cherokee_hashtable_slot_t *slots;
+	cuint_t                    size;
+	cuint_t                    bits;
+	cuint_t                    len;
+} cherokee_hashtable_t;
+
+typedef int   (* cherokee_hashtable_match_func_t) (void *value, void *param);
+typedef ret_t (* cherokee_hashtable_while_func_t) (void *value, void *param);
+
+#define HASHTABLE(h) ((cherokee_hashtable_t *)(h))
+
+ret_t cherokee_hashtable_init     (cherokee_hashtable_t *ht);
+ret_t cherokee_hashtable_mrproper (cherokee_hashtable_t *ht, cherokee_func_free_t free_value);
+
+ret_t cherokee_hashtable_add      (cherokee_hashtable_t *ht, crc_t hash, void *value);
+ret_t cherokee_hashtable_del      (cherokee_hashtable_t *ht, crc_t hash, void *value);
+ret_t cherokee_hashtable_get      (cherokee_hashtable_t            *ht,
+				   crc_t                            hash,
+				   cherokee_hashtable_match_func_t  match,
+				   void                            *param,
+				   void                           **value);
+
+ret_t cherokee_hashtable_while    (cherokee_hashtable_t            *ht,
+				   cherokee_hashtable_while_func_t  func,
+				   void                            *param);
+
+ret_t cherokee_hashtable_len      (cherokee_hashtable_t *ht, size_t *len);
+
+CHEROKEE_END_DECLS
+
+#endif /* CHEROKEE_HASHTABLE_H */
@@ -72,6 +72,14 @@ struct cherokee_header {
 	off_t                   query_string_off;
 	cint_t                  query_string_len;
 
+	/* Incremental request scanning: resume point, and offsets
+	 * of the LFs ending each one of the lines found so far
+	 */
+	cuint_t                 scan_pos;
+	cuint_t                *scan_lines;
+	cuint_t                 scan_lines_len;
+	cuint_t                 scan_lines_size;
+
 	/* Debug & sanity checks
 	 */
 	cherokee_buffer_t      *input_buffer;
@@ -26,6 +26,7 @@
 #include "common-internal.h"
 #include "header.h"
 #include "header-protected.h"
+#include "header_scan.h"
 
 #include "util.h"
 
@@ -85,6 +86,13 @@ clean_headers (cherokee_header_t *hdr)
 	clean_unknown_headers (hdr);
 }
 
+static void
+clean_scan (cherokee_header_t *hdr)
+{
+	hdr->scan_pos       = 0;
+	hdr->scan_lines_len = 0;
+}
+
 
 ret_t
 cherokee_header_init (cherokee_header_t *hdr, cherokee_header_type_t type)
@@ -116,6 +124,13 @@ cherokee_header_init (cherokee_header_t *hdr, cherokee_header_type_t type)
 	hdr->query_string_off = 0;
 	hdr->query_string_len = 0;
 
+	/* Incremental scanning
+	 */
+	hdr->scan_pos        = 0;
+	hdr->scan_lines      = NULL;
+	hdr->scan_lines_len  = 0;
+	hdr->scan_lines_size = 0;
+
 	/* Sanity
 	 */
 	hdr->input_buffer       = NULL;
@@ -129,6 +144,14 @@ ret_t
 cherokee_header_mrproper (cherokee_header_t *hdr)
 {
 	clean_unknown_headers (hdr);
+
+	if (hdr->scan_lines != NULL) {
+		free (hdr->scan_lines);
+		hdr->scan_lines      = NULL;
+		hdr->scan_lines_size = 0;
+	}
+
+	clean_scan (hdr);
 	return ret_ok;
 }
 
@@ -152,6 +175,7 @@ ret_t
 cherokee_header_clean (cherokee_header_t *hdr)
 {
 	clean_headers (hdr);
+	clean_scan (hdr);
 
 	hdr->method   = http_unknown;
 	hdr->version  = http_version_unknown;
@@ -808,46 +832,86 @@ cherokee_header_copy_version (cherokee_header_t *hdr, cherokee_buffer_t *buf)
 static ret_t
 has_header_response (cherokee_header_t *hdr, cherokee_buffer_t *buffer)
 {
-	char *tmp;
-
-	tmp = strstr (buffer->buf, CRLF_CRLF);
-	if (tmp == NULL)
-		return ret_not_found;
+	char *p   = buffer->buf;
+	char *end = buffer->buf + buffer->len;
 
-	/* Content until CRLF_CRLF plus two of the last line CRLF
+	/* Look for CRLF_CRLF, checking around every LF
 	 */
-	hdr->input_header_len = (tmp - buffer->buf) + 2;
+	while ((p = cherokee_header_scan_chr (p, end, CHR_LF)) != NULL) {
+		if ((p > buffer->buf) && (p + 2 < end) &&
+		    (p[-1] == CHR_CR) && (p[1] == CHR_CR) && (p[2] == CHR_LF))
+		{
+			/* Content until CRLF_CRLF plus two of the last line CRLF
+			 */
+			hdr->input_header_len = (p - 1 - buffer->buf) + 2;
+			return ret_ok;
+		}
+		p++;
+	}
+
+	return ret_not_found;
+}
+
+
+static ret_t
+add_scan_line (cherokee_header_t *hdr, cuint_t lf_off)
+{
+	if (hdr->scan_lines_len >= hdr->scan_lines_size) {
+		cuint_t  size = (hdr->scan_lines_size > 0) ? hdr->scan_lines_size * 2 : 16;
+		cuint_t *n    = realloc (hdr->scan_lines, size * sizeof(cuint_t));
+
+		if (unlikely (n == NULL)) {
+			return ret_nomem;
+		}
+
+		hdr->scan_lines      = n;
+		hdr->scan_lines_size = size;
+	}
+
+	hdr->scan_lines[hdr->scan_lines_len++] = lf_off;
 	return ret_ok;
 }
 
 
 static ret_t
-has_header_request (cherokee_header_t *hdr, cherokee_buffer_t *buffer, cuint_t tail_len)
+has_header_request (cherokee_header_t *hdr, cherokee_buffer_t *buffer)
 {
 	ret_t    ret;
-	char    *start;
-	char    *end;
+	char    *p;
+	char    *eol;
+	char    *fin;
+	char    *lf       = NULL;
+	cint_t   cr_n, lf_n;
 	cuint_t  crlf_len = 0;
 
-	/* Skip initial CRLFs:
-	 * NOTE: they are not allowed by standard (RFC) but many
-	 * popular HTTP clients (including MSIE, etc.)  may send a
-	 * couple of them between two requests, so every widely used
-	 * web server has to deal with them.
+	/* The scanning resumes where the previous call stopped, as
+	 * long as the buffer was not cleaned in the meanwhile.
 	 */
-	crlf_len = cherokee_buffer_cnt_spn (buffer, 0, CRLF);
-	if (unlikely (crlf_len > MAX_HEADER_CRLF)) {
-		/* Too many initial CRLF
-		 */
-		return ret_error;
+	if (unlikely (hdr->scan_pos > buffer->len)) {
+		clean_scan (hdr);
 	}
 
-	if ((crlf_len > 0) && (crlf_len < buffer->len)) {
-		/* Found heading CRLFs and their length is less than
-		 * buffer length so we have to move the real content
-		 * to the beginning of the buffer.
+	if (hdr->scan_pos == 0) {
+		/* Skip initial CRLFs:
+		 * NOTE: they are not allowed by standard (RFC) but many
+		 * popular HTTP clients (including MSIE, etc.)  may send a
+		 * couple of them between two requests, so every widely used
+		 * web server has to deal with them.
 		 */
-		cherokee_buffer_move_to_begin (buffer, (int) crlf_len);
+		crlf_len = cherokee_buffer_cnt_spn (buffer, 0, CRLF);
+		if (unlikely (crlf_len > MAX_HEADER_CRLF)) {
+			/* Too many initial CRLF
+			 */
+			return ret_error;
+		}
+
+		if ((crlf_len > 0) && (crlf_len < buffer->len)) {
+			/* Found heading CRLFs and their length is less than
+			 * buffer length so we have to move the real content
+			 * to the beginning of the buffer.
+			 */
+			cherokee_buffer_move_to_begin (buffer, (int) crlf_len);
+		}
 	}
 
 	/* Do we have enough information ?
@@ -859,23 +923,76 @@ has_header_request (cherokee_header_t *hdr, cherokee_buffer_t *buffer, cuint_t t
 		return ret_not_found;
 	}
 
-	/* Look for the starting point
-	 */
-	start = (tail_len >= buffer->len) ?
-		buffer->buf : buffer->buf + (buffer->len - tail_len);
+	p   = buffer->buf + hdr->scan_pos;
+	fin = buffer->buf + MIN (buffer->len, MAX_HEADER_LEN);
 
-	/* It could be a partial header, or maybe a POST request
-	 */
-	ret = cherokee_find_header_end_cstr (start,
-					     (buffer->buf + buffer->len) - start,
-					     &end, &crlf_len);
-	if (ret != ret_ok) {
-		return ret_not_found;
-	}
+	while (p < fin) {
+		eol = cherokee_header_scan_eol (p, fin);
+		if (eol == NULL) {
+			break;
+		}
 
-	hdr->input_header_len = ((int) (end - buffer->buf)) + crlf_len;
+		/* Walk the CR/LF run. Same rules as in
+		 * cherokee_find_header_end_cstr()
+		 */
+		cr_n = 0;
+		lf_n = 0;
+
+		for (p = eol; p < fin; p++) {
+			if (*p == CHR_LF) {
+				if (lf_n == 0) {
+					lf  = p;
+					ret = add_scan_line (hdr, p - buffer->buf);
+					if (unlikely (ret != ret_ok)) {
+						return ret_error;
+					}
+				}
+
+				lf_n++;
+				if (lf_n == 2) {
+					hdr->input_header_len = (p + 1) - buffer->buf;
+					hdr->scan_pos         = hdr->input_header_len;
+					return ret_ok;
+				}
+
+			} else if (*p == CHR_CR) {
+				cr_n++;
 
-	return ret_ok;
+			} else {
+				break;
+			}
+
+			if (unlikely (((cr_n == 1) && (lf_n == 2)) ||
+				      ((cr_n == 2) && (lf_n == 0))))
+			{
+				return ret_error;
+			}
+		}
+
+		/* Incomplete run: it will be checked again when there
+		 * is more data
+		 */
+		if (p >= fin) {
+			if (lf_n > 0) {
+				hdr->scan_lines_len--;
+			}
+
+			hdr->scan_pos = eol - buffer->buf;
+			return ret_not_found;
+		}
+
+		/* A line followed by SP or HT is continued on the
+		 * next one (folding): it was not a line end
+		 */
+		if ((lf_n > 0) && (lf + 1 == p) &&
+		    ((*p == CHR_SP) || (*p == CHR_HT)))
+		{
+			hdr->scan_lines_len--;
+		}
+	}
+
+	hdr->scan_pos = fin - buffer->buf;
+	return ret_not_found;
 }
 
 
@@ -884,7 +1001,11 @@ cherokee_header_has_header (cherokee_header_t *hdr, cherokee_buffer_t *buffer, i
 {
 	switch (hdr->type) {
 	case header_type_request:
-		return has_header_request (hdr, buffer, tail_len);
+		/* The request scanning is incremental: it does
+		 * not need to know how much data was appended.
+		 */
+		UNUSED (tail_len);
+		return has_header_request (hdr, buffer);
 
 	case header_type_response:
 	case header_type_basic:
@@ -898,16 +1019,165 @@ cherokee_header_has_header (cherokee_header_t *hdr, cherokee_buffer_t *buffer, i
 }
 
 
+/* Known headers: perfect hash over the length, and the first and
+ * last characters of the name (case insensitive). Every known name
+ * lands on a different slot, so one comparison confirms the match.
+ */
+#define KNOWN_HEADERS_HASH(name,len) \
+	((((len) * 9) + ((name)[0] | 0x20) + (((name)[(len)-1] | 0x20) << 2)) & 63)
+
+static const struct {
+	const char               *name;
+	cuint_t                   len;
+	cherokee_common_header_t  header;
+} known_headers_hash[64] = {
+	{NULL,                 0, HEADER_LENGTH             },   /*  0 */
+	{"Content-Length",    14, header_content_length     },   /*  1 */
+	{NULL,                 0, HEADER_LENGTH             },   /*  2 */
+	{NULL,                 0, HEADER_LENGTH             },   /*  3 */
+	{"Accept-Encoding",   15, header_accept_encoding    },   /*  4 */
+	{"If-Range",           8, header_if_range           },   /*  5 */
+	{NULL,                 0, HEADER_LENGTH             },   /*  6 */
+	{"X-Forwarded-For",   15, header_x_forwarded_for    },   /*  7 */
+	{"Upgrade",            7, header_upgrade            },   /*  8 */
+	{"X-Real-IP",          9, header_x_real_ip          },   /*  9 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 10 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 11 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 12 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 13 */
+	{"Authorization",     13, header_authorization      },   /* 14 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 15 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 16 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 17 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 18 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 19 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 20 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 21 */
+	{"If-Modified-Since", 17, header_if_modified_since  },   /* 22 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 23 */
+	{"X-Forwarded-Host",  16, header_x_forwarded_host   },   /* 24 */
+	{"Keep-Alive",        10, header_keepalive          },   /* 25 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 26 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 27 */
+	{"Host",               4, header_host               },   /* 28 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 29 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 30 */
+	{"User-Agent",        10, header_user_agent         },   /* 31 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 32 */
+	{"Set-Cookie",        10, header_set_cookie         },   /* 33 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 34 */
+	{"Content-Type",      12, header_content_type       },   /* 35 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 36 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 37 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 38 */
+	{"Accept",             6, header_accept             },   /* 39 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 40 */
+	{"Transfer-Encoding", 17, header_transfer_encoding  },   /* 41 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 42 */
+	{"Expect",             6, header_expect             },   /* 43 */
+	{"Location",           8, header_location           },   /* 44 */
+	{"Cookie",             6, header_cookie             },   /* 45 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 46 */
+	{"Accept-Charset",    14, header_accept_charset     },   /* 47 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 48 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 49 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 50 */
+	{"Range",              5, header_range              },   /* 51 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 52 */
+	{"Connection",        10, header_connection         },   /* 53 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 54 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 55 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 56 */
+	{"Referer",            7, header_referer            },   /* 57 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 58 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 59 */
+	{"Accept-Language",   15, header_accept_language    },   /* 60 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 61 */
+	{"If-None-Match",     13, header_if_none_match      },   /* 62 */
+	{NULL,                 0, HEADER_LENGTH             },   /* 63 */
+};
+
+static cherokee_common_header_t
+lookup_known_header (const char *name, cuint_t len)
+{
+	cuint_t slot;
+
+	if (unlikely (len == 0))
+		return HEADER_LENGTH;
+
+	slot = KNOWN_HEADERS_HASH ((const unsigned char *)name, len);
+
+	if ((known_headers_hash[slot].len == len) &&
+	    (strncasecmp (name, known_headers_hash[slot].name, len) == 0))
+	{
+		return known_headers_hash[slot].header;
+	}
+
+	return HEADER_LENGTH;
+}
+
+
+/* Bounded version of cherokee_header_get_next_line(): lines end with
+ * CRLF or LF, unless the next one starts with SP or HT (folding).
+ */
+static char *
+get_next_line (char *begin, char *limit)
+{
+	char *lf;
+	char *p    = begin;
+
+	do {
+		lf = cherokee_header_scan_chr (p, limit, CHR_LF);
+		if (unlikely (lf == NULL))
+			return NULL;
+
+		p = lf + 1;
+	} while ((p < limit) && ((*p == CHR_SP) || (*p == CHR_HT)));
+
+	if ((lf != begin) && (*(lf - 1) == CHR_CR))
+		return lf - 1;
+
+	return lf;
+}
+
+
+/* Same, but using the line ends found by the incremental scanning
+ */
+static char *
+get_scanned_line (cherokee_header_t *hdr, cuint_t *n, char *begin)
+{
+	char    *lf;
+	cuint_t  off = begin - hdr->input_buffer->buf;
+
+	while ((*n < hdr->scan_lines_len) &&
+	       (hdr->scan_lines[*n] < off))
+	{
+		*n += 1;
+	}
+
+	if (*n >= hdr->scan_lines_len)
+		return NULL;
+
+	lf = hdr->input_buffer->buf + hdr->scan_lines[*n];
+	if ((lf != begin) && (*(lf - 1) == CHR_CR))
+		return lf - 1;
+
+	return lf;
+}
+
+
 ret_t
 cherokee_header_parse (cherokee_header_t *hdr, cherokee_buffer_t *buffer, cherokee_http_t *error_code)
 {
-	ret_t  ret;
-	char  *val_beg;
-	char  *val_end;
-	char  *header_end;
-	char  chr_header_end;
-	char  *begin           = buffer->buf;
-	char  *end             = NULL;
+	ret_t               ret;
+	char               *val_beg;
+	char               *val_end;
+	char               *header_end;
+	char                chr_header_end;
+	cherokee_boolean_t  scanned;
+	cuint_t             line_n          = 0;
+	char               *begin           = buffer->buf;
+	char               *end             = NULL;
 
 	/* Set default error code.
 	 */
@@ -934,7 +1204,8 @@ cherokee_header_parse (cherokee_header_t *hdr, cherokee_buffer_t *buffer, cherok
 	if (unlikely (hdr->input_header_len < 1)) {
 		/* Strange, anyway go on and look for EOH
 		 */
-		ret = has_header_request (hdr, buffer, buffer->len);
+		clean_scan (hdr);
+		ret = has_header_request (hdr, buffer);
 		if (ret != ret_ok) {
 			if (ret == ret_not_found) {
 				LOG_ERROR (CHEROKEE_ERROR_HEADER_NO_EOH,
@@ -947,6 +1218,12 @@ cherokee_header_parse (cherokee_header_t *hdr, cherokee_buffer_t *buffer, cherok
 	}
 	header_end = &(buffer->buf[hdr->input_header_len]);
 
+	/* The line ends might already be known
+	 */
+	scanned = ((hdr->type == header_type_request) &&
+		   (hdr->scan_lines_len > 0) &&
+		   (hdr->scan_pos == hdr->input_header_len));
+
 	/* Terminate current request space (there may be other
 	 * pipelined requests in the buffer) after the EOH.
 	 */
@@ -996,12 +1273,18 @@ cherokee_header_parse (cherokee_header_t *hdr, cherokee_buffer_t *buffer, cherok
 		cuint_t header_len;
 		int	val_offs;
 		int	val_len;
-		char    first_char;
 		char    chr_end;
 
+		cherokee_common_header_t known;
+
 		/* Check where the line ends
 		 */
-		end = cherokee_header_get_next_line (begin);
+		if (scanned) {
+			end = get_scanned_line (hdr, &line_n, begin);
+		} else {
+			end = get_next_line (begin, header_end);
+		}
+
 		if (end == NULL)
 			break;
 
@@ -1010,7 +1293,7 @@ cherokee_header_parse (cherokee_header_t *hdr, cherokee_buffer_t *buffer, cherok
 
 		/* Current line may have embedded CR+SP or CRLF+SP
 		 */
-		val_beg = strchr (begin, ':');
+		val_beg = cherokee_header_scan_chr (begin, end, ':');
 		if (unlikely (val_beg == NULL))
 			goto next;
 
@@ -1041,118 +1324,15 @@ cherokee_header_parse (cherokee_header_t *hdr, cherokee_buffer_t *buffer, cherok
 		if (unlikely (val_len < 1))
 			goto next;
 
-		first_char = *begin;
-		if (first_char > 'Z')
-			first_char -=  'a' - 'A';
-
-
-#define header_equals(str,hdr_enum,begin,len) ((len == (sizeof(str)-1)) && \
-					       (hdr->header[hdr_enum].info_off == 0) && \
-					       (strncasecmp (begin, str, sizeof(str)-1) == 0))
-
-		switch (first_char) {
-		case 'A':
-			if (header_equals ("Accept-Encoding", header_accept_encoding, begin, header_len)) {
-				ret = add_known_header (hdr, header_accept_encoding, val_offs, val_len);
-			} else if (header_equals ("Accept-Charset", header_accept_charset, begin, header_len)) {
-				ret = add_known_header (hdr, header_accept_charset, val_offs, val_len);
-			} else if (header_equals ("Accept-Language", header_accept_language, begin, header_len)) {
-				ret = add_known_header (hdr, header_accept_language, val_offs, val_len);
-			} else if (header_equals ("Accept", header_accept, begin, header_len)) {
-				ret = add_known_header (hdr, header_accept, val_offs, val_len);
-			} else if (header_equals ("Authorization", header_authorization, begin, header_len)) {
-				ret = add_known_header (hdr, header_authorization, val_offs, val_len);
-			} else
-				goto unknown;
-			break;
-		case 'C':
-			if (header_equals ("Connection", header_connection, begin, header_len)) {
-				ret = add_known_header (hdr, header_connection, val_offs, val_len);
-			} else if (header_equals ("Content-Length", header_content_length, begin, header_len)) {
-				ret = add_known_header (hdr, header_content_length, val_offs, val_len);
-			} else if (header_equals ("Content-Type", header_content_type, begin, header_len)) {
-				ret = add_known_header (hdr, header_content_type, val_offs, val_len);
-			} else if (header_equals ("Cookie", header_cookie, begin, header_len)) {
-				ret = add_known_header (hdr, header_cookie, val_offs, val_len);
-			} else
-				goto unknown;
-			break;
-		case 'E':
-			if (header_equals ("Expect", header_expect, begin, header_len)) {
-				ret = add_known_header (hdr, header_expect, val_offs, val_len);
-			} else
-				goto unknown;
-			break;
-		case 'H':
-			if (header_equals ("Host", header_host, begin, header_len)) {
-				ret = add_known_header (hdr, header_host, val_offs, val_len);
-			} else
-				goto unknown;
-			break;
-		case 'I':
-			if (header_equals ("If-Modified-Since", header_if_modified_since, begin, header_len)) {
-				ret = add_known_header (hdr, header_if_modified_since, val_offs, val_len);
-			} else if (header_equals ("If-None-Match", header_if_none_match, begin, header_len)) {
-				ret = add_known_header (hdr, header_if_none_match, val_offs, val_len);
-			} else if (header_equals ("If-Range", header_if_range, begin, header_len)) {
-				ret = add_known_header (hdr, header_if_range, val_offs, val_len);
-			} else
-				goto unknown;
-			break;
-		case 'K':
-			if (header_equals ("Keep-Alive", header_keepalive, begin, header_len)) {
-				ret = add_known_header (hdr, header_keepalive, val_offs, val_len);
-			} else
-				goto unknown;
-			break;
-		case 'L':
-			if (header_equals ("Location", header_location, begin, header_len)) {
-				ret = add_known_header (hdr, header_location, val_offs, val_len);
-			} else
-				goto unknown;
-			break;
-		case 'R':
-			if (header_equals ("Range", header_range, begin, header_len)) {
-				ret = add_known_header (hdr, header_range, val_offs, val_len);
-			} else if (header_equals ("Referer", header_referer, begin, header_len)) {
-				ret = add_known_header (hdr, header_referer, val_offs, val_len);
-			} else
-				goto unknown;
-			break;
-		case 'S':
-			if (header_equals ("Set-Cookie", header_set_cookie, begin, header_len)) {
-				ret = add_known_header (hdr, header_set_cookie, val_offs, val_len);
-			} else
-				goto unknown;
-			break;
-		case 'T':
-			if (header_equals ("Transfer-Encoding", header_transfer_encoding, begin, header_len)) {
-				ret = add_known_header (hdr, header_transfer_encoding, val_offs, val_len);
-			} else
-				goto unknown;
-			break;
-		case 'U':
-			if (header_equals ("Upgrade", header_upgrade, begin, header_len)) {
-				ret = add_known_header (hdr, header_upgrade, val_offs, val_len);
-			} else if (header_equals ("User-Agent", header_user_agent, begin, header_len)) {
-				ret = add_known_header (hdr, header_user_agent, val_offs, val_len);
-			} else
-				goto unknown;
-			break;
-		case 'X':
-			if (header_equals ("X-Forwarded-For", header_x_forwarded_for, begin, header_len)) {
-				ret = add_known_header (hdr, header_x_forwarded_for, val_offs, val_len);
-			} else if (header_equals ("X-Forwarded-Host", header_x_forwarded_host, begin, header_len)) {
-				ret = add_known_header (hdr, header_x_forwarded_host, val_offs, val_len);
-			} else if (header_equals ("X-Real-IP", header_x_real_ip, begin, header_len)) {
-				ret = add_known_header (hdr, header_x_real_ip, val_offs, val_len);
-			} else
-				goto unknown;
-			break;
-		default:
-		unknown:
-			/* Add a unknown header
-			 */
+		/* Known or unknown header. Only the first occurrence
+		 * of a known header is indexed as such.
+		 */
+		known = lookup_known_header (begin, header_len);
+		if ((known != HEADER_LENGTH) &&
+		    (hdr->header[known].info_off == 0))
+		{
+			ret = add_known_header (hdr, known, val_offs, val_len);
+		} else {
 			ret = add_unknown_header (hdr, begin-buffer->buf, val_offs, val_len);
 		}
 
@@ -37,7 +37,7 @@
 CHEROKEE_BEGIN_DECLS
 
 /* NOTE:
- * Keep it sync with known_headers_names of header.c
+ * Keep it sync with known_headers_hash of header.c
  */
 typedef enum {
 	header_accept,
@@ -0,0 +1,187 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/* Cherokee
+ *
+ * Authors:
+ *      Alvaro Lopez Ortega <alvaro@alobbs.com>
+ *
+ * Copyright (C) 2001-2011 Alvaro Lopez Ortega
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+
+#include "common-internal.h"
+#include "header_scan.h"
+
+#ifdef HAVE_SIMD_DISPATCH
+# include <immintrin.h>
+#endif
+
+
+static char *
+scan_scalar (const char *p, const char *end, char c1, char c2)
+{
+	while (p < end) {
+		if ((*p == c1) || (*p == c2)) {
+			return (char *)p;
+		}
+		p++;
+	}
+
+	return NULL;
+}
+
+
+#ifdef HAVE_SIMD_DISPATCH
+
+/* SSE4.2: PCMPESTRI looks for any of the two bytes in 16 byte
+ * blocks. Vector loads never cross the end of the buffer: the last
+ * partial block is handled by the scalar loop.
+ */
+__attribute__((target("sse4.2")))
+static char *
+scan_sse42 (const char *p, const char *end, char c1, char c2)
+{
+	int     idx;
+	__m128i set;
+	__m128i block;
+
+	set = _mm_setr_epi8 (c1, c2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+	while (end - p >= 16) {
+		block = _mm_loadu_si128 ((const __m128i *)p);
+		idx   = _mm_cmpestri (set, 2, block, 16,
+				      _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+		if (idx < 16) {
+			return (char *)p + idx;
+		}
+		p += 16;
+	}
+
+	return scan_scalar (p, end, c1, c2);
+}
+
+
+/* AVX2: two byte comparisons over 32 byte blocks
+ */
+__attribute__((target("avx2")))
+static char *
+scan_avx2 (const char *p, const char *end, char c1, char c2)
+{
+	unsigned int mask;
+	__m256i      v1;
+	__m256i      v2;
+	__m256i      block;
+
+	v1 = _mm256_set1_epi8 (c1);
+	v2 = _mm256_set1_epi8 (c2);
+
+	while (end - p >= 32) {
+		block = _mm256_loadu_si256 ((const __m256i *)p);
+		mask  = (unsigned int) _mm256_movemask_epi8 (
+			_mm256_or_si256 (_mm256_cmpeq_epi8 (block, v1),
+					 _mm256_cmpeq_epi8 (block, v2)));
+		if (mask != 0) {
+			return (char *)p + __builtin_ctz (mask);
+		}
+		p += 32;
+	}
+
+	return scan_scalar (p, end, c1, c2);
+}
+
+#endif /* HAVE_SIMD_DISPATCH */
+
+
+static const struct {
+	const char                  *name;
+	cherokee_header_scan_func_t  func;
+} scan_impls[] = {
+#ifdef HAVE_SIMD_DISPATCH
+	{"avx2",   scan_avx2},
+	{"sse4.2", scan_sse42},
+#endif
+	{"scalar", scan_scalar},
+	{NULL,     NULL}
+};
+
+cherokee_header_scan_func_t cherokee_header_scan = scan_scalar;
+
+
+static cherokee_boolean_t
+impl_supported (const char *name)
+{
+#ifdef HAVE_SIMD_DISPATCH
+	__builtin_cpu_init();
+
+	if (strcmp (name, "avx2") == 0) {
+		return __builtin_cpu_supports ("avx2");
+	} else if (strcmp (name, "sse4.2") == 0) {
+		return __builtin_cpu_supports ("sse4.2");
+	}
+#endif
+	return (strcmp (name, "scalar") == 0);
+}
+
+
+ret_t
+cherokee_header_scan_set_impl (const char *name)
+{
+	cuint_t i;
+
+	for (i = 0; scan_impls[i].name != NULL; i++) {
+		if (strcmp (scan_impls[i].name, name) != 0)
+			continue;
+
+		if (! impl_supported (name))
+			return ret_no_sys;
+
+		cherokee_header_scan = scan_impls[i].func;
+		return ret_ok;
+	}
+
+	return ret_not_found;
+}
+
+
+const char *
+cherokee_header_scan_get_impl (void)
+{
+	cuint_t i;
+
+	for (i = 0; scan_impls[i].name != NULL; i++) {
+		if (scan_impls[i].func == cherokee_header_scan)
+			return scan_impls[i].name;
+	}
+
+	return "unknown";
+}
+
+
+ret_t
+cherokee_header_scan_init (void)
+{
+	cuint_t i;
+
+	/* The list is sorted by preference
+	 */
+	for (i = 0; scan_impls[i].name != NULL; i++) {
+		if (cherokee_header_scan_set_impl (scan_impls[i].name) == ret_ok)
+			break;
+	}
+
+	return ret_ok;
+}
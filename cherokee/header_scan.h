@@ -0,0 +1,55 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/* Cherokee
+ *
+ * Authors:
+ *      Alvaro Lopez Ortega <alvaro@alobbs.com>
+ *
+ * Copyright (C) 2001-2011 Alvaro Lopez Ortega
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+
+#if !defined (CHEROKEE_INSIDE_CHEROKEE_H) && !defined (CHEROKEE_COMPILATION)
+# error "Only <cherokee/cherokee.h> can be included directly, this file may disappear or change contents."
+#endif
+
+#ifndef CHEROKEE_HEADER_SCAN_H
+#define CHEROKEE_HEADER_SCAN_H
+
+#include <cherokee/common.h>
+
+CHEROKEE_BEGIN_DECLS
+
+/* Byte scanning kernels used by the header parsers. The fastest
+ * implementation supported by the CPU is picked at start up.
+ */
+typedef char * (* cherokee_header_scan_func_t) (const char *p, const char *end, char c1, char c2);
+
+extern cherokee_header_scan_func_t cherokee_header_scan;
+
+ret_t       cherokee_header_scan_init     (void);
+ret_t       cherokee_header_scan_set_impl (const char *name);
+const char *cherokee_header_scan_get_impl (void);
+
+/* First CR or LF, or first 'c', within [p, end). NULL otherwise.
+ */
+#define cherokee_header_scan_eol(p,end)   cherokee_header_scan ((p), (end), CHR_CR, CHR_LF)
+#define cherokee_header_scan_chr(p,end,c) cherokee_header_scan ((p), (end), (c), (c))
+
+CHEROKEE_END_DECLS
+
+#endif /* CHEROKEE_HEADER_SCAN_H */
@@ -25,6 +25,7 @@
 #include "common-internal.h"
 #include "init.h"
 #include "cacheline.h"
+#include "header_scan.h"
 #include "trace.h"
 #include "ncpus.h"
 #include "util.h"
@@ -97,6 +98,10 @@ cherokee_init (void)
 	 */
 	cherokee_cacheline_size_get (&cherokee_cacheline_size);
 
+	/* Pick the header scanning kernels for this CPU
+	 */
+	cherokee_header_scan_init();
+
 	/* Get the file descriptor number limit
 	 */
 	ret = cherokee_sys_fdlimit_get (&cherokee_fdlimit);
@@ -29,6 +29,7 @@
 #include "server-protected.h"
 #include "util.h"
 #include "bogotime.h"
+#include "hashtable.h"
 
 #ifdef HAVE_SYS_MMAN_H
 # include <sys/mman.h>
@@ -38,16 +39,27 @@
 # include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+#endif
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <signal.h>
+
+#if defined(HAVE_SYS_INOTIFY_H) && defined(HAVE_INOTIFY_INIT1) && defined(HAVE_PTHREAD)
+# define HAVE_IOCACHE_WATCHER 1
+#endif
 
 #define ENTRIES "iocache"
 
 #define LASTING_MMAP     (5 * 60)            /* secs */
 #define LASTING_STAT     (5 * 60)            /* secs */
+#define LASTING_WATCHED  (60 * 60)           /* secs */
+#define MAX_FDS          0                   /* disabled */
 #define MIN_FILE_SIZE    1                   /* bytes */
 #define MAX_FILE_SIZE    SENDFILE_MIN_SIZE   /* bytes */
 
@@ -67,6 +79,9 @@ typedef struct {
 	cherokee_iocache_entry_t base;
 	time_t                   stat_expiration;
 	time_t                   mmap_expiration;
+	cuint_t                  invalidations;
+	cherokee_boolean_t       watched;
+	struct stat              fd_state;
 	CHEROKEE_MUTEX_T        (parent_lock);
 } cherokee_iocache_entry_extension_t;
 
@@ -79,6 +94,371 @@ CHEROKEE_ADD_FUNC_NEW (iocache);
 CHEROKEE_ADD_FUNC_FREE (iocache);
 
 
+/* Watcher: when inotify is enabled, the entries of the files living
+ * in watched directories last much longer. A thread reads the events
+ * reported by the kernel, and invalidates the affected entries.
+ */
+#ifdef HAVE_IOCACHE_WATCHER
+
+#define WATCH_EVENTS (IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE |	\
+		      IN_CREATE | IN_DELETE | IN_MOVED_FROM |	\
+		      IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+typedef struct {
+	int                wd;
+	cherokee_buffer_t  path;
+	cherokee_boolean_t ancestor;
+} cherokee_iocache_dir_t;
+
+struct cherokee_iocache_watcher {
+	int                   fd;
+	pthread_t             thread;
+	cherokee_iocache_t   *iocache;
+	cherokee_hashtable_t  dirs;
+	CHEROKEE_MUTEX_T     (dirs_lock);
+};
+
+static void
+dir_free (cherokee_iocache_dir_t *dir)
+{
+	cherokee_buffer_mrproper (&dir->path);
+	free (dir);
+}
+
+static int
+dir_match_wd (cherokee_iocache_dir_t *dir, int *wd)
+{
+	return (dir->wd == *wd);
+}
+
+static void
+entry_invalidate (cherokee_cache_entry_t *entry)
+{
+	/* Whoever is updating the entry right now will notice that
+	 * the counter has changed.
+	 */
+	CHEROKEE_ATOMIC_ADD (&PRIV(entry)->invalidations, 1);
+
+	PRIV(entry)->stat_expiration = 0;
+	PRIV(entry)->mmap_expiration = 0;
+}
+
+static ret_t
+invalidate_prefix_cb (cherokee_cache_entry_t *entry, void *param)
+{
+	cherokee_buffer_t *prefix = BUF(param);
+
+	/* shard->lock is LOCKED (reader)
+	 */
+	if ((entry->key.len >= prefix->len) &&
+	    (strncmp (entry->key.buf, prefix->buf, prefix->len) == 0))
+	{
+		entry_invalidate (entry);
+	}
+
+	return ret_ok;
+}
+
+static void
+invalidate (cherokee_iocache_t *iocache,
+	    cherokee_buffer_t  *path)
+{
+	ret_t                   ret;
+	cherokee_cache_entry_t *entry = NULL;
+
+	/* Both 'path' and 'path/' might be cached
+	 */
+	ret = cherokee_cache_find (CACHE(iocache), path, &entry);
+	if (ret == ret_ok) {
+		TRACE (ENTRIES, "Invalidating: '%s'\n", path->buf);
+
+		entry_invalidate (entry);
+		cherokee_cache_entry_unref (&entry);
+	}
+
+	if (cherokee_buffer_is_ending (path, '/'))
+		return;
+
+	cherokee_buffer_add_char (path, '/');
+
+	ret = cherokee_cache_find (CACHE(iocache), path, &entry);
+	if (ret == ret_ok) {
+		TRACE (ENTRIES, "Invalidating: '%s'\n", path->buf);
+
+		entry_invalidate (entry);
+		cherokee_cache_entry_unref (&entry);
+	}
+
+	cherokee_buffer_drop_ending (path, 1);
+}
+
+static void
+watcher_process (cherokee_iocache_watcher_t *watcher,
+		 struct inotify_event       *event,
+		 cherokee_buffer_t          *path)
+{
+	ret_t                   ret;
+	cherokee_boolean_t      ancestor;
+	cherokee_iocache_dir_t *dir      = NULL;
+
+	/* Events were lost: nothing can be trusted
+	 */
+	if (event->mask & IN_Q_OVERFLOW) {
+		TRACE (ENTRIES, "%s\n", "Event queue overflow: invalidating all the entries");
+
+		cherokee_buffer_clean (path);
+		cherokee_cache_foreach (CACHE(watcher->iocache), invalidate_prefix_cb, path);
+		return;
+	}
+
+	/* Find the watched directory
+	 */
+	CHEROKEE_MUTEX_LOCK (&watcher->dirs_lock);
+
+	ret = cherokee_hashtable_get (&watcher->dirs, event->wd,
+				      (cherokee_hashtable_match_func_t) dir_match_wd,
+				      &event->wd, (void **)&dir);
+	if (ret != ret_ok) {
+		CHEROKEE_MUTEX_UNLOCK (&watcher->dirs_lock);
+		return;
+	}
+
+	cherokee_buffer_clean (path);
+	cherokee_buffer_add_buffer (path, &dir->path);
+	ancestor = dir->ancestor;
+
+	if (event->mask & IN_IGNORED) {
+		cherokee_hashtable_del (&watcher->dirs, event->wd, dir);
+		dir_free (dir);
+	}
+
+	CHEROKEE_MUTEX_UNLOCK (&watcher->dirs_lock);
+
+	/* The directory itself
+	 */
+	invalidate (watcher->iocache, path);
+
+	/* Whatever is under a directory that has gone away
+	 */
+	if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT | IN_IGNORED)) {
+		if (event->mask & IN_MOVE_SELF) {
+			inotify_rm_watch (watcher->fd, event->wd);
+		}
+
+		if (! cherokee_buffer_is_ending (path, '/')) {
+			cherokee_buffer_add_char (path, '/');
+		}
+
+		cherokee_cache_foreach (CACHE(watcher->iocache), invalidate_prefix_cb, path);
+		return;
+	}
+
+	/* The file the event refers to
+	 */
+	if (event->len > 0) {
+		if (! cherokee_buffer_is_ending (path, '/')) {
+			cherokee_buffer_add_char (path, '/');
+		}
+		cherokee_buffer_add (path, event->name, strlen(event->name));
+
+		invalidate (watcher->iocache, path);
+
+		/* It might be a directory, or a symbolic link to
+		 * one, on the path of other entries
+		 */
+		if (ancestor) {
+			cherokee_buffer_add_char (path, '/');
+			cherokee_cache_foreach (CACHE(watcher->iocache), invalidate_prefix_cb, path);
+		}
+	}
+}
+
+static NORETURN void *
+watcher_routine (void *param)
+{
+	ssize_t                     len;
+	char                       *p;
+	struct inotify_event       *event;
+	cherokee_buffer_t           path    = CHEROKEE_BUF_INIT;
+	cherokee_iocache_watcher_t *watcher = param;
+	char                        buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+	/* It can only be canceled while waiting for events
+	 */
+	pthread_setcancelstate (PTHREAD_CANCEL_DISABLE, NULL);
+	pthread_cleanup_push ((void (*)(void *)) cherokee_buffer_mrproper, &path);
+
+	while (true) {
+		pthread_setcancelstate (PTHREAD_CANCEL_ENABLE, NULL);
+		len = read (watcher->fd, buf, sizeof(buf));
+		pthread_setcancelstate (PTHREAD_CANCEL_DISABLE, NULL);
+
+		if (len <= 0) {
+			if ((len < 0) && (errno == EINTR))
+				continue;
+			break;
+		}
+
+		for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + event->len) {
+			event = (struct inotify_event *) p;
+			watcher_process (watcher, event, &path);
+		}
+	}
+
+	pthread_cleanup_pop (1);
+	pthread_exit (NULL);
+}
+
+static ret_t
+watcher_new (cherokee_iocache_watcher_t **watcher,
+	     cherokee_iocache_t          *iocache)
+{
+	ret_t ret;
+	CHEROKEE_NEW_STRUCT (n, iocache_watcher);
+
+	n->iocache = iocache;
+	cherokee_hashtable_init (&n->dirs);
+	CHEROKEE_MUTEX_INIT (&n->dirs_lock, CHEROKEE_MUTEX_FAST);
+
+	n->fd = inotify_init1 (IN_CLOEXEC);
+	if (n->fd < 0) {
+		LOG_ERRNO_S (errno, cherokee_err_warning, CHEROKEE_ERROR_IOCACHE_INOTIFY_INIT);
+		goto error;
+	}
+
+	ret = cherokee_thread_create_nosignals (&n->thread, watcher_routine, n);
+	if (ret != ret_ok) {
+		cherokee_fd_close (n->fd);
+		goto error;
+	}
+
+	*watcher = n;
+	return ret_ok;
+
+error:
+	cherokee_hashtable_mrproper (&n->dirs, NULL);
+	CHEROKEE_MUTEX_DESTROY (&n->dirs_lock);
+	free (n);
+	return ret_error;
+}
+
+static void
+watcher_free (cherokee_iocache_watcher_t *watcher)
+{
+	pthread_cancel (watcher->thread);
+	pthread_join (watcher->thread, NULL);
+
+	cherokee_fd_close (watcher->fd);
+	cherokee_hashtable_mrproper (&watcher->dirs, (cherokee_func_free_t) dir_free);
+	CHEROKEE_MUTEX_DESTROY (&watcher->dirs_lock);
+
+	free (watcher);
+}
+
+static ret_t
+watcher_add_dir (cherokee_iocache_watcher_t *watcher,
+		 cherokee_buffer_t          *path,
+		 cherokee_boolean_t          ancestor)
+{
+	int                     wd;
+	ret_t                   ret;
+	cherokee_iocache_dir_t *dir = NULL;
+
+	wd = inotify_add_watch (watcher->fd, path->buf, WATCH_EVENTS);
+	if (wd < 0) {
+		TRACE (ENTRIES, "Couldn't watch '%s': errno=%d\n", path->buf, errno);
+		return ret_error;
+	}
+
+	/* Remember the path of new watches
+	 */
+	CHEROKEE_MUTEX_LOCK (&watcher->dirs_lock);
+
+	ret = cherokee_hashtable_get (&watcher->dirs, wd,
+				      (cherokee_hashtable_match_func_t) dir_match_wd,
+				      &wd, (void **)&dir);
+	if (ret != ret_ok) {
+		dir = (cherokee_iocache_dir_t *) malloc (sizeof(cherokee_iocache_dir_t));
+		if (unlikely (dir == NULL)) {
+			CHEROKEE_MUTEX_UNLOCK (&watcher->dirs_lock);
+			return ret_nomem;
+		}
+
+		TRACE (ENTRIES, "Watching '%s' (wd=%d)\n", path->buf, wd);
+
+		dir->wd       = wd;
+		dir->ancestor = false;
+		cherokee_buffer_init (&dir->path);
+		cherokee_buffer_add_buffer (&dir->path, path);
+
+		cherokee_hashtable_add (&watcher->dirs, wd, dir);
+	}
+
+	if (ancestor) {
+		dir->ancestor = true;
+	}
+
+	CHEROKEE_MUTEX_UNLOCK (&watcher->dirs_lock);
+	return ret_ok;
+}
+
+static ret_t
+watcher_add (cherokee_iocache_watcher_t *watcher,
+	     cherokee_buffer_t          *file)
+{
+	ret_t              ret;
+	char              *slash;
+	cherokee_boolean_t ancestor = false;
+	cherokee_buffer_t  path     = CHEROKEE_BUF_INIT;
+
+	/* Watch the directory holding the file: besides the changes
+	 * on the file, it reports its creation and removal. Its upper
+	 * directories are watched too, so renaming any of them, or
+	 * re-pointing a symbolic link on the way, is noticed as well.
+	 */
+	cherokee_buffer_add_buffer (&path, file);
+
+	while (true) {
+		slash = strrchr (path.buf, '/');
+		if (slash == NULL) {
+			ret = ret_not_found;
+			break;
+		}
+
+		if (slash == path.buf) {
+			cherokee_buffer_drop_ending (&path, path.len - 1);
+		} else {
+			cherokee_buffer_drop_ending (&path, path.len - (slash - path.buf));
+		}
+
+		ret = watcher_add_dir (watcher, &path, ancestor);
+		if ((ret != ret_ok) || (path.len <= 1))
+			break;
+
+		ancestor = true;
+	}
+
+	cherokee_buffer_mrproper (&path);
+	return ret;
+}
+
+#endif /* HAVE_IOCACHE_WATCHER */
+
+
+static void
+fd_release (cherokee_iocache_entry_t *entry)
+{
+	cherokee_iocache_t *iocache = IOCACHE(CACHE_ENTRY(entry)->cache);
+
+	/* entry->mutex is LOCKED. The handlers still sending the
+	 * file keep the descriptor open.
+	 */
+	cherokee_iocache_fd_unref (&entry->fd);
+	CHEROKEE_ATOMIC_ADD (&iocache->fds.evictions, 1);
+
+	BIT_UNSET (entry->info, iocache_fd);
+}
+
 static ret_t
 clean_info_cb (cherokee_cache_entry_t *entry)
 {
@@ -101,6 +481,18 @@ clean_info_cb (cherokee_cache_entry_t *entry)
 		ioentry->mmaped_len = 0;
 	}
 
+	/* Close the file descriptor
+	 */
+	if (ioentry->fd != NULL) {
+		fd_release (ioentry);
+	}
+
+	/* Forget the response headers
+	 */
+	cherokee_buffer_mrproper (&ioentry->headers.buf);
+	ioentry->headers.mime_known = false;
+	ioentry->headers.mime       = NULL;
+
 	/* Mark it as expired
 	 */
 	PRIV(entry)->mmap_expiration = 0;
@@ -112,6 +504,7 @@ clean_info_cb (cherokee_cache_entry_t *entry)
 static ret_t
 free_cb (cherokee_cache_entry_t *entry)
 {
+	cherokee_buffer_mrproper (&IOCACHE_ENTRY(entry)->headers.buf);
 	CHEROKEE_MUTEX_DESTROY (&PRIV(entry)->parent_lock);
 	return ret_ok;
 }
@@ -162,9 +555,19 @@ iocache_entry_new_cb (cherokee_cache_t        *cache,
 	 */
 	PRIV(n)->stat_expiration = 0;
 	PRIV(n)->mmap_expiration = 0;
+	PRIV(n)->invalidations   = 0;
+	PRIV(n)->watched         = false;
 	PUBL(n)->mmaped          = NULL;
 	PUBL(n)->mmaped_len      = 0;
+	PUBL(n)->fd              = NULL;
 	PUBL(n)->info            = 0;
+
+	cherokee_buffer_init (&PUBL(n)->headers.buf);
+	PUBL(n)->headers.etag_len   = 0;
+	PUBL(n)->headers.mime_known = false;
+	PUBL(n)->headers.mime       = NULL;
+	PUBL(n)->headers.mtime      = 0;
+	PUBL(n)->headers.size       = 0;
 	PUBL(n)->state_ret       = ret_ok;
 
 	/* Return the new object
@@ -212,6 +615,20 @@ cherokee_iocache_configure (cherokee_iocache_t     *iocache,
 			ret = cherokee_atoi (subconf->val.buf, &val);
 			if (ret != ret_ok) return ret_error;
 			iocache->lasting_mmap = val;
+
+		} else if (equal_buf_str (&subconf->key, "lasting_watched")) {
+			ret = cherokee_atoi (subconf->val.buf, &val);
+			if (ret != ret_ok) return ret_error;
+			iocache->lasting_watched = val;
+
+		} else if (equal_buf_str (&subconf->key, "max_fds")) {
+			ret = cherokee_atoi (subconf->val.buf, &val);
+			if (ret != ret_ok) return ret_error;
+			iocache->max_fds = val;
+
+		} else if (equal_buf_str (&subconf->key, "inotify")) {
+			ret = cherokee_atob (subconf->val.buf, &iocache->inotify);
+			if (ret != ret_ok) return ret_error;
 		}
 	}
 
@@ -236,10 +653,48 @@ cherokee_iocache_init (cherokee_iocache_t *iocache)
 	CACHE(iocache)->new_cb_param = NULL;
 	CACHE(iocache)->stats_cb     = get_stats_cb;
 
-	iocache->max_file_size = MAX_FILE_SIZE;
-	iocache->min_file_size = MIN_FILE_SIZE;
-	iocache->lasting_stat  = LASTING_STAT;
-	iocache->lasting_mmap  = LASTING_MMAP;
+	iocache->max_file_size   = MAX_FILE_SIZE;
+	iocache->min_file_size   = MIN_FILE_SIZE;
+	iocache->lasting_stat    = LASTING_STAT;
+	iocache->lasting_mmap    = LASTING_MMAP;
+	iocache->lasting_watched = LASTING_WATCHED;
+	iocache->inotify         = false;
+	iocache->watcher         = NULL;
+	iocache->max_fds         = MAX_FDS;
+	iocache->fds.open        = 0;
+	iocache->fds.hits        = 0;
+	iocache->fds.misses      = 0;
+	iocache->fds.evictions   = 0;
+
+	return ret_ok;
+}
+
+ret_t
+cherokee_iocache_watch (cherokee_iocache_t *iocache)
+{
+#ifdef HAVE_IOCACHE_WATCHER
+	ret_t ret;
+#endif
+
+	/* It has to be invoked once the server has been daemonized,
+	 * and before the threads start using the cache.
+	 */
+	if ((! iocache->inotify) ||
+	    (iocache->watcher != NULL))
+	{
+		return ret_ok;
+	}
+
+#ifdef HAVE_IOCACHE_WATCHER
+	ret = watcher_new (&iocache->watcher, iocache);
+	if (ret != ret_ok) {
+		/* Fall back to expiration */
+		iocache->inotify = false;
+	}
+#else
+	LOG_WARNING_S (CHEROKEE_ERROR_IOCACHE_NO_INOTIFY);
+	iocache->inotify = false;
+#endif
 
 	return ret_ok;
 }
@@ -247,6 +702,13 @@ cherokee_iocache_init (cherokee_iocache_t *iocache)
 ret_t
 cherokee_iocache_mrproper (cherokee_iocache_t *iocache)
 {
+#ifdef HAVE_IOCACHE_WATCHER
+	if (iocache->watcher != NULL) {
+		watcher_free (iocache->watcher);
+		iocache->watcher = NULL;
+	}
+#endif
+
 	return cherokee_cache_mrproper (CACHE(iocache));
 }
 
@@ -260,8 +722,77 @@ cherokee_iocache_entry_unref (cherokee_iocache_entry_t **entry)
 	return cherokee_cache_entry_unref ((cherokee_cache_entry_t **)entry);
 }
 
+ret_t
+cherokee_iocache_entry_get_fd (cherokee_iocache_entry_t  *entry,
+			       cherokee_iocache_fd_t    **fd,
+			       struct stat               *info)
+{
+	ret_t ret = ret_not_found;
+
+	/* The descriptor and the information describing the file
+	 * it was opened for are taken together.
+	 */
+	CHEROKEE_MUTEX_LOCK (CACHE_ENTRY(entry)->mutex);
+
+	if (entry->fd != NULL) {
+		CHEROKEE_ATOMIC_ADD (&entry->fd->ref_count, 1);
+		memcpy (info, &PRIV(entry)->fd_state, sizeof(struct stat));
+
+		*fd = entry->fd;
+		ret = ret_ok;
+	}
+
+	CHEROKEE_MUTEX_UNLOCK (CACHE_ENTRY(entry)->mutex);
+	return ret;
+}
+
+ret_t
+cherokee_iocache_fd_unref (cherokee_iocache_fd_t **fd)
+{
+	cherokee_iocache_fd_t *shared = *fd;
+
+	*fd = NULL;
+
+	if (CHEROKEE_ATOMIC_ADD (&shared->ref_count, -1) > 0)
+		return ret_ok;
+
+	TRACE(ENTRIES, "Closing shared descriptor fd=%d\n", shared->fd);
+
+	cherokee_fd_close (shared->fd);
+	CHEROKEE_ATOMIC_ADD (&shared->iocache->fds.open, -1);
+
+	free (shared);
+	return ret_ok;
+}
+
+static void
+entry_set_expiration (cherokee_iocache_entry_t *entry,
+		      time_t                   *expiration,
+		      cuint_t                   lasting,
+		      cuint_t                   invalidations)
+{
+	cherokee_iocache_t *iocache = IOCACHE(CACHE_ENTRY(entry)->cache);
+
+	if (! PRIV(entry)->watched) {
+		*expiration = cherokee_bogonow_now + lasting;
+		return;
+	}
+
+	/* Watched entries last until they are invalidated, or for
+	 * lasting_watched at most in case an event was missed. If it
+	 * happened while they were being updated, the information
+	 * might be outdated already.
+	 */
+	*expiration = cherokee_bogonow_now + iocache->lasting_watched;
+
+	if (CHEROKEE_ATOMIC_ADD (&PRIV(entry)->invalidations, 0) != invalidations) {
+		*expiration = 0;
+	}
+}
+
 static ret_t
-ioentry_update_stat (cherokee_iocache_entry_t *entry)
+ioentry_update_stat (cherokee_iocache_entry_t *entry,
+		     cuint_t                   invalidations)
 {
 	int                 re;
 	ret_t               ret;
@@ -285,6 +816,15 @@ ioentry_update_stat (cherokee_iocache_entry_t *entry)
 		return ret_ok_and_sent;
 	}
 
+	/* Watch it before stat()ing it, so no change is missed
+	 */
+#ifdef HAVE_IOCACHE_WATCHER
+	if (iocache->watcher != NULL) {
+		ret = watcher_add (iocache->watcher, &CACHE_ENTRY(entry)->key);
+		PRIV(entry)->watched = (ret == ret_ok);
+	}
+#endif
+
 	/* Update stat
 	 */
 	re = cherokee_stat (CACHE_ENTRY(entry)->key.buf, &entry->state);
@@ -311,8 +851,9 @@ ioentry_update_stat (cherokee_iocache_entry_t *entry)
 
 	TRACE (ENTRIES, "Updated stat: %s, ret=%d\n", CACHE_ENTRY(entry)->key.buf, ret);
 
-	PRIV(entry)->stat_expiration = cherokee_bogonow_now + iocache->lasting_stat;
-	PUBL(entry)->state_ret       = ret;
+	PUBL(entry)->state_ret = ret;
+	entry_set_expiration (entry, &PRIV(entry)->stat_expiration,
+			      iocache->lasting_stat, invalidations);
 
 	BIT_SET (PUBL(entry)->info, iocache_stat);
 	return (ret == ret_ok) ? ret_ok : ret_deny;
@@ -320,7 +861,8 @@ ioentry_update_stat (cherokee_iocache_entry_t *entry)
 
 static ret_t
 ioentry_update_mmap (cherokee_iocache_entry_t *entry,
-		     int                      *fd)
+		     int                      *fd,
+		     cuint_t                   invalidations)
 {
 	ret_t              ret;
 	int                fd_local = -1;
@@ -367,8 +909,9 @@ ioentry_update_mmap (cherokee_iocache_entry_t *entry,
 				break;
 			}
 
-			PRIV(entry)->stat_expiration = cherokee_bogonow_now + iocache->lasting_stat;
-			PUBL(entry)->state_ret       = ret;
+			PUBL(entry)->state_ret = ret;
+			entry_set_expiration (entry, &PRIV(entry)->stat_expiration,
+					      iocache->lasting_stat, invalidations);
 
 			goto error;
 		}
@@ -418,8 +961,9 @@ ioentry_update_mmap (cherokee_iocache_entry_t *entry,
 
 	TRACE(ENTRIES, "Updated mmap: %s\n", filename->buf);
 
-	PUBL(entry)->mmaped_len      = entry->state.st_size;
-	PRIV(entry)->mmap_expiration = cherokee_bogonow_now + iocache->lasting_mmap;
+	PUBL(entry)->mmaped_len = entry->state.st_size;
+	entry_set_expiration (entry, &PRIV(entry)->mmap_expiration,
+			      iocache->lasting_mmap, invalidations);
 
 	if ((fd == NULL) && (fd_local != -1)) {
 		cherokee_fd_close (fd_local);
@@ -438,12 +982,117 @@ error:
 }
 
 
+static cherokee_boolean_t
+same_file (struct stat *a, struct stat *b)
+{
+	return ((a->st_dev   == b->st_dev)   &&
+		(a->st_ino   == b->st_ino)   &&
+		(a->st_size  == b->st_size)  &&
+		(a->st_mtime == b->st_mtime));
+}
+
+static ret_t
+ioentry_update_descriptor (cherokee_iocache_entry_t *entry)
+{
+	int                    re;
+	int                    fd;
+	cuint_t                open;
+	cherokee_iocache_fd_t *shared;
+	cherokee_buffer_t     *filename = &CACHE_ENTRY(entry)->key;
+	cherokee_iocache_t    *iocache  = IOCACHE(CACHE_ENTRY(entry)->cache);
+
+	/* The descriptor is valid as long as it refers to the
+	 * very same file the cached information describes.
+	 */
+	if (entry->fd != NULL) {
+		if (same_file (&PRIV(entry)->fd_state, &entry->state)) {
+			CHEROKEE_ATOMIC_ADD (&iocache->fds.hits, 1);
+			return ret_ok;
+		}
+
+		TRACE(ENTRIES, "Descriptor is outdated: %s\n", filename->buf);
+		fd_release (entry);
+	}
+
+	/* Only regular files
+	 */
+	if (unlikely (! S_ISREG(entry->state.st_mode))) {
+		return ret_deny;
+	}
+
+	/* Reserve a slot
+	 */
+	do {
+		open = iocache->fds.open;
+		if (open >= iocache->max_fds) {
+			TRACE(ENTRIES, "No room for more descriptors: %s\n", filename->buf);
+			return ret_no_sys;
+		}
+	} while (! CHEROKEE_ATOMIC_CAS (&iocache->fds.open, open, open + 1));
+
+	CHEROKEE_ATOMIC_ADD (&iocache->fds.misses, 1);
+
+	/* Open the file
+	 */
+	fd = cherokee_open (filename->buf, (O_RDONLY | O_BINARY), 0);
+	if (unlikely (fd < 0)) {
+		TRACE(ENTRIES, "Couldn't open(%s) = %s\n", filename->buf, strerror(errno));
+		CHEROKEE_ATOMIC_ADD (&iocache->fds.open, -1);
+
+		switch (errno) {
+		case EACCES:
+			return ret_deny;
+		case ENOENT:
+		case ENOTDIR:
+			return ret_not_found;
+		default:
+			return ret_error;
+		}
+	}
+
+	cherokee_fd_set_closexec (fd);
+
+	/* The file might have changed after it was stat()ed
+	 */
+	re = cherokee_fstat (fd, &PRIV(entry)->fd_state);
+	if (unlikely (re < 0)) {
+		cherokee_fd_close (fd);
+		CHEROKEE_ATOMIC_ADD (&iocache->fds.open, -1);
+		return ret_error;
+	}
+
+	if (! same_file (&PRIV(entry)->fd_state, &entry->state)) {
+		TRACE(ENTRIES, "File changed while being opened: %s\n", filename->buf);
+		memcpy (&entry->state, &PRIV(entry)->fd_state, sizeof(struct stat));
+	}
+
+	shared = (cherokee_iocache_fd_t *) malloc (sizeof(cherokee_iocache_fd_t));
+	if (unlikely (shared == NULL)) {
+		cherokee_fd_close (fd);
+		CHEROKEE_ATOMIC_ADD (&iocache->fds.open, -1);
+		return ret_nomem;
+	}
+
+	shared->fd        = fd;
+	shared->ref_count = 1;
+	shared->iocache   = iocache;
+
+	TRACE(ENTRIES, "Cached descriptor: %s, fd=%d\n", filename->buf, fd);
+
+	entry->fd = shared;
+	BIT_SET (entry->info, iocache_fd);
+
+	return ret_ok;
+}
+
+
 static ret_t
 entry_update_fd (cherokee_iocache_entry_t *entry,
 		 cherokee_iocache_info_t   info,
 		 int                      *fd)
 {
 	ret_t               ret;
+	cuint_t             invalidations;
 	cherokee_iocache_t *iocache = IOCACHE(CACHE_ENTRY(entry)->cache);
 
 	/* Returns:
@@ -474,16 +1123,20 @@ entry_update_fd (cherokee_iocache_entry_t *entry,
 		return ret_ok_and_sent;
 	}
 
+	/* Changes reported from now on will invalidate the update
+	 */
+	invalidations = CHEROKEE_ATOMIC_ADD (&PRIV(entry)->invalidations, 0);
+
 	/* Check the required info
 	 */
 	if (info & iocache_stat) {
-		ioentry_update_stat (entry);
+		ioentry_update_stat (entry, invalidations);
 	}
 
 	if (info & iocache_mmap) {
 		/* Update mmap
 		 */
-		ret = ioentry_update_stat (entry);
+		ret = ioentry_update_stat (entry, invalidations);
 		if ((ret != ret_ok) &&
 		    (ret != ret_ok_and_sent))
 		{
@@ -502,7 +1155,23 @@ entry_update_fd (cherokee_iocache_entry_t *entry,
 
 		/* Go ahead
 		 */
-		ret = ioentry_update_mmap (entry, fd);
+		ret = ioentry_update_mmap (entry, fd, invalidations);
+		if (ret != ret_ok) {
+			return ret;
+		}
+	}
+
+	if (info & iocache_fd) {
+		/* Update the file descriptor
+		 */
+		ret = ioentry_update_stat (entry, invalidations);
+		if ((ret != ret_ok) &&
+		    (ret != ret_ok_and_sent))
+		{
+			return ret_deny;
+		}
+
+		ret = ioentry_update_descriptor (entry);
 		if (ret != ret_ok) {
 			return ret;
 		}
@@ -512,6 +1181,39 @@ entry_update_fd (cherokee_iocache_entry_t *entry,
 }
 
 
+static cherokee_boolean_t
+entry_is_fresh (cherokee_iocache_entry_t *entry,
+		cherokee_iocache_info_t   info)
+{
+	/* Entries that are up to date do not need to be locked:
+	 * they are only rewritten once they have expired.
+	 */
+	if ((entry->info & info) != info)
+		return false;
+
+	if (PUBL(entry)->state_ret != ret_ok)
+		return false;
+
+	if ((info & iocache_stat) &&
+	    (PRIV(entry)->stat_expiration < cherokee_bogonow_now))
+		return false;
+
+	if ((info & iocache_mmap) &&
+	    ((entry->mmaped == NULL) ||
+	     (PRIV(entry)->mmap_expiration < cherokee_bogonow_now)))
+		return false;
+
+	if (info & iocache_fd) {
+		if ((entry->fd == NULL) ||
+		    (PRIV(entry)->stat_expiration < cherokee_bogonow_now))
+			return false;
+
+		CHEROKEE_ATOMIC_ADD (&IOCACHE(CACHE_ENTRY(entry)->cache)->fds.hits, 1);
+	}
+
+	return true;
+}
+
 static ret_t
 entry_update (cherokee_iocache_entry_t *entry,
 	      cherokee_iocache_info_t    info)
@@ -523,8 +1225,8 @@ entry_update (cherokee_iocache_entry_t *entry,
 static ret_t
 fetch_info_cb (cherokee_cache_entry_t *entry)
 {
-	/* cache->priv->mutex is LOCKED
-	 * entry->mutex       is LOCKED
+	/* shard->lock  is LOCKED (writer)
+	 * entry->mutex is LOCKED
 	 */
 	entry_update (IOCACHE_ENTRY(entry),
 		      (iocache_stat | iocache_mmap));
@@ -559,6 +1261,10 @@ iocache_get (cherokee_iocache_t        *iocache,
 
 	/* Update the cached info
 	 */
+	if (entry_is_fresh (*ret_io, info)) {
+		return ret_ok;
+	}
+
 	CHEROKEE_MUTEX_LOCK (entry->mutex);
 	if (fd) {
 		ret = entry_update_fd (*ret_io, info, fd);
@@ -590,6 +1296,10 @@ cherokee_iocache_autoget_fd (cherokee_iocache_t        *iocache,
 		if (unlikely (cherokee_buffer_cmp_buf (file, &CACHE_ENTRY(entry)->key) != 0))
 			SHOULDNT_HAPPEN;
 
+		if (entry_is_fresh (entry, info)) {
+			return ret_ok;
+		}
+
 		CHEROKEE_MUTEX_LOCK (CACHE_ENTRY(entry)->mutex);
 		ret = entry_update_fd (entry, info, fd);
 		CHEROKEE_MUTEX_UNLOCK (CACHE_ENTRY(entry)->mutex);
@@ -615,6 +1325,10 @@ cherokee_iocache_autoget (cherokee_iocache_t        *iocache,
 		if (unlikely (cherokee_buffer_cmp_buf (file, &CACHE_ENTRY(entry)->key) != 0))
 			SHOULDNT_HAPPEN;
 
+		if (entry_is_fresh (entry, info)) {
+			return ret_ok;
+		}
+
 		CHEROKEE_MUTEX_LOCK (CACHE_ENTRY(entry)->mutex);
 		ret = entry_update (entry, info);
 		CHEROKEE_MUTEX_UNLOCK (CACHE_ENTRY(entry)->mutex);
@@ -626,20 +1340,16 @@ cherokee_iocache_autoget (cherokee_iocache_t        *iocache,
 }
 
 
+static ret_t
+add_mmaped_size_cb (cherokee_cache_entry_t *entry, void *param)
+{
+	*((size_t *)param) += IOCACHE_ENTRY(entry)->mmaped_len;
+	return ret_ok;
+}
+
 ret_t
 cherokee_iocache_get_mmaped_size (cherokee_iocache_t *cache, size_t *total)
 {
-	cuint_t          n;
-	cherokee_list_t *i;
-	cherokee_list_t *lists[4] = {&CACHE(cache)->_t1, &CACHE(cache)->_t2};
-
 	*total = 0;
-
-	for (n=0; n<2; n++) {
-		list_for_each (i, lists[n]) {
-			*total += IOCACHE_ENTRY(i)->mmaped_len;
-		}
-	}
-
-	return ret_ok;
+	return cherokee_cache_foreach (CACHE(cache), add_mmaped_size_cb, total);
 }
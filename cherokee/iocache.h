@@ -38,6 +38,8 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+typedef struct cherokee_iocache_watcher cherokee_iocache_watcher_t;
+
 typedef struct {
 	cherokee_cache_t        cache;
 
@@ -46,14 +48,38 @@ typedef struct {
 	cuint_t                 min_file_size;
 	cuint_t                 lasting_mmap;
 	cuint_t                 lasting_stat;
+
+	/* Invalidation */
+	cherokee_boolean_t          inotify;
+	cuint_t                     lasting_watched;
+	cherokee_iocache_watcher_t *watcher;
+
+	/* Open file descriptors */
+	cuint_t                 max_fds;
+	struct {
+		cuint_t         open;
+		culong_t        hits;
+		culong_t        misses;
+		culong_t        evictions;
+	} fds;
 } cherokee_iocache_t;
 
 typedef enum {
 	iocache_nothing = 0,
 	iocache_stat    = 1,
-	iocache_mmap    = 1 << 1
+	iocache_mmap    = 1 << 1,
+	iocache_fd      = 1 << 2
 } cherokee_iocache_info_t;
 
+/* Descriptor kept open by an entry. The handlers sending the file
+ * take a reference: it is closed after the last one is released.
+ */
+typedef struct {
+	int                     fd;
+	cint_t                  ref_count;
+	cherokee_iocache_t     *iocache;
+} cherokee_iocache_fd_t;
+
 typedef struct {
 	/* Inheritance */
 	cherokee_cache_entry_t  base;
@@ -64,6 +90,19 @@ typedef struct {
 	ret_t                   state_ret;
 	void                   *mmaped;
 	size_t                  mmaped_len;
+	cherokee_iocache_fd_t  *fd;
+
+	/* Response headers: built and validated by the handlers.
+	 * They must hold the entry mutex to access them.
+	 */
+	struct {
+		cherokee_buffer_t  buf;
+		cuint_t            etag_len;
+		cherokee_boolean_t mime_known;
+		void              *mime;
+		time_t             mtime;
+		off_t              size;
+	} headers;
 } cherokee_iocache_entry_t;
 
 #define IOCACHE(x)       ((cherokee_iocache_t *)(x))
@@ -80,10 +119,17 @@ ret_t cherokee_iocache_mrproper        (cherokee_iocache_t  *iocache);
 
 ret_t cherokee_iocache_configure       (cherokee_iocache_t     *iocache,
 					cherokee_config_node_t *conf);
+ret_t cherokee_iocache_watch           (cherokee_iocache_t     *iocache);
 
 /* I/O cache entry
  */
 ret_t cherokee_iocache_entry_unref     (cherokee_iocache_entry_t **entry);
+ret_t cherokee_iocache_entry_get_fd    (cherokee_iocache_entry_t  *entry,
+					cherokee_iocache_fd_t    **fd,
+					struct stat               *info);
+
+/* Shared descriptors */
+ret_t cherokee_iocache_fd_unref        (cherokee_iocache_fd_t    **fd);
 
 /* Autoget: Get or Update
  */
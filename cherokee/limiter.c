@@ -55,78 +55,22 @@ ret_t
 cherokee_limiter_add_conn (cherokee_limiter_t *limiter,
 			   void               *conn)
 {
-	cherokee_list_t *i;
-	cherokee_list_t *prev;
-
-	/* Enlist the connection. Shorted insert by unblocking order
+	/* The thread timers take care of waking it up once
+	 * conn->limit_blocked_until is reached.
 	 */
-	prev = &limiter->conns;
-	list_for_each (i, &limiter->conns) {
-		if (CONN(i)->limit_blocked_until > CONN(conn)->limit_blocked_until)
-			break;
-
-		prev = i;
-	}
-
 	limiter->conns_num++;
-	cherokee_list_add (LIST(conn), prev);
+	cherokee_list_add_tail (LIST(conn), &limiter->conns);
 
 	return ret_ok;
 }
 
 
-cherokee_msec_t
-cherokee_limiter_get_time_limit (cherokee_limiter_t *limiter,
-				 cherokee_msec_t     fdwatch_msecs)
-{
-	long long              time_delta;
-	cherokee_connection_t *conn;
-
-	/* Shortcut
-	 */
-	if ((fdwatch_msecs == 0) ||
-	    (limiter->conns_num == 0))
-	{
-		return fdwatch_msecs;
-	}
-
-	/* Pick the first connection
-	 */
-	conn = CONN(limiter->conns.next);
-
-	/* Return the delta time of the first connection (the
-	 * connection that will be enabled sooner)
-	 */
-	time_delta = conn->limit_blocked_until - cherokee_bogonow_msec;
-	if (unlikely (time_delta <= 0)) {
-		return 0;
-	}
-
-	/* Check as 'signed long long' */
-	return MIN(time_delta, (long long)fdwatch_msecs);
-}
-
-
 ret_t
-cherokee_limiter_reactive (cherokee_limiter_t *limiter,
-			   void               *thread)
+cherokee_limiter_del_conn (cherokee_limiter_t *limiter,
+			   void               *conn)
 {
-	cherokee_list_t *i, *tmp;
-
-	list_for_each_safe (i, tmp, &limiter->conns) {
-		/* Check whether the limit has expired
-		 */
-		if (CONN(i)->limit_blocked_until > cherokee_bogonow_msec)
-			break;
-
-		/* Re-active the connection
-		 */
-		limiter->conns_num--;
-		cherokee_list_del(i);
-
-		CONN(i)->limit_blocked_until = 0;
-		cherokee_thread_inject_active_connection (thread, CONN(i));
-	}
+	limiter->conns_num--;
+	cherokee_list_del (LIST(conn));
 
 	return ret_ok;
 }
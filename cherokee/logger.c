@@ -206,13 +206,10 @@ cherokee_logger_write_access (cherokee_logger_t *logger, void *conn)
 		}
 	}
 
-	/* Call the virtual method
+	/* Call the virtual method. It is not serialized: the log
+	 * writers take care of concurrent writes.
 	 */
-	CHEROKEE_MUTEX_LOCK (&PRIV(logger)->mutex);
-	ret = logger->write_access (logger, conn);
-	CHEROKEE_MUTEX_UNLOCK (&PRIV(logger)->mutex);
-
-	return ret;
+	return logger->write_access (logger, conn);
 }
 
 
@@ -709,18 +709,13 @@ cherokee_logger_custom_write_access (cherokee_logger_custom_t *logger,
 
 	cherokee_buffer_add_char (log, '\n');
 
-	/* Flush buffer if full
+	/* Hand it over: it is flushed if the buffer is full
 	 */
-	if (log->len < logger->writer_access->max_bufsize)
-		goto ok;
-
-	ret = cherokee_logger_writer_flush (logger->writer_access, true);
+	ret = cherokee_logger_writer_release_buf (logger->writer_access);
 	if (unlikely (ret != ret_ok)) {
-		goto error;
+		return ret_error;
 	}
 
-ok:
-	cherokee_logger_writer_release_buf (logger->writer_access);
 	return ret_ok;
 
 error:
@@ -745,19 +740,13 @@ cherokee_logger_custom_write_string (cherokee_logger_custom_t *logger,
 		goto error;
 	}
 
-	/* Flush buffer if full
+	/* Hand it over: it is flushed if the buffer is full
 	 */
-  	if (log->len < logger->writer_access->max_bufsize) {
-		goto ok;
-	}
-
-	ret = cherokee_logger_writer_flush (logger->writer_access, true);
+	ret = cherokee_logger_writer_release_buf (logger->writer_access);
 	if (unlikely (ret != ret_ok)) {
-		goto error;
+		return ret_error;
 	}
 
-ok:
-	cherokee_logger_writer_release_buf (logger->writer_access);
 	return ret_ok;
 
 error:
@@ -133,11 +133,7 @@ cherokee_logger_ncsa_init_base (cherokee_logger_ncsa_t    *logger,
 	/* Init the local buffers
 	 */
 	cherokee_buffer_init (&logger->now_dtm);
-	cherokee_buffer_init (&logger->referer);
-	cherokee_buffer_init (&logger->useragent);
-	cherokee_buffer_ensure_size (&logger->now_dtm,   64);
-	cherokee_buffer_ensure_size (&logger->referer, 1024);
-	cherokee_buffer_ensure_size (&logger->useragent, 512);
+	cherokee_buffer_ensure_size (&logger->now_dtm, 64);
 
 	/* Init the logger writer
 	 */
@@ -181,8 +177,6 @@ ret_t
 cherokee_logger_ncsa_free (cherokee_logger_ncsa_t *logger)
 {
 	cherokee_buffer_mrproper (&logger->now_dtm);
-	cherokee_buffer_mrproper (&logger->referer);
-	cherokee_buffer_mrproper (&logger->useragent);
 
 	return ret_ok;
 }
@@ -204,11 +198,13 @@ build_log_string (cherokee_logger_ncsa_t *logger,
 	const char        *method;
 	const char        *username;
 	const char        *version;
+	char              *referer                      = NULL;
+	char              *useragent                    = NULL;
 	cuint_t            method_len                   = 0;
 	size_t             username_len                 = 0;
 	cuint_t            version_len                  = 0;
-	cherokee_buffer_t *referer                      = &logger->referer;
-	cherokee_buffer_t *useragent                    = &logger->useragent;
+	cuint_t            referer_len                  = 0;
+	cuint_t            useragent_len                = 0;
 	char               ipaddr[CHE_INET_ADDRSTRLEN];
 
 	/* Look for the user
@@ -291,25 +287,23 @@ build_log_string (cherokee_logger_ncsa_t *logger,
 		return ret_ok;
 	}
 
-	/* "combined" information
+	/* "combined" information: the header values are referenced
+	 * in place so that several threads can log at once.
 	 */
-	cherokee_buffer_clean (referer);
-	cherokee_buffer_clean (useragent);
-
-	cherokee_header_copy_known (&cnt->header, header_referer, referer);
-	cherokee_header_copy_known (&cnt->header, header_user_agent, useragent);
-	cherokee_buffer_ensure_addlen (buf, 8 + referer->len + referer->len);
-
-	if (referer->len > 0) {
-		cherokee_buffer_add_str    (buf, " \"");
-		cherokee_buffer_add_buffer (buf, referer);
-		cherokee_buffer_add_str    (buf, "\" \"");
+	cherokee_header_get_known (&cnt->header, header_referer, &referer, &referer_len);
+	cherokee_header_get_known (&cnt->header, header_user_agent, &useragent, &useragent_len);
+	cherokee_buffer_ensure_addlen (buf, 8 + referer_len + useragent_len);
+
+	if (referer_len > 0) {
+		cherokee_buffer_add_str (buf, " \"");
+		cherokee_buffer_add     (buf, referer, referer_len);
+		cherokee_buffer_add_str (buf, "\" \"");
 	} else {
 		cherokee_buffer_add_str (buf, " \"-\" \"");
 	}
 
-	if (useragent->len > 0) {
-		cherokee_buffer_add_buffer (buf, useragent);
+	if (useragent_len > 0) {
+		cherokee_buffer_add (buf, useragent, useragent_len);
 	}
 
 	cherokee_buffer_add_str (buf, "\"\n");
@@ -334,18 +328,13 @@ cherokee_logger_ncsa_write_access (cherokee_logger_ncsa_t *logger, cherokee_conn
 		goto error;
 	}
 
-	/* Flush buffer if full
+	/* Hand it over: it is flushed if the buffer is full
 	 */
-	if (log->len < logger->writer_access->max_bufsize)
-		goto ok;
-
-	ret = cherokee_logger_writer_flush (logger->writer_access, true);
+	ret = cherokee_logger_writer_release_buf (logger->writer_access);
 	if (unlikely (ret != ret_ok)) {
-		goto error;
+		return ret_error;
 	}
 
-ok:
-	cherokee_logger_writer_release_buf (logger->writer_access);
 	return ret_ok;
 
 error:
@@ -42,9 +42,6 @@ typedef struct {
 	time_t             now_time;
 	cherokee_buffer_t  now_dtm;
 
-	cherokee_buffer_t  referer;
-	cherokee_buffer_t  useragent;
-
 	cherokee_logger_writer_t *writer_access;
 } cherokee_logger_ncsa_t;
 
@@ -37,9 +37,47 @@
 # include <syslog.h>
 #endif
 
+/* <syslog.h> takes LOG_WARNING over with its priority value
+ */
+#undef  LOG_WARNING
+#define LOG_WARNING(e_num,arg...) cherokee_error_log (cherokee_err_warning, __FILE__, __LINE__, e_num, ##arg)
+
+#define ENTRIES "log,writer"
+
+#define RING_IOV_MAX 64
+
+/* Per-thread log ring. The thread that owns it is the only one
+ * moving 'head' forward, whereas 'tail' is only updated by whoever
+ * holds the writer mutex while flushing. Once its thread is gone,
+ * the ring is freed as soon as it has been written.
+ */
+typedef struct {
+	cherokee_list_t           listed;
+	char                     *data;
+	size_t                    size;
+	volatile size_t           head;
+	volatile size_t           tail;
+	volatile cullong_t        dropped;
+	cherokee_buffer_t         line;
+	cherokee_boolean_t        orphan;
+	cherokee_logger_writer_t *writer;
+} ring_t;
+
+#define RING(r) ((ring_t *)(r))
+
 typedef struct {
 	CHEROKEE_MUTEX_T  (mutex);
-	int                foo;
+#ifdef HAVE_PTHREAD
+	pthread_key_t                   ring_key;
+#endif
+	cherokee_boolean_t              ring_key_set;
+	cherokee_list_t                 rings;
+	cullong_t                       dropped_reported;
+	cullong_t                       dropped_reaped;
+
+	cherokee_logger_writer_notify_t notify;
+	void                           *notify_param;
+	size_t                          notify_mark;
 } priv_t;
 
 #define PRIV(l) ((priv_t *)(l->priv))
@@ -55,6 +93,8 @@ cherokee_logger_writer_new (cherokee_logger_writer_t **writer)
 	n->type        = cherokee_logger_writer_syslog;
 	n->fd          = -1;
 	n->max_bufsize = DEFAULT_LOGGER_MAX_BUFSIZE;
+	n->ring_size   = 0;
+	n->overflow    = cherokee_logger_writer_overflow_block;
 
 	cherokee_buffer_init (&n->command);
 	cherokee_buffer_init (&n->filename);
@@ -70,6 +110,15 @@ cherokee_logger_writer_new (cherokee_logger_writer_t **writer)
 	}
 
 	CHEROKEE_MUTEX_INIT (&PRIV(n)->mutex, NULL);
+	INIT_LIST_HEAD (&PRIV(n)->rings);
+
+	PRIV(n)->ring_key_set     = false;
+	PRIV(n)->dropped_reported = 0;
+	PRIV(n)->dropped_reaped   = 0;
+	PRIV(n)->notify           = NULL;
+	PRIV(n)->notify_param     = NULL;
+	PRIV(n)->notify_mark      = 0;
+
 	n->initialized = false;
 
 	*writer = n;
@@ -113,15 +162,93 @@ logger_writer_close_file (cherokee_logger_writer_t *writer)
 }
 
 
+static void
+ring_free (ring_t *ring)
+{
+	cherokee_buffer_mrproper (&ring->line);
+
+	free (ring->data);
+	free (ring);
+}
+
+
+static size_t
+ring_pending (ring_t *ring,
+	      size_t *head)
+{
+	*head = ring->head;
+	CHEROKEE_MEMORY_BARRIER;
+
+	return *head - ring->tail;
+}
+
+
+/* Rings of the threads that have exited. It must be called with
+ * the writer mutex locked.
+ */
+static void
+rings_reap (cherokee_logger_writer_t *writer)
+{
+	size_t           head;
+	cherokee_list_t *i, *j;
+
+	list_for_each_safe (i, j, &PRIV(writer)->rings) {
+		ring_t *ring = RING(i);
+
+		if ((! ring->orphan) ||
+		    (ring_pending (ring, &head) > 0))
+		{
+			continue;
+		}
+
+		TRACE (ENTRIES, "Freeing the %d bytes ring of an exited thread\n", ring->size);
+
+		PRIV(writer)->dropped_reaped += ring->dropped;
+
+		cherokee_list_del (&ring->listed);
+		ring_free (ring);
+	}
+}
+
+
+#ifdef HAVE_PTHREAD
+static void
+ring_thread_exit (void *param)
+{
+	ring_t                   *ring   = param;
+	cherokee_logger_writer_t *writer = ring->writer;
+
+	/* Its lines might not have been written yet
+	 */
+	CHEROKEE_MUTEX_LOCK (&PRIV(writer)->mutex);
+	ring->orphan = true;
+	rings_reap (writer);
+	CHEROKEE_MUTEX_UNLOCK (&PRIV(writer)->mutex);
+}
+#endif
+
+
 ret_t
 cherokee_logger_writer_free (cherokee_logger_writer_t *writer)
 {
+	cherokee_list_t *i, *j;
+
 	logger_writer_close_file (writer);
 
 	cherokee_buffer_mrproper (&writer->buffer);
 	cherokee_buffer_mrproper (&writer->filename);
 	cherokee_buffer_mrproper (&writer->command);
 
+	list_for_each_safe (i, j, &PRIV(writer)->rings) {
+		ring_free (RING(i));
+	}
+
+#ifdef HAVE_PTHREAD
+	if (PRIV(writer)->ring_key_set) {
+		pthread_key_delete (PRIV(writer)->ring_key);
+	}
+#endif
+
 	CHEROKEE_MUTEX_DESTROY (&PRIV(writer)->mutex);
 
 	free (writer->priv);
@@ -160,6 +287,64 @@ config_read_type (cherokee_config_node_t         *config,
 }
 
 
+static ret_t
+logger_writer_configure_ring (cherokee_logger_writer_t *writer,
+			      cherokee_config_node_t   *config)
+{
+	ret_t              ret;
+	int                ring_len = DEFAULT_LOGGER_RING_SIZE;
+	cherokee_buffer_t *tmp      = NULL;
+
+	ret = cherokee_config_node_read (config, "ring_size", &tmp);
+	if (ret == ret_ok) {
+		ret = cherokee_atoi (tmp->buf, &ring_len);
+		if (ret != ret_ok) {
+			return ret_error;
+		}
+	}
+
+	ret = cherokee_config_node_read (config, "overflow", &tmp);
+	if (ret == ret_ok) {
+		if (equal_buf_str (tmp, "drop")) {
+			writer->overflow = cherokee_logger_writer_overflow_drop;
+		} else if (equal_buf_str (tmp, "block")) {
+			writer->overflow = cherokee_logger_writer_overflow_block;
+		} else {
+			LOG_CRITICAL (CHEROKEE_ERROR_LOGGER_WRITER_OVERFLOW, tmp->buf);
+			return ret_error;
+		}
+	}
+
+#ifdef HAVE_PTHREAD
+	if (ring_len <= 0) {
+		writer->ring_size = 0;
+		return ret_ok;
+	}
+
+	/* Power of two, so the offsets are a simple mask
+	 */
+	writer->ring_size = LOGGER_RING_MIN_SIZE;
+	while ((writer->ring_size < (size_t) ring_len) &&
+	       (writer->ring_size < LOGGER_MAX_BUFSIZE))
+	{
+		writer->ring_size <<= 1;
+	}
+
+	if (! PRIV(writer)->ring_key_set) {
+		if (pthread_key_create (&PRIV(writer)->ring_key, ring_thread_exit) != 0) {
+			writer->ring_size = 0;
+			return ret_ok;
+		}
+		PRIV(writer)->ring_key_set = true;
+	}
+#else
+	writer->ring_size = 0;
+#endif
+
+	return ret_ok;
+}
+
+
 ret_t
 cherokee_logger_writer_configure (cherokee_logger_writer_t *writer, cherokee_config_node_t *config)
 {
@@ -225,6 +410,13 @@ cherokee_logger_writer_configure (cherokee_logger_writer_t *writer, cherokee_con
 		writer->max_bufsize = (size_t)buf_len;
 	}
 
+	/* Per-thread rings
+	 */
+	ret = logger_writer_configure_ring (writer, config);
+	if (ret != ret_ok) {
+		return ret;
+	}
+
 	return ret_ok;
 }
 
@@ -361,9 +553,160 @@ error:
 }
 
 
+static ring_t *
+ring_peek (cherokee_logger_writer_t *writer)
+{
+#ifdef HAVE_PTHREAD
+	return pthread_getspecific (PRIV(writer)->ring_key);
+#else
+	UNUSED (writer);
+	return NULL;
+#endif
+}
+
+
+static ring_t *
+ring_get (cherokee_logger_writer_t *writer)
+{
+#ifdef HAVE_PTHREAD
+	ring_t *ring;
+
+	ring = pthread_getspecific (PRIV(writer)->ring_key);
+	if (likely (ring != NULL)) {
+		return ring;
+	}
+
+	/* First line logged by this thread
+	 */
+	ring = (ring_t *) malloc (sizeof(ring_t));
+	if (unlikely (ring == NULL)) {
+		return NULL;
+	}
+
+	ring->data = (char *) malloc (writer->ring_size);
+	if (unlikely (ring->data == NULL)) {
+		free (ring);
+		return NULL;
+	}
+
+	INIT_LIST_HEAD (&ring->listed);
+	cherokee_buffer_init (&ring->line);
+
+	ring->size    = writer->ring_size;
+	ring->head    = 0;
+	ring->tail    = 0;
+	ring->dropped = 0;
+	ring->orphan  = false;
+	ring->writer  = writer;
+
+	CHEROKEE_MUTEX_LOCK (&PRIV(writer)->mutex);
+	cherokee_list_add_tail (&ring->listed, &PRIV(writer)->rings);
+	CHEROKEE_MUTEX_UNLOCK (&PRIV(writer)->mutex);
+
+	pthread_setspecific (PRIV(writer)->ring_key, ring);
+
+	TRACE (ENTRIES, "New %d bytes ring for thread %p\n", ring->size, CHEROKEE_THREAD_SELF);
+	return ring;
+#else
+	UNUSED (writer);
+	return NULL;
+#endif
+}
+
+
+static void
+ring_notify (cherokee_logger_writer_t *writer)
+{
+	if (PRIV(writer)->notify != NULL) {
+		PRIV(writer)->notify (PRIV(writer)->notify_param);
+	}
+}
+
+
+static void
+ring_commit (cherokee_logger_writer_t *writer,
+	     ring_t                   *ring)
+{
+	size_t head;
+	size_t used;
+	size_t offset;
+	size_t first;
+	size_t len    = ring->line.len;
+
+	if (len == 0) {
+		return;
+	}
+
+	/* A line that would never fit
+	 */
+	if (unlikely (len > ring->size)) {
+		ring->dropped++;
+		goto out;
+	}
+
+	/* Wait for room, or drop the line
+	 */
+	head = ring->head;
+
+	while (true) {
+		CHEROKEE_MEMORY_BARRIER;
+		used = head - ring->tail;
+
+		if (ring->size - used >= len) {
+			break;
+		}
+
+		ring_notify (writer);
+
+		if (writer->overflow == cherokee_logger_writer_overflow_drop) {
+			ring->dropped++;
+			goto out;
+		}
+
+		usleep (1000);
+	}
+
+	/* Copy the line, it might wrap around
+	 */
+	offset = head & (ring->size - 1);
+	first  = MIN (len, ring->size - offset);
+
+	memcpy (ring->data + offset, ring->line.buf, first);
+	if (first < len) {
+		memcpy (ring->data, ring->line.buf + first, len - first);
+	}
+
+	/* Publish it
+	 */
+	CHEROKEE_MEMORY_BARRIER;
+	ring->head = head + len;
+
+	if ((used < PRIV(writer)->notify_mark) &&
+	    (used + len >= PRIV(writer)->notify_mark))
+	{
+		ring_notify (writer);
+	}
+
+out:
+	cherokee_buffer_clean (&ring->line);
+}
+
+
 ret_t
 cherokee_logger_writer_get_buf (cherokee_logger_writer_t *writer, cherokee_buffer_t **buf)
 {
+	ring_t *ring;
+
+	/* Lock-free: each thread renders into its own ring
+	 */
+	if (writer->ring_size > 0) {
+		ring = ring_get (writer);
+		if (likely (ring != NULL)) {
+			*buf = &ring->line;
+			return ret_ok;
+		}
+	}
+
 	CHEROKEE_MUTEX_LOCK (&PRIV(writer)->mutex);
 	*buf = &writer->buffer;
 
@@ -373,11 +716,240 @@ cherokee_logger_writer_get_buf (cherokee_logger_writer_t *writer, cherokee_buffe
 ret_t
 cherokee_logger_writer_release_buf (cherokee_logger_writer_t *writer)
 {
+	ret_t   ret  = ret_ok;
+	ring_t *ring = NULL;
+
+	/* Follow the path get_buf() took: the thread has no ring
+	 * when it could not be allocated, and the mutex is held.
+	 */
+	if (writer->ring_size > 0) {
+		ring = ring_peek (writer);
+		if (likely (ring != NULL)) {
+			ring_commit (writer, ring);
+			return ret_ok;
+		}
+	}
+
+	/* Flush buffer if full
+	 */
+	if (writer->buffer.len >= writer->max_bufsize) {
+		ret = cherokee_logger_writer_flush (writer, true);
+	}
+
 	CHEROKEE_MUTEX_UNLOCK (&PRIV(writer)->mutex);
+	return ret;
+}
+
+
+ret_t
+cherokee_logger_writer_set_notify (cherokee_logger_writer_t        *writer,
+				   cherokee_logger_writer_notify_t  func,
+				   void                            *param,
+				   size_t                           mark)
+{
+	PRIV(writer)->notify       = func;
+	PRIV(writer)->notify_param = param;
+	PRIV(writer)->notify_mark  = MAX (mark, 1);
+
 	return ret_ok;
 }
 
 
+ret_t
+cherokee_logger_writer_get_dropped (cherokee_logger_writer_t *writer,
+				    cullong_t                *dropped)
+{
+	cherokee_list_t *i;
+
+	CHEROKEE_MUTEX_LOCK (&PRIV(writer)->mutex);
+
+	*dropped = PRIV(writer)->dropped_reaped;
+	list_for_each (i, &PRIV(writer)->rings) {
+		*dropped += RING(i)->dropped;
+	}
+	CHEROKEE_MUTEX_UNLOCK (&PRIV(writer)->mutex);
+
+	return ret_ok;
+}
+
+
+static void
+rings_to_buffer (cherokee_logger_writer_t *writer)
+{
+	size_t           head;
+	size_t           len;
+	size_t           offset;
+	size_t           first;
+	cherokee_list_t *i;
+
+	list_for_each (i, &PRIV(writer)->rings) {
+		ring_t *ring = RING(i);
+
+		len = ring_pending (ring, &head);
+		if (len == 0) {
+			continue;
+		}
+
+		offset = ring->tail & (ring->size - 1);
+		first  = MIN (len, ring->size - offset);
+
+		cherokee_buffer_add (&writer->buffer, ring->data + offset, first);
+		if (first < len) {
+			cherokee_buffer_add (&writer->buffer, ring->data, len - first);
+		}
+
+		CHEROKEE_MEMORY_BARRIER;
+		ring->tail = head;
+	}
+}
+
+
+static ret_t
+rings_writev (cherokee_logger_writer_t *writer)
+{
+	int                 n;
+	ssize_t             nwr;
+	size_t              head;
+	size_t              len;
+	size_t              offset;
+	size_t              first;
+	size_t              total;
+	size_t              taken;
+	cherokee_boolean_t  more;
+	cherokee_list_t    *i;
+	struct iovec        iov[RING_IOV_MAX];
+	size_t              heads[RING_IOV_MAX];
+	ring_t             *rings[RING_IOV_MAX];
+
+	do {
+		n     = 0;
+		total = 0;
+		more  = false;
+
+		/* Lines that skipped the rings go first
+		 */
+		if (! cherokee_buffer_is_empty (&writer->buffer)) {
+			iov[n].iov_base = writer->buffer.buf;
+			iov[n].iov_len  = writer->buffer.len;
+			rings[n]        = NULL;
+			total          += writer->buffer.len;
+			n++;
+		}
+
+		list_for_each (i, &PRIV(writer)->rings) {
+			ring_t *ring = RING(i);
+
+			len = ring_pending (ring, &head);
+			if (len == 0) {
+				continue;
+			}
+
+			if (n + 2 > RING_IOV_MAX) {
+				more = true;
+				break;
+			}
+
+			offset = ring->tail & (ring->size - 1);
+			first  = MIN (len, ring->size - offset);
+
+			iov[n].iov_base = ring->data + offset;
+			iov[n].iov_len  = first;
+			rings[n]        = ring;
+			heads[n]        = ring->tail + first;
+			n++;
+
+			if (first < len) {
+				iov[n].iov_base = ring->data;
+				iov[n].iov_len  = len - first;
+				rings[n]        = ring;
+				heads[n]        = head;
+				n++;
+			}
+
+			total += len;
+		}
+
+		if (n == 0) {
+			return ret_ok;
+		}
+
+		do {
+			nwr = writev (writer->fd, iov, n);
+		} while (nwr == -1 && errno == EINTR);
+
+		if (nwr <= 0) {
+			/* Do not let the rings stall the threads
+			 * that are logging: discard what could not
+			 * be written. Newer lines are kept.
+			 */
+			while (n-- > 0) {
+				if (rings[n] == NULL) {
+					cherokee_buffer_clean (&writer->buffer);
+					continue;
+				}
+
+				CHEROKEE_MEMORY_BARRIER;
+				if (rings[n]->tail < heads[n]) {
+					rings[n]->tail = heads[n];
+				}
+			}
+
+			return ret_error;
+		}
+
+		TRACE (ENTRIES, "writev: %d vectors, %d of %d bytes\n", n, nwr, total);
+
+		/* Consume what has been written, in order
+		 */
+		for (len = (size_t) nwr, n = 0; len > 0; n++) {
+			taken = MIN (len, iov[n].iov_len);
+			len  -= taken;
+
+			if (rings[n] == NULL) {
+				cherokee_buffer_move_to_begin (&writer->buffer, taken);
+				continue;
+			}
+
+			CHEROKEE_MEMORY_BARRIER;
+			if (taken == iov[n].iov_len) {
+				rings[n]->tail = heads[n];
+			} else {
+				rings[n]->tail += taken;
+			}
+		}
+
+	} while ((more) || ((size_t) nwr < total));
+
+	return ret_ok;
+}
+
+
+static void
+report_dropped (cherokee_logger_writer_t *writer)
+{
+	cullong_t        dropped = PRIV(writer)->dropped_reaped;
+	cherokee_list_t *i;
+
+	list_for_each (i, &PRIV(writer)->rings) {
+		dropped += RING(i)->dropped;
+	}
+
+	if (likely (dropped == PRIV(writer)->dropped_reported)) {
+		return;
+	}
+
+	dropped -= PRIV(writer)->dropped_reported;
+	PRIV(writer)->dropped_reported += dropped;
+
+	/* The error log might be this very writer, so it cannot
+	 * be locked meanwhile.
+	 */
+	CHEROKEE_MUTEX_UNLOCK (&PRIV(writer)->mutex);
+	LOG_WARNING (CHEROKEE_ERROR_LOGGER_WRITER_DROPPED, dropped);
+	CHEROKEE_MUTEX_LOCK (&PRIV(writer)->mutex);
+}
+
+
 ret_t
 cherokee_logger_writer_flush (cherokee_logger_writer_t *writer,
 			      cherokee_boolean_t        locked)
@@ -387,7 +959,9 @@ cherokee_logger_writer_flush (cherokee_logger_writer_t *writer,
 
 	/* The internal buffer might be empty
 	 */
-	if (cherokee_buffer_is_empty (&writer->buffer)) {
+	if ((cherokee_buffer_is_empty (&writer->buffer)) &&
+	    (cherokee_list_empty (&PRIV(writer)->rings)))
+	{
 		return ret_ok;
 	}
 
@@ -395,6 +969,25 @@ cherokee_logger_writer_flush (cherokee_logger_writer_t *writer,
 		CHEROKEE_MUTEX_LOCK (&PRIV(writer)->mutex);
 	}
 
+	/* Files and pipes take the rings straight away. The rest of
+	 * writers are fed through the internal buffer.
+	 */
+	switch (writer->type) {
+	case cherokee_logger_writer_pipe:
+	case cherokee_logger_writer_file:
+		if (! cherokee_list_empty (&PRIV(writer)->rings)) {
+			ret = rings_writev (writer);
+			goto out;
+		}
+		break;
+	default:
+		rings_to_buffer (writer);
+	}
+
+	if (cherokee_buffer_is_empty (&writer->buffer)) {
+		goto out;
+	}
+
 	/* If not, do the proper thing
 	 */
 	switch (writer->type) {
@@ -461,6 +1054,11 @@ cherokee_logger_writer_flush (cherokee_logger_writer_t *writer,
 	}
 
 out:
+	if (! cherokee_list_empty (&PRIV(writer)->rings)) {
+		report_dropped (writer);
+		rings_reap (writer);
+	}
+
 	if (! locked) {
 		CHEROKEE_MUTEX_UNLOCK (&PRIV(writer)->mutex);
 	}
@@ -36,6 +36,7 @@
 CHEROKEE_BEGIN_DECLS
 
 #define LOGGER_BUF_PAGESIZE	4096	/* page size to round down write(n) */
+#define LOGGER_RING_MIN_SIZE	4096	/* smallest per-thread ring */
 
 typedef enum {
 	cherokee_logger_writer_stderr,
@@ -44,20 +45,30 @@ typedef enum {
 	cherokee_logger_writer_pipe
 } cherokee_logger_writer_types_t;
 
+typedef enum {
+	cherokee_logger_writer_overflow_drop,
+	cherokee_logger_writer_overflow_block
+} cherokee_logger_writer_overflow_t;
+
+typedef void (* cherokee_logger_writer_notify_t) (void *param);
+
 typedef struct {
-	cherokee_list_t                listed;
-	cherokee_logger_writer_types_t type;
+	cherokee_list_t                   listed;
+	cherokee_logger_writer_types_t    type;
 
-	int                            fd;
-	size_t                         max_bufsize;
-	cherokee_buffer_t              buffer;
+	int                               fd;
+	size_t                            max_bufsize;
+	cherokee_buffer_t                 buffer;
 
-	cherokee_buffer_t              filename;
-	cherokee_buffer_t              command;
+	size_t                            ring_size;
+	cherokee_logger_writer_overflow_t overflow;
 
-	cherokee_boolean_t             initialized;
+	cherokee_buffer_t                 filename;
+	cherokee_buffer_t                 command;
 
-	void                          *priv;
+	cherokee_boolean_t                initialized;
+
+	void                             *priv;
 } cherokee_logger_writer_t;
 
 #define LOGGER_WRITER(x) ((cherokee_logger_writer_t *)(x))
@@ -75,6 +86,11 @@ ret_t cherokee_logger_writer_flush       (cherokee_logger_writer_t *writer, cher
 ret_t cherokee_logger_writer_get_buf     (cherokee_logger_writer_t *writer, cherokee_buffer_t **buf);
 ret_t cherokee_logger_writer_release_buf (cherokee_logger_writer_t *writer);
 
+/* Per-thread rings
+ */
+ret_t cherokee_logger_writer_set_notify  (cherokee_logger_writer_t *writer, cherokee_logger_writer_notify_t func, void *param, size_t mark);
+ret_t cherokee_logger_writer_get_dropped (cherokee_logger_writer_t *writer, cullong_t *dropped);
+
 /* Extra */
 ret_t cherokee_logger_writer_get_id (cherokee_config_node_t *conf, cherokee_buffer_t *id);
 
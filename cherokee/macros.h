@@ -100,7 +100,11 @@
 #define LOGGER_MIN_BUFSIZE            0
 #define DEFAULT_LOGGER_MAX_BUFSIZE    32768
 #define LOGGER_MAX_BUFSIZE            (4 * 1024 * 1024)
+#define DEFAULT_LOGGER_RING_SIZE      (64 * 1024)
 #define LOGGER_FLUSH_LAPSE            10
+#define DEFAULT_RESOLV_TTL            300
+#define DEFAULT_RESOLV_NEGATIVE_TTL   10
+#define DEFAULT_RESOLV_THREADS        2
 #define RESPINS_MAX                   16
 #define SENDFILE_MIN_SIZE             (128 * 1024)   /* 128Kb */
 #define SENDFILE_MAX_SIZE             2147483647     /* 2Gb -1*/
@@ -108,6 +112,9 @@
 #define NONCE_EXPIRATION              60
 #define POST_READ_SIZE                32700
 #define FLCACHE_LAPSE                 60
+#define FLCACHE_MEMORY_MAX_SIZE       (8 * 1024 * 1024)   /* 8Mb */
+#define FLCACHE_MEMORY_MAX_FILE_SIZE  (64 * 1024)         /* 64Kb */
+#define FLCACHE_COALESCE_TIMEOUT      5
 
 #define FD_NUM_SPARE                  10        /* range:  8 ... 20    */
 #define FD_NUM_MIN_SYSTEM             20        /* range: 16 ... 64    */
@@ -30,11 +30,28 @@
 
 #define ENTRIES           "post"
 #define HTTP_100_RESPONSE "HTTP/1.1 100 Continue" CRLF CRLF
+#define SPLICE_SIZE       (64 * 1024)
 
 
 /* Base functions
  */
 
+static void
+splice_close (cherokee_post_t *post)
+{
+	if (post->send.splice_pipe[0] != -1) {
+		cherokee_fd_close (post->send.splice_pipe[0]);
+		post->send.splice_pipe[0] = -1;
+	}
+
+	if (post->send.splice_pipe[1] != -1) {
+		cherokee_fd_close (post->send.splice_pipe[1]);
+		post->send.splice_pipe[1] = -1;
+	}
+
+	post->send.splice_len = 0;
+}
+
 ret_t
 cherokee_post_init (cherokee_post_t *post)
 {
@@ -45,9 +62,14 @@ cherokee_post_init (cherokee_post_t *post)
 
 	post->send.phase         = cherokee_post_send_phase_read;
 	post->send.read          = 0;
+	post->send.splice_pipe[0] = -1;
+	post->send.splice_pipe[1] = -1;
+	post->send.splice_len    = 0;
+	post->send.splice_off    = false;
 
 	post->chunked.last       = false;
 	post->chunked.processed  = 0;
+	post->chunked.left       = 0;
 	post->chunked.retransmit = false;
 
 	cherokee_buffer_init (&post->send.buffer);
@@ -69,11 +91,18 @@ cherokee_post_clean (cherokee_post_t *post)
 
 	post->send.phase         = cherokee_post_send_phase_read;
 	post->send.read          = 0;
+	post->send.splice_off    = false;
 
 	post->chunked.last       = false;
 	post->chunked.processed  = 0;
+	post->chunked.left       = 0;
 	post->chunked.retransmit = false;
 
+	/* Idle connections must not hold the pipe: its fds are
+	 * not accounted in the server's limit
+	 */
+	splice_close (post);
+
 	cherokee_buffer_mrproper (&post->send.buffer);
 	cherokee_buffer_mrproper (&post->chunked.buffer);
 	cherokee_buffer_mrproper (&post->read_header_100cont);
@@ -86,6 +115,8 @@ cherokee_post_clean (cherokee_post_t *post)
 ret_t
 cherokee_post_mrproper (cherokee_post_t *post)
 {
+	splice_close (post);
+
 	cherokee_buffer_mrproper (&post->send.buffer);
 	cherokee_buffer_mrproper (&post->chunked.buffer);
 	cherokee_buffer_mrproper (&post->read_header_100cont);
@@ -289,6 +320,7 @@ process_chunk (cherokee_post_t   *post,
 	char    *p;
 	char    *begin;
 	char    *end;
+	off_t    len;
         ssize_t  content_size;
 
         TRACE (ENTRIES, "Post in-buffer len=%d\n", in->len);
@@ -299,6 +331,28 @@ process_chunk (cherokee_post_t   *post,
         while (true) {
                 end = in->buf + in->len;
 
+		/* Body of the current chunk. It is passed on as it
+		 * arrives, so big chunks are never held in memory.
+		 */
+		if (post->chunked.left > 0) {
+			len = MIN (end - p, post->chunked.left);
+			if (len <= 0) {
+				break;
+			}
+
+			if (post->chunked.retransmit) {
+				cherokee_buffer_add (out, p, len);
+			} else if (post->chunked.left > 2) {
+				cherokee_buffer_add (out, p, MIN (len, post->chunked.left - 2));
+			}
+
+			post->chunked.left -= len;
+
+			p     += len;
+			begin  = p;
+			continue;
+		}
+
                 /* Iterate through the number
 		 */
                 while ((p < end) &&
@@ -307,8 +361,8 @@ process_chunk (cherokee_post_t   *post,
                         ((*p >= 'A') && (*p <= 'F'))))
                         p++;
 
-                if (unlikely (p+2 > end)) {
-                        return ret_ok;
+                if (p+2 > end) {
+                        break;
 		}
 
                 /* Check the CRLF after the length
@@ -329,20 +383,10 @@ process_chunk (cherokee_post_t   *post,
                         return ret_error;
 		}
 
-                /* Check if there's enough info
+		/* Last block check
 		 */
                 if (content_size == 0) {
                         post->chunked.last = true;
-
-		} else if (p + content_size + 2 > end) {
-                        TRACE (ENTRIES, "Unfinished chunk(len="FMT_OFFSET"), has=%d, out->len="FMT_OFFSET"\n",
-                               content_size, (int)(end-p), out->len);
-			break;
-                }
-
-		/* Last block check
-		 */
-                if (post->chunked.last) {
                         TRACE(ENTRIES, "Last chunk: %s\n", "exiting");
 
 			if (post->chunked.retransmit) {
@@ -352,20 +396,19 @@ process_chunk (cherokee_post_t   *post,
 			break;
 		}
 
-		/* Move the information
+		/* Chunk header
 		 */
 		if (post->chunked.retransmit) {
-			cherokee_buffer_add (out, begin, (p + content_size + 2) - begin);
-		} else {
-			cherokee_buffer_add (out, p, content_size);
+			cherokee_buffer_add (out, begin, p - begin);
 		}
 
                 TRACE (ENTRIES, "Processing chunk len=%d\n", content_size);
 
-                /* Next iteration
+		/* The body, and its trailing CRLF
 		 */
-                begin = p + content_size + 2;
-		p = begin;
+		post->chunked.left = content_size + 2;
+
+		begin = p;
 	}
 
 	/* Clean up in-buffer
@@ -376,7 +419,9 @@ process_chunk (cherokee_post_t   *post,
 
 	/* Very unlikely, but still possible
 	 */
-	if (! cherokee_buffer_is_empty(in)) {
+	if ((post->chunked.last) &&
+	    (! cherokee_buffer_is_empty(in)))
+	{
 		TRACE (ENTRIES, "There are %d left-over bytes in the post buffer -> incoming header", in->len);
 /* 		cherokee_buffer_add_buffer (&conn->incoming_header, in); */
 /* 		cherokee_buffer_clean (in); */
@@ -533,7 +578,179 @@ do_send_socket (cherokee_socket_t        *sock,
 int
 cherokee_post_has_buffered_info (cherokee_post_t *post)
 {
-	return (! cherokee_buffer_is_empty (&post->send.buffer));
+	return ((! cherokee_buffer_is_empty (&post->send.buffer)) ||
+		(post->send.splice_len > 0));
+}
+
+
+static ret_t
+splice_init (cherokee_post_t *post)
+{
+#ifdef HAVE_SPLICE
+	int re;
+
+	re = pipe (post->send.splice_pipe);
+	if (re != 0) {
+		post->send.splice_pipe[0] = -1;
+		post->send.splice_pipe[1] = -1;
+		return ret_error;
+	}
+
+	cherokee_fd_set_closexec (post->send.splice_pipe[0]);
+	cherokee_fd_set_closexec (post->send.splice_pipe[1]);
+
+	TRACE (ENTRIES, "Post splice pipe=%d,%d\n",
+	       post->send.splice_pipe[0], post->send.splice_pipe[1]);
+	return ret_ok;
+#else
+	UNUSED(post);
+	return ret_no_sys;
+#endif
+}
+
+
+static ret_t
+splice_drain (cherokee_post_t   *post,
+	      cherokee_buffer_t *buffer)
+{
+	ret_t  ret;
+	size_t size;
+
+	/* Move whatever is in the pipe to the buffer, so the
+	 * regular path can take it from there.
+	 */
+	while (post->send.splice_len > 0) {
+		ret = cherokee_buffer_read_from_fd (buffer, post->send.splice_pipe[0],
+						    post->send.splice_len, &size);
+		if (ret != ret_ok) {
+			return ret_error;
+		}
+
+		post->send.splice_len -= size;
+	}
+
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_post_send_splice (cherokee_post_t          *post,
+			   cherokee_socket_t        *sock_in,
+			   int                       fd_out,
+			   cherokee_buffer_t        *tmp,
+			   cherokee_socket_status_t *blocking,
+			   cherokee_boolean_t       *did_IO)
+{
+	ret_t              ret;
+	size_t             size;
+	off_t              to_read;
+	cherokee_buffer_t *buffer  = tmp ? tmp : &post->send.buffer;
+
+	/* Plain posts only, once the header surplus has been sent.
+	 * The kernel moves the body from the client socket to the
+	 * back-end through a pipe. Nothing else is read from the
+	 * client until the pipe has been drained.
+	 */
+	if ((post->send.splice_off) ||
+	    (post->encoding != post_enc_regular) ||
+	    (! cherokee_buffer_is_empty (&post->header_surplus)))
+	{
+		return ret_no_sys;
+	}
+
+	if ((post->send.splice_len == 0) &&
+	    (cherokee_post_read_finished (post)))
+	{
+		return ret_ok;
+	}
+
+	if (post->send.splice_pipe[0] == -1) {
+		if (sock_in->is_tls == TLS) {
+			post->send.splice_off = true;
+			return ret_no_sys;
+		}
+
+		ret = splice_init (post);
+		if (ret != ret_ok) {
+			post->send.splice_off = true;
+			return ret_no_sys;
+		}
+	}
+
+	/* Client -> pipe
+	 */
+	if ((post->send.splice_len == 0) &&
+	    (! cherokee_post_read_finished (post)))
+	{
+		to_read = MIN (post->len - post->send.read, SPLICE_SIZE);
+
+		ret = cherokee_socket_splice_in (sock_in, post->send.splice_pipe[1], to_read, &size);
+		switch (ret) {
+		case ret_ok:
+			break;
+		case ret_eagain:
+			*blocking = socket_reading;
+			return ret_eagain;
+		case ret_no_sys:
+			post->send.splice_off = true;
+			return ret_no_sys;
+		case ret_eof:
+			return ret_eof;
+		default:
+			return ret_error;
+		}
+
+		TRACE (ENTRIES, "Post spliced from client: %d bytes\n", size);
+
+		post->send.read       += size;
+		post->send.splice_len  = size;
+		*did_IO                = true;
+	}
+
+	/* Pipe -> back-end
+	 */
+	if (post->send.splice_len > 0) {
+		ret = cherokee_socket_splice_fd (post->send.splice_pipe[0], fd_out,
+						 post->send.splice_len, &size);
+		switch (ret) {
+		case ret_ok:
+			break;
+		case ret_eagain:
+			*blocking = socket_writing;
+			return ret_eagain;
+		case ret_no_sys:
+			TRACE (ENTRIES, "Back-end does not take splice(), %d bytes go to the buffer\n",
+			       post->send.splice_len);
+
+			post->send.splice_off = true;
+
+			ret = splice_drain (post, buffer);
+			if (ret != ret_ok) {
+				return ret_error;
+			}
+
+			post->send.phase = cherokee_post_send_phase_write;
+			return ret_no_sys;
+		default:
+			return ret_error;
+		}
+
+		TRACE (ENTRIES, "Post spliced to back-end: %d bytes\n", size);
+
+		post->send.splice_len -= size;
+		*did_IO                = true;
+
+		if (post->send.splice_len > 0) {
+			return ret_eagain;
+		}
+	}
+
+	if (! cherokee_post_read_finished (post)) {
+		return ret_eagain;
+	}
+
+	TRACE (ENTRIES, "Post splice: %s\n", "finished");
+	return ret_ok;
 }
 
 
@@ -548,6 +765,18 @@ cherokee_post_send_to_socket (cherokee_post_t          *post,
 	ret_t              ret;
 	cherokee_buffer_t *buffer = tmp ? tmp : &post->send.buffer;
 
+	/* Zero-copy, if possible
+	 */
+	if ((post->send.phase == cherokee_post_send_phase_read) &&
+	    (sock_out->is_tls != TLS))
+	{
+		ret = cherokee_post_send_splice (post, sock_in, SOCKET_FD(sock_out),
+						 tmp, blocking, did_IO);
+		if (ret != ret_no_sys) {
+			return ret;
+		}
+	}
+
 	switch (post->send.phase) {
 	case cherokee_post_send_phase_read:
 		TRACE (ENTRIES, "Post send, phase: %s\n", "read");
@@ -631,6 +860,15 @@ cherokee_post_send_to_fd (cherokee_post_t          *post,
 	int                r;
 	cherokee_buffer_t *buffer = tmp ? tmp : &post->send.buffer;
 
+	/* Zero-copy, if possible
+	 */
+	if (post->send.phase == cherokee_post_send_phase_read) {
+		ret = cherokee_post_send_splice (post, sock_in, fd_out,
+						 tmp, blocking, did_IO);
+		if (ret != ret_no_sys) {
+			return ret;
+		}
+	}
 
 	switch (post->send.phase) {
 	case cherokee_post_send_phase_read:
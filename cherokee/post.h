@@ -57,11 +57,15 @@ typedef struct {
 		off_t                      read;
 		cherokee_post_send_phase_t phase;
 		cherokee_buffer_t          buffer;
+		int                        splice_pipe[2];
+		size_t                     splice_len;
+		cherokee_boolean_t         splice_off;
 	} send;
 
 	struct {
 		cherokee_boolean_t         last;
 		off_t                      processed;
+		off_t                      left;
 		cherokee_buffer_t          buffer;
 		cherokee_boolean_t         retransmit;
 	} chunked;
@@ -104,6 +108,13 @@ ret_t cherokee_post_send_to_fd        (cherokee_post_t          *post,
 				       cherokee_socket_status_t *blocking,
 				       cherokee_boolean_t       *did_IO);
 
+ret_t cherokee_post_send_splice       (cherokee_post_t          *post,
+				       cherokee_socket_t        *sock_in,
+				       int                       fd_out,
+				       cherokee_buffer_t        *tmp,
+				       cherokee_socket_status_t *blocking,
+				       cherokee_boolean_t       *did_IO);
+
 CHEROKEE_END_DECLS
 
 #endif /* CHEROKEE_POST_H */
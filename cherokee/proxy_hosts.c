@@ -29,77 +29,74 @@
 
 #define ENTRIES "proxy"
 
+/* Idle connections kept by each thread. The rest of them go to
+ * the shared list of the poll.
+ */
+#define LOCAL_MAX 4
 
-static void
-poll_free (void *p)
-{
-	cherokee_handler_proxy_poll_t *poll = p;
-	poll = p;
-}
 
 ret_t
 cherokee_handler_proxy_hosts_init (cherokee_handler_proxy_hosts_t *hosts)
 {
- 	CHEROKEE_MUTEX_INIT (&hosts->hosts_mutex, CHEROKEE_MUTEX_FAST);
-	cherokee_avl_init (&hosts->hosts);
-	cherokee_buffer_init (&hosts->tmp);
-
+	INIT_LIST_HEAD (&hosts->polls);
 	return ret_ok;
 }
 
 ret_t
 cherokee_handler_proxy_hosts_mrproper (cherokee_handler_proxy_hosts_t *hosts)
 {
-	CHEROKEE_MUTEX_DESTROY (&hosts->hosts_mutex);
-	cherokee_avl_mrproper (&hosts->hosts, poll_free);
-	cherokee_buffer_mrproper (&hosts->tmp);
+	cherokee_list_t *i, *j;
+
+	list_for_each_safe (i, j, &hosts->polls) {
+		cherokee_list_del (i);
+		cherokee_handler_proxy_poll_free (PROXY_POLL(i));
+	}
 
 	return ret_ok;
 }
 
 ret_t
-cherokee_handler_proxy_hosts_get (cherokee_handler_proxy_hosts_t  *hosts,
-				  cherokee_source_t               *src,
-				  cherokee_handler_proxy_poll_t  **poll,
-				  cuint_t                          reuse_max)
+cherokee_handler_proxy_hosts_add (cherokee_handler_proxy_hosts_t *hosts,
+				  cherokee_source_t              *src,
+				  cuint_t                         reuse_max,
+				  cuint_t                         reuse_min)
 {
 	ret_t                          ret;
 	cherokee_handler_proxy_poll_t *n;
 
-	CHEROKEE_MUTEX_LOCK (&hosts->hosts_mutex);
-
-	/* Build the index name */
-	cherokee_buffer_clean       (&hosts->tmp);
-	cherokee_buffer_add_buffer  (&hosts->tmp, &src->host);
-	cherokee_buffer_add_char    (&hosts->tmp, ':');
-	cherokee_buffer_add_ulong10 (&hosts->tmp, src->port);
-
-	/* Check the hosts tree */
-	ret = cherokee_avl_get (&hosts->hosts, &hosts->tmp, (void **)poll);
-	switch (ret) {
-	case ret_ok:
-		break;
-	case ret_not_found: {
-		ret = cherokee_handler_proxy_poll_new (&n, reuse_max);
-		if (ret != ret_ok) {
-			goto error;
-		}
-
-		cherokee_avl_add (&hosts->hosts, &hosts->tmp, n);
-		*poll = n;
-		break;
+	/* Is it already there? */
+	ret = cherokee_handler_proxy_hosts_get (hosts, src, &n);
+	if (ret == ret_ok) {
+		return ret_ok;
 	}
-	default:
-		goto error;
+
+	ret = cherokee_handler_proxy_poll_new (&n, src, reuse_max, reuse_min);
+	if (ret != ret_ok) {
+		return ret_error;
 	}
 
-	/* Got it */
-	CHEROKEE_MUTEX_UNLOCK (&hosts->hosts_mutex);
+	cherokee_list_add_tail (&n->listed, &hosts->polls);
 	return ret_ok;
+}
 
-error:
-	CHEROKEE_MUTEX_UNLOCK (&hosts->hosts_mutex);
-	return ret_error;
+ret_t
+cherokee_handler_proxy_hosts_get (cherokee_handler_proxy_hosts_t  *hosts,
+				  cherokee_source_t               *src,
+				  cherokee_handler_proxy_poll_t  **poll)
+{
+	cherokee_list_t *i;
+
+	/* The list does not change after the configuration has
+	 * been read, so it can be walked without locking it.
+	 */
+	list_for_each (i, &hosts->polls) {
+		if (PROXY_POLL(i)->src_ref == src) {
+			*poll = PROXY_POLL(i);
+			return ret_ok;
+		}
+	}
+
+	return ret_not_found;
 }
 
 
@@ -108,143 +105,362 @@ error:
 
 ret_t
 cherokee_handler_proxy_poll_new (cherokee_handler_proxy_poll_t **poll,
-				 cuint_t                         reuse_max)
+				 cherokee_source_t              *src,
+				 cuint_t                         reuse_max,
+				 cuint_t                         reuse_min)
 {
 	CHEROKEE_NEW_STRUCT (n, handler_proxy_poll);
 
+	n->src_ref   = src;
 	n->reuse_len = 0;
 	n->reuse_max = reuse_max;
+	n->reuse_min = MIN (reuse_min, reuse_max);
+	n->opening   = 0;
+	n->local_max = MIN (LOCAL_MAX, reuse_max);
 
+	INIT_LIST_HEAD (&n->listed);
 	INIT_LIST_HEAD (&n->active);
 	INIT_LIST_HEAD (&n->reuse);
+	INIT_LIST_HEAD (&n->locals);
 	CHEROKEE_MUTEX_INIT (&n->mutex, CHEROKEE_MUTEX_FAST);
 
+#ifdef HAVE_PTHREAD
+	if (pthread_key_create (&n->locals_key, NULL) != 0) {
+		CHEROKEE_MUTEX_DESTROY (&n->mutex);
+		free (n);
+		return ret_error;
+	}
+#endif
+
 	*poll = n;
 	return ret_ok;
 }
 
 
+static void
+conns_free (cherokee_list_t *conns)
+{
+	cherokee_list_t *i, *j;
+
+	list_for_each_safe (i, j, conns) {
+		cherokee_list_del (i);
+		cherokee_handler_proxy_conn_free (PROXY_CONN(i));
+	}
+}
+
+
 ret_t
 cherokee_handler_proxy_poll_free (cherokee_handler_proxy_poll_t *poll)
 {
-	cherokee_list_t               *i, *j;
-	cherokee_handler_proxy_conn_t *poll_conn;
+	cherokee_list_t                *i, *j;
+	cherokee_handler_proxy_local_t *local;
 
-	list_for_each_safe (i, j, &poll->active) {
-		poll_conn = PROXY_CONN(i);
-		cherokee_list_del (&poll_conn->listed);
-		cherokee_handler_proxy_conn_free (poll_conn);
-	}
+	/* The threads are gone by now, so their lists can be
+	 * freed from here.
+	 */
+	list_for_each_safe (i, j, &poll->locals) {
+		local = (cherokee_handler_proxy_local_t *) i;
 
-	list_for_each_safe (i, j, &poll->reuse) {
-		poll_conn = PROXY_CONN(i);
+		conns_free (&local->active);
+		conns_free (&local->reuse);
 
-		poll->reuse_len -= 1;
-		cherokee_list_del (&poll_conn->listed);
-		cherokee_handler_proxy_conn_free (poll_conn);
+		cherokee_list_del (&local->listed);
+		free (local);
 	}
 
+	conns_free (&poll->active);
+	conns_free (&poll->reuse);
+	poll->reuse_len = 0;
+
+#ifdef HAVE_PTHREAD
+	pthread_key_delete (poll->locals_key);
+#endif
 	CHEROKEE_MUTEX_DESTROY (&poll->mutex);
+
+	free (poll);
 	return ret_ok;
 }
 
 
-ret_t
-cherokee_handler_proxy_poll_get (cherokee_handler_proxy_poll_t  *poll,
-				 cherokee_handler_proxy_conn_t **pconn,
-				 cherokee_source_t              *src)
+static cherokee_handler_proxy_local_t *
+local_get (cherokee_handler_proxy_poll_t *poll)
 {
-	ret_t            ret;
-	cherokee_list_t *i;
+	cherokee_handler_proxy_local_t *local;
 
-	CHEROKEE_MUTEX_LOCK (&poll->mutex);
+	if (poll->local_max == 0) {
+		return NULL;
+	}
 
-	if (poll->reuse_len > 0) {
-		/* Reuse a prev connection */
-		poll->reuse_len -= 1;
+#ifdef HAVE_PTHREAD
+	local = pthread_getspecific (poll->locals_key);
+#else
+	local = cherokee_list_empty (&poll->locals) ? NULL :
+		(cherokee_handler_proxy_local_t *) poll->locals.next;
+#endif
+	if (likely (local != NULL)) {
+		return local;
+	}
 
-		i = poll->reuse.prev;
-		cherokee_list_del (i);
-		cherokee_list_add (i, &poll->active);
+	/* First connection of the thread. The lists are kept by
+	 * the poll, and freed along with it.
+	 */
+	local = malloc (sizeof (cherokee_handler_proxy_local_t));
+	if (unlikely (local == NULL)) {
+		return NULL;
+	}
 
-		*pconn = PROXY_CONN(i);
-	} else {
-		cherokee_handler_proxy_conn_t *n;
+	INIT_LIST_HEAD (&local->active);
+	INIT_LIST_HEAD (&local->reuse);
+	local->reuse_len = 0;
 
-		/* Create a new connection */
-		ret = cherokee_handler_proxy_conn_new (&n);
-		if (ret != ret_ok)
-			goto error;
+	CHEROKEE_MUTEX_LOCK (&poll->mutex);
+	cherokee_list_add (&local->listed, &poll->locals);
+	CHEROKEE_MUTEX_UNLOCK (&poll->mutex);
 
-		ret = cherokee_handler_proxy_conn_get_addrinfo (n, src);
-		if (ret != ret_ok) {
-			cherokee_handler_proxy_conn_free (n);
-			goto error;
-		}
+#ifdef HAVE_PTHREAD
+	pthread_setspecific (poll->locals_key, local);
+#endif
+	return local;
+}
 
-		ret = cherokee_handler_proxy_conn_init_socket (n, src);
-		if (ret != ret_ok) {
-			cherokee_handler_proxy_conn_free (n);
-			goto error;
-		}
 
-		cherokee_list_add (&n->listed, &poll->active);
-		n->poll_ref = poll;
-		*pconn = n;
+static cherokee_boolean_t
+conn_is_alive (cherokee_handler_proxy_conn_t *pconn)
+{
+	int  re;
+	char tmp;
+
+	/* An idle connection must not have anything to read: EOF
+	 * means the server closed it, and data would not belong to
+	 * any request.
+	 */
+	do {
+		re = recv (pconn->socket.socket, &tmp, 1, MSG_PEEK | MSG_DONTWAIT);
+	} while ((re < 0) && (errno == EINTR));
+
+	if (re < 0) {
+		return ((errno == EAGAIN) || (errno == EWOULDBLOCK));
 	}
 
-	CHEROKEE_MUTEX_UNLOCK (&poll->mutex);
+	return false;
+}
+
+
+static ret_t
+conn_preopen (cherokee_handler_proxy_poll_t  *poll,
+	      cherokee_handler_proxy_conn_t **pconn)
+{
+	ret_t                          ret;
+	int                            fd  = -1;
+	cherokee_handler_proxy_conn_t *n   = NULL;
+
+	ret = cherokee_handler_proxy_conn_new (&n);
+	if (ret != ret_ok)
+		return ret_error;
+
+	n->poll_ref = poll;
+
+	/* It does not wait for the name resolution: the connection
+	 * will be opened next time, once the address is cached.
+	 */
+	ret = cherokee_handler_proxy_conn_get_addrinfo (n, poll->src_ref, &fd);
+	if (ret != ret_ok)
+		goto error;
+
+	ret = cherokee_handler_proxy_conn_init_socket (n, poll->src_ref);
+	if (ret != ret_ok)
+		goto error;
+
+	/* Nor for the connection. If it is still in progress when
+	 * the connection is reused, the handler completes it.
+	 */
+	ret = cherokee_socket_connect (&n->socket);
+	if ((ret != ret_ok) && (ret != ret_eagain))
+		goto error;
+
+	TRACE (ENTRIES, "Pre-opened connection fd=%d\n", n->socket.socket);
+
+	*pconn = n;
 	return ret_ok;
+
 error:
-	CHEROKEE_MUTEX_UNLOCK (&poll->mutex);
+	cherokee_handler_proxy_conn_free (n);
 	return ret_error;
 }
 
+static cuint_t
+poll_preopen_reserve (cherokee_handler_proxy_poll_t *poll)
+{
+	cuint_t num;
+
+	/* Must be called with the mutex locked. The connections
+	 * are reserved, so other threads do not open them too.
+	 */
+	if (poll->reuse_len + poll->opening >= poll->reuse_min)
+		return 0;
+
+	num = poll->reuse_min - (poll->reuse_len + poll->opening);
+	poll->opening += num;
+
+	return num;
+}
+
+static void
+poll_preopen (cherokee_handler_proxy_poll_t *poll,
+	      cuint_t                        num)
+{
+	ret_t                          ret;
+	cuint_t                        n;
+	cherokee_handler_proxy_conn_t *pconn;
+
+	for (n = 0; n < num; n++) {
+		ret = conn_preopen (poll, &pconn);
+		if (ret != ret_ok)
+			break;
+
+		CHEROKEE_MUTEX_LOCK (&poll->mutex);
+		poll->reuse_len += 1;
+		cherokee_list_add_tail (&pconn->listed, &poll->reuse);
+		CHEROKEE_MUTEX_UNLOCK (&poll->mutex);
+	}
+
+	CHEROKEE_MUTEX_LOCK (&poll->mutex);
+	poll->opening -= num;
+	CHEROKEE_MUTEX_UNLOCK (&poll->mutex);
+}
+
 static ret_t
-poll_release (cherokee_handler_proxy_poll_t *poll,
-	      cherokee_handler_proxy_conn_t *pconn)
+poll_reuse (cherokee_handler_proxy_poll_t  *poll,
+	    cherokee_list_t                *reuse,
+	    cuint_t                        *reuse_len,
+	    cherokee_handler_proxy_conn_t **pconn)
 {
-	/* Not longer an active connection */
-	cherokee_list_del (&pconn->listed);
+	cherokee_list_t *i;
 
-	/* Don't reuse connection w/o keep-alive
+	/* Reuse the most recently used connection. The least
+	 * recently used ones are left to be evicted.
 	 */
-	if (! pconn->keepalive_in) {
-		cherokee_handler_proxy_conn_free (pconn);
+	while (*reuse_len > 0) {
+		*reuse_len -= 1;
+
+		i = reuse->next;
+		cherokee_list_del (i);
+
+		if (! conn_is_alive (PROXY_CONN(i))) {
+			TRACE (ENTRIES, "Discarding closed connection fd=%d\n",
+			       PROXY_CONN(i)->socket.socket);
+
+			CHEROKEE_ATOMIC_ADD (&poll->src_ref->pool.evictions, 1);
+			cherokee_handler_proxy_conn_free (PROXY_CONN(i));
+			continue;
+		}
+
+		*pconn = PROXY_CONN(i);
 		return ret_ok;
 	}
 
-	/* If the reuse-list is full, dispose the oldest obj
+	return ret_not_found;
+}
+
+ret_t
+cherokee_handler_proxy_poll_get (cherokee_handler_proxy_poll_t  *poll,
+				 cherokee_handler_proxy_conn_t **pconn,
+				 cherokee_source_t              *src)
+{
+	ret_t                           ret;
+	cuint_t                         preopen;
+	cherokee_handler_proxy_conn_t  *n      = NULL;
+	cherokee_handler_proxy_local_t *local;
+
+	/* The connections of the thread go first. They do not
+	 * need the lock.
 	 */
-	if (poll->reuse_len > poll->reuse_max) {
-		cherokee_handler_proxy_conn_t *oldest;
+	local = local_get (poll);
 
-		oldest = PROXY_CONN(poll->reuse.prev);
-		cherokee_list_del (&oldest->listed);
-		poll->reuse_len -= 1;
+	if (local != NULL) {
+		ret = poll_reuse (poll, &local->reuse, &local->reuse_len, &n);
+		if (ret == ret_ok)
+			goto reuse;
+	}
 
-		cherokee_handler_proxy_conn_free (oldest);
+	/* Then the shared ones, which are topped up to the
+	 * minimum with pre-opened connections.
+	 */
+	CHEROKEE_MUTEX_LOCK (&poll->mutex);
+
+	ret = poll_reuse (poll, &poll->reuse, &poll->reuse_len, &n);
+	if ((ret == ret_ok) && (local == NULL)) {
+		cherokee_list_add (&n->listed, &poll->active);
 	}
 
-	/* Clean up
+	preopen = poll_preopen_reserve (poll);
+	CHEROKEE_MUTEX_UNLOCK (&poll->mutex);
+
+	if (preopen > 0) {
+		poll_preopen (poll, preopen);
+	}
+
+	if (ret == ret_ok)
+		goto reuse;
+
+	/* Create a new connection */
+	CHEROKEE_ATOMIC_ADD (&src->pool.misses, 1);
+
+	ret = cherokee_handler_proxy_conn_new (&n);
+	if (ret != ret_ok)
+		return ret_error;
+
+	/* The address is resolved, and the socket set up, by the
+	 * handler: the look-up must not block the thread.
 	 */
-	pconn->keepalive_in = false;
-	pconn->size_in      = 0;
-	pconn->sent_out     = 0;
-	pconn->enc          = pconn_enc_none;
+	n->poll_ref = poll;
 
-	pconn->post.do_buf_sent = true;
-	pconn->post.sent        = 0;
+	if (local == NULL) {
+		CHEROKEE_MUTEX_LOCK (&poll->mutex);
+		cherokee_list_add (&n->listed, &poll->active);
+		CHEROKEE_MUTEX_UNLOCK (&poll->mutex);
+	}
 
-	cherokee_buffer_clean (&pconn->post.buf_temp);
-	cherokee_buffer_clean (&pconn->header_in_raw);
+	goto out;
 
-	/* Store it to be reused
+reuse:
+	CHEROKEE_ATOMIC_ADD (&src->pool.hits, 1);
+
+out:
+	n->local_ref = local;
+	if (local != NULL) {
+		cherokee_list_add (&n->listed, &local->active);
+	}
+
+	*pconn = n;
+	return ret_ok;
+}
+
+static void
+poll_release_shared (cherokee_handler_proxy_poll_t *poll,
+		     cherokee_handler_proxy_conn_t *pconn)
+{
+	cherokee_handler_proxy_conn_t *oldest;
+
+	/* Must be called with the mutex locked. If the list is
+	 * full, evict the least recently used connection.
 	 */
+	if (poll->reuse_len >= poll->reuse_max) {
+		if (unlikely (poll->reuse_len == 0)) {
+			cherokee_handler_proxy_conn_free (pconn);
+			return;
+		}
+
+		oldest = PROXY_CONN(poll->reuse.prev);
+		cherokee_list_del (&oldest->listed);
+		poll->reuse_len -= 1;
+
+		CHEROKEE_ATOMIC_ADD (&poll->src_ref->pool.evictions, 1);
+		cherokee_handler_proxy_conn_free (oldest);
+	}
+
 	poll->reuse_len += 1;
 	cherokee_list_add (&pconn->listed, &poll->reuse);
-
-	return ret_ok;
 }
 
 
@@ -268,6 +484,7 @@ cherokee_handler_proxy_conn_new (cherokee_handler_proxy_conn_t **pconn)
 	cherokee_buffer_ensure_size (&n->header_in_raw, 512);
 
 	n->poll_ref      = NULL;
+	n->local_ref     = NULL;
 	n->keepalive_in  = false;
 	n->size_in       = 0;
 	n->sent_out      = 0;
@@ -284,6 +501,13 @@ cherokee_handler_proxy_conn_new (cherokee_handler_proxy_conn_t **pconn)
 ret_t
 cherokee_handler_proxy_conn_free (cherokee_handler_proxy_conn_t *pconn)
 {
+	cherokee_resolv_cache_t *resolv;
+
+	if (pconn->addr_info_ref != NULL) {
+		cherokee_resolv_cache_get_default (&resolv);
+		cherokee_resolv_cache_release_addrinfo (resolv, pconn->addr_info_ref);
+	}
+
 	cherokee_socket_close    (&pconn->socket);
 	cherokee_socket_mrproper (&pconn->socket);
 
@@ -298,14 +522,69 @@ cherokee_handler_proxy_conn_free (cherokee_handler_proxy_conn_t *pconn)
 ret_t
 cherokee_handler_proxy_conn_release (cherokee_handler_proxy_conn_t *pconn)
 {
-	ret_t                          ret;
-	cherokee_handler_proxy_poll_t *poll = pconn->poll_ref;
+	cherokee_handler_proxy_conn_t  *oldest;
+	cherokee_handler_proxy_poll_t  *poll   = pconn->poll_ref;
+	cherokee_handler_proxy_local_t *local  = pconn->local_ref;
 
-	CHEROKEE_MUTEX_LOCK (&poll->mutex);
-	ret = poll_release (poll, pconn);
-	CHEROKEE_MUTEX_UNLOCK (&poll->mutex);
+	/* Not longer an active connection. The lists of the
+	 * thread are only touched by the thread itself.
+	 */
+	if (local != NULL) {
+		cherokee_list_del (&pconn->listed);
+	} else {
+		CHEROKEE_MUTEX_LOCK (&poll->mutex);
+		cherokee_list_del (&pconn->listed);
+		CHEROKEE_MUTEX_UNLOCK (&poll->mutex);
+	}
+
+	/* Don't reuse connection w/o keep-alive
+	 */
+	if (! pconn->keepalive_in) {
+		cherokee_handler_proxy_conn_free (pconn);
+		return ret_ok;
+	}
+
+	/* Clean up
+	 */
+	pconn->keepalive_in = false;
+	pconn->size_in      = 0;
+	pconn->sent_out     = 0;
+	pconn->enc          = pconn_enc_none;
+	pconn->local_ref    = NULL;
+
+	pconn->post.do_buf_sent = true;
+	pconn->post.sent        = 0;
+
+	cherokee_buffer_clean (&pconn->post.buf_temp);
+	cherokee_buffer_clean (&pconn->header_in_raw);
+
+	/* Store it to be reused
+	 */
+	if (local == NULL) {
+		CHEROKEE_MUTEX_LOCK (&poll->mutex);
+		poll_release_shared (poll, pconn);
+		CHEROKEE_MUTEX_UNLOCK (&poll->mutex);
+		return ret_ok;
+	}
 
-	return ret;
+	/* If the list of the thread is full, its least recently
+	 * used connection overflows to the shared list, where the
+	 * rest of threads can still reuse it.
+	 */
+	if (local->reuse_len >= poll->local_max) {
+		oldest = PROXY_CONN(local->reuse.prev);
+		cherokee_list_del (&oldest->listed);
+		local->reuse_len -= 1;
+
+		CHEROKEE_MUTEX_LOCK (&poll->mutex);
+		poll_release_shared (poll, oldest);
+		CHEROKEE_MUTEX_UNLOCK (&poll->mutex);
+	}
+
+	local->reuse_len += 1;
+	cherokee_list_add (&pconn->listed, &local->reuse);
+
+	return ret_ok;
 }
 
 
@@ -499,10 +778,13 @@ cherokee_handler_proxy_conn_init_socket (cherokee_handler_proxy_conn_t *pconn,
 
 ret_t
 cherokee_handler_proxy_conn_get_addrinfo (cherokee_handler_proxy_conn_t  *pconn,
-					  cherokee_source_t              *src)
+					  cherokee_source_t              *src,
+					  int                            *fd)
 {
 	ret_t                    ret;
-	struct addrinfo         *ai;
+	cuint_t                  total;
+	const struct addrinfo   *i;
+	const struct addrinfo   *ai     = NULL;
 	cherokee_resolv_cache_t *resolv;
 
 	/* Resolve the hostname of the target server
@@ -512,20 +794,33 @@ cherokee_handler_proxy_conn_get_addrinfo (cherokee_handler_proxy_conn_t  *pconn,
 		return ret_error;
 	}
 
-	ret = cherokee_resolv_cache_get_addrinfo (resolv, &src->host, &pconn->addr_info_ref);
-	if ((ret != ret_ok) || (pconn->addr_info_ref == NULL)) {
+	ret = cherokee_resolv_cache_get_addrinfo_async (resolv, &src->host, &ai, fd);
+	if (ret == ret_eagain) {
+		return ret_eagain;
+	} else if ((ret != ret_ok) || (ai == NULL)) {
 		return ret_error;
 	}
 
-	/* Count the number of IPs
+	/* The connection keeps a reference to the list it is
+	 * using, so it cannot be freed under its feet.
 	 */
-	if (pconn->addr_total == 0) {
-		ai = pconn->addr_info_ref;
-		while (ai != NULL) {
-			pconn->addr_total += 1;
-			ai = ai->ai_next;
-		}
+	if (ai == pconn->addr_info_ref) {
+		cherokee_resolv_cache_release_addrinfo (resolv, ai);
+		return ret_ok;
+	}
+
+	if (pconn->addr_info_ref != NULL) {
+		cherokee_resolv_cache_release_addrinfo (resolv, pconn->addr_info_ref);
 	}
 
+	total = 0;
+	for (i = ai; i != NULL; i = i->ai_next) {
+		total += 1;
+	}
+
+	pconn->addr_info_ref = ai;
+	pconn->addr_current  = 0;
+	pconn->addr_total    = total;
+
 	return ret_ok;
 }
@@ -26,7 +26,6 @@
 #define CHEROKEE_HANDLER_PROXY_HOST_H
 
 #include "common-internal.h"
-#include "avl.h"
 #include "list.h"
 #include "source.h"
 #include "socket.h"
@@ -38,42 +37,66 @@ typedef enum {
 } cherokee_handler_proxy_enc_t;
 
 typedef struct {
-	/* Connection poll */
-	cherokee_avl_t            hosts;
-	CHEROKEE_MUTEX_T         (hosts_mutex);
-	cherokee_buffer_t         tmp;
+	/* Connection polls: one per source. The list is
+	 * filled at configuration time and read-only after it.
+	 */
+	cherokee_list_t           polls;
 } cherokee_handler_proxy_hosts_t;
 
 typedef struct {
-	CHEROKEE_MUTEX_T (mutex);
-	cherokee_list_t   active;
-	cherokee_list_t   reuse;
-	cuint_t           reuse_len;
-	cuint_t           reuse_max;
+	/* Connections of a single thread. They are only
+	 * touched by it, so no lock is needed.
+	 */
+	cherokee_list_t    listed;
+	cherokee_list_t    active;
+	cherokee_list_t    reuse;
+	cuint_t            reuse_len;
+} cherokee_handler_proxy_local_t;
+
+typedef struct {
+	cherokee_list_t    listed;
+	cherokee_source_t *src_ref;
+
+	/* Shared lists: the overflow of the per-thread ones */
+	CHEROKEE_MUTEX_T  (mutex);
+	cherokee_list_t    active;
+	cherokee_list_t    reuse;
+	cuint_t            reuse_len;
+	cuint_t            reuse_max;
+	cuint_t            reuse_min;
+	cuint_t            opening;
+
+	/* Per-thread lists */
+	cherokee_list_t    locals;
+	cuint_t            local_max;
+#ifdef HAVE_PTHREAD
+	pthread_key_t      locals_key;
+#endif
 } cherokee_handler_proxy_poll_t;
 
 typedef struct {
-	cherokee_list_t                listed;
-	cherokee_socket_t              socket;
-	cherokee_handler_proxy_poll_t *poll_ref;
+	cherokee_list_t                 listed;
+	cherokee_socket_t               socket;
+	cherokee_handler_proxy_poll_t  *poll_ref;
+	cherokee_handler_proxy_local_t *local_ref;
 
 	/* Name resolution */
-	const struct addrinfo         *addr_info_ref;
-	cuint_t                        addr_total;
-	cuint_t                        addr_current;
+	const struct addrinfo          *addr_info_ref;
+	cuint_t                         addr_total;
+	cuint_t                         addr_current;
 
 	/* In */
-	cherokee_handler_proxy_enc_t   enc;
-	cherokee_buffer_t              header_in_raw;
-	cherokee_boolean_t             keepalive_in;
-	size_t                         size_in;
+	cherokee_handler_proxy_enc_t    enc;
+	cherokee_buffer_t               header_in_raw;
+	cherokee_boolean_t              keepalive_in;
+	size_t                          size_in;
 
 	/* Out */
-	size_t                         sent_out;
+	size_t                          sent_out;
 	struct {
-		cherokee_buffer_t      buf_temp;
-		cherokee_boolean_t     do_buf_sent;
-		off_t                  sent;
+		cherokee_buffer_t       buf_temp;
+		cherokee_boolean_t      do_buf_sent;
+		off_t                   sent;
 	} post;
 } cherokee_handler_proxy_conn_t;
 
@@ -87,15 +110,20 @@ typedef struct {
 ret_t cherokee_handler_proxy_hosts_init     (cherokee_handler_proxy_hosts_t *hosts);
 ret_t cherokee_handler_proxy_hosts_mrproper (cherokee_handler_proxy_hosts_t *hosts);
 
+ret_t cherokee_handler_proxy_hosts_add      (cherokee_handler_proxy_hosts_t  *hosts,
+					     cherokee_source_t               *src,
+					     cuint_t                          reuse_max,
+					     cuint_t                          reuse_min);
 ret_t cherokee_handler_proxy_hosts_get      (cherokee_handler_proxy_hosts_t  *hosts,
 					     cherokee_source_t               *src,
-					     cherokee_handler_proxy_poll_t  **poll,
-					     cuint_t                          reuse_max);
+					     cherokee_handler_proxy_poll_t  **poll);
 
 /* Polls
  */
 ret_t cherokee_handler_proxy_poll_new       (cherokee_handler_proxy_poll_t  **poll,
-					     cuint_t                          reuse_max);
+					     cherokee_source_t               *src,
+					     cuint_t                          reuse_max,
+					     cuint_t                          reuse_min);
 ret_t cherokee_handler_proxy_poll_free      (cherokee_handler_proxy_poll_t   *poll);
 ret_t cherokee_handler_proxy_poll_get       (cherokee_handler_proxy_poll_t   *poll,
 					     cherokee_handler_proxy_conn_t  **pconn,
@@ -113,7 +141,8 @@ ret_t cherokee_handler_proxy_conn_recv_headers (cherokee_handler_proxy_conn_t  *
 						cherokee_buffer_t              *body,
 						cherokee_boolean_t              flexible);
 ret_t cherokee_handler_proxy_conn_get_addrinfo (cherokee_handler_proxy_conn_t  *pconn,
-						cherokee_source_t              *src);
+						cherokee_source_t              *src,
+						int                            *fd);
 ret_t cherokee_handler_proxy_conn_init_socket  (cherokee_handler_proxy_conn_t  *pconn,
 						cherokee_source_t              *src);
 
@@ -27,13 +27,363 @@
 #include "avl.h"
 #include "util.h"
 
+#ifdef HAVE_PCRE2
+# define PCRE2_CODE_UNIT_WIDTH 8
+# include <pcre2.h>
+#elif defined(HAVE_SYSTEM_PCRE)
+# include <pcre.h>
+#else
+# include "pcre/pcre.h"
+#endif
+
 #define ENTRIES "regex"
 
+#ifdef HAVE_PCRE2
+# if PCRE2_ERROR_NOMATCH != CHEROKEE_REGEX_NOMATCH
+#  error "PCRE2_ERROR_NOMATCH does not match CHEROKEE_REGEX_NOMATCH"
+# endif
+#elif PCRE_ERROR_NOMATCH != CHEROKEE_REGEX_NOMATCH
+# error "PCRE_ERROR_NOMATCH does not match CHEROKEE_REGEX_NOMATCH"
+#endif
+
+/* JIT machine stack: grows on demand up to the maximum
+ */
+#define JIT_STACK_MIN (32  * 1024)
+#define JIT_STACK_MAX (512 * 1024)
+
+#if defined(HAVE_SYSTEM_PCRE) && defined(PCRE_STUDY_JIT_COMPILE)
+# define REGEX_PCRE_JIT 1
+#endif
+
+#if defined(HAVE_PCRE2) || defined(REGEX_PCRE_JIT)
+# define REGEX_THREAD_DATA 1
+#endif
+
+struct cherokee_regex {
+#ifdef HAVE_PCRE2
+	pcre2_code         *code;
+#else
+	pcre               *code;
+	pcre_extra         *extra;
+#endif
+};
+
 struct cherokee_regex_table {
 	cherokee_avl_t      cache;
 	CHEROKEE_RWLOCK_T  (rwlock);
 };
 
+static cherokee_boolean_t jit_enabled = true;
+
+
+/* Per thread matching resources
+ */
+#ifdef REGEX_THREAD_DATA
+typedef struct {
+#ifdef HAVE_PCRE2
+	pcre2_match_data    *match_data;
+	pcre2_match_context *context;
+	pcre2_jit_stack     *jit_stack;
+#else
+	pcre_jit_stack      *jit_stack;
+#endif
+} regex_thread_t;
+
+# ifdef HAVE_PTHREAD
+static pthread_key_t   thread_data_key;
+static pthread_once_t  thread_data_once = PTHREAD_ONCE_INIT;
+# else
+static regex_thread_t *thread_data      = NULL;
+# endif
+
+static void
+thread_data_free (void *param)
+{
+	regex_thread_t *data = param;
+
+	if (data == NULL)
+		return;
+
+#ifdef HAVE_PCRE2
+	if (data->match_data != NULL)
+		pcre2_match_data_free (data->match_data);
+	if (data->context != NULL)
+		pcre2_match_context_free (data->context);
+	if (data->jit_stack != NULL)
+		pcre2_jit_stack_free (data->jit_stack);
+#else
+	if (data->jit_stack != NULL)
+		pcre_jit_stack_free (data->jit_stack);
+#endif
+
+	free (data);
+}
+
+# ifdef HAVE_PTHREAD
+static void
+thread_data_key_init (void)
+{
+	pthread_key_create (&thread_data_key, thread_data_free);
+}
+# endif
+
+static regex_thread_t *
+thread_data_get (void)
+{
+	regex_thread_t *data;
+
+# ifdef HAVE_PTHREAD
+	pthread_once (&thread_data_once, thread_data_key_init);
+	data = pthread_getspecific (thread_data_key);
+# else
+	data = thread_data;
+# endif
+	if (likely (data != NULL))
+		return data;
+
+	/* First match in this thread
+	 */
+	data = calloc (1, sizeof(regex_thread_t));
+	if (unlikely (data == NULL))
+		return NULL;
+
+#ifdef HAVE_PCRE2
+	data->match_data = pcre2_match_data_create (OVECTOR_LEN / 3, NULL);
+	data->context    = pcre2_match_context_create (NULL);
+
+	if (unlikely ((data->match_data == NULL) ||
+		      (data->context == NULL)))
+	{
+		thread_data_free (data);
+		return NULL;
+	}
+
+	data->jit_stack = pcre2_jit_stack_create (JIT_STACK_MIN, JIT_STACK_MAX, NULL);
+	if (data->jit_stack != NULL) {
+		pcre2_jit_stack_assign (data->context, NULL, data->jit_stack);
+	}
+#else
+	data->jit_stack = pcre_jit_stack_alloc (JIT_STACK_MIN, JIT_STACK_MAX);
+#endif
+
+# ifdef HAVE_PTHREAD
+	pthread_setspecific (thread_data_key, data);
+# else
+	thread_data = data;
+# endif
+
+	return data;
+}
+#endif /* REGEX_THREAD_DATA */
+
+
+#ifdef REGEX_PCRE_JIT
+static pcre_jit_stack *
+jit_stack_cb (void *param)
+{
+	regex_thread_t *data;
+
+	UNUSED (param);
+
+	/* NULL makes PCRE fall back to the default 32K one
+	 */
+	data = thread_data_get();
+	if (unlikely (data == NULL))
+		return NULL;
+
+	return data->jit_stack;
+}
+#endif
+
+
+/* Compiled RegEx
+ */
+
+void
+cherokee_regex_set_jit (cherokee_boolean_t enabled)
+{
+	jit_enabled = enabled;
+}
+
+
+cherokee_boolean_t
+cherokee_regex_jit_available (void)
+{
+#if defined(HAVE_PCRE2) || defined(REGEX_PCRE_JIT)
+	int re;
+	int available = 0;
+
+# ifdef HAVE_PCRE2
+	re = pcre2_config (PCRE2_CONFIG_JIT, &available);
+# else
+	re = pcre_config (PCRE_CONFIG_JIT, &available);
+# endif
+	return ((re >= 0) && (available != 0));
+#else
+	return false;
+#endif
+}
+
+
+ret_t
+cherokee_regex_new (cherokee_regex_t  **regex,
+		    const char         *pattern,
+		    cherokee_buffer_t  *error,
+		    cint_t             *error_offset)
+{
+#ifdef HAVE_PCRE2
+	int          re;
+	int          error_code;
+	PCRE2_SIZE   offset;
+	PCRE2_UCHAR  msg[256];
+#else
+	const char  *msg;
+	int          offset;
+#endif
+	CHEROKEE_NEW_STRUCT (n, regex);
+
+#ifdef HAVE_PCRE2
+	n->code = pcre2_compile ((PCRE2_SPTR) pattern, PCRE2_ZERO_TERMINATED, 0,
+				 &error_code, &offset, NULL);
+	if (n->code == NULL) {
+		if (error != NULL) {
+			pcre2_get_error_message (error_code, msg, sizeof(msg));
+			cherokee_buffer_add (error, (char *)msg, strlen((char *)msg));
+		}
+		if (error_offset != NULL) {
+			*error_offset = (cint_t) offset;
+		}
+
+		free (n);
+		return ret_error;
+	}
+
+	/* The library might have been built without JIT support,
+	 * pcre2_match() interprets the pattern in that case.
+	 */
+	if (jit_enabled) {
+		re = pcre2_jit_compile (n->code, PCRE2_JIT_COMPLETE);
+		TRACE (ENTRIES, "JIT compiling '%s': %s\n", pattern, (re == 0) ? "ok" : "unavailable");
+	}
+#else
+	n->extra = NULL;
+	n->code  = pcre_compile (pattern, 0, &msg, &offset, NULL);
+	if (n->code == NULL) {
+		if (error != NULL) {
+			cherokee_buffer_add (error, msg, strlen(msg));
+		}
+		if (error_offset != NULL) {
+			*error_offset = offset;
+		}
+
+		free (n);
+		return ret_error;
+	}
+
+# ifdef HAVE_SYSTEM_PCRE
+	/* Study the pattern: it might find a faster way to reject the
+	 * subjects, and it is where the JIT compilation happens.
+	 */
+	if (jit_enabled) {
+#  ifdef REGEX_PCRE_JIT
+		n->extra = pcre_study (n->code, PCRE_STUDY_JIT_COMPILE, &msg);
+		if (n->extra != NULL) {
+			pcre_assign_jit_stack (n->extra, jit_stack_cb, NULL);
+		}
+#  else
+		n->extra = pcre_study (n->code, 0, &msg);
+#  endif
+		TRACE (ENTRIES, "Studying '%s': %s\n", pattern, (n->extra != NULL) ? "ok" : "nothing to learn");
+	}
+# endif
+#endif
+
+	*regex = n;
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_regex_free (cherokee_regex_t *regex)
+{
+#ifdef HAVE_PCRE2
+	pcre2_code_free (regex->code);
+#else
+# ifdef HAVE_SYSTEM_PCRE
+	if (regex->extra != NULL) {
+#  ifdef REGEX_PCRE_JIT
+		pcre_free_study (regex->extra);
+#  else
+		pcre_free (regex->extra);
+#  endif
+	}
+# endif
+	pcre_free (regex->code);
+#endif
+
+	free (regex);
+	return ret_ok;
+}
+
+
+int
+cherokee_regex_exec (cherokee_regex_t *regex,
+		     const char       *subject,
+		     cuint_t           subject_len,
+		     cint_t           *ovector,
+		     cint_t            ovector_len)
+{
+#ifdef HAVE_PCRE2
+	int             re;
+	int             n;
+	int             pairs;
+	PCRE2_SIZE     *offsets;
+	regex_thread_t *data;
+
+	data = thread_data_get();
+	if (unlikely (data == NULL))
+		return PCRE2_ERROR_NOMEMORY;
+
+	re = pcre2_match (regex->code, (PCRE2_SPTR) subject, subject_len, 0, 0,
+			  data->match_data, data->context);
+	if (re < 0)
+		return re;
+
+	/* Hand the offsets over in the pcre_exec() layout: only two
+	 * thirds of the vector hold them. Nor can there be more than
+	 * the match data holds.
+	 */
+	pairs = MIN (ovector_len / 3, (int) pcre2_get_ovector_count (data->match_data));
+	if ((re == 0) || (re > pairs)) {
+		re = 0;
+	} else {
+		pairs = re;
+	}
+
+	offsets = pcre2_get_ovector_pointer (data->match_data);
+
+	for (n = 0; n < pairs; n++) {
+		if (offsets[n*2] == PCRE2_UNSET) {
+			ovector[n*2]   = -1;
+			ovector[n*2+1] = -1;
+			continue;
+		}
+
+		ovector[n*2]   = (cint_t) offsets[n*2];
+		ovector[n*2+1] = (cint_t) offsets[n*2+1];
+	}
+
+	return re;
+#else
+	return pcre_exec (regex->code, regex->extra,
+			  subject, subject_len, 0, 0, ovector, ovector_len);
+#endif
+}
+
+
+/* RegEx table
+ */
+
 
 ret_t
 cherokee_regex_table_new  (cherokee_regex_table_t **table)
@@ -57,7 +407,7 @@ cherokee_regex_table_free (cherokee_regex_table_t *table)
 {
 	CHEROKEE_RWLOCK_DESTROY (&table->rwlock);
 
-	cherokee_avl_mrproper (&table->cache, free);
+	cherokee_avl_mrproper (AVL_GENERIC(&table->cache), (cherokee_func_free_t) cherokee_regex_free);
 
 	free(table);
 	return ret_ok;
@@ -67,10 +417,11 @@ cherokee_regex_table_free (cherokee_regex_table_t *table)
 static ret_t
 _add (cherokee_regex_table_t *table, char *pattern, void **regex)
 {
-	ret_t      ret;
-	const char *error_msg;
-	int         error_offset;
-	void       *tmp           = NULL;
+	ret_t              ret;
+	cint_t             error_offset = 0;
+	void              *tmp          = NULL;
+	cherokee_regex_t  *compiled     = NULL;
+	cherokee_buffer_t  error_msg    = CHEROKEE_BUF_INIT;
 
 	/* It wasn't in the cache. Lets go to compile the pattern..
 	 * First of all, we have to check again the table because another
@@ -87,18 +438,19 @@ _add (cherokee_regex_table_t *table, char *pattern, void **regex)
 		return ret_ok;
 	}
 
-	tmp = pcre_compile (pattern, 0, &error_msg, &error_offset, NULL);
-	if (tmp == NULL) {
-		LOG_ERROR (CHEROKEE_ERROR_REGEX_COMPILATION, pattern, error_msg, error_offset);
+	ret = cherokee_regex_new (&compiled, pattern, &error_msg, &error_offset);
+	if (ret != ret_ok) {
+		LOG_ERROR (CHEROKEE_ERROR_REGEX_COMPILATION, pattern, error_msg.buf, error_offset);
 		CHEROKEE_RWLOCK_UNLOCK (&table->rwlock);
+		cherokee_buffer_mrproper (&error_msg);
 		return ret_error;
 	}
 
-	cherokee_avl_add_ptr (&table->cache, pattern, tmp);
+	cherokee_avl_add_ptr (&table->cache, pattern, compiled);
 	CHEROKEE_RWLOCK_UNLOCK (&table->rwlock);
 
 	if (regex != NULL)
-		*regex = tmp;
+		*regex = compiled;
 
 	return ret_ok;
 }
@@ -142,7 +494,7 @@ configure_rewrite_entry (cherokee_list_t        *list,
 	cherokee_regex_entry_t *n;
 	cherokee_buffer_t      *substring;
 	cint_t                  hidden     = 1;
-	pcre                   *re         = NULL;
+	cherokee_regex_t       *re         = NULL;
 	cherokee_buffer_t      *regex      = NULL;
 
 	TRACE(ENTRIES, "Converting rewrite rule '%s'\n", conf->key.buf);
@@ -225,11 +577,11 @@ cherokee_regex_substitute (cherokee_buffer_t *regex_str,
 			   cint_t             stringcount,
 			   char               dollar_char)
 {
-	cint_t              re;
 	char               *s;
 	char                num;
+	cint_t              begin;
+	cint_t              end;
 	cherokee_boolean_t  dollar    = false;
-	const char         *substring = NULL;
 
 	for (s = regex_str->buf; *s != '\0'; s++) {
 		if (! dollar) {
@@ -260,17 +612,18 @@ cherokee_regex_substitute (cherokee_buffer_t *regex_str,
 
 		/* Perform the actually substitution
 		 */
-		substring = NULL;
+		dollar = false;
 
-		re = pcre_get_substring (source->buf, ovector, stringcount, num, &substring);
-		if ((re < 0) || (substring == NULL)) {
-			dollar = false;
+		if (num >= stringcount)
 			continue;
-		}
 
-		cherokee_buffer_add (target, substring, strlen(substring));
-		pcre_free_substring (substring);
-		dollar = false;
+		begin = ovector[num*2];
+		end   = ovector[num*2+1];
+
+		if ((begin < 0) || (end <= begin))
+			continue;
+
+		cherokee_buffer_add (target, source->buf + begin, end - begin);
 	}
 
 	return ret_ok;
@@ -33,7 +33,6 @@
 #include <cherokee/list.h>
 #include <cherokee/buffer.h>
 #include <cherokee/config_node.h>
-#include <pcre/pcre.h>
 
 CHEROKEE_BEGIN_DECLS
 
@@ -43,6 +42,38 @@ CHEROKEE_BEGIN_DECLS
 typedef struct cherokee_regex_table cherokee_regex_table_t;
 #define REGEX(x) ((cherokee_regex_table_t *)(x))
 
+/* Compiled RegEx
+ */
+typedef struct cherokee_regex cherokee_regex_t;
+
+ret_t cherokee_regex_new      (cherokee_regex_t  **regex,
+			       const char         *pattern,
+			       cherokee_buffer_t  *error,
+			       cint_t             *error_offset);
+ret_t cherokee_regex_free     (cherokee_regex_t   *regex);
+
+/* Same return values as pcre_exec(): <0 on failure, 0 if the ovector
+ * was too small, or the number of captured substrings plus one.
+ * CHEROKEE_REGEX_NOMATCH tells a subject that did not match apart
+ * from the rest of errors.
+ */
+#define CHEROKEE_REGEX_NOMATCH -1
+
+int   cherokee_regex_exec     (cherokee_regex_t   *regex,
+			       const char         *subject,
+			       cuint_t             subject_len,
+			       cint_t             *ovector,
+			       cint_t              ovector_len);
+
+/* Whether the patterns compiled from now on are studied and JIT
+ * compiled (when the PCRE library supports it). Default: yes.
+ */
+void  cherokee_regex_set_jit  (cherokee_boolean_t  enabled);
+
+/* Whether the PCRE library in use is able to JIT compile patterns
+ */
+cherokee_boolean_t cherokee_regex_jit_available (void);
+
 /* RegEx table
  */
 ret_t cherokee_regex_table_new   (cherokee_regex_table_t **table);
@@ -56,7 +87,7 @@ ret_t cherokee_regex_table_add  (cherokee_regex_table_t *table, char *pattern);
  */
 typedef struct {
 	cherokee_list_t    listed;
-	pcre              *re;
+	cherokee_regex_t  *re;
 	char               hidden;
 	cherokee_buffer_t  subs;
 } cherokee_regex_entry_t;
@@ -31,42 +31,199 @@
 # include <netdb.h>
 #endif
 
+#include <signal.h>
+#include <stddef.h>
+
+#ifdef HAVE_POLL_H
+# include <poll.h>
+#elif defined(HAVE_SYS_POLL_H)
+# include <sys/poll.h>
+#endif
+
 #include "resolv_cache.h"
 #include "socket_lowlevel.h"
 #include "util.h"
 #include "avl.h"
 #include "socket.h"
 #include "bogotime.h"
+#include "list.h"
 
 
 #define ENTRIES "resolve"
 
+/* Look-ups are refreshed in the background once this fraction of
+ * the TTL has gone by, so hot names never expire in front of a
+ * request.
+ */
+#define REFRESH_AHEAD(ttl) (((ttl) * 3) / 4)
+
+/* Address lists are packed in a single block, so the sockaddrs
+ * are rounded up to keep them aligned.
+ */
+#define ADDR_ALIGN(len)    (((len) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+
+typedef enum {
+	entry_pending,
+	entry_resolved,
+	entry_failed
+} cherokee_resolv_cache_state_t;
+
+/* Reference counted copy of a getaddrinfo() result. The entry holds
+ * a reference to its current list, and every caller that got it
+ * holds another one until it releases it.
+ */
+typedef struct {
+	cint_t          refs;
+	struct addrinfo ai[1];
+} addr_list_t;
+
+#define ADDR_LIST(a) ((addr_list_t *)((char *)(a) - offsetof(addr_list_t, ai)))
 
 typedef struct {
-	struct addrinfo    *addr;
-	cherokee_buffer_t  ip_str;
-	cherokee_buffer_t  ip_str_all;
+	cherokee_list_t                queued;
+	cherokee_boolean_t             in_queue;
+	cherokee_buffer_t              domain;
+
+	cherokee_resolv_cache_state_t  state;
+	time_t                         refresh_at;
+	time_t                         expires_at;
+	int                            notify[2];
+
+	addr_list_t                   *addr;
+	cherokee_buffer_t              ip_str;
+	cherokee_buffer_t              ip_str_all;
 } cherokee_resolv_cache_entry_t;
 
+#define RESOLV_ENTRY(e) ((cherokee_resolv_cache_entry_t *)(e))
+
 struct cherokee_resolv_cache {
 	cherokee_avl_t     table;
 	CHEROKEE_RWLOCK_T (lock);
+
+	/* Properties
+	 */
+	cuint_t            ttl;
+	cuint_t            negative_ttl;
+	cuint_t            threads_num;
+
+	/* Resolver threads
+	 */
+	cherokee_list_t    queue;
+	CHEROKEE_MUTEX_T  (queue_mutex);
+#ifdef HAVE_PTHREAD
+	pthread_cond_t     queue_cond;
+	pthread_t         *threads;
+#endif
+	cuint_t            threads_running;
+	pid_t              threads_pid;
+	cherokee_boolean_t exiting;
 };
 
 static cherokee_resolv_cache_t *__global_resolv = NULL;
 
 
+/* Address lists
+ */
+static addr_list_t *
+addr_list_new (struct addrinfo *res)
+{
+	cuint_t          n;
+	cuint_t          num  = 0;
+	size_t           size = 0;
+	char            *p;
+	struct addrinfo *i;
+	addr_list_t     *list;
+
+	for (i = res; i != NULL; i = i->ai_next) {
+		num  += 1;
+		size += ADDR_ALIGN (i->ai_addrlen);
+	}
+
+	if (unlikely (num == 0)) {
+		return NULL;
+	}
+
+	list = (addr_list_t *) malloc (sizeof(addr_list_t) +
+				       sizeof(struct addrinfo) * (num - 1) + size);
+	if (unlikely (list == NULL)) {
+		return NULL;
+	}
+
+	/* The sockaddrs go right after the nodes
+	 */
+	p = (char *) &list->ai[num];
+
+	for (i = res, n = 0; i != NULL; i = i->ai_next, n++) {
+		list->ai[n]              = *i;
+		list->ai[n].ai_canonname = NULL;
+		list->ai[n].ai_addr      = (struct sockaddr *) p;
+		list->ai[n].ai_next      = (n + 1 < num) ? &list->ai[n+1] : NULL;
+
+		memcpy (p, i->ai_addr, i->ai_addrlen);
+		p += ADDR_ALIGN (i->ai_addrlen);
+	}
+
+	list->refs = 1;
+	return list;
+}
+
+
+static void
+addr_list_ref (addr_list_t *list)
+{
+	CHEROKEE_ATOMIC_ADD (&list->refs, 1);
+}
+
+
+static void
+addr_list_unref (addr_list_t *list)
+{
+	if (CHEROKEE_ATOMIC_ADD (&list->refs, -1) > 0) {
+		return;
+	}
+
+	free (list);
+}
+
+
 /* Entries
  */
+static void entry_free (void *entry);
+
 static ret_t
-entry_new (cherokee_resolv_cache_entry_t **entry)
+entry_new (cherokee_resolv_cache_entry_t **entry,
+	   cherokee_buffer_t              *domain)
 {
 	CHEROKEE_NEW_STRUCT(n, resolv_cache_entry);
 
-	n->addr = NULL;
+	INIT_LIST_HEAD (&n->queued);
+	cherokee_buffer_init (&n->domain);
 	cherokee_buffer_init (&n->ip_str);
 	cherokee_buffer_init (&n->ip_str_all);
 
+	n->in_queue   = false;
+	n->state      = entry_pending;
+	n->refresh_at = 0;
+	n->expires_at = 0;
+	n->notify[0]  = -1;
+	n->notify[1]  = -1;
+	n->addr       = NULL;
+
+	cherokee_buffer_add_buffer (&n->domain, domain);
+
+	/* Connections waiting for the look-up poll on this pipe
+	 */
+	if (cherokee_pipe (n->notify) != 0) {
+		entry_free (n);
+		return ret_error;
+	}
+
+	cherokee_fd_set_nonblocking (n->notify[0], true);
+	cherokee_fd_set_nonblocking (n->notify[1], true);
+	cherokee_fd_set_closexec (n->notify[0]);
+	cherokee_fd_set_closexec (n->notify[1]);
+
 	*entry = n;
 	return ret_ok;
 }
@@ -78,9 +235,17 @@ entry_free (void *entry)
 	cherokee_resolv_cache_entry_t *e = entry;
 
 	if (e->addr) {
-		freeaddrinfo (e->addr);
+		addr_list_unref (e->addr);
 	}
 
+	if (e->notify[0] != -1) {
+		cherokee_fd_close (e->notify[0]);
+	}
+	if (e->notify[1] != -1) {
+		cherokee_fd_close (e->notify[1]);
+	}
+
+	cherokee_buffer_mrproper (&e->domain);
 	cherokee_buffer_mrproper (&e->ip_str);
 	cherokee_buffer_mrproper (&e->ip_str_all);
 	free(entry);
@@ -88,16 +253,14 @@ entry_free (void *entry)
 
 
 static ret_t
-entry_fill_up (cherokee_resolv_cache_entry_t *entry,
-	       cherokee_buffer_t             *domain)
+entry_lookup (cherokee_buffer_t  *domain,
+	      struct addrinfo   **addr)
 {
-	ret_t            ret;
-	char             tmp[46];       // Max IPv6 length is 45
-	struct addrinfo *addr;
-	time_t           eagain_at = 0;
+	ret_t  ret;
+	time_t eagain_at = 0;
 
 	while (true) {
-		ret = cherokee_gethostbyname (domain, &entry->addr);
+		ret = cherokee_gethostbyname (domain, addr);
 		if (ret == ret_ok) {
 			break;
 
@@ -118,13 +281,97 @@ entry_fill_up (cherokee_resolv_cache_entry_t *entry,
 		}
 	}
 
-	if (unlikely (entry->addr == NULL)) {
+	if (unlikely (*addr == NULL)) {
 		return ret_error;
 	}
 
+	return ret_ok;
+}
+
+
+static cherokee_boolean_t
+entry_has_addr (struct addrinfo *list,
+		struct addrinfo *addr)
+{
+	while (list != NULL) {
+		if ((list->ai_family  == addr->ai_family)  &&
+		    (list->ai_addrlen == addr->ai_addrlen) &&
+		    (memcmp (list->ai_addr, addr->ai_addr, addr->ai_addrlen) == 0))
+		{
+			return true;
+		}
+
+		list = list->ai_next;
+	}
+
+	return false;
+}
+
+
+static cherokee_boolean_t
+entry_same_addrs (struct addrinfo *a,
+		  struct addrinfo *b)
+{
+	struct addrinfo *i;
+
+	/* Round-robin DNS servers rotate the records on every
+	 * reply, so the lists are compared as sets.
+	 */
+	for (i = a; i != NULL; i = i->ai_next) {
+		if (! entry_has_addr (b, i))
+			return false;
+	}
+
+	for (i = b; i != NULL; i = i->ai_next) {
+		if (! entry_has_addr (a, i))
+			return false;
+	}
+
+	return true;
+}
+
+
+static ret_t
+entry_fill_up (cherokee_resolv_cache_entry_t *entry,
+	       struct addrinfo               *new_addr)
+{
+	ret_t            ret;
+	char             tmp[46];       // Max IPv6 length is 45
+	struct addrinfo *addr;
+	addr_list_t     *list;
+
+	/* Same addresses: keep the ones the callers might be
+	 * already referencing.
+	 */
+	if ((entry->addr != NULL) &&
+	    (entry_same_addrs (entry->addr->ai, new_addr)))
+	{
+		freeaddrinfo (new_addr);
+		return ret_ok;
+	}
+
+	list = addr_list_new (new_addr);
+	freeaddrinfo (new_addr);
+
+	if (unlikely (list == NULL)) {
+		return ret_nomem;
+	}
+
+	/* The callers still using the previous list hold a
+	 * reference: the last one to release it frees it.
+	 */
+	if (entry->addr != NULL) {
+		addr_list_unref (entry->addr);
+	}
+
+	entry->addr = list;
+
 	/* Render the text representation
 	 */
-	ret = cherokee_ntop (entry->addr->ai_family, entry->addr->ai_addr, tmp, sizeof(tmp));
+	cherokee_buffer_clean (&entry->ip_str);
+	cherokee_buffer_clean (&entry->ip_str_all);
+
+	ret = cherokee_ntop (list->ai->ai_family, list->ai->ai_addr, tmp, sizeof(tmp));
 	if (ret != ret_ok) {
 		return ret_error;
 	}
@@ -135,9 +382,9 @@ entry_fill_up (cherokee_resolv_cache_entry_t *entry,
 	 */
 	cherokee_buffer_add_buffer (&entry->ip_str_all, &entry->ip_str);
 
-	addr = entry->addr;
+	addr = list->ai;
 	while (addr != NULL) {
-		ret = cherokee_ntop (entry->addr->ai_family, addr->ai_addr, tmp, sizeof(tmp));
+		ret = cherokee_ntop (list->ai->ai_family, addr->ai_addr, tmp, sizeof(tmp));
 		if (ret != ret_ok) {
 			return ret_error;
 		}
@@ -152,6 +399,222 @@ entry_fill_up (cherokee_resolv_cache_entry_t *entry,
 }
 
 
+/* Stores the result of a look-up. It must be called with the
+ * table locked for writing.
+ */
+static void
+entry_update (cherokee_resolv_cache_t       *resolv,
+	      cherokee_resolv_cache_entry_t *entry,
+	      ret_t                          lookup_ret,
+	      struct addrinfo               *addr)
+{
+	ret_t   ret = lookup_ret;
+	ssize_t re;
+
+	if (ret == ret_ok) {
+		ret = entry_fill_up (entry, addr);
+	}
+
+	if (ret == ret_ok) {
+		entry->state      = entry_resolved;
+		entry->refresh_at = cherokee_bogonow_now + REFRESH_AHEAD (resolv->ttl);
+		entry->expires_at = cherokee_bogonow_now + resolv->ttl;
+
+		TRACE (ENTRIES, "Resolve '%s': %s (ttl %d)\n", entry->domain.buf, entry->ip_str_all.buf, resolv->ttl);
+
+	} else if (entry->addr != NULL) {
+		/* The refresh failed: keep serving the known
+		 * addresses, and try again later on.
+		 */
+		entry->state      = entry_resolved;
+		entry->refresh_at = cherokee_bogonow_now + resolv->negative_ttl;
+
+		TRACE (ENTRIES, "Resolve '%s': refresh failed, keeping %s\n", entry->domain.buf, entry->ip_str_all.buf);
+
+	} else {
+		entry->state      = entry_failed;
+		entry->expires_at = cherokee_bogonow_now + resolv->negative_ttl;
+
+		TRACE (ENTRIES, "Resolve '%s': failed (negative ttl %d)\n", entry->domain.buf, resolv->negative_ttl);
+	}
+
+	/* Wake up the connections waiting for it. The byte is
+	 * not read back, so the pipe stays readable.
+	 */
+	do {
+		re = write (entry->notify[1], "", 1);
+	} while ((re < 0) && (errno == EINTR));
+}
+
+
+static void
+entry_set_pending (cherokee_resolv_cache_entry_t *entry)
+{
+	ssize_t re;
+	char    buf[16];
+
+	/* Drain former notifications
+	 */
+	do {
+		re = read (entry->notify[0], buf, sizeof(buf));
+	} while ((re > 0) || ((re < 0) && (errno == EINTR)));
+
+	entry->state = entry_pending;
+}
+
+
+/* Resolver threads
+ */
+#ifdef HAVE_PTHREAD
+static NORETURN void *
+resolver_routine (void *param)
+{
+	ret_t                          ret;
+	struct addrinfo               *addr;
+	cherokee_resolv_cache_entry_t *entry;
+	cherokee_resolv_cache_t       *resolv = RESOLV(param);
+
+	CHEROKEE_MUTEX_LOCK (&resolv->queue_mutex);
+
+	while (! resolv->exiting) {
+		if (cherokee_list_empty (&resolv->queue)) {
+			pthread_cond_wait (&resolv->queue_cond, &resolv->queue_mutex);
+			continue;
+		}
+
+		entry = RESOLV_ENTRY (resolv->queue.next);
+		cherokee_list_del (&entry->queued);
+		CHEROKEE_MUTEX_UNLOCK (&resolv->queue_mutex);
+
+		/* Blocking look-up, away from the worker threads
+		 */
+		addr = NULL;
+		ret  = entry_lookup (&entry->domain, &addr);
+
+		CHEROKEE_RWLOCK_WRITER (&resolv->lock);
+		entry_update (resolv, entry, ret, addr);
+		CHEROKEE_RWLOCK_UNLOCK (&resolv->lock);
+
+		CHEROKEE_MUTEX_LOCK (&resolv->queue_mutex);
+		entry->in_queue = false;
+	}
+
+	CHEROKEE_MUTEX_UNLOCK (&resolv->queue_mutex);
+	pthread_exit (NULL);
+}
+
+
+static ret_t
+resolver_launch (cherokee_resolv_cache_t *resolv)
+{
+	ret_t ret;
+
+	if (resolv->threads == NULL) {
+		resolv->threads = (pthread_t *) malloc (sizeof(pthread_t) * resolv->threads_num);
+		if (unlikely (resolv->threads == NULL)) {
+			return ret_nomem;
+		}
+	}
+
+	while (resolv->threads_running < resolv->threads_num) {
+		ret = cherokee_thread_create_nosignals (&resolv->threads[resolv->threads_running],
+							resolver_routine, resolv);
+		if (ret != ret_ok) {
+			break;
+		}
+		resolv->threads_running++;
+	}
+
+	resolv->threads_pid = getpid();
+	return (resolv->threads_running > 0) ? ret_ok : ret_error;
+}
+#endif
+
+
+/* Hands the entry over to the resolver threads. It returns
+ * ret_ok if the look-up has been queued, or ret_not_found if it
+ * has to be done by the caller.
+ */
+static ret_t
+resolver_queue (cherokee_resolv_cache_t       *resolv,
+		cherokee_resolv_cache_entry_t *entry)
+{
+#ifdef HAVE_PTHREAD
+	ret_t            ret = ret_ok;
+	cherokee_list_t *i, *j;
+
+	CHEROKEE_MUTEX_LOCK (&resolv->queue_mutex);
+
+	if (entry->in_queue) {
+		goto out;
+	}
+
+	/* The threads do not survive a fork()
+	 */
+	if ((resolv->threads_running > 0) &&
+	    (resolv->threads_pid != getpid()))
+	{
+		resolv->threads_running = 0;
+		list_for_each_safe (i, j, &resolv->queue) {
+			RESOLV_ENTRY(i)->in_queue = false;
+			cherokee_list_del (i);
+		}
+	}
+
+	if (resolv->threads_running == 0) {
+		ret = resolver_launch (resolv);
+		if (ret != ret_ok) {
+			ret = ret_not_found;
+			goto out;
+		}
+	}
+
+	TRACE (ENTRIES, "Resolve '%s': queued\n", entry->domain.buf);
+
+	entry->in_queue = true;
+	cherokee_list_add_tail (&entry->queued, &resolv->queue);
+	pthread_cond_signal (&resolv->queue_cond);
+
+out:
+	CHEROKEE_MUTEX_UNLOCK (&resolv->queue_mutex);
+	return ret;
+#else
+	UNUSED (resolv);
+	UNUSED (entry);
+	return ret_not_found;
+#endif
+}
+
+
+static void
+resolver_stop (cherokee_resolv_cache_t *resolv)
+{
+#ifdef HAVE_PTHREAD
+	cuint_t i;
+
+	CHEROKEE_MUTEX_LOCK (&resolv->queue_mutex);
+	resolv->exiting = true;
+	pthread_cond_broadcast (&resolv->queue_cond);
+	CHEROKEE_MUTEX_UNLOCK (&resolv->queue_mutex);
+
+	if (resolv->threads_pid == getpid()) {
+		for (i = 0; i < resolv->threads_running; i++) {
+			pthread_join (resolv->threads[i], NULL);
+		}
+	}
+
+	resolv->threads_running = 0;
+	resolv->exiting         = false;
+
+	if (resolv->threads != NULL) {
+		free (resolv->threads);
+		resolv->threads = NULL;
+	}
+#else
+	UNUSED (resolv);
+#endif
+}
+
 
 /* Table
  */
@@ -167,6 +630,21 @@ cherokee_resolv_cache_init (cherokee_resolv_cache_t *resolv)
 	if (unlikely (ret != ret_ok)) return ret;
 
 	CHEROKEE_RWLOCK_INIT (&resolv->lock, NULL);
+
+	resolv->ttl             = DEFAULT_RESOLV_TTL;
+	resolv->negative_ttl    = DEFAULT_RESOLV_NEGATIVE_TTL;
+	resolv->threads_num     = DEFAULT_RESOLV_THREADS;
+	resolv->threads_running = 0;
+	resolv->threads_pid     = 0;
+	resolv->exiting         = false;
+
+	INIT_LIST_HEAD (&resolv->queue);
+	CHEROKEE_MUTEX_INIT (&resolv->queue_mutex, NULL);
+#ifdef HAVE_PTHREAD
+	pthread_cond_init (&resolv->queue_cond, NULL);
+	resolv->threads = NULL;
+#endif
+
 	return ret_ok;
 }
 
@@ -174,9 +652,60 @@ cherokee_resolv_cache_init (cherokee_resolv_cache_t *resolv)
 ret_t
 cherokee_resolv_cache_mrproper (cherokee_resolv_cache_t *resolv)
 {
+	resolver_stop (resolv);
+
 	cherokee_avl_mrproper (&resolv->table, entry_free);
 	CHEROKEE_RWLOCK_DESTROY (&resolv->lock);
 
+	CHEROKEE_MUTEX_DESTROY (&resolv->queue_mutex);
+#ifdef HAVE_PTHREAD
+	pthread_cond_destroy (&resolv->queue_cond);
+#endif
+
+	return ret_ok;
+}
+
+
+static ret_t
+configure_uint (cherokee_config_node_t *config,
+		const char             *key,
+		int                     min,
+		cuint_t                *val)
+{
+	ret_t              ret;
+	int                num;
+	cherokee_buffer_t *tmp;
+
+	ret = cherokee_config_node_read (config, key, &tmp);
+	if (ret != ret_ok) {
+		return ret_ok;
+	}
+
+	ret = cherokee_atoi (tmp->buf, &num);
+	if ((ret != ret_ok) || (num < min)) {
+		LOG_CRITICAL (CHEROKEE_ERROR_RESOLVE_CONFIG, key, tmp->buf);
+		return ret_error;
+	}
+
+	*val = num;
+	return ret_ok;
+}
+
+ret_t
+cherokee_resolv_cache_configure (cherokee_resolv_cache_t *resolv,
+				 cherokee_config_node_t  *config)
+{
+	ret_t ret;
+
+	ret = configure_uint (config, "ttl", 1, &resolv->ttl);
+	if (ret != ret_ok) return ret;
+
+	ret = configure_uint (config, "negative_ttl", 0, &resolv->negative_ttl);
+	if (ret != ret_ok) return ret;
+
+	ret = configure_uint (config, "threads", 1, &resolv->threads_num);
+	if (ret != ret_ok) return ret;
+
 	return ret_ok;
 }
 
@@ -203,45 +732,193 @@ cherokee_resolv_cache_get_default (cherokee_resolv_cache_t **resolv)
 ret_t
 cherokee_resolv_cache_clean (cherokee_resolv_cache_t *resolv)
 {
+	/* The resolver threads reference the entries. They will
+	 * be launched again by the next asynchronous look-up.
+	 */
+	resolver_stop (resolv);
+
+	CHEROKEE_MUTEX_LOCK (&resolv->queue_mutex);
+	INIT_LIST_HEAD (&resolv->queue);
+	CHEROKEE_MUTEX_UNLOCK (&resolv->queue_mutex);
+
 	CHEROKEE_RWLOCK_WRITER (&resolv->lock);
-	cherokee_avl_mrproper (&resolv->table, entry_free);
+	cherokee_avl_mrproper (AVL_GENERIC(&resolv->table), entry_free);
 	CHEROKEE_RWLOCK_UNLOCK (&resolv->lock);
 
 	return ret_ok;
 }
 
 
+/* Look-ups
+ */
 static ret_t
-table_add_new_entry (cherokee_resolv_cache_t        *resolv,
-		     cherokee_buffer_t              *domain,
-		     cherokee_resolv_cache_entry_t **entry)
+table_get (cherokee_resolv_cache_t        *resolv,
+	   cherokee_buffer_t              *domain,
+	   cherokee_boolean_t              async,
+	   cherokee_resolv_cache_entry_t **entry,
+	   int                            *fd)
 {
 	ret_t                          ret;
-	cherokee_resolv_cache_entry_t *n    = NULL;
+	struct addrinfo               *addr    = NULL;
+	cherokee_boolean_t             refresh = false;
+	cherokee_resolv_cache_entry_t *n       = NULL;
 
-	/* Instance the entry
+	/* Look for the name in the cache
 	 */
-	ret = entry_new (&n);
-	if (unlikely (ret != ret_ok)) {
-		return ret;
+	CHEROKEE_RWLOCK_READER (&resolv->lock);
+
+	ret = cherokee_avl_get (&resolv->table, domain, (void **)&n);
+	if (ret == ret_ok) {
+		switch (n->state) {
+		case entry_resolved:
+			/* Hit. Refresh it ahead of the expiration.
+			 */
+			refresh = (cherokee_bogonow_now >= n->refresh_at);
+			CHEROKEE_RWLOCK_UNLOCK (&resolv->lock);
+
+			TRACE (ENTRIES, "Resolve '%s': hit%s\n", domain->buf, refresh ? ", refreshing" : "");
+
+			/* The known addresses are served while the
+			 * entry is refreshed in the background.
+			 */
+			if (refresh) {
+				ret = resolver_queue (resolv, n);
+				if ((ret != ret_ok) &&
+				    (cherokee_bogonow_now >= n->expires_at))
+				{
+					goto lookup;
+				}
+			}
+
+			*entry = n;
+			return ret_ok;
+
+		case entry_failed:
+			if (cherokee_bogonow_now < n->expires_at) {
+				CHEROKEE_RWLOCK_UNLOCK (&resolv->lock);
+				TRACE (ENTRIES, "Resolve '%s': negative hit\n", domain->buf);
+				return ret_error;
+			}
+			break;
+
+		case entry_pending:
+			if (fd != NULL) {
+				*fd = n->notify[0];
+			}
+			CHEROKEE_RWLOCK_UNLOCK (&resolv->lock);
+
+			TRACE (ENTRIES, "Resolve '%s': pending\n", domain->buf);
+			return ret_eagain;
+		}
 	}
 
-	/* Fill it up
+	CHEROKEE_RWLOCK_UNLOCK (&resolv->lock);
+
+	/* Bad luck: it wasn't cached, or the cached failure expired
 	 */
-	ret = entry_fill_up (n, domain);
-	if (unlikely (ret != ret_ok)) {
-		entry_free (n);
-		return ret;
+	TRACE (ENTRIES, "Resolve '%s': missed\n", domain->buf);
+
+	CHEROKEE_RWLOCK_WRITER (&resolv->lock);
+
+	ret = cherokee_avl_get (&resolv->table, domain, (void **)&n);
+	if (ret != ret_ok) {
+		ret = entry_new (&n, domain);
+		if (unlikely (ret != ret_ok)) {
+			CHEROKEE_RWLOCK_UNLOCK (&resolv->lock);
+			return ret;
+		}
+
+		ret = cherokee_avl_add (&resolv->table, domain, n);
+		if (unlikely (ret != ret_ok)) {
+			CHEROKEE_RWLOCK_UNLOCK (&resolv->lock);
+			entry_free (n);
+			return ret;
+		}
+
+	} else if (n->state == entry_pending) {
+		/* Someone else got there first
+		 */
+		if (fd != NULL) {
+			*fd = n->notify[0];
+		}
+		CHEROKEE_RWLOCK_UNLOCK (&resolv->lock);
+		return ret_eagain;
 	}
 
-	/* Add it to the table
+	entry_set_pending (n);
+
+	if (fd != NULL) {
+		*fd = n->notify[0];
+	}
+
+	CHEROKEE_RWLOCK_UNLOCK (&resolv->lock);
+
+	/* Hand it over to the resolver threads. Numeric addresses
+	 * are resolved right away.
 	 */
+	if ((async) &&
+	    (! cherokee_string_is_ipv6 (domain)) &&
+	    (strspn (domain->buf, "0123456789.") != domain->len))
+	{
+		ret = resolver_queue (resolv, n);
+		if (ret == ret_ok) {
+			return ret_eagain;
+		}
+	}
+
+lookup:
+	/* Resolve it in place
+	 */
+	ret = entry_lookup (domain, &addr);
+
 	CHEROKEE_RWLOCK_WRITER (&resolv->lock);
-	ret = cherokee_avl_add (&resolv->table, domain, (void **)n);
+	entry_update (resolv, n, ret, addr);
+	ret = (n->state == entry_resolved) ? ret_ok : ret_error;
 	CHEROKEE_RWLOCK_UNLOCK (&resolv->lock);
 
 	*entry = n;
-	return ret_ok;
+	return ret;
+}
+
+
+/* Takes a reference to the current address list of a resolved
+ * entry. Its list might be replaced meanwhile, but never removed.
+ */
+static void
+entry_get_addrinfo (cherokee_resolv_cache_t        *resolv,
+		    cherokee_resolv_cache_entry_t  *entry,
+		    const struct addrinfo         **addr_info)
+{
+	CHEROKEE_RWLOCK_READER (&resolv->lock);
+	addr_list_ref (entry->addr);
+	*addr_info = entry->addr->ai;
+	CHEROKEE_RWLOCK_UNLOCK (&resolv->lock);
+}
+
+
+static ret_t
+table_get_blocking (cherokee_resolv_cache_t        *resolv,
+		    cherokee_buffer_t              *domain,
+		    cherokee_resolv_cache_entry_t **entry)
+{
+	ret_t         ret;
+	int           fd  = -1;
+	struct pollfd pfd;
+
+	while (true) {
+		ret = table_get (resolv, domain, false, entry, &fd);
+		if (ret != ret_eagain) {
+			return ret;
+		}
+
+		/* A resolver thread is on it
+		 */
+		pfd.fd      = fd;
+		pfd.events  = POLLIN;
+		pfd.revents = 0;
+
+		poll (&pfd, 1, 1000);
+	}
 }
 
 
@@ -253,24 +930,10 @@ cherokee_resolv_cache_get_ipstr (cherokee_resolv_cache_t  *resolv,
 	ret_t                          ret;
 	cherokee_resolv_cache_entry_t *entry = NULL;
 
-	/* Look for the name in the cache
-	 */
-	CHEROKEE_RWLOCK_READER (&resolv->lock);
-	ret = cherokee_avl_get (&resolv->table, domain, (void **)&entry);
-	CHEROKEE_RWLOCK_UNLOCK (&resolv->lock);
-
+	ret = table_get_blocking (resolv, domain, &entry);
 	if (ret != ret_ok) {
-		TRACE (ENTRIES, "Resolve '%s': missed.\n", domain->buf);
-
-		/* Bad luck: it wasn't cached
-		 */
-		ret = table_add_new_entry (resolv, domain, &entry);
-		if (ret != ret_ok) {
-			return ret;
-		}
-		TRACE (ENTRIES, "Resolve '%s': added succesfuly as '%s'.\n", domain->buf, entry->ip_str_all.buf);
-	} else {
-		TRACE (ENTRIES, "Resolve '%s': hit: %s\n", domain->buf, entry->ip_str_all.buf);
+		TRACE (ENTRIES, "Resolve '%s': error ret=%d.\n", domain->buf, ret);
+		return ret;
 	}
 
 	/* Return the ip string
@@ -302,11 +965,9 @@ cherokee_resolv_cache_get_host (cherokee_resolv_cache_t *resolv,
 	/* Copy it to the socket object
 	 */
 	ret = cherokee_socket_update_from_addrinfo (sock, addr, 0);
-	if (ret != ret_ok) {
-		return ret;
-	}
+	cherokee_resolv_cache_release_addrinfo (resolv, addr);
 
-	return ret_ok;
+	return ret;
 }
 
 
@@ -318,27 +979,46 @@ cherokee_resolv_cache_get_addrinfo (cherokee_resolv_cache_t *resolv,
 	ret_t                          ret;
 	cherokee_resolv_cache_entry_t *entry = NULL;
 
-	/* Look for the name in the cache
-	 */
-	CHEROKEE_RWLOCK_READER (&resolv->lock);
-	ret = cherokee_avl_get (&resolv->table, domain, (void **)&entry);
-	CHEROKEE_RWLOCK_UNLOCK (&resolv->lock);
+	ret = table_get_blocking (resolv, domain, &entry);
+	if (ret != ret_ok) {
+		TRACE (ENTRIES, "Resolve '%s': error ret=%d.\n", domain->buf, ret);
+		return ret;
+	}
+
+	entry_get_addrinfo (resolv, entry, addr_info);
+	return ret_ok;
+}
+
 
+ret_t
+cherokee_resolv_cache_get_addrinfo_async (cherokee_resolv_cache_t *resolv,
+					  cherokee_buffer_t       *domain,
+					  const struct addrinfo  **addr_info,
+					  int                     *fd)
+{
+	ret_t                          ret;
+	cherokee_resolv_cache_entry_t *entry = NULL;
+
+	ret = table_get (resolv, domain, true, &entry, fd);
 	if (ret != ret_ok) {
-		TRACE (ENTRIES, "Resolve '%s': missed.\n", domain->buf);
+		return ret;
+	}
 
-		/* Bad luck: it wasn't cached
-		 */
-		ret = table_add_new_entry (resolv, domain, &entry);
-		if (ret != ret_ok) {
-			TRACE (ENTRIES, "Resolve '%s': error ret=%d.\n", domain->buf, ret);
-			return ret;
-		}
-		TRACE (ENTRIES, "Resolve '%s': added succesfuly as '%s'.\n", domain->buf, entry->ip_str.buf);
-	} else {
-		TRACE (ENTRIES, "Resolve '%s': hit.\n", domain->buf);
+	entry_get_addrinfo (resolv, entry, addr_info);
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_resolv_cache_release_addrinfo (cherokee_resolv_cache_t *resolv,
+					const struct addrinfo   *addr_info)
+{
+	UNUSED (resolv);
+
+	if (addr_info == NULL) {
+		return ret_ok;
 	}
 
-	*addr_info = entry->addr;
+	addr_list_unref (ADDR_LIST (addr_info));
 	return ret_ok;
 }
@@ -30,6 +30,7 @@
 #define CHEROKEE_RESOLV_CACHE_H
 
 #include <cherokee/common.h>
+#include <cherokee/config_node.h>
 
 
 CHEROKEE_BEGIN_DECLS
@@ -43,10 +44,22 @@ ret_t cherokee_resolv_cache_get_default (cherokee_resolv_cache_t **resolv);
 ret_t cherokee_resolv_cache_init      (cherokee_resolv_cache_t *resolv);
 ret_t cherokee_resolv_cache_mrproper  (cherokee_resolv_cache_t *resolv);
 ret_t cherokee_resolv_cache_clean     (cherokee_resolv_cache_t *resolv);
+ret_t cherokee_resolv_cache_configure (cherokee_resolv_cache_t *resolv, cherokee_config_node_t *config);
 
 ret_t cherokee_resolv_cache_get_ipstr    (cherokee_resolv_cache_t *resolv, cherokee_buffer_t *domain, const char **ip);
 ret_t cherokee_resolv_cache_get_host     (cherokee_resolv_cache_t *resolv, cherokee_buffer_t *domain, void *sock);
-ret_t cherokee_resolv_cache_get_addrinfo (cherokee_resolv_cache_t *resolv, cherokee_buffer_t *domain, const struct addrinfo **addr_info);
+
+/* The address lists are reference counted: every list returned by
+ * the look-ups must be released once the caller is done with it.
+ */
+ret_t cherokee_resolv_cache_get_addrinfo     (cherokee_resolv_cache_t *resolv, cherokee_buffer_t *domain, const struct addrinfo **addr_info);
+ret_t cherokee_resolv_cache_release_addrinfo (cherokee_resolv_cache_t *resolv, const struct addrinfo *addr_info);
+
+/* Non-blocking look-up: it returns ret_eagain while the name is
+ * being resolved. The caller should poll 'fd' for reading, and
+ * try again once it becomes readable.
+ */
+ret_t cherokee_resolv_cache_get_addrinfo_async (cherokee_resolv_cache_t *resolv, cherokee_buffer_t *domain, const struct addrinfo **addr_info, int *fd);
 
 CHEROKEE_END_DECLS
 
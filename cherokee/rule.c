@@ -37,9 +37,12 @@ cherokee_rule_init_base (cherokee_rule_t *rule, cherokee_plugin_info_t *info)
 	INIT_LIST_HEAD (&rule->list_node);
 
 	rule->match       = NULL;
+	rule->index_keys  = NULL;
 	rule->final       = true;
 	rule->priority    = CHEROKEE_RULE_PRIO_NONE;
 	rule->parent_rule = NULL;
+	rule->index_type  = rule_index_none;
+	rule->index_pos   = 0;
 
 	cherokee_config_entry_init (&rule->config);
 	return ret_ok;
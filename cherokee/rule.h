@@ -46,6 +46,17 @@ CHEROKEE_BEGIN_DECLS
 typedef ret_t (* rule_func_new_t)       (void **rule);
 typedef ret_t (* rule_func_configure_t) (void  *rule, cherokee_config_node_t *conf, void *vsrv);
 typedef ret_t (* rule_func_match_t)     (void  *rule, void *cnt, void *ret_conf);
+typedef ret_t (* rule_func_index_t)     (void  *rule, void *rule_list);
+
+/* Index classes: a rule can tell the rule list which requests it
+ * could possibly match, so the rest of them can skip it.
+ */
+typedef enum {
+	rule_index_none,
+	rule_index_directory,
+	rule_index_extension,
+	rule_index_request
+} cherokee_rule_index_t;
 
 /* Data types
  */
@@ -60,9 +71,14 @@ struct cherokee_rule {
 	cuint_t                 priority;
 	struct cherokee_rule   *parent_rule;
 
+	/* Rule list index */
+	cherokee_rule_index_t   index_type;
+	cuint_t                 index_pos;
+
 	/* Virtual methods */
 	rule_func_match_t       match;
 	rule_func_configure_t   configure;
+	rule_func_index_t       index_keys;
 };
 
 typedef struct cherokee_rule cherokee_rule_t;
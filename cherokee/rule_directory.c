@@ -27,6 +27,7 @@
 #include "plugin_loader.h"
 #include "connection-protected.h"
 #include "util.h"
+#include "rule_list.h"
 
 #define ENTRIES "rule,directory"
 
@@ -128,6 +129,13 @@ configure (cherokee_rule_directory_t *rule,
 	return ret_ok;
 }
 
+static ret_t
+index_keys (cherokee_rule_directory_t *rule,
+	    cherokee_rule_list_t      *list)
+{
+	return cherokee_rule_list_index_directory (list, RULE(rule), &rule->directory);
+}
+
 static ret_t
 _free (void *p)
 {
@@ -148,9 +156,10 @@ cherokee_rule_directory_new (cherokee_rule_directory_t **rule)
 
 	/* Virtual methods
 	 */
-	RULE(n)->match     = (rule_func_match_t) match;
-	RULE(n)->configure = (rule_func_configure_t) configure;
-	MODULE(n)->free    = (module_func_free_t) _free;
+	RULE(n)->match      = (rule_func_match_t) match;
+	RULE(n)->configure  = (rule_func_configure_t) configure;
+	RULE(n)->index_keys = (rule_func_index_t) index_keys;
+	MODULE(n)->free     = (module_func_free_t) _free;
 
 	/* Properties
 	 */
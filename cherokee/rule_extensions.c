@@ -29,6 +29,7 @@
 #include "server-protected.h"
 #include "thread.h"
 #include "util.h"
+#include "rule_list.h"
 
 #define ENTRIES "rule,extensions"
 #define MAGIC   0xFABADA
@@ -79,6 +80,30 @@ configure (cherokee_rule_extensions_t *rule,
 	return parse_value (tmp, &rule->extensions);
 }
 
+static ret_t
+index_key (cherokee_buffer_t *key, void *value, void *param)
+{
+	cherokee_rule_t *rule = RULE(((void **)param)[0]);
+
+	UNUSED(value);
+	return cherokee_rule_list_index_extension (((void **)param)[1], rule, key);
+}
+
+static ret_t
+index_keys (cherokee_rule_extensions_t *rule,
+	    cherokee_rule_list_t       *list)
+{
+	ret_t  ret;
+	void  *param[2] = {rule, list};
+
+	ret = cherokee_avl_while (AVL_GENERIC(&rule->extensions), index_key, param, NULL, NULL);
+	if (ret != ret_ok) {
+		return ret_error;
+	}
+
+	return ret_ok;
+}
+
 static ret_t
 _free (void *p)
 {
@@ -255,9 +280,10 @@ cherokee_rule_extensions_new (cherokee_rule_extensions_t **rule)
 
 	/* Virtual methods
 	 */
-	RULE(n)->match     = (rule_func_match_t) match;
-	RULE(n)->configure = (rule_func_configure_t) configure;
-	MODULE(n)->free    = (module_func_free_t) _free;
+	RULE(n)->match      = (rule_func_match_t) match;
+	RULE(n)->configure  = (rule_func_configure_t) configure;
+	RULE(n)->index_keys = (rule_func_index_t) index_keys;
+	MODULE(n)->free     = (module_func_free_t) _free;
 
 	/* Properties
 	 */
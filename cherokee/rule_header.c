@@ -29,7 +29,6 @@
 #include "server-protected.h"
 #include "connection-protected.h"
 #include "util.h"
-#include "pcre/pcre.h"
 
 #define ENTRIES "rule,header"
 
@@ -62,9 +61,7 @@ match_regex (cherokee_rule_header_t  *rule,
 
 	/* Check whether it matches
 	 */
-	re = pcre_exec (rule->pcre, NULL,
-			info, info_len,
-			0, 0, NULL, 0);
+	re = cherokee_regex_exec (rule->pcre, info, info_len, NULL, 0);
 
 	if (re < 0) {
 		TRACE (ENTRIES, "Request '%s' didn't match header(%d) with '%s'\n",
@@ -108,10 +105,10 @@ match_complete (cherokee_rule_header_t  *rule,
 
 	/* Check whether it matches
 	 */
-	re = pcre_exec (rule->pcre, NULL,
-			conn->incoming_header.buf,
-			conn->incoming_header.len,
-			0, 0, NULL, 0);
+	re = cherokee_regex_exec (rule->pcre,
+				  conn->incoming_header.buf,
+				  conn->incoming_header.len,
+				  NULL, 0);
 
 	if (re < 0) {
 		TRACE (ENTRIES, "Request '%s' didn't match complete header with '%s'\n",
@@ -31,6 +31,9 @@
 
 #define ENTRIES "rules"
 
+#define MASK_SET(m,n) ((m)->bits[(n) >> 5] |= (1u << ((n) & 31)))
+#define MASK_GET(m,n) ((m)->bits[(n) >> 5] &  (1u << ((n) & 31)))
+
 
 ret_t
 cherokee_rule_list_init (cherokee_rule_list_t *list)
@@ -42,6 +45,16 @@ cherokee_rule_list_init (cherokee_rule_list_t *list)
 	ret = cherokee_rule_default_new (&list->def_rule);
 	if (ret != ret_ok) return ret;
 
+	/* Index
+	 */
+	cherokee_avl_init (&list->index.directories);
+	cherokee_avl_init (&list->index.extensions);
+	cherokee_buffer_init (&list->index.request_pattern);
+
+	list->index.request_num  = 0;
+	list->index.request_pcre = NULL;
+	memset (&list->index.request_mask, 0, sizeof(cherokee_rule_mask_t));
+
 	return ret_ok;
 }
 
@@ -57,6 +70,18 @@ cherokee_rule_list_mrproper (cherokee_rule_list_t *list)
 	}
 
 	cherokee_rule_free (list->def_rule);
+
+	/* Index
+	 */
+	cherokee_avl_mrproper (AVL_GENERIC(&list->index.directories), free);
+	cherokee_avl_mrproper (AVL_GENERIC(&list->index.extensions), free);
+	cherokee_buffer_mrproper (&list->index.request_pattern);
+
+	if (list->index.request_pcre != NULL) {
+		cherokee_regex_free (list->index.request_pcre);
+		list->index.request_pcre = NULL;
+	}
+
 	return ret_ok;
 }
 
@@ -82,18 +107,210 @@ update_connection (cherokee_connection_t   *conn,
 	}
 }
 
+static void
+index_eval_directory (cherokee_rule_list_t  *list,
+		      cherokee_connection_t *conn,
+		      cherokee_rule_mask_t  *mask)
+{
+	ret_t                 ret;
+	cuint_t               n;
+	cuint_t               w;
+	char                  tmp;
+	cherokee_rule_mask_t *keys;
+	cherokee_buffer_t    *req  = &conn->request;
+
+	/* A directory rule matches its own path, or any of the paths
+	 * under it. Thus, the only prefixes worth looking for are the
+	 * ones finishing right before a slash (plus the first
+	 * character and the whole request).
+	 */
+	for (n = 1; n <= req->len; n++) {
+		if ((n != 1) &&
+		    (n != req->len) &&
+		    (req->buf[n] != '/'))
+		{
+			continue;
+		}
+
+		tmp = req->buf[n];
+		req->buf[n] = '\0';
+
+		ret = cherokee_avl_get_ptr (&list->index.directories, req->buf, (void **)&keys);
+
+		req->buf[n] = tmp;
+
+		if (ret == ret_ok) {
+			for (w = 0; w < CHEROKEE_RULE_INDEX_WORDS; w++) {
+				mask->bits[w] |= keys->bits[w];
+			}
+		}
+	}
+}
+
+static void
+index_eval_extension (cherokee_rule_list_t  *list,
+		      cherokee_connection_t *conn,
+		      cherokee_rule_mask_t  *mask)
+{
+	ret_t                 ret;
+	cuint_t               n;
+	char                 *dot;
+	char                 *slash;
+	char                 *end;
+	char                 *p;
+	cherokee_rule_mask_t *keys;
+	char                 *dot_prev = NULL;
+
+	/* It must walk the request exactly as the extensions rule
+	 * does, so it looks up the very same strings.
+	 */
+	end = conn->request.buf + conn->request.len;
+	p   = end - 1;
+
+	while (p > conn->request.buf) {
+		if ((*p != '.') ||
+		    (p[1] == '\0') ||
+		    (p[1] == '/'))
+		{
+			p--;
+			continue;
+		}
+
+		dot   = p;
+		slash = NULL;
+
+		while (p < end) {
+			if (*p == '/') {
+				slash = p;
+				*p = '\0';
+				break;
+			}
+
+			p++;
+
+			if ((dot_prev != NULL) && (p >= dot_prev)) {
+				break;
+			}
+		}
+
+		ret = cherokee_avl_get_ptr (&list->index.extensions, dot+1, (void **)&keys);
+		if (ret == ret_ok) {
+			for (n = 0; n < CHEROKEE_RULE_INDEX_WORDS; n++) {
+				mask->bits[n] |= keys->bits[n];
+			}
+		}
+
+		if (slash != NULL) {
+			*slash = '/';
+		}
+
+		dot_prev = dot;
+		p = dot - 1;
+	}
+}
+
+static void
+index_eval_request (cherokee_rule_list_t  *list,
+		    cherokee_connection_t *conn,
+		    cherokee_rule_mask_t  *mask)
+{
+	int     re;
+	cuint_t n;
+
+	if (! cherokee_buffer_is_empty (&conn->query_string)) {
+		cherokee_buffer_add_str (&conn->request, "?");
+		cherokee_buffer_add_buffer (&conn->request, &conn->query_string);
+	}
+
+	/* None of the request rules can match unless the combined
+	 * expression does.
+	 */
+	re = cherokee_regex_exec (list->index.request_pcre,
+				  conn->request.buf,
+				  conn->request.len,
+				  NULL, 0);
+
+	if (! cherokee_buffer_is_empty (&conn->query_string)) {
+		cherokee_buffer_drop_ending (&conn->request, conn->query_string.len + 1);
+	}
+
+	if (re == CHEROKEE_REGEX_NOMATCH) {
+		TRACE(ENTRIES, "Index: no request rule can match '%s'\n", conn->request.buf);
+		return;
+	}
+
+	/* Any other error (match or recursion limits, memory) says
+	 * nothing about the rules: they are evaluated one by one.
+	 */
+	if (re < 0) {
+		TRACE(ENTRIES, "Index: combined expression failed (re=%d), evaluating the request rules\n", re);
+	}
+
+	for (n = 0; n < CHEROKEE_RULE_INDEX_WORDS; n++) {
+		mask->bits[n] |= list->index.request_mask.bits[n];
+	}
+}
+
+static cherokee_boolean_t
+index_skip (cherokee_rule_list_t  *list,
+	    cherokee_rule_t       *rule,
+	    cherokee_connection_t *conn,
+	    cherokee_rule_mask_t  *mask,
+	    cuint_t               *evaluated)
+{
+	if (rule->index_type == rule_index_none) {
+		return false;
+	}
+
+	/* Evaluate the index lazily, one class of rules at a time
+	 */
+	if (! (*evaluated & (1 << rule->index_type))) {
+		if (*evaluated == 0) {
+			memset (mask, 0, sizeof(cherokee_rule_mask_t));
+		}
+
+		*evaluated |= (1 << rule->index_type);
+
+		switch (rule->index_type) {
+		case rule_index_directory:
+			index_eval_directory (list, conn, mask);
+			break;
+		case rule_index_extension:
+			index_eval_extension (list, conn, mask);
+			break;
+		case rule_index_request:
+			index_eval_request (list, conn, mask);
+			break;
+		default:
+			SHOULDNT_HAPPEN;
+			return false;
+		}
+	}
+
+	return (MASK_GET (mask, rule->index_pos) == 0);
+}
+
 ret_t
 cherokee_rule_list_match (cherokee_rule_list_t    *list,
 			  cherokee_connection_t   *conn,
 			  cherokee_config_entry_t *ret_config)
 {
-	ret_t            ret;
-	cherokee_list_t *i;
-	cherokee_rule_t *rule;
+	ret_t                 ret;
+	cherokee_list_t      *i;
+	cherokee_rule_t      *rule;
+	cherokee_rule_mask_t  mask;
+	cuint_t               evaluated = 0;
 
 	list_for_each (i, &list->rules) {
 		rule = list_entry (i, cherokee_rule_t, list_node);
 
+		/* The index knows it cannot match
+		 */
+		if (index_skip (list, rule, conn, &mask, &evaluated)) {
+			TRACE(ENTRIES, "Skipping rule prio=%d\n", rule->priority);
+			continue;
+		}
+
 		TRACE(ENTRIES, "Trying rule prio=%d\n", rule->priority);
 
 		/* Does this rule apply
@@ -167,3 +384,188 @@ cherokee_rule_list_sort (cherokee_rule_list_t *list)
 	cherokee_list_sort (&list->rules, rule_cmp);
 	return ret_ok;
 }
+
+
+static ret_t
+index_add_key (cherokee_avl_t  *avl,
+	       const char      *key,
+	       cherokee_rule_t *rule)
+{
+	ret_t                 ret;
+	cherokee_rule_mask_t *keys = NULL;
+
+	ret = cherokee_avl_get_ptr (avl, key, (void **)&keys);
+	if (ret != ret_ok) {
+		keys = (cherokee_rule_mask_t *) calloc (1, sizeof(cherokee_rule_mask_t));
+		if (unlikely (keys == NULL)) {
+			return ret_nomem;
+		}
+
+		ret = cherokee_avl_add_ptr (avl, key, keys);
+		if (unlikely (ret != ret_ok)) {
+			free (keys);
+			return ret;
+		}
+	}
+
+	MASK_SET (keys, rule->index_pos);
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_rule_list_index_directory (cherokee_rule_list_t *list,
+				    cherokee_rule_t      *rule,
+				    cherokee_buffer_t    *directory)
+{
+	if (cherokee_buffer_is_empty (directory)) {
+		return ret_not_found;
+	}
+
+	rule->index_type = rule_index_directory;
+	return index_add_key (&list->index.directories, directory->buf, rule);
+}
+
+
+ret_t
+cherokee_rule_list_index_extension (cherokee_rule_list_t *list,
+				    cherokee_rule_t      *rule,
+				    cherokee_buffer_t    *extension)
+{
+	rule->index_type = rule_index_extension;
+	return index_add_key (&list->index.extensions, extension->buf, rule);
+}
+
+
+static cherokee_boolean_t
+request_is_combinable (cherokee_buffer_t *pattern)
+{
+	char *p;
+	char *end = pattern->buf + pattern->len;
+
+	/* Back-references, recursions, verbs, quoting and comments
+	 * would not survive being wrapped in a bigger expression.
+	 */
+	for (p = pattern->buf; p < end; p++) {
+		switch (*p) {
+		case '#':
+			return false;
+		case '\\':
+			if (p + 1 >= end)
+				return false;
+			p++;
+			if (((*p >= '0') && (*p <= '9')) ||
+			    (*p == 'g') || (*p == 'k') || (*p == 'Q'))
+				return false;
+			break;
+		case '(':
+			if ((p + 1 < end) && (p[1] == '*'))
+				return false;
+			if ((p + 2 < end) && (p[1] == '?') &&
+			    (strchr ("R&+-0123456789P", p[2]) != NULL))
+				return false;
+			break;
+		default:
+			break;
+		}
+	}
+
+	return true;
+}
+
+
+ret_t
+cherokee_rule_list_index_request (cherokee_rule_list_t *list,
+				  cherokee_rule_t      *rule,
+				  cherokee_buffer_t    *pattern)
+{
+	if (! request_is_combinable (pattern)) {
+		TRACE(ENTRIES, "Index: request '%s' cannot be combined\n", pattern->buf);
+		return ret_not_found;
+	}
+
+	if (! cherokee_buffer_is_empty (&list->index.request_pattern)) {
+		cherokee_buffer_add_str (&list->index.request_pattern, "|");
+	}
+
+	cherokee_buffer_add_str    (&list->index.request_pattern, "(?:");
+	cherokee_buffer_add_buffer (&list->index.request_pattern, pattern);
+	cherokee_buffer_add_str    (&list->index.request_pattern, ")");
+
+	MASK_SET (&list->index.request_mask, rule->index_pos);
+	list->index.request_num += 1;
+
+	rule->index_type = rule_index_request;
+	return ret_ok;
+}
+
+
+static void
+index_drop_requests (cherokee_rule_list_t *list)
+{
+	cherokee_list_t *i;
+	cherokee_rule_t *rule;
+
+	list_for_each (i, &list->rules) {
+		rule = list_entry (i, cherokee_rule_t, list_node);
+		if (rule->index_type == rule_index_request) {
+			rule->index_type = rule_index_none;
+		}
+	}
+}
+
+
+ret_t
+cherokee_rule_list_compile (cherokee_rule_list_t *list)
+{
+	ret_t             ret;
+	cherokee_list_t  *i;
+	cherokee_rule_t  *rule;
+	cherokee_regex_t *regex;
+	cuint_t           pos   = 0;
+
+	/* Ask the rules for their index keys. The rules that report
+	 * none are always evaluated.
+	 */
+	list_for_each (i, &list->rules) {
+		rule = list_entry (i, cherokee_rule_t, list_node);
+
+		rule->index_type = rule_index_none;
+
+		if ((rule->index_keys == NULL) ||
+		    (pos >= CHEROKEE_RULE_INDEX_MAX))
+		{
+			continue;
+		}
+
+		rule->index_pos = pos++;
+
+		ret = rule->index_keys (rule, list);
+		if (ret != ret_ok) {
+			rule->index_type = rule_index_none;
+		}
+
+		TRACE(ENTRIES, "Index: rule prio=%d, pos=%d, type=%d\n",
+		      rule->priority, rule->index_pos, rule->index_type);
+	}
+
+	/* Combine the request expressions. With a single one there
+	 * is nothing to save.
+	 */
+	if (list->index.request_num < 2) {
+		index_drop_requests (list);
+		return ret_ok;
+	}
+
+	ret = cherokee_regex_new (&regex, list->index.request_pattern.buf, NULL, NULL);
+	if (ret != ret_ok) {
+		TRACE(ENTRIES, "Index: could not combine requests: %s\n", list->index.request_pattern.buf);
+		index_drop_requests (list);
+		return ret_ok;
+	}
+
+	list->index.request_pcre = regex;
+
+	TRACE(ENTRIES, "Index: combined %d requests\n", list->index.request_num);
+	return ret_ok;
+}
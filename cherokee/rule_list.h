@@ -32,12 +32,31 @@
 #include <cherokee/rule.h>
 #include <cherokee/list.h>
 #include <cherokee/connection.h>
+#include <cherokee/avl.h>
+#include <cherokee/buffer.h>
 
 CHEROKEE_BEGIN_DECLS
 
+#define CHEROKEE_RULE_INDEX_MAX   512
+#define CHEROKEE_RULE_INDEX_WORDS (CHEROKEE_RULE_INDEX_MAX / 32)
+
+typedef struct {
+	cuint_t bits[CHEROKEE_RULE_INDEX_WORDS];
+} cherokee_rule_mask_t;
+
 typedef struct {
-	cherokee_list_t  rules;
-	cherokee_rule_t *def_rule;
+	cherokee_avl_t        directories;
+	cherokee_avl_t        extensions;
+	cherokee_buffer_t     request_pattern;
+	cuint_t               request_num;
+	cherokee_rule_mask_t  request_mask;
+	void                 *request_pcre;
+} cherokee_rule_list_index_t;
+
+typedef struct {
+	cherokee_list_t             rules;
+	cherokee_rule_t            *def_rule;
+	cherokee_rule_list_index_t  index;
 } cherokee_rule_list_t;
 
 
@@ -46,11 +65,18 @@ ret_t cherokee_rule_list_mrproper (cherokee_rule_list_t *list);
 
 ret_t cherokee_rule_list_add      (cherokee_rule_list_t *list, cherokee_rule_t *rule);
 ret_t cherokee_rule_list_sort     (cherokee_rule_list_t *list);
+ret_t cherokee_rule_list_compile  (cherokee_rule_list_t *list);
 
 ret_t cherokee_rule_list_match    (cherokee_rule_list_t    *list,
 				   cherokee_connection_t   *conn,
 				   cherokee_config_entry_t *ret_config);
 
+/* Index keys, reported by the rules
+ */
+ret_t cherokee_rule_list_index_directory (cherokee_rule_list_t *list, cherokee_rule_t *rule, cherokee_buffer_t *directory);
+ret_t cherokee_rule_list_index_extension (cherokee_rule_list_t *list, cherokee_rule_t *rule, cherokee_buffer_t *extension);
+ret_t cherokee_rule_list_index_request   (cherokee_rule_list_t *list, cherokee_rule_t *rule, cherokee_buffer_t *pattern);
+
 CHEROKEE_END_DECLS
 
 #endif /* CHEROKEE_RULE_LIST_H */
@@ -28,7 +28,7 @@
 #include "server-protected.h"
 #include "connection-protected.h"
 #include "util.h"
-#include "pcre/pcre.h"
+#include "rule_list.h"
 
 #define ENTRIES "rule,request"
 
@@ -67,11 +67,10 @@ match (cherokee_rule_request_t *rule,
 
 	/* Evaluate the pcre
 	 */
-	re = pcre_exec (rule->pcre, NULL,
-			conn->request.buf,
-			conn->request.len,
-			0, 0,
-			conn->regex_ovector, OVECTOR_LEN);
+	re = cherokee_regex_exec (rule->pcre,
+				  conn->request.buf,
+				  conn->request.len,
+				  conn->regex_ovector, OVECTOR_LEN);
 
 	if (re < 0) {
 		TRACE (ENTRIES, "Request \"%s\" didn't match with \"%s\"\n",
@@ -128,6 +127,13 @@ configure (cherokee_rule_request_t   *rule,
 }
 
 
+static ret_t
+index_keys (cherokee_rule_request_t *rule,
+	    cherokee_rule_list_t    *list)
+{
+	return cherokee_rule_list_index_request (list, RULE(rule), &rule->pattern);
+}
+
 static ret_t
 _free (void *p)
 {
@@ -149,9 +155,10 @@ cherokee_rule_request_new (cherokee_rule_request_t  **rule)
 
 	/* Virtual methods
 	 */
-	RULE(n)->match     = (rule_func_match_t) match;
-	RULE(n)->configure = (rule_func_configure_t) configure;
-	MODULE(n)->free    = (module_func_free_t) _free;
+	RULE(n)->match      = (rule_func_match_t) match;
+	RULE(n)->configure  = (rule_func_configure_t) configure;
+	RULE(n)->index_keys = (rule_func_index_t) index_keys;
+	MODULE(n)->free     = (module_func_free_t) _free;
 
 	/* Properties
 	 */
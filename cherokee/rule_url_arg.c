@@ -29,7 +29,6 @@
 #include "server-protected.h"
 #include "connection-protected.h"
 #include "util.h"
-#include "pcre/pcre.h"
 
 #define ENTRIES "rule,url_arg"
 
@@ -44,9 +43,7 @@ check_argument (cherokee_rule_url_arg_t *rule,
 
 	/* Check whether it matches
 	 */
-	re = pcre_exec (rule->pcre, NULL,
-			value->buf, value->len,
-			0, 0, NULL, 0);
+	re = cherokee_regex_exec (rule->pcre, value->buf, value->len, NULL, 0);
 
 	if (re < 0) {
 		TRACE (ENTRIES, "Parameter value '%s' didn't match with '%s'\n",
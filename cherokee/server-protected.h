@@ -58,6 +58,8 @@
 #include "logger_writer.h"
 #include "collector.h"
 #include "post_track.h"
+#include "vserver_index.h"
+#include "fork_server.h"
 
 struct cherokee_server {
 	/* Exit related
@@ -73,6 +75,8 @@ struct cherokee_server {
 	/* Virtual servers
 	 */
 	cherokee_list_t            vservers;
+	cherokee_vserver_index_t   vservers_index;
+	cherokee_fork_server_t     fork_server;
 
 	/* Threads
 	 */
@@ -109,6 +113,15 @@ struct cherokee_server {
 	int                        log_flush_lapse;
 	time_t                     log_flush_next;
 
+	cherokee_boolean_t         log_flusher_on;
+	cherokee_boolean_t         log_flusher_exit;
+	cherokee_boolean_t         log_flusher_pending;
+#ifdef HAVE_PTHREAD
+	pthread_t                  log_flusher;
+	pthread_mutex_t            log_flusher_mutex;
+	pthread_cond_t             log_flusher_cond;
+#endif
+
 	/* Extensions
 	 */
 	cherokee_cryptor_t        *cryptor;
@@ -139,6 +152,7 @@ struct cherokee_server {
 
 	cherokee_list_t            listeners;
 	CHEROKEE_MUTEX_T          (listeners_mutex);
+	cherokee_boolean_t         reuseport;
 
 	/* Server name
 	 */
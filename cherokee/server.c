@@ -86,6 +86,7 @@
 #include "bogotime.h"
 #include "source_interpreter.h"
 #include "post_track.h"
+#include "resolv_cache.h"
 
 #define ENTRIES "core,server"
 #define GRNAM_BUF_LEN 8192
@@ -141,6 +142,7 @@ cherokee_server_new  (cherokee_server_t **srv)
 	n->fdlimit_available = -1;
 
 	n->listen_queue      = 65534;
+	n->reuseport         = false;
 	n->sendfile.min      = SENDFILE_MIN_SIZE;
 	n->sendfile.max      = SENDFILE_MAX_SIZE;
 
@@ -166,6 +168,8 @@ cherokee_server_new  (cherokee_server_t **srv)
 	 */
 	INIT_LIST_HEAD (&n->vservers);
 	INIT_LIST_HEAD (&n->listeners);
+	cherokee_vserver_index_init (&n->vservers_index);
+	cherokee_fork_server_init (&n->fork_server);
 	CHEROKEE_MUTEX_INIT (&n->listeners_mutex, CHEROKEE_MUTEX_FAST);
 
 	/* Module loader
@@ -183,6 +187,9 @@ cherokee_server_new  (cherokee_server_t **srv)
 
 	n->log_flush_next       = 0;
 	n->log_flush_lapse      = LOGGER_FLUSH_LAPSE;
+	n->log_flusher_on       = false;
+	n->log_flusher_exit     = false;
+	n->log_flusher_pending  = false;
 
 	/* Programmed tasks
 	 */
@@ -256,6 +263,163 @@ destroy_thread (cherokee_thread_t *thread)
 }
 
 
+static void
+flush_logs (cherokee_server_t *srv)
+{
+	cherokee_list_t   *i;
+	cherokee_logger_t *logger;
+
+	list_for_each (i, &srv->vservers) {
+		logger = VSERVER_LOGGER(i);
+		if (logger) {
+			cherokee_logger_flush (VSERVER_LOGGER(i));
+		}
+	}
+}
+
+
+#ifdef HAVE_PTHREAD
+static void
+log_flusher_notify (void *param)
+{
+	cherokee_server_t *srv = SRV(param);
+
+	/* The flusher might be busy writing: do not lose the call
+	 */
+	CHEROKEE_MUTEX_LOCK (&srv->log_flusher_mutex);
+	srv->log_flusher_pending = true;
+	pthread_cond_signal (&srv->log_flusher_cond);
+	CHEROKEE_MUTEX_UNLOCK (&srv->log_flusher_mutex);
+}
+
+static NORETURN void *
+log_flusher_routine (void *param)
+{
+	long               msecs;
+	struct timeval     now;
+	struct timespec    until;
+	cherokee_server_t *srv = SRV(param);
+
+	/* Lapse 0 means 'as soon as possible': the writers wake
+	 * the thread up as soon as a ring gets data.
+	 */
+	msecs = (srv->log_flush_lapse > 0) ? (srv->log_flush_lapse * 1000) : 100;
+
+	CHEROKEE_MUTEX_LOCK (&srv->log_flusher_mutex);
+
+	while (! srv->log_flusher_exit) {
+		if (! srv->log_flusher_pending) {
+			gettimeofday (&now, NULL);
+			until.tv_sec  = now.tv_sec + (msecs / 1000);
+			until.tv_nsec = (now.tv_usec * 1000) + ((msecs % 1000) * 1000000);
+			if (until.tv_nsec >= 1000000000) {
+				until.tv_sec  += 1;
+				until.tv_nsec -= 1000000000;
+			}
+
+			pthread_cond_timedwait (&srv->log_flusher_cond, &srv->log_flusher_mutex, &until);
+			if (srv->log_flusher_exit) {
+				break;
+			}
+		}
+
+		srv->log_flusher_pending = false;
+
+		CHEROKEE_MUTEX_UNLOCK (&srv->log_flusher_mutex);
+		flush_logs (srv);
+		CHEROKEE_MUTEX_LOCK (&srv->log_flusher_mutex);
+	}
+
+	CHEROKEE_MUTEX_UNLOCK (&srv->log_flusher_mutex);
+	pthread_exit (NULL);
+}
+#endif
+
+
+static ret_t
+log_flusher_start (cherokee_server_t *srv)
+{
+#ifdef HAVE_PTHREAD
+	ret_t                     ret;
+	size_t                    mark;
+	cherokee_list_t          *i;
+	cherokee_logger_writer_t *writer;
+
+	/* Is there any writer using per-thread rings?
+	 */
+	list_for_each (i, &srv->logger_writers) {
+		if (LOGGER_WRITER(i)->ring_size > 0)
+			break;
+	}
+
+	if (i == &srv->logger_writers) {
+		return ret_ok;
+	}
+
+	pthread_mutex_init (&srv->log_flusher_mutex, NULL);
+	pthread_cond_init (&srv->log_flusher_cond, NULL);
+
+	ret = cherokee_thread_create_nosignals (&srv->log_flusher, log_flusher_routine, srv);
+	if (ret != ret_ok) {
+		pthread_cond_destroy (&srv->log_flusher_cond);
+		pthread_mutex_destroy (&srv->log_flusher_mutex);
+		return ret_error;
+	}
+
+	srv->log_flusher_on = true;
+
+	/* Writers wake it up when a ring gets half full
+	 */
+	list_for_each (i, &srv->logger_writers) {
+		writer = LOGGER_WRITER(i);
+		if (writer->ring_size == 0)
+			continue;
+
+		mark = (srv->log_flush_lapse > 0) ? (writer->ring_size / 2) : 1;
+		cherokee_logger_writer_set_notify (writer, log_flusher_notify, srv, mark);
+	}
+#else
+	UNUSED (srv);
+#endif
+	return ret_ok;
+}
+
+
+static void
+log_flusher_stop (cherokee_server_t *srv)
+{
+#ifdef HAVE_PTHREAD
+	cherokee_list_t *i;
+
+	if (! srv->log_flusher_on) {
+		return;
+	}
+
+	list_for_each (i, &srv->logger_writers) {
+		cherokee_logger_writer_set_notify (LOGGER_WRITER(i), NULL, NULL, 0);
+	}
+
+	CHEROKEE_MUTEX_LOCK (&srv->log_flusher_mutex);
+	srv->log_flusher_exit = true;
+	pthread_cond_signal (&srv->log_flusher_cond);
+	CHEROKEE_MUTEX_UNLOCK (&srv->log_flusher_mutex);
+
+	pthread_join (srv->log_flusher, NULL);
+
+	pthread_cond_destroy (&srv->log_flusher_cond);
+	pthread_mutex_destroy (&srv->log_flusher_mutex);
+
+	srv->log_flusher_on = false;
+
+	/* Whatever the threads left behind
+	 */
+	flush_logs (srv);
+#else
+	UNUSED (srv);
+#endif
+}
+
+
 ret_t
 cherokee_server_free (cherokee_server_t *srv)
 {
@@ -286,6 +450,10 @@ cherokee_server_free (cherokee_server_t *srv)
 	TRACE(ENTRIES, "Destroying main_thread %p\n", srv->main_thread);
 	cherokee_thread_free (srv->main_thread);
 
+	/* Log flusher
+	 */
+	log_flusher_stop (srv);
+
 	/* File descriptors
 	 */
 	list_for_each_safe (i, j, &srv->listeners) {
@@ -331,6 +499,9 @@ cherokee_server_free (cherokee_server_t *srv)
 
 	/* Virtual servers
 	 */
+	cherokee_vserver_index_mrproper (&srv->vservers_index);
+	cherokee_fork_server_mrproper (&srv->fork_server);
+
 	list_for_each_safe (i, j, &srv->vservers) {
 		cherokee_virtual_server_free (VSERVER(i));
 	}
@@ -500,6 +671,10 @@ print_banner (cherokee_server_t *srv)
 		cherokee_buffer_add_va (&n, ", %d threads", srv->thread_num);
 		cherokee_buffer_add_va (&n, ", %d connections per thread", srv->main_thread->conns_max);
 
+		if (srv->reuseport) {
+			cherokee_buffer_add_str (&n, ", per-thread listeners");
+		}
+
 		switch (srv->thread_policy) {
 #ifdef HAVE_PTHREAD
 		case SCHED_FIFO:
@@ -642,8 +817,10 @@ initialize_server_threads (cherokee_server_t *srv)
 
 	/* If Cherokee runs in single thread mode, it has to add the
 	 * server sockets to the fdpoll. They will remain in there.
+	 * It is also the case when the threads accept through their
+	 * own SO_REUSEPORT listeners.
 	 */
-	if (srv->thread_num == 1) {
+	if ((srv->thread_num == 1) || (srv->reuseport)) {
 		cherokee_list_t *j;
 
 		list_for_each (j, &srv->listeners) {
@@ -678,6 +855,36 @@ initialize_server_threads (cherokee_server_t *srv)
 		/* Add it to the thread list
 		 */
 		cherokee_list_add (LIST(thread), &srv->thread_list);
+
+		/* Hand the thread its own listeners
+		 */
+		if (srv->reuseport) {
+			cherokee_list_t *j;
+			cherokee_bind_t *clone;
+
+			list_for_each (j, &srv->listeners) {
+				ret = cherokee_bind_get_reuseport (BIND(j), &clone);
+				if (unlikely (ret != ret_ok)) {
+					return ret_error;
+				}
+
+				ret = cherokee_thread_add_listener (thread, clone);
+				if (unlikely (ret != ret_ok)) {
+					cherokee_bind_free (clone);
+					return ret_error;
+				}
+			}
+		}
+	}
+
+	/* Nobody would accept from spare listeners
+	 */
+	if (srv->reuseport) {
+		cherokee_list_t *j;
+
+		list_for_each (j, &srv->listeners) {
+			cherokee_bind_free_reuseport (BIND(j));
+		}
 	}
 #endif
 
@@ -761,12 +968,43 @@ init_vservers_tls (cherokee_server_t *srv)
 	cherokee_list_t    *i;
 	cuint_t             ok    = 0;
 	cherokee_boolean_t  error = false;
+	cherokee_boolean_t  lazy  = false;
+
+	if (srv->cryptor != NULL) {
+		lazy = srv->cryptor->lazy_certs;
+	}
+
+	/* The key files are likely readable by the original user
+	 * only: they cannot be loaded once it has been dropped.
+	 */
+	if ((lazy) &&
+	    ((srv->user != srv->user_orig) ||
+	     (srv->group != srv->group_orig) ||
+	     (! cherokee_buffer_is_empty (&srv->chroot))))
+	{
+		LOG_ERROR_S (CHEROKEE_ERROR_SERVER_TLS_LAZY_PRIVS);
+
+		srv->cryptor->lazy_certs = false;
+		lazy = false;
+	}
 
 	/* Initialize TLS in all the virtual servers
 	 */
 	list_for_each (i, &srv->vservers) {
 		cherokee_virtual_server_t *vserver = VSERVER(i);
 
+		/* The certificates can be loaded by the cryptor
+		 * once they are requested. The default virtual
+		 * server is always loaded.
+		 */
+		if ((lazy) && (i != srv->vservers.prev)) {
+			ret = cherokee_virtual_server_has_tls (vserver);
+			if (ret == ret_ok) {
+				ok += 1;
+			}
+			continue;
+		}
+
 		ret = cherokee_virtual_server_init_tls (vserver);
 		if (ret < ret_ok) {
 			LOG_CRITICAL (CHEROKEE_ERROR_SERVER_TLS_INIT,
@@ -953,6 +1191,7 @@ cherokee_server_initialize (cherokee_server_t *srv)
 		ret = cherokee_bind_init_port (BIND(i),
 					       srv->listen_queue,
 					       srv->ipv6,
+					       srv->reuseport,
 					       srv->server_token);
 		if (ret != ret_ok)
 			return ret;
@@ -978,6 +1217,32 @@ cherokee_server_initialize (cherokee_server_t *srv)
 	srv->thread_num = 1;
 #endif
 
+	/* Per-thread listeners: they have to be bound before the
+	 * server drops its privileges.
+	 */
+	if (srv->thread_num <= 1) {
+		srv->reuseport = false;
+	}
+
+	if (srv->reuseport) {
+		list_for_each (i, &srv->listeners) {
+			ret = cherokee_bind_init_reuseport (BIND(i),
+							    srv->thread_num - 1,
+							    srv->listen_queue);
+			if (ret != ret_ok) {
+				LOG_WARNING (CHEROKEE_ERROR_SERVER_REUSEPORT, BIND(i)->port);
+				srv->reuseport = false;
+				break;
+			}
+		}
+
+		if (! srv->reuseport) {
+			list_for_each (i, &srv->listeners) {
+				cherokee_bind_free_reuseport (BIND(i));
+			}
+		}
+	}
+
 	/* Check the number of reusable connections
 	 */
 	if (srv->conns_reuse_max == -1)
@@ -1044,12 +1309,26 @@ cherokee_server_initialize (cherokee_server_t *srv)
 		return ret_error;
 	}
 
+	/* Fork-server: CGIs are spawned from it, rather than from
+	 * the worker, once this has grown. If it cannot be started
+	 * they will be forked by the worker.
+	 */
+	cherokee_fork_server_start (&srv->fork_server);
+
 	/* Collectors
 	 */
 	ret = initialize_collectors (srv);
 	if (ret != ret_ok)
 		return ret_error;
 
+	/* I/O cache invalidation
+	 */
+	if (srv->iocache) {
+		ret = cherokee_iocache_watch (srv->iocache);
+		if (ret != ret_ok)
+			return ret_error;
+	}
+
 	/* Create the threads
 	 */
 	ret = initialize_server_threads (srv);
@@ -1066,21 +1345,6 @@ cherokee_server_initialize (cherokee_server_t *srv)
 }
 
 
-static void
-flush_logs (cherokee_server_t *srv)
-{
-	cherokee_list_t   *i;
-	cherokee_logger_t *logger;
-
-	list_for_each (i, &srv->vservers) {
-		logger = VSERVER_LOGGER(i);
-		if (logger) {
-			cherokee_logger_flush (VSERVER_LOGGER(i));
-		}
-	}
-}
-
-
 static void
 flcaches_cleanup (cherokee_server_t *srv)
 {
@@ -1133,6 +1397,11 @@ cherokee_server_unlock_threads (cherokee_server_t *srv)
 		if (unlikely(ret < ret_ok)) return ret;
 	}
 
+	/* Log flusher: it drains the per-thread log rings
+	 */
+	ret = log_flusher_start (srv);
+	if (unlikely(ret < ret_ok)) return ret;
+
 	return ret_ok;
 }
 
@@ -1165,7 +1434,9 @@ cherokee_server_step (cherokee_server_t *srv)
 
 	/* Programmed tasks
 	 */
-	if (srv->log_flush_next < cherokee_bogonow_now) {
+	if ((! srv->log_flusher_on) &&
+	    (srv->log_flush_next < cherokee_bogonow_now))
+	{
 		flush_logs (srv);
 		srv->log_flush_next = cherokee_bogonow_now + srv->log_flush_lapse;
 	}
@@ -1364,6 +1635,7 @@ configure_server_property (cherokee_config_node_t *conf, void *data)
 {
 	ret_t              ret;
 	int                val;
+	cherokee_boolean_t flag;
 	char              *key = conf->key.buf;
 	cherokee_server_t *srv = SRV(data);
 	long               num;
@@ -1394,6 +1666,19 @@ configure_server_property (cherokee_config_node_t *conf, void *data)
 		ret = cherokee_atoi (conf->val.buf, &srv->conns_reuse_max);
 		if (ret != ret_ok) return ret_error;
 
+	} else if (equal_buf_str (&conf->key, "reuseport")) {
+		ret = cherokee_atob (conf->val.buf, &srv->reuseport);
+		if (ret != ret_ok) return ret_error;
+
+	} else if (equal_buf_str (&conf->key, "fork_server")) {
+		ret = cherokee_atob (conf->val.buf, &srv->fork_server.enabled);
+		if (ret != ret_ok) return ret_error;
+
+	} else if (equal_buf_str (&conf->key, "regex_jit")) {
+		ret = cherokee_atob (conf->val.buf, &flag);
+		if (ret != ret_ok) return ret_error;
+		cherokee_regex_set_jit (flag);
+
 	} else if (equal_buf_str (&conf->key, "ipv6")) {
 		ret = cherokee_atob (conf->val.buf, &srv->ipv6);
 		if (ret != ret_ok) return ret_error;
@@ -1585,6 +1870,17 @@ configure_server_property (cherokee_config_node_t *conf, void *data)
 		if (ret != ret_ok)
 			return ret;
 
+	} else if (equal_buf_str (&conf->key, "resolv")) {
+		cherokee_resolv_cache_t *resolv;
+
+		ret = cherokee_resolv_cache_get_default (&resolv);
+		if (ret != ret_ok)
+			return ret;
+
+		ret = cherokee_resolv_cache_configure (resolv, conf);
+		if (ret != ret_ok)
+			return ret;
+
 	} else if (equal_buf_str (&conf->key, "module_dir") ||
 		   equal_buf_str (&conf->key, "module_deps") ||
 		   equal_buf_str (&conf->key, "iocache")) {
@@ -1699,6 +1995,12 @@ configure_server (cherokee_server_t *srv)
 	if (ret != ret_ok)
 		return ret;
 
+	/* Index the virtual servers by host
+	 */
+	ret = cherokee_vserver_index_build (&srv->vservers_index, &srv->vservers);
+	if (ret != ret_ok)
+		return ret;
+
 	/* Sanity check: Port Binds
 	 */
 	if (cherokee_list_empty (&srv->listeners)) {
@@ -1884,6 +2186,8 @@ cherokee_server_handle_HUP (cherokee_server_t *srv)
 		cherokee_fd_close (BIND(i)->socket.socket);
 	}
 
+	/* The threads close their own listeners, on their next step
+	 */
 
 	return ret_ok;
 }
@@ -2028,43 +2332,20 @@ cherokee_server_get_vserver (cherokee_server_t          *srv,
 			     cherokee_connection_t      *conn,
 			     cherokee_virtual_server_t **vsrv)
 {
-	int                        re;
-	ret_t                      ret;
-	cherokee_list_t           *i;
-	cherokee_virtual_server_t *vserver;
+	ret_t                           ret;
+	cherokee_vserver_index_cache_t *cache = NULL;
 
 	TRACE (ENTRIES, "Trying to match '%s'\n", host->buf);
 
-	/* Evaluate the vrules
+	/* Each thread remembers its latest lookups
 	 */
-	list_for_each (i, &srv->vservers) {
-		vserver = VSERVER(i);
-
-		if (! vserver->matching)
-			continue;
-
-		ret = cherokee_vrule_match (vserver->matching, host, conn);
-		if (ret == ret_ok) {
-			TRACE (ENTRIES, "Virtual server '%s' matched vrule\n", vserver->name.buf);
-			*vsrv = vserver;
-			return ret_ok;
-		}
+	if ((conn != NULL) && (CONN_THREAD(conn) != NULL)) {
+		cache = &CONN_THREAD(conn)->vserver_cache;
 	}
 
-	/* In case there was no match, try with the nicknames
-	 */
-	list_for_each (i, &srv->vservers) {
-		vserver = VSERVER(i);
-
-		if (! vserver->match_nick)
-			continue;
-
-		re = cherokee_buffer_cmp_buf (host, &vserver->name);
-		if (re == 0) {
-			TRACE (ENTRIES, "Virtual server '%s' matched by its nick\n", vserver->name.buf);
-			*vsrv = vserver;
-			return ret_ok;
-		}
+	ret = cherokee_vserver_index_get (&srv->vservers_index, cache, host, conn, (void **)vsrv, NULL);
+	if (ret == ret_ok) {
+		return ret_ok;
 	}
 
 	/* Nothing matched, return the 'default' vserver (lowest priority)
@@ -1349,6 +1349,143 @@ cherokee_socket_sendfile (cherokee_socket_t *socket,
 }
 
 
+#ifdef HAVE_SPLICE
+static ret_t
+do_splice (int fd_in, int fd_out, size_t size, size_t *spliced)
+{
+	ssize_t                   re;
+	static cherokee_boolean_t no_sys = false;
+
+	if (unlikely (no_sys))
+		return ret_no_sys;
+
+	do {
+		re = splice (fd_in, NULL, fd_out, NULL, size,
+			     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	} while ((re < 0) && (errno == EINTR));
+
+	if (re < 0) {
+		switch (errno) {
+		case EAGAIN:
+#if defined(EWOULDBLOCK) && (EWOULDBLOCK != EAGAIN)
+		case EWOULDBLOCK:
+#endif
+			return ret_eagain;
+		case EINVAL:
+			/* One of the descriptors does not support it
+			 */
+			return ret_no_sys;
+		case ENOSYS:
+			no_sys = true;
+			return ret_no_sys;
+		}
+
+		return ret_error;
+
+	} else if (re == 0) {
+		return ret_eof;
+	}
+
+	*spliced = re;
+	return ret_ok;
+}
+#endif
+
+
+ret_t
+cherokee_socket_splice_in (cherokee_socket_t *socket,
+			   int                pipe_fd,
+			   size_t             size,
+			   size_t            *spliced)
+{
+	/* Moves up to 'size' bytes from the socket into the
+	 * writing end of a pipe, without copying them to user space.
+	 */
+	*spliced = 0;
+
+#ifdef HAVE_SPLICE
+	if (unlikely (socket->is_tls == TLS))
+		return ret_no_sys;
+
+	return do_splice (SOCKET_FD(socket), pipe_fd, size, spliced);
+#else
+	UNUSED(socket);
+	UNUSED(pipe_fd);
+	UNUSED(size);
+
+	return ret_no_sys;
+#endif
+}
+
+
+ret_t
+cherokee_socket_splice_out (cherokee_socket_t *socket,
+			    int                pipe_fd,
+			    size_t             size,
+			    size_t            *spliced)
+{
+	ret_t ret;
+
+	/* Moves up to 'size' bytes from the reading end of a pipe
+	 * to the socket.
+	 */
+	*spliced = 0;
+
+#ifdef HAVE_SPLICE
+	if (unlikely (socket->is_tls == TLS))
+		return ret_no_sys;
+
+	ret = do_splice (pipe_fd, SOCKET_FD(socket), size, spliced);
+
+	/* The pipe is only drained when it has content, so an empty
+	 * read means the socket could not take anything
+	 */
+	if (ret == ret_eof)
+		return ret_error;
+
+	return ret;
+#else
+	UNUSED(socket);
+	UNUSED(pipe_fd);
+	UNUSED(size);
+	UNUSED(ret);
+
+	return ret_no_sys;
+#endif
+}
+
+
+ret_t
+cherokee_socket_splice_fd (int     fd_in,
+			   int     fd_out,
+			   size_t  size,
+			   size_t *spliced)
+{
+	ret_t ret;
+
+	/* Moves up to 'size' bytes between two file descriptors. At
+	 * least one of them has to be a pipe, and 'fd_in' is expected
+	 * to have some content.
+	 */
+	*spliced = 0;
+
+#ifdef HAVE_SPLICE
+	ret = do_splice (fd_in, fd_out, size, spliced);
+	if (ret == ret_eof)
+		return ret_error;
+
+	return ret;
+#else
+	UNUSED(fd_in);
+	UNUSED(fd_out);
+	UNUSED(size);
+	UNUSED(ret);
+
+	return ret_no_sys;
+#endif
+}
+
+
 ret_t
 cherokee_socket_gethostbyname (cherokee_socket_t *socket, cherokee_buffer_t *hostname)
 {
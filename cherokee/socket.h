@@ -132,6 +132,9 @@ ret_t cherokee_socket_listen            (cherokee_socket_t *socket, int backlog)
 ret_t cherokee_socket_bufwrite          (cherokee_socket_t *socket, cherokee_buffer_t *buf, size_t *written);
 ret_t cherokee_socket_bufread           (cherokee_socket_t *socket, cherokee_buffer_t *buf, size_t count, size_t *read);
 ret_t cherokee_socket_sendfile          (cherokee_socket_t *socket, int fd, size_t size, off_t *offset, ssize_t *sent);
+ret_t cherokee_socket_splice_in         (cherokee_socket_t *socket, int pipe_fd, size_t size, size_t *spliced);
+ret_t cherokee_socket_splice_out        (cherokee_socket_t *socket, int pipe_fd, size_t size, size_t *spliced);
+ret_t cherokee_socket_splice_fd         (int fd_in, int fd_out, size_t size, size_t *spliced);
 ret_t cherokee_socket_connect           (cherokee_socket_t *socket);
 
 ret_t cherokee_socket_ntop              (cherokee_socket_t *socket, char *buf, size_t buf_size);
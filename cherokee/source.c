@@ -46,10 +46,14 @@ cherokee_source_init (cherokee_source_t *src)
 	cherokee_buffer_init (&src->unix_socket);
 	cherokee_buffer_init (&src->host);
 
-	src->type         = source_host;
-	src->port         = -1;
-	src->free         = NULL;
-	src->addr_current = NULL;
+	src->type          = source_host;
+	src->port          = -1;
+	src->free          = NULL;
+	src->addr_current  = NULL;
+
+	src->pool.hits      = 0;
+	src->pool.misses    = 0;
+	src->pool.evictions = 0;
 
 	return ret_ok;
 }
@@ -114,6 +118,19 @@ cherokee_source_connect (cherokee_source_t *src, cherokee_socket_t *sock)
 			return ret_error;
 		}
 
+		/* The host might have been resolved again, and the
+		 * former list freed: the current address must belong
+		 * to the new one.
+		 */
+		for (addr = addr_info; addr != NULL; addr = addr->ai_next) {
+			if (addr == src->addr_current)
+				break;
+		}
+
+		if (addr == NULL) {
+			src->addr_current = NULL;
+		}
+
 		/* Current address
 		 */
 		if (src->addr_current) {
@@ -153,6 +170,7 @@ cherokee_source_connect (cherokee_source_t *src, cherokee_socket_t *sock)
 			addr = addr->ai_next;
 			if (addr == NULL) {
 				if (tested_all) {
+					cherokee_resolv_cache_release_addrinfo (resolv, addr_info);
 					return ret_error;
 				}
 
@@ -176,10 +194,13 @@ cherokee_source_connect (cherokee_source_t *src, cherokee_socket_t *sock)
 			break;
 		default:
 			SHOULDNT_HAPPEN;
+			cherokee_resolv_cache_release_addrinfo (resolv, addr_info);
 			return ret_error;
 		}
 
 		ret = cherokee_socket_update_from_addrinfo (sock, src->addr_current, 0);
+		cherokee_resolv_cache_release_addrinfo (resolv, addr_info);
+
 		if (unlikely (ret != ret_ok)) {
 			return ret_error;
 		}
@@ -199,6 +220,46 @@ cherokee_source_connect (cherokee_source_t *src, cherokee_socket_t *sock)
 }
 
 
+ret_t
+cherokee_source_resolve_polling (cherokee_source_t     *src,
+				 cherokee_connection_t *conn)
+{
+	ret_t                    ret;
+	int                      fd        = -1;
+	const struct addrinfo   *addr_info = NULL;
+	cherokee_resolv_cache_t *resolv;
+
+	if (! cherokee_buffer_is_empty (&src->unix_socket)) {
+		return ret_ok;
+	}
+
+	ret = cherokee_resolv_cache_get_default (&resolv);
+	if (unlikely (ret != ret_ok)) {
+		return ret_error;
+	}
+
+	/* Do not block the thread while the name is resolved
+	 */
+	ret = cherokee_resolv_cache_get_addrinfo_async (resolv, &src->host, &addr_info, &fd);
+	switch (ret) {
+	case ret_ok:
+		cherokee_resolv_cache_release_addrinfo (resolv, addr_info);
+		return ret_ok;
+	case ret_eagain:
+		TRACE (ENTRIES, "Waiting for '%s' to be resolved, fd=%d\n", src->host.buf, fd);
+
+		ret = cherokee_thread_deactive_to_polling (CONN_THREAD(conn), conn, fd,
+							   FDPOLL_MODE_READ, true);
+		if (ret != ret_ok) {
+			return ret_error;
+		}
+		return ret_eagain;
+	default:
+		return ret_error;
+	}
+}
+
+
 ret_t
 cherokee_source_connect_polling (cherokee_source_t     *src,
 				 cherokee_socket_t     *socket,
@@ -206,6 +267,11 @@ cherokee_source_connect_polling (cherokee_source_t     *src,
 {
 	ret_t ret;
 
+	ret = cherokee_source_resolve_polling (src, conn);
+	if (ret != ret_ok) {
+		return ret;
+	}
+
  	ret = cherokee_source_connect (src, socket);
 	switch (ret) {
 	case ret_ok:
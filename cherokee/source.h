@@ -50,6 +50,13 @@ typedef struct {
 	cint_t                 port;
 	const struct addrinfo *addr_current;
 
+	/* Kept-alive connections */
+	struct {
+		culong_t       hits;
+		culong_t       misses;
+		culong_t       evictions;
+	} pool;
+
 	cherokee_func_free_t   free;
 } cherokee_source_t;
 
@@ -67,6 +74,9 @@ ret_t cherokee_source_connect_polling (cherokee_source_t     *src,
 				       cherokee_socket_t     *socket,
 				       cherokee_connection_t *conn);
 
+ret_t cherokee_source_resolve_polling (cherokee_source_t     *src,
+				       cherokee_connection_t *conn);
+
 ret_t cherokee_source_copy_name       (cherokee_source_t     *src,
 				       cherokee_buffer_t     *buf);
 
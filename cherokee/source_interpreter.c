@@ -695,6 +695,13 @@ cherokee_source_interpreter_connect_polling (cherokee_source_interpreter_t *src,
 	int   unlocked;
 	int   kill_prev;
 
+	/* Resolve the host name
+	 */
+	ret = cherokee_source_resolve_polling (SOURCE(src), conn);
+	if (ret != ret_ok) {
+		return ret;
+	}
+
 	/* Connect
 	 */
  	ret = cherokee_source_connect (SOURCE(src), socket);
@@ -149,6 +149,8 @@ cherokee_thread_new  (cherokee_thread_t      **thd,
 	INIT_LIST_HEAD (LIST(&n->active_list));
 	INIT_LIST_HEAD (LIST(&n->reuse_list));
 	INIT_LIST_HEAD (LIST(&n->polling_list));
+	INIT_LIST_HEAD (LIST(&n->ready_list));
+	INIT_LIST_HEAD (LIST(&n->listeners));
 
 	n->exit                = false;
 	n->ended               = false;
@@ -200,6 +202,12 @@ cherokee_thread_new  (cherokee_thread_t      **thd,
 	n->bogo_now = 0;
 	memset (&n->bogo_now_tmgmt, 0, sizeof (struct tm));
 	cherokee_buffer_init (&n->bogo_now_strgmt);
+	cherokee_buffer_init (&n->expires_strgmt);
+	n->expires_time = 0;
+
+	/* Virtual server lookups
+	 */
+	cherokee_vserver_index_cache_init (&n->vserver_cache);
 
 	/* Temporary buffer used by utility functions
 	 */
@@ -211,6 +219,7 @@ cherokee_thread_new  (cherokee_thread_t      **thd,
 	/* Traffic shaping
 	 */
 	cherokee_limiter_init (&n->limiter);
+	cherokee_timer_wheel_init (&n->timers, cherokee_bogonow_msec);
 
 	/* The thread must adquire this mutex before
 	 * process its connections
@@ -312,6 +321,76 @@ del_connection_polling (cherokee_thread_t *thd, cherokee_connection_t *conn)
 }
 
 
+#define READY_CONN(l) (list_entry (l, cherokee_connection_t, ready_node))
+
+static void
+conn_set_ready (cherokee_thread_t *thd, cherokee_connection_t *conn)
+{
+	/* Already enqueued
+	 */
+	if (! cherokee_list_empty (&conn->ready_node))
+		return;
+
+	cherokee_list_add_tail (&conn->ready_node, &thd->ready_list);
+}
+
+static void
+conn_unset_ready (cherokee_connection_t *conn)
+{
+	if (cherokee_list_empty (&conn->ready_node))
+		return;
+
+	cherokee_list_del (&conn->ready_node);
+	INIT_LIST_HEAD (&conn->ready_node);
+}
+
+
+#define TIMER_CONN(t) (list_entry (t, cherokee_connection_t, timer))
+
+static void
+conn_update_timer (cherokee_thread_t *thd, cherokee_connection_t *conn)
+{
+	cherokee_msec_t expire;
+
+	/* Traffic shaping: it wakes up as soon as it can send
+	 * again. Otherwise, right after the timeout is reached.
+	 */
+	if (conn->limit_blocked_until > 0) {
+		expire = conn->limit_blocked_until;
+	} else if ((conn->flcache.wait_ref != NULL) &&
+		   (conn->flcache.wait_until < conn->timeout)) {
+		expire = ((cherokee_msec_t) conn->flcache.wait_until + 1) * 1000;
+	} else {
+		expire = ((cherokee_msec_t) conn->timeout + 1) * 1000;
+	}
+
+	if ((TIMER_IS_ARMED (&conn->timer)) &&
+	    (conn->timer.expire == expire))
+	{
+		return;
+	}
+
+	cherokee_timer_wheel_add (&thd->timers, &conn->timer, expire);
+}
+
+
+static ret_t
+thread_poll_add (cherokee_thread_t *thd, int fd, int rw, void *data)
+{
+	ret_t ret;
+
+	ret = cherokee_fdpoll_add (thd->fdpoll, fd, rw);
+	if (unlikely (ret != ret_ok))
+		return ret;
+
+	/* The readiness events will point to the connection. It is
+	 * fine if the fdpoll method does not support it.
+	 */
+	cherokee_fdpoll_set_data (thd->fdpoll, fd, data);
+	return ret_ok;
+}
+
+
 static ret_t
 connection_reuse_or_free (cherokee_thread_t *thread, cherokee_connection_t *conn)
 {
@@ -337,6 +416,11 @@ connection_reuse_or_free (cherokee_thread_t *thread, cherokee_connection_t *conn
 static void
 purge_connection (cherokee_thread_t *thread, cherokee_connection_t *conn)
 {
+	/* It might have been enqueued, and it is surely timed
+	 */
+	conn_unset_ready (conn);
+	cherokee_timer_wheel_del (&thread->timers, &conn->timer);
+
 	/* It maybe have a delayed log
 	 */
 	cherokee_connection_update_vhost_traffic (conn);
@@ -484,6 +568,13 @@ maybe_purge_closed_connection (cherokee_thread_t *thread, cherokee_connection_t
 	cherokee_connection_clean (conn);
 	conn_set_mode (thread, conn, socket_reading);
 
+	/* Pipelined request: it does not have to wait for the socket.
+	 * cherokee_connection_clean() has already counted it as pending.
+	 */
+	if (! cherokee_buffer_is_empty (&conn->incoming_header)) {
+		BIT_SET (conn->options, conn_op_was_polling);
+	}
+
 	/* Update the timeout value
 	 */
 	conn->timeout = cherokee_bogonow_now + conn->timeout_lapse;
@@ -529,113 +620,64 @@ send_hardcoded_error (cherokee_socket_t *sock,
 
 
 static ret_t
-process_polling_connections (cherokee_thread_t *thd)
+process_polling_connection (cherokee_thread_t *thd, cherokee_connection_t *conn)
 {
-	int                    re;
-	ret_t                  ret;
-	cherokee_list_t       *tmp, *i;
-	cherokee_connection_t *conn;
+	ret_t ret;
 
-	list_for_each_safe (i, tmp, LIST(&thd->polling_list)) {
-		conn = CONN(i);
+	/* Has it been too much without any work?
+	 */
+	if (conn->timeout < cherokee_bogonow_now) {
+		TRACE (ENTRIES",polling,timeout",
+		       "thread (%p) processing polling conn (%p, %s): Time out\n",
+		       thd, conn, cherokee_connection_get_phase_str (conn));
 
-		/* Thread's properties
+		/* Information collection
 		 */
-		if (CONN_VSRV(conn)) {
-			/* Current connection
-			 */
-			CHEROKEE_THREAD_PROP_SET (thread_connection_ptr, conn);
-
-			/* Error writer
-			 */
-			if (CONN_VSRV(conn)->error_writer) {
-				CHEROKEE_THREAD_PROP_SET (thread_error_writer_ptr,
-							  CONN_VSRV(conn)->error_writer);
-			}
+		if (THREAD_SRV(thd)->collector != NULL) {
+			cherokee_collector_log_timeout (THREAD_SRV(thd)->collector);
 		}
 
-		/* Has it been too much without any work?
+		/* Most likely a 'Gateway Timeout'
 		 */
-		if (conn->timeout < cherokee_bogonow_now) {
-			TRACE (ENTRIES",polling,timeout",
-			       "thread (%p) processing polling conn (%p, %s): Time out\n",
-			       thd, conn, cherokee_connection_get_phase_str (conn));
-
-			/* Information collection
+		if (conn->phase <= phase_add_headers) {
+			/* Push a hardcoded error
 			 */
-			if (THREAD_SRV(thd)->collector != NULL) {
-				cherokee_collector_log_timeout (THREAD_SRV(thd)->collector);
-			}
-
-			/* Most likely a 'Gateway Timeout'
-			 */
-			if (conn->phase <= phase_add_headers) {
-				/* Push a hardcoded error
-				 */
-				send_hardcoded_error (&conn->socket,
-						      http_gateway_timeout_string,
-						      THREAD_TMP_BUF1(thd));
+			send_hardcoded_error (&conn->socket,
+					      http_gateway_timeout_string,
+					      THREAD_TMP_BUF1(thd));
 
-				/* Assign the error code. Even though it wasn't used
-				 * before the handler::free function could check it.
-				 */
-				conn->error_code = http_gateway_timeout;
-
-				/* Purge the connection
-				 */
-				purge_closed_polling_connection (thd, conn);
-				continue;
-			}
-
-			/* Timed-out: Reactive the connection. The
-			 * main loop will take care of closing it.
+			/* Assign the error code. Even though it wasn't used
+			 * before the handler::free function could check it.
 			 */
-			ret = reactive_conn_from_polling (thd, conn);
-			if (unlikely (ret != ret_ok)) {
-				purge_closed_polling_connection (thd, conn);
-				continue;
-			}
+			conn->error_code = http_gateway_timeout;
 
-			BIT_UNSET (conn->options, conn_op_was_polling);
-			continue;
-		}
-
-		/* Is there information to be sent?
-		 */
-		if (conn->buffer.len > 0) {
-			ret = reactive_conn_from_polling (thd, conn);
-			if (unlikely (ret != ret_ok)) {
-				purge_closed_polling_connection (thd, conn);
-				continue;
-			}
-			continue;
-		}
-
-		/* Check the "extra" file descriptor
-		 */
-		re = cherokee_fdpoll_check (thd->fdpoll, conn->polling_fd, conn->polling_mode);
-		switch (re) {
-		case -1:
-			/* Error, move back the connection
+			/* Purge the connection
 			 */
-			TRACE (ENTRIES",polling", "conn %p(fd=%d): status is Error (fd=%d)\n",
-			       conn, SOCKET_FD(&conn->socket), conn->polling_fd);
-
 			purge_closed_polling_connection (thd, conn);
-			continue;
-		case 0:
-			/* Nothing to do.. wait longer
-			 */
-			continue;
+			return ret_eof;
 		}
 
-		/* Move from the 'polling' to the 'active' list:
+		/* Timed-out: Reactive the connection. The
+		 * main loop will take care of closing it.
 		 */
 		ret = reactive_conn_from_polling (thd, conn);
 		if (unlikely (ret != ret_ok)) {
 			purge_closed_polling_connection (thd, conn);
-			continue;
+			return ret_eof;
 		}
+
+		BIT_UNSET (conn->options, conn_op_was_polling);
+		return ret_ok;
+	}
+
+	/* Either the "extra" file descriptor is ready, or there is
+	 * information to be sent: move from the 'polling' to the
+	 * 'active' list.
+	 */
+	ret = reactive_conn_from_polling (thd, conn);
+	if (unlikely (ret != ret_ok)) {
+		purge_closed_polling_connection (thd, conn);
+		return ret_eof;
 	}
 
 	return ret_ok;
@@ -643,871 +685,1091 @@ process_polling_connections (cherokee_thread_t *thd)
 
 
 static ret_t
-process_active_connections (cherokee_thread_t *thd)
+process_active_connection (cherokee_thread_t *thd, cherokee_connection_t *conn)
 {
-	int                       re;
 	ret_t                     ret;
 	off_t                     len;
-	cherokee_list_t          *i, *tmp;
-	cherokee_connection_t    *conn        = NULL;
 	cherokee_server_t        *srv         = SRV(thd->server);
 	cherokee_socket_status_t  blocking;
 
-#ifdef TRACE_ENABLED
-	if (cherokee_trace_is_tracing()) {
-		if (! cherokee_list_empty (&thd->active_list)) {
-			TRACE (ENTRIES",active", "Active connections:%s", "\n");
-		}
+	TRACE (ENTRIES, "thread (%p) processing conn (%p), phase %d '%s', socket=%d, %s\n",
+	       thd, conn, conn->phase, cherokee_connection_get_phase_str (conn),
+	       conn->socket.socket, (conn->socket.status == socket_reading)? "read" : (conn->socket.status == socket_writing)? "writing" : "closed");
 
-		list_for_each_safe (i, tmp, &thd->active_list) {
-			conn = CONN(i);
+	/* Has the connection been too much time w/o any work
+	 */
+	if (conn->timeout < cherokee_bogonow_now) {
+		TRACE (ENTRIES",polling,timeout",
+		       "thread (%p) processing active conn (%p, %s): Time out\n",
+		       thd, conn, cherokee_connection_get_phase_str (conn));
 
-			TRACE (ENTRIES",active", "   \\- thread (%p) processing conn (%p), phase %d '%s', socket=%d,%s\n",
-			       thd, conn, conn->phase, cherokee_connection_get_phase_str (conn),
-			       conn->socket.socket, (conn->socket.status == socket_reading)? "read" : (conn->socket.status == socket_writing)? "writing" : "closed");
+		/* The lingering close timeout expired.
+		 * Proceed to close the connection.
+		 */
+		if ((conn->phase == phase_shutdown) ||
+		    (conn->phase == phase_lingering))
+		{
+			close_active_connection (thd, conn, false);
+			return ret_eof;
+		}
+
+		/* Information collection
+		 */
+		if (THREAD_SRV(thd)->collector != NULL) {
+			cherokee_collector_log_timeout (THREAD_SRV(thd)->collector);
 		}
+
+		goto shutdown;
 	}
-#endif
 
-	/* Process active connections
+	/* Update the connection timeout
 	 */
-	list_for_each_safe (i, tmp, LIST(&thd->active_list)) {
-		conn = CONN(i);
+	if ((conn->phase != phase_tls_handshake) &&
+	    (conn->phase != phase_reading_header) &&
+	    (conn->phase != phase_reading_post) &&
+	    (conn->phase != phase_shutdown) &&
+	    (conn->phase != phase_lingering))
+	{
+		cherokee_connection_update_timeout (conn);
+	}
 
-		TRACE (ENTRIES, "thread (%p) processing conn (%p), phase %d '%s', socket=%d, %s\n",
-		       thd, conn, conn->phase, cherokee_connection_get_phase_str (conn),
-		       conn->socket.socket, (conn->socket.status == socket_reading)? "read" : (conn->socket.status == socket_writing)? "writing" : "closed");
+	/* Maybe update traffic counters
+	 */
+	if ((CONN_VSRV(conn)->collector) &&
+	    (conn->traffic_next < cherokee_bogonow_now) &&
+	    ((conn->rx_partial != 0) || (conn->tx_partial != 0)))
+	{
+		cherokee_connection_update_vhost_traffic (conn);
+	}
 
-		/* Thread's properties
-		 */
-		if (CONN_VSRV(conn)) {
-			/* Current connection
-			 */
-			CHEROKEE_THREAD_PROP_SET (thread_connection_ptr, conn);
+	/* It was dispatched without waiting for its file
+	 * descriptor. Next time it will have to.
+	 */
+	if (conn->options & conn_op_was_polling) {
+		BIT_UNSET (conn->options, conn_op_was_polling);
+	}
 
-			/* Error writer
-			 */
-			if (CONN_VSRV(conn)->error_writer) {
-				CHEROKEE_THREAD_PROP_SET (thread_error_writer_ptr,
-							  CONN_VSRV(conn)->error_writer);
+	TRACE (ENTRIES, "conn on phase n=%d: %s\n",
+	       conn->phase, cherokee_connection_get_phase_str (conn));
+
+	/* Phases
+	 */
+	switch (conn->phase) {
+	case phase_tls_handshake:
+		blocking = socket_closed;
+
+		ret = cherokee_socket_init_tls (&conn->socket, CONN_VSRV(conn), conn, &blocking);
+		switch (ret) {
+		case ret_eagain:
+			switch (blocking) {
+			case socket_reading:
+				conn_set_mode (thd, conn, socket_reading);
+				break;
+
+			case socket_writing:
+				conn_set_mode (thd, conn, socket_writing);
+				break;
+
+			default:
+				break;
 			}
-		}
 
-		/* Has the connection been too much time w/o any work
-		 */
-		if (conn->timeout < cherokee_bogonow_now) {
-			TRACE (ENTRIES",polling,timeout",
-			       "thread (%p) processing active conn (%p, %s): Time out\n",
-			       thd, conn, cherokee_connection_get_phase_str (conn));
+			return ret_ok;
+
+		case ret_ok:
+			TRACE(ENTRIES, "Handshake %s\n", "finished");
 
-			/* The lingering close timeout expired.
-			 * Proceed to close the connection.
+			/* The client might have sent the request on the same
+			 * package as the last piece of the handshake. Thus,
+			 * the server shouldn't stop on fdpoll->watch(), the
+			 * connection is marked as ready as well.
 			 */
-			if ((conn->phase == phase_shutdown) ||
-			    (conn->phase == phase_lingering))
-			{
-				close_active_connection (thd, conn, false);
-				continue;
-			}
+			BIT_SET (conn->options, conn_op_was_polling);
+			thd->pending_read_num++;
 
-			/* Information collection
+			/* Set mode and update timeout
 			 */
-			if (THREAD_SRV(thd)->collector != NULL) {
-				cherokee_collector_log_timeout (THREAD_SRV(thd)->collector);
-			}
+			conn_set_mode (thd, conn, socket_reading);
+
+			conn->timeout_lapse  = srv->timeout;
+			cherokee_connection_update_timeout (conn);
+
+			conn->phase = phase_reading_header;
+			break;
+
+		case ret_eof:
+		case ret_error:
+			goto shutdown;
 
+		default:
+			RET_UNKNOWN(ret);
 			goto shutdown;
 		}
+		break;
 
-		/* Update the connection timeout
+	case phase_reading_header:
+		/* Maybe the buffer has a request (previous pipelined)
 		 */
-		if ((conn->phase != phase_tls_handshake) &&
-		    (conn->phase != phase_reading_header) &&
-		    (conn->phase != phase_reading_post) &&
-		    (conn->phase != phase_shutdown) &&
-		    (conn->phase != phase_lingering))
+		if (! cherokee_buffer_is_empty (&conn->incoming_header))
 		{
-			cherokee_connection_update_timeout (conn);
+			ret = cherokee_header_has_header (&conn->header,
+							  &conn->incoming_header,
+							  conn->incoming_header.len);
+			switch (ret) {
+			case ret_ok:
+				goto phase_reading_header_EXIT;
+			case ret_not_found:
+				break;
+			case ret_error:
+				goto shutdown;
+			default:
+				RET_UNKNOWN(ret);
+				goto shutdown;
+			}
 		}
 
-		/* Maybe update traffic counters
+		/* Read from the client
 		 */
-		if ((CONN_VSRV(conn)->collector) &&
-		    (conn->traffic_next < cherokee_bogonow_now) &&
-		    ((conn->rx_partial != 0) || (conn->tx_partial != 0)))
-		{
-			cherokee_connection_update_vhost_traffic (conn);
+		ret = cherokee_connection_recv (conn,
+						&conn->incoming_header,
+						DEFAULT_RECV_SIZE, &len);
+		switch (ret) {
+		case ret_ok:
+			break;
+		case ret_eagain:
+			return ret_ok;
+		case ret_eof:
+		case ret_error:
+			goto shutdown;
+		default:
+			RET_UNKNOWN(ret);
+			goto shutdown;
 		}
 
-		/* Traffic shaping limiter
+		/* Check security after read
 		 */
-		if (conn->limit_blocked_until > 0) {
-			cherokee_thread_retire_active_connection (thd, conn);
-			cherokee_limiter_add_conn (&thd->limiter, conn);
-			continue;
+		ret = cherokee_connection_reading_check (conn);
+		if (ret != ret_ok) {
+			conn->keepalive      = 0;
+			conn->phase          = phase_setup_connection;
+			conn->header.version = http_version_11;
+			return ret_ok;
 		}
 
-		/* Check if the connection is active
+		/* May it already has the full header
 		 */
-		if (conn->options & conn_op_was_polling) {
-			BIT_UNSET (conn->options, conn_op_was_polling);
-		}
-		else if (conn->phase == phase_shutdown) {
-			; /* No FD check*/
+		ret = cherokee_header_has_header (&conn->header, &conn->incoming_header, len+4);
+		switch (ret) {
+		case ret_ok:
+			break;
+		case ret_not_found:
+			conn->phase = phase_reading_header;
+			return ret_ok;
+		case ret_error:
+			goto shutdown;
+		default:
+			RET_UNKNOWN(ret);
+			goto shutdown;
 		}
-		else if ((conn->phase == phase_reading_header) && (conn->incoming_header.len > 0)) {
-			; /* No need, there's info already */
+
+		/* fall down */
+
+	phase_reading_header_EXIT:
+		conn->phase = phase_processing_header;
+
+		/* fall down */
+
+	case phase_processing_header:
+		/* Get the request
+		 */
+		ret = cherokee_connection_get_request (conn);
+		switch (ret) {
+		case ret_ok:
+			break;
+
+		case ret_eagain:
+			return ret_ok;
+
+		default:
+			cherokee_connection_setup_error_handler (conn);
+			conn_set_mode (thd, conn, socket_writing);
+			return ret_ok;
 		}
-		else {
-			re = cherokee_fdpoll_check (thd->fdpoll,
-						    SOCKET_FD(&conn->socket),
-						    conn->socket.status);
-			switch (re) {
-			case -1:
-				close_active_connection (thd, conn, false);
-				continue;
-			case 0:
-				if (! cherokee_socket_pending_read (&conn->socket)) {
-					continue;
-				}
-			}
+
+		/* Thread's error logger
+		 */
+		if (CONN_VSRV(conn) &&
+		    CONN_VSRV(conn)->error_writer)
+		{
+			CHEROKEE_THREAD_PROP_SET (thread_error_writer_ptr,
+						  CONN_VSRV(conn)->error_writer);
 		}
 
-		TRACE (ENTRIES, "conn on phase n=%d: %s\n",
-		       conn->phase, cherokee_connection_get_phase_str (conn));
+		/* Update timeout of the Keep-alive connections carried over..
+		 * The previous timeout was set to allow them to linger open
+		 * for a while. The new one is set to allow the server to serve
+		 * the new request.
+		 */
+		if ((conn->keepalive > 0) &&
+		    (conn->keepalive < CONN_SRV(conn)->keepalive_max))
+		{
+			cherokee_connection_update_timeout (conn);
+		}
 
-		/* Phases
+		/* Information collection
 		 */
-		switch (conn->phase) {
-		case phase_tls_handshake:
-			blocking = socket_closed;
+		if (THREAD_SRV(thd)->collector != NULL) {
+			cherokee_collector_log_request (THREAD_SRV(thd)->collector);
+		}
 
-			ret = cherokee_socket_init_tls (&conn->socket, CONN_VSRV(conn), conn, &blocking);
-			switch (ret) {
-			case ret_eagain:
-				switch (blocking) {
-				case socket_reading:
-					conn_set_mode (thd, conn, socket_reading);
-					break;
+		conn->phase = phase_setup_connection;
 
-				case socket_writing:
-					conn_set_mode (thd, conn, socket_writing);
-					break;
+		/* fall down */
 
-				default:
-					break;
-				}
+	case phase_setup_connection: {
+		cherokee_rule_list_t *rules;
+		cherokee_boolean_t    is_userdir;
 
-				continue;
+		/* Turn the connection in write mode
+		 */
+		conn_set_mode (thd, conn, socket_writing);
 
-			case ret_ok:
-				TRACE(ENTRIES, "Handshake %s\n", "finished");
+		/* HSTS support
+		 */
+		if ((conn->socket.is_tls != TLS) &&
+		    (CONN_VSRV(conn)->hsts.enabled))
+		{
+			cherokee_connection_setup_hsts_handler (conn);
+			return ret_ok;
+		}
+
+		/* Is it already an error response?
+		 */
+		if (http_type_300 (conn->error_code) ||
+		    http_type_400 (conn->error_code) ||
+		    http_type_500 (conn->error_code))
+		{
+			cherokee_connection_setup_error_handler (conn);
+			return ret_ok;
+		}
+
+		/* Front-line cache
+		 */
+		if ((CONN_VSRV(conn)->flcache) &&
+		    (conn->header.method == http_get))
+		{
+			TRACE (ENTRIES, "Front-line cache available: '%s'\n", CONN_VSRV(conn)->name.buf);
 
-				/* The client might have sent the request on the same
-				 * package as the last piece of the handshake. Thus,
-				 * the server shouldn't stop on fdpoll->watch(), the
-				 * connection is marked as ready as well.
+			ret = cherokee_flcache_req_get_cached (CONN_VSRV(conn)->flcache, conn);
+			if (ret == ret_ok) {
+				/* Set Keepalive, Rate, and skip to add_headers
 				 */
-				BIT_SET (conn->options, conn_op_was_polling);
-				thd->pending_read_num++;
+				cherokee_connection_set_keepalive (conn);
+				cherokee_connection_set_rate (conn, &conn->config_entry);
 
-				/* Set mode and update timeout
+				conn->phase = phase_add_headers;
+				goto add_headers;
+
+			} else if (ret == ret_eagain) {
+				/* It is being cached by another request:
+				 * parked until the entry is done.
 				 */
-				conn_set_mode (thd, conn, socket_reading);
+				return ret_ok;
+			}
+		}
 
-				conn->timeout_lapse  = srv->timeout;
-				cherokee_connection_update_timeout (conn);
+		TRACE (ENTRIES, "Setup connection begins: request=\"%s\"\n", conn->request.buf);
+		TRACE_CONN(conn);
 
-				conn->phase = phase_reading_header;
-				break;
+		cherokee_config_entry_ref_clean (&conn->config_entry);
 
-			case ret_eof:
-			case ret_error:
-				goto shutdown;
+		/* Choose the virtual entries table
+		 */
+		is_userdir = ((CONN_VSRV(conn)->userdir.len > 0) && (conn->userdir.len > 0));
 
-			default:
-				RET_UNKNOWN(ret);
-				goto shutdown;
-			}
-			break;
+		if (is_userdir) {
+			rules = &CONN_VSRV(conn)->userdir_rules;
+		} else {
+			rules = &CONN_VSRV(conn)->rules;
+		}
 
-		case phase_reading_header:
-			/* Maybe the buffer has a request (previous pipelined)
-			 */
-			if (! cherokee_buffer_is_empty (&conn->incoming_header))
-			{
-				ret = cherokee_header_has_header (&conn->header,
-								  &conn->incoming_header,
-								  conn->incoming_header.len);
-				switch (ret) {
-				case ret_ok:
-					goto phase_reading_header_EXIT;
-				case ret_not_found:
-					break;
-				case ret_error:
-					goto shutdown;
-				default:
-					RET_UNKNOWN(ret);
-					goto shutdown;
-				}
-			}
+		/* Local directory
+		 */
+		if (cherokee_buffer_is_empty (&conn->local_directory)) {
+			if (is_userdir)
+				ret = cherokee_connection_build_local_directory_userdir (conn, CONN_VSRV(conn));
+			else
+				ret = cherokee_connection_build_local_directory (conn, CONN_VSRV(conn));
+		}
 
-			/* Read from the client
-			 */
-			ret = cherokee_connection_recv (conn,
-							&conn->incoming_header,
-							DEFAULT_RECV_SIZE, &len);
-			switch (ret) {
-			case ret_ok:
-				break;
-			case ret_eagain:
-				continue;
-			case ret_eof:
-			case ret_error:
-				goto shutdown;
-			default:
-				RET_UNKNOWN(ret);
-				goto shutdown;
-			}
+		/* Check against the rule list. It fills out ->config_entry, and
+		 * conn->auth_type
+		 * conn->expiration*
+		 * conn->timeout_*
+		 */
+		ret = cherokee_rule_list_match (rules, conn, &conn->config_entry);
+		if (unlikely (ret != ret_ok)) {
+			cherokee_connection_setup_error_handler (conn);
+			return ret_ok;
+		}
 
-			/* Check security after read
-			 */
-			ret = cherokee_connection_reading_check (conn);
-			if (ret != ret_ok) {
-				conn->keepalive      = 0;
-				conn->phase          = phase_setup_connection;
-				conn->header.version = http_version_11;
-				continue;
-			}
+		/* Local directory
+		 */
+		cherokee_connection_set_custom_droot (conn, &conn->config_entry);
 
-			/* May it already has the full header
-			 */
-			ret = cherokee_header_has_header (&conn->header, &conn->incoming_header, len+4);
-			switch (ret) {
-			case ret_ok:
-				break;
-			case ret_not_found:
-				conn->phase = phase_reading_header;
-				continue;
-			case ret_error:
-				goto shutdown;
-			default:
-				RET_UNKNOWN(ret);
-				goto shutdown;
-			}
+		/* Set the logger of the connection
+		 */
+		if (conn->config_entry.no_log != true) {
+			conn->logger_ref = CONN_VSRV(conn)->logger;
+		}
 
-			/* fall down */
+		/* Check of the HTTP method is supported by the handler
+		 */
+		ret = cherokee_connection_check_http_method (conn, &conn->config_entry);
+		if (unlikely (ret != ret_ok)) {
+			cherokee_connection_setup_error_handler (conn);
+			return ret_ok;
+		}
 
-		phase_reading_header_EXIT:
-			conn->phase = phase_processing_header;
+		/* Check Only-Secure connections
+		 */
+		ret = cherokee_connection_check_only_secure (conn, &conn->config_entry);
+		if (unlikely (ret != ret_ok)) {
+			cherokee_connection_setup_error_handler (conn);
+			return ret_ok;
+		}
 
-			/* fall down */
+		/* Check for IP validation
+		 */
+		ret = cherokee_connection_check_ip_validation (conn, &conn->config_entry);
+		if (unlikely (ret != ret_ok)) {
+			cherokee_connection_setup_error_handler (conn);
+			return ret_ok;
+		}
 
-		case phase_processing_header:
-			/* Get the request
-			 */
-			ret = cherokee_connection_get_request (conn);
-			switch (ret) {
-			case ret_ok:
-				break;
+		/* Check for authentication
+		 */
+		ret = cherokee_connection_check_authentication (conn, &conn->config_entry);
+		if (unlikely (ret != ret_ok)) {
+			cherokee_connection_setup_error_handler (conn);
+			return ret_ok;
+		}
 
-			case ret_eagain:
-				continue;
+		/* Update the keep-alive property
+		 */
+		cherokee_connection_set_keepalive (conn);
 
-			default:
-				cherokee_connection_setup_error_handler (conn);
-				conn_set_mode (thd, conn, socket_writing);
-				continue;
-			}
+		/* Traffic Shaping
+		 */
+		cherokee_connection_set_rate (conn, &conn->config_entry);
 
-			/* Thread's error logger
-			 */
-			if (CONN_VSRV(conn) &&
-			    CONN_VSRV(conn)->error_writer)
-			{
-				CHEROKEE_THREAD_PROP_SET (thread_error_writer_ptr,
-							  CONN_VSRV(conn)->error_writer);
-			}
+		/* Create the handler
+		 */
+		ret = cherokee_connection_create_handler (conn, &conn->config_entry);
+		switch (ret) {
+		case ret_ok:
+			break;
+		case ret_eagain:
+			cherokee_connection_clean_for_respin (conn);
+			return ret_ok;
+		case ret_eof:
+			/* Connection drop */
+			close_active_connection (thd, conn, true);
+			return ret_eof;
+		default:
+			cherokee_connection_setup_error_handler (conn);
+			return ret_ok;
+		}
 
-			/* Update timeout of the Keep-alive connections carried over..
-			 * The previous timeout was set to allow them to linger open
-			 * for a while. The new one is set to allow the server to serve
-			 * the new request.
-			 */
-			if ((conn->keepalive > 0) &&
-			    (conn->keepalive < CONN_SRV(conn)->keepalive_max))
-			{
-				cherokee_connection_update_timeout (conn);
-			}
+		/* Turn chunked encoding on, if possible
+		*/
+		cherokee_connection_set_chunked_encoding (conn);
+
+		/* Instance an encoder if needed
+		*/
+		ret = cherokee_connection_create_encoder (conn, conn->config_entry.encoders);
+		if (unlikely (ret != ret_ok)) {
+			cherokee_connection_setup_error_handler (conn);
+			return ret_ok;
+		}
+
+		/* Parse the rest of headers
+		 */
+		ret = cherokee_connection_parse_range (conn);
+		if (unlikely (ret != ret_ok)) {
+			cherokee_connection_setup_error_handler (conn);
+			return ret_ok;
+		}
+
+		/* Front-line cache
+		 */
+		if ((CONN_VSRV(conn)->flcache != NULL) &&
+		    (conn->config_entry.flcache == true) &&
+		    (cherokee_flcache_req_is_storable (CONN_VSRV(conn)->flcache, conn) == ret_ok))
+		{
+			cherokee_flcache_req_set_store (CONN_VSRV(conn)->flcache, conn);
 
-			/* Information collection
+			/* Update expiration
 			 */
-			if (THREAD_SRV(thd)->collector != NULL) {
-				cherokee_collector_log_request (THREAD_SRV(thd)->collector);
+			if (conn->flcache.mode == flcache_mode_in) {
+				if (conn->config_entry.expiration == cherokee_expiration_epoch) {
+					conn->flcache.avl_node_ref->valid_until = 0;
+				} else if (conn->config_entry.expiration == cherokee_expiration_time) {
+					conn->flcache.avl_node_ref->valid_until = cherokee_bogonow_now + conn->config_entry.expiration_time;
+				}
 			}
+		}
 
-			conn->phase = phase_setup_connection;
-
-			/* fall down */
+		conn->phase = phase_init;
+	}
 
-		case phase_setup_connection: {
-			cherokee_rule_list_t *rules;
-			cherokee_boolean_t    is_userdir;
+	case phase_init:
+		/* Look for the request
+		 */
+		ret = cherokee_connection_open_request (conn);
+		switch (ret) {
+		case ret_ok:
+		case ret_error:
+			break;
 
-			/* Turn the connection in write mode
-			 */
-			conn_set_mode (thd, conn, socket_writing);
+		case ret_eagain:
+			return ret_ok;
 
-			/* HSTS support
-			 */
-			if ((conn->socket.is_tls != TLS) &&
-			    (CONN_VSRV(conn)->hsts.enabled))
-			{
-				cherokee_connection_setup_hsts_handler (conn);
-				continue;
-			}
+		default:
+			if ((MODULE(conn->handler)->info) &&
+			    (MODULE(conn->handler)->info->name))
+				LOG_ERROR (CHEROKEE_ERROR_THREAD_HANDLER_RET,
+					   ret, MODULE(conn->handler)->info->name);
+			else
+				RET_UNKNOWN(ret);
+			break;
+		}
 
-			/* Is it already an error response?
-			 */
-			if (http_type_300 (conn->error_code) ||
-			    http_type_400 (conn->error_code) ||
-			    http_type_500 (conn->error_code))
-			{
-				cherokee_connection_setup_error_handler (conn);
-				continue;
-			}
+		/* If it is an error, and the connection has not a handler to manage
+		 * this error, the handler has to be changed by an error_handler.
+		 */
+		if (conn->handler == NULL) {
+			goto shutdown;
+		}
 
-			/* Front-line cache
-			 */
-			if ((CONN_VSRV(conn)->flcache) &&
-			    (conn->header.method == http_get))
-			{
-				TRACE (ENTRIES, "Front-line cache available: '%s'\n", CONN_VSRV(conn)->name.buf);
-
-				ret = cherokee_flcache_req_get_cached (CONN_VSRV(conn)->flcache, conn);
-				if (ret == ret_ok) {
-					/* Set Keepalive, Rate, and skip to add_headers
+ 		if (http_type_300(conn->error_code) ||
+		    http_type_400(conn->error_code) ||
+		    http_type_500(conn->error_code))
+		{
+			if (HANDLER_SUPPORTS (conn->handler, hsupport_error)) {
+				ret = cherokee_connection_clean_error_headers (conn);
+				if (unlikely (ret != ret_ok)) {
+					goto shutdown;
+				}
+			} else {
+				/* Try to setup an error handler
+				 */
+				ret = cherokee_connection_setup_error_handler (conn);
+				if ((ret != ret_ok) &&
+				    (ret != ret_eagain))
+				{
+					/* Critical error: It couldn't instance the handler
 					 */
-					cherokee_connection_set_keepalive (conn);
-					cherokee_connection_set_rate (conn, &conn->config_entry);
-
-					conn->phase = phase_add_headers;
-					goto add_headers;
+					goto shutdown;
 				}
+				return ret_ok;
 			}
+		}
 
-			TRACE (ENTRIES, "Setup connection begins: request=\"%s\"\n", conn->request.buf);
-			TRACE_CONN(conn);
+		/* Figure next state
+		 */
+		if (! (http_method_with_input (conn->header.method) ||
+		       http_method_with_optional_input (conn->header.method)))
+		{
+			conn->phase = phase_add_headers;
+			goto add_headers;
+		}
 
-			cherokee_config_entry_ref_clean (&conn->config_entry);
+		/* Register with the POST tracker
+		 */
+		if ((srv->post_track) && (conn->post.has_info)) {
+			srv->post_track->func_register (srv->post_track, conn);
+		}
 
-			/* Choose the virtual entries table
-			 */
-			is_userdir = ((CONN_VSRV(conn)->userdir.len > 0) && (conn->userdir.len > 0));
+		conn->phase = phase_reading_post;
 
-			if (is_userdir) {
-				rules = &CONN_VSRV(conn)->userdir_rules;
-			} else {
-				rules = &CONN_VSRV(conn)->rules;
-			}
+	case phase_reading_post:
+		/* Read/Send the POST info
+		 */
+		ret = cherokee_connection_read_post (conn);
+		switch (ret) {
+		case ret_ok:
+			break;
+		case ret_eagain:
+			/* Blocking on socket read */
+			conn_set_mode (thd, conn, socket_reading);
+			return ret_ok;
+		case ret_deny:
+			/* Blocking on back-end write.
+			 * Skip next fd check */
+			BIT_SET (conn->options, conn_op_was_polling);
+			return ret_ok;
+		case ret_eof:
+		case ret_error:
+			conn->error_code = http_internal_error;
+			cherokee_connection_setup_error_handler (conn);
+			return ret_ok;
+		default:
+			RET_UNKNOWN(ret);
+		}
 
-			/* Local directory
-			 */
-			if (cherokee_buffer_is_empty (&conn->local_directory)) {
-				if (is_userdir)
-					ret = cherokee_connection_build_local_directory_userdir (conn, CONN_VSRV(conn));
-				else
-					ret = cherokee_connection_build_local_directory (conn, CONN_VSRV(conn));
-			}
+		/* Turn the connection in write mode
+		 */
+		conn_set_mode (thd, conn, socket_writing);
+		conn->phase = phase_add_headers;
 
-			/* Check against the rule list. It fills out ->config_entry, and
-			 * conn->auth_type
-			 * conn->expiration*
-			 * conn->timeout_*
-			 */
-			ret = cherokee_rule_list_match (rules, conn, &conn->config_entry);
-			if (unlikely (ret != ret_ok)) {
-				cherokee_connection_setup_error_handler (conn);
-				continue;
-			}
+	case phase_add_headers:
+	add_headers:
 
-			/* Local directory
-			 */
-			cherokee_connection_set_custom_droot (conn, &conn->config_entry);
+		/* Build the header
+		 */
+		ret = cherokee_connection_build_header (conn);
+		switch (ret) {
+		case ret_ok:
+			break;
+		case ret_eagain:
+			return ret_ok;
+		case ret_eof:
+		case ret_error:
+			conn->error_code = http_internal_error;
+			cherokee_connection_setup_error_handler (conn);
+			return ret_ok;
+		default:
+			RET_UNKNOWN(ret);
+		}
 
-			/* Set the logger of the connection
-			 */
-			if (conn->config_entry.no_log != true) {
-				conn->logger_ref = CONN_VSRV(conn)->logger;
-			}
+		/* If it is an error, we have to respin the connection
+		 * to install a proper error handler.
+		 */
+		if ((http_type_300 (conn->error_code) ||
+		     http_type_400 (conn->error_code) ||
+		     http_type_500 (conn->error_code)) &&
+		    (!HANDLER_SUPPORTS (conn->handler, hsupport_error))) {
+			conn->phase = phase_setup_connection;
+			return ret_ok;
+		}
 
-			/* Check of the HTTP method is supported by the handler
-			 */
-			ret = cherokee_connection_check_http_method (conn, &conn->config_entry);
-			if (unlikely (ret != ret_ok)) {
-				cherokee_connection_setup_error_handler (conn);
-				continue;
-			}
+		/* If it has mmaped content, skip next stage
+		 */
+		if (conn->mmaped != NULL)
+			goto phase_send_headers_EXIT;
 
-			/* Check Only-Secure connections
-			 */
-			ret = cherokee_connection_check_only_secure (conn, &conn->config_entry);
-			if (unlikely (ret != ret_ok)) {
-				cherokee_connection_setup_error_handler (conn);
-				continue;
+		/* Front-line cache: store
+		 */
+		if (conn->flcache.mode == flcache_mode_in) {
+			ret = cherokee_flcache_conn_commit_header (&conn->flcache, conn);
+			if (ret != ret_ok) {
+				/* Disabled Front-Line Cache */
+				conn->flcache.mode = flcache_mode_error;
 			}
+		}
 
-			/* Check for IP validation
-			 */
-			ret = cherokee_connection_check_ip_validation (conn, &conn->config_entry);
-			if (unlikely (ret != ret_ok)) {
-				cherokee_connection_setup_error_handler (conn);
-				continue;
-			}
+		conn->phase = phase_send_headers;
 
-			/* Check for authentication
-			 */
-			ret = cherokee_connection_check_authentication (conn, &conn->config_entry);
-			if (unlikely (ret != ret_ok)) {
-				cherokee_connection_setup_error_handler (conn);
-				continue;
+	case phase_send_headers:
+
+		/* Send headers to the client
+		 */
+		ret = cherokee_connection_send_header (conn);
+		switch (ret) {
+		case ret_eagain:
+			return ret_ok;
+
+		case ret_ok:
+			if (!http_method_with_body (conn->header.method)) {
+				maybe_purge_closed_connection (thd, conn);
+				return ret_ok;
 			}
+			if (!http_code_with_body (conn->error_code)) {
+				maybe_purge_closed_connection (thd, conn);
+				return ret_ok;
+			}
+			break;
 
-			/* Update the keep-alive property
-			 */
-			cherokee_connection_set_keepalive (conn);
+		case ret_eof:
+		case ret_error:
+			goto shutdown;
 
-			/* Traffic Shaping
-			 */
-			cherokee_connection_set_rate (conn, &conn->config_entry);
+		default:
+			RET_UNKNOWN(ret);
+		}
 
-			/* Create the handler
-			 */
-			ret = cherokee_connection_create_handler (conn, &conn->config_entry);
+	phase_send_headers_EXIT:
+		conn->phase = phase_stepping;
+
+	case phase_stepping:
+
+		/* Special case:
+		 * If the content is mmap()ed, it has to send the header +
+		 * the file content and stop processing the connection.
+		 */
+		if (conn->mmaped != NULL) {
+			ret = cherokee_connection_send_header_and_mmaped (conn);
 			switch (ret) {
-			case ret_ok:
-				break;
 			case ret_eagain:
-				cherokee_connection_clean_for_respin (conn);
-				continue;
+				return ret_ok;
+
 			case ret_eof:
-				/* Connection drop */
+				maybe_purge_closed_connection (thd, conn);
+				return ret_ok;
+
+			case ret_error:
 				close_active_connection (thd, conn, true);
-				continue;
+				return ret_eof;
+
 			default:
-				cherokee_connection_setup_error_handler (conn);
-				continue;
+				maybe_purge_closed_connection (thd, conn);
+				return ret_ok;
 			}
+		}
 
-			/* Turn chunked encoding on, if possible
-			*/
-			cherokee_connection_set_chunked_encoding (conn);
+		/* Handler step: read or make new data to send
+		 * Front-line cache handled internally.
+		 */
+		ret = cherokee_connection_step (conn);
+		switch (ret) {
+		case ret_eagain:
+			break;
 
-			/* Instance an encoder if needed
-			*/
-			ret = cherokee_connection_create_encoder (conn, conn->config_entry.encoders);
-			if (unlikely (ret != ret_ok)) {
-				cherokee_connection_setup_error_handler (conn);
-				continue;
-			}
+		case ret_eof_have_data:
+			ret = cherokee_connection_send (conn);
 
-			/* Parse the rest of headers
-			 */
-			ret = cherokee_connection_parse_range (conn);
-			if (unlikely (ret != ret_ok)) {
-				cherokee_connection_setup_error_handler (conn);
-				continue;
+			switch (ret) {
+			case ret_ok:
+				maybe_purge_closed_connection (thd, conn);
+				return ret_ok;
+			case ret_eagain:
+				break;
+			case ret_eof:
+			case ret_error:
+			default:
+				close_active_connection (thd, conn, false);
+				return ret_eof;
 			}
+			break;
 
-			/* Front-line cache
-			 */
-			if ((CONN_VSRV(conn)->flcache != NULL) &&
-			    (conn->config_entry.flcache == true) &&
-			    (cherokee_flcache_req_is_storable (CONN_VSRV(conn)->flcache, conn) == ret_ok))
-			{
-				cherokee_flcache_req_set_store (CONN_VSRV(conn)->flcache, conn);
+		case ret_ok:
+			ret = cherokee_connection_send (conn);
 
-				/* Update expiration
-				 */
-				if (conn->flcache.mode == flcache_mode_in) {
-					if (conn->config_entry.expiration == cherokee_expiration_epoch) {
-						conn->flcache.avl_node_ref->valid_until = 0;
-					} else if (conn->config_entry.expiration == cherokee_expiration_time) {
-						conn->flcache.avl_node_ref->valid_until = cherokee_bogonow_now + conn->config_entry.expiration_time;
-					}
-				}
+			switch (ret) {
+			case ret_ok:
+				return ret_ok;
+			case ret_eagain:
+				break;
+			case ret_eof:
+			case ret_error:
+			default:
+				close_active_connection (thd, conn, false);
+				return ret_eof;
 			}
+			break;
+
+		case ret_ok_and_sent:
+			break;
 
-			conn->phase = phase_init;
+		case ret_eof:
+			maybe_purge_closed_connection (thd, conn);
+			return ret_ok;
+
+		case ret_error:
+			close_active_connection (thd, conn, false);
+			return ret_eof;
+
+		default:
+			RET_UNKNOWN(ret);
+			goto shutdown;
 		}
+		break;
 
-		case phase_init:
-			/* Look for the request
-			 */
-			ret = cherokee_connection_open_request (conn);
+	shutdown:
+		conn->phase = phase_shutdown;
+
+	case phase_shutdown:
+		/* Perform a proper SSL/TLS shutdown
+		 */
+		if (conn->socket.is_tls == TLS) {
+			ret = conn->socket.cryptor->shutdown (conn->socket.cryptor);
 			switch (ret) {
 			case ret_ok:
+			case ret_eof:
 			case ret_error:
 				break;
 
 			case ret_eagain:
-				continue;
+				conn_set_mode (thd, conn, socket_reading);
+				return ret_ok;
 
 			default:
-				if ((MODULE(conn->handler)->info) &&
-				    (MODULE(conn->handler)->info->name))
-					LOG_ERROR (CHEROKEE_ERROR_THREAD_HANDLER_RET,
-						   ret, MODULE(conn->handler)->info->name);
-				else
-					RET_UNKNOWN(ret);
-				break;
+				RET_UNKNOWN (ret);
+				close_active_connection (thd, conn, false);
+				return ret_eof;
 			}
+		}
 
-			/* If it is an error, and the connection has not a handler to manage
-			 * this error, the handler has to be changed by an error_handler.
+		/* Shutdown socket for writing
+		 */
+		ret = cherokee_connection_shutdown_wr (conn);
+		switch (ret) {
+		case ret_ok:
+			/* Extend the timeout
 			 */
-			if (conn->handler == NULL) {
-				goto shutdown;
-			}
-
- 			if (http_type_300(conn->error_code) ||
-			    http_type_400(conn->error_code) ||
-			    http_type_500(conn->error_code))
-			{
-				if (HANDLER_SUPPORTS (conn->handler, hsupport_error)) {
-					ret = cherokee_connection_clean_error_headers (conn);
-					if (unlikely (ret != ret_ok)) {
-						goto shutdown;
-					}
-				} else {
-					/* Try to setup an error handler
-					 */
-					ret = cherokee_connection_setup_error_handler (conn);
-					if ((ret != ret_ok) &&
-					    (ret != ret_eagain))
-					{
-						/* Critical error: It couldn't instance the handler
-						 */
-						goto shutdown;
-					}
-					continue;
-				}
-			}
+			conn->timeout = cherokee_bogonow_now + SECONDS_TO_LINGER;
+			TRACE (ENTRIES, "Lingering-close timeout = now + %d secs\n", SECONDS_TO_LINGER);
 
-			/* Figure next state
+			/* Wait for the socket to be readable:
+			 * FIN + ACK will have arrived by then
 			 */
-			if (! (http_method_with_input (conn->header.method) ||
-			       http_method_with_optional_input (conn->header.method)))
-			{
-				conn->phase = phase_add_headers;
-				goto add_headers;
-			}
+			conn_set_mode (thd, conn, socket_reading);
+			conn->phase = phase_lingering;
 
-			/* Register with the POST tracker
+			/* Go to polling..
 			 */
-			if ((srv->post_track) && (conn->post.has_info)) {
-				srv->post_track->func_register (srv->post_track, conn);
-			}
+			return ret_ok;
+		default:
+			/* Error, no linger and no last read,
+			 * just close the connection.
+			 */
+			close_active_connection (thd, conn, true);
+			return ret_eof;
+		}
 
-			conn->phase = phase_reading_post;
+		/* fall down */
 
-		case phase_reading_post:
-			/* Read/Send the POST info
+	case phase_lingering:
+		ret = cherokee_connection_linger_read (conn);
+		switch (ret) {
+		case ret_ok:
+		case ret_eagain:
+			return ret_ok;
+		case ret_eof:
+		case ret_error:
+			close_active_connection (thd, conn, false);
+			return ret_eof;
+		default:
+			RET_UNKNOWN(ret);
+			close_active_connection (thd, conn, false);
+			return ret_eof;
+		}
+		break;
+
+	default:
+ 		SHOULDNT_HAPPEN;
+	}
+
+	return ret_ok;
+}
+
+
+static void
+set_ready_polling_fd (cherokee_thread_t *thd, int fd)
+{
+	cherokee_list_t *i;
+
+	list_for_each (i, &thd->polling_list) {
+		if (CONN(i)->polling_fd == fd) {
+			conn_set_ready (thd, CONN(i));
+		}
+	}
+}
+
+
+static void
+collect_ready_connections (cherokee_thread_t *thd)
+{
+	int                    n;
+	int                    re;
+	int                    fd;
+	ret_t                  ret;
+	void                  *data;
+	cherokee_list_t       *i, *tmp;
+	cherokee_connection_t *conn;
+
+	/* Readiness events: each one of them carries the connection
+	 * waiting on its file descriptor. Idle connections are not
+	 * visited at all.
+	 */
+	for (n = 0;; n++) {
+		ret = cherokee_fdpoll_get_event (thd->fdpoll, n, &fd, &data);
+		if (ret != ret_ok)
+			break;
+
+		/* Listeners: handled by the accept loop
+		 */
+		if (data == NULL)
+			continue;
+
+		/* Shared polling file descriptor
+		 */
+		if (data == thd) {
+			set_ready_polling_fd (thd, fd);
+			continue;
+		}
+
+		conn_set_ready (thd, CONN(data));
+	}
+
+	if (ret != ret_no_sys)
+		return;
+
+	/* The fdpoll method does not support readiness events:
+	 * check every connection file descriptor.
+	 */
+	list_for_each_safe (i, tmp, &thd->polling_list) {
+		conn = CONN(i);
+
+		re = cherokee_fdpoll_check (thd->fdpoll, conn->polling_fd, conn->polling_mode);
+		switch (re) {
+		case -1:
+			/* Error, move back the connection
 			 */
-			ret = cherokee_connection_read_post (conn);
-			switch (ret) {
-			case ret_ok:
-				break;
-			case ret_eagain:
-				/* Blocking on socket read */
-				conn_set_mode (thd, conn, socket_reading);
-				continue;
-			case ret_deny:
-				/* Blocking on back-end write.
-				 * Skip next fd check */
-				BIT_SET (conn->options, conn_op_was_polling);
-				continue;
-			case ret_eof:
-			case ret_error:
-				conn->error_code = http_internal_error;
-				cherokee_connection_setup_error_handler (conn);
-				continue;
-			default:
-				RET_UNKNOWN(ret);
-			}
+			TRACE (ENTRIES",polling", "conn %p(fd=%d): status is Error (fd=%d)\n",
+			       conn, SOCKET_FD(&conn->socket), conn->polling_fd);
 
-			/* Turn the connection in write mode
+			purge_closed_polling_connection (thd, conn);
+			continue;
+		case 0:
+			/* Nothing to do.. wait longer
 			 */
-			conn_set_mode (thd, conn, socket_writing);
-			conn->phase = phase_add_headers;
+			continue;
+		}
+
+		conn_set_ready (thd, conn);
+	}
+
+	list_for_each_safe (i, tmp, &thd->active_list) {
+		conn = CONN(i);
+
+		re = cherokee_fdpoll_check (thd->fdpoll,
+					    SOCKET_FD(&conn->socket),
+					    conn->socket.status);
+		switch (re) {
+		case -1:
+			close_active_connection (thd, conn, false);
+			continue;
+		case 0:
+			continue;
+		}
+
+		conn_set_ready (thd, conn);
+	}
+}
+
+
+static void
+conn_timer_expired (cherokee_timer_t *timer, void *param)
+{
+	cherokee_thread_t     *thd  = THREAD(param);
+	cherokee_connection_t *conn = TIMER_CONN(timer);
+
+	/* Traffic shaping: it is allowed to send again
+	 */
+	if (conn->in_limiter) {
+		cherokee_limiter_del_conn (&thd->limiter, conn);
+
+		conn->in_limiter          = false;
+		conn->limit_blocked_until = 0;
+		cherokee_thread_inject_active_connection (thd, conn);
+		return;
+	}
+
+	/* It was blocked, but it went polling (or is still in the
+	 * active list) instead of waiting in the limiter. The block
+	 * is over, the timer goes back to the regular timeout.
+	 */
+	if (conn->limit_blocked_until > 0) {
+		conn->limit_blocked_until = 0;
+		conn_update_timer (thd, conn);
+		return;
+	}
+
+	/* Front-line cache: it gave up waiting for the response
+	 * being coalesced. It will reach the back-end itself.
+	 */
+	if ((conn->flcache.wait_ref != NULL) &&
+	    (conn->flcache.wait_until < cherokee_bogonow_now))
+	{
+		conn_set_ready (thd, conn);
+		return;
+	}
+
+	/* The timeout was pushed forward in the meanwhile
+	 */
+	if (conn->timeout >= cherokee_bogonow_now) {
+		conn_update_timer (thd, conn);
+		return;
+	}
 
-		case phase_add_headers:
-		add_headers:
+	/* Time out: it will get processed and closed
+	 */
+	conn_set_ready (thd, conn);
+}
 
-			/* Build the header
-			 */
-			ret = cherokee_connection_build_header (conn);
-			switch (ret) {
-			case ret_ok:
-				break;
-			case ret_eagain:
-				continue;
-			case ret_eof:
-			case ret_error:
-				conn->error_code = http_internal_error;
-				cherokee_connection_setup_error_handler (conn);
-				continue;
-			default:
-				RET_UNKNOWN(ret);
-			}
 
-			/* If it is an error, we have to respin the connection
-			 * to install a proper error handler.
-			 */
-			if ((http_type_300 (conn->error_code) ||
-			     http_type_400 (conn->error_code) ||
-			     http_type_500 (conn->error_code)) &&
-			    (!HANDLER_SUPPORTS (conn->handler, hsupport_error))) {
-				conn->phase = phase_setup_connection;
-				continue;
-			}
+static int
+thread_watch_msecs (cherokee_thread_t *thd, int fdwatch_msecs)
+{
+	ret_t           ret;
+	cherokee_msec_t next;
 
-			/* If it has mmaped content, skip next stage
-			 */
-			if (conn->mmaped != NULL)
-				goto phase_send_headers_EXIT;
+	if (fdwatch_msecs == 0)
+		return 0;
 
-			/* Front-line cache: store
-			 */
-			if (conn->flcache.mode == flcache_mode_in) {
-				ret = cherokee_flcache_conn_commit_header (&conn->flcache, conn);
-				if (ret != ret_ok) {
-					/* Disabled Front-Line Cache */
-					conn->flcache.mode = flcache_mode_error;
-				}
-			}
+	/* Do not sleep past the next timer
+	 */
+	ret = cherokee_timer_wheel_next (&thd->timers, &next);
+	if (ret != ret_ok)
+		return fdwatch_msecs;
 
-			conn->phase = phase_send_headers;
+	if (next <= cherokee_bogonow_msec)
+		return 0;
 
-		case phase_send_headers:
+	return (int) MIN (next - cherokee_bogonow_msec, (cherokee_msec_t) fdwatch_msecs);
+}
 
-			/* Send headers to the client
-			 */
-			ret = cherokee_connection_send_header (conn);
-			switch (ret) {
-			case ret_eagain:
-				continue;
 
-			case ret_ok:
-				if (!http_method_with_body (conn->header.method)) {
-					maybe_purge_closed_connection (thd, conn);
-					continue;
-				}
-				if (!http_code_with_body (conn->error_code)) {
-					maybe_purge_closed_connection (thd, conn);
-					continue;
-				}
-				break;
+static void
+check_pending_work (cherokee_thread_t *thd, cherokee_connection_t *conn)
+{
+	/* It left the active list: it is polling
+	 */
+	if (conn->polling_fd != -1) {
+		return;
+	}
 
-			case ret_eof:
-			case ret_error:
-				goto shutdown;
+	/* Traffic shaping, or a connection that asked to sleep:
+	 * it waits in the limiter until its timer goes off.
+	 */
+	if (conn->limit_blocked_until > 0) {
+		cherokee_thread_retire_active_connection (thd, conn);
+		cherokee_limiter_add_conn (&thd->limiter, conn);
+		conn->in_limiter = true;
+		return;
+	}
 
-			default:
-				RET_UNKNOWN(ret);
-			}
+	/* Data sitting in SSL buffers that needs to be processed
+	 * before we wait for file descriptors.
+	 */
+	if (cherokee_socket_pending_read (&conn->socket)) {
+		thd->pending_read_num++;
+		conn_set_ready (thd, conn);
+		return;
+	}
 
-		phase_send_headers_EXIT:
-			conn->phase = phase_stepping;
+	/* It does not have to wait for its file descriptor
+	 */
+	if ((conn->options & conn_op_was_polling) ||
+	    (conn->phase == phase_shutdown))
+	{
+		conn_set_ready (thd, conn);
+	}
+}
 
-		case phase_stepping:
 
-			/* Special case:
-			 * If the content is mmap()ed, it has to send the header +
-			 * the file content and stop processing the connection.
-			 */
-			if (conn->mmaped != NULL) {
-				ret = cherokee_connection_send_header_and_mmaped (conn);
-				switch (ret) {
-				case ret_eagain:
-					continue;
-
-				case ret_eof:
-					maybe_purge_closed_connection (thd, conn);
-					continue;
-
-				case ret_error:
-					close_active_connection (thd, conn, true);
-					continue;
-
-				default:
-					maybe_purge_closed_connection (thd, conn);
-					continue;
-				}
-			}
+static ret_t
+process_connections (cherokee_thread_t *thd)
+{
+	ret_t                  ret;
+	cherokee_list_t        ready;
+	cherokee_connection_t *conn;
 
-			/* Handler step: read or make new data to send
-			 * Front-line cache handled internally.
-			 */
-			ret = cherokee_connection_step (conn);
-			switch (ret) {
-			case ret_eagain:
-				break;
+#ifdef TRACE_ENABLED
+	if (cherokee_trace_is_tracing()) {
+		cherokee_list_t *i;
 
-			case ret_eof_have_data:
-				ret = cherokee_connection_send (conn);
-
-				switch (ret) {
-				case ret_ok:
-					maybe_purge_closed_connection (thd, conn);
-					continue;
-				case ret_eagain:
-					break;
-				case ret_eof:
-				case ret_error:
-				default:
-					close_active_connection (thd, conn, false);
-					continue;
-				}
-				break;
+		if (! cherokee_list_empty (&thd->active_list)) {
+			TRACE (ENTRIES",active", "Active connections:%s", "\n");
+		}
 
-			case ret_ok:
-				ret = cherokee_connection_send (conn);
-
-				switch (ret) {
-				case ret_ok:
-					continue;
-				case ret_eagain:
-					break;
-				case ret_eof:
-				case ret_error:
-				default:
-					close_active_connection (thd, conn, false);
-					continue;
-				}
-				break;
+		list_for_each (i, &thd->active_list) {
+			conn = CONN(i);
 
-			case ret_ok_and_sent:
-				break;
+			TRACE (ENTRIES",active", "   \\- thread (%p) processing conn (%p), phase %d '%s', socket=%d,%s\n",
+			       thd, conn, conn->phase, cherokee_connection_get_phase_str (conn),
+			       conn->socket.socket, (conn->socket.status == socket_reading)? "read" : (conn->socket.status == socket_writing)? "writing" : "closed");
+		}
+	}
+#endif
 
-			case ret_eof:
-				maybe_purge_closed_connection (thd, conn);
-				continue;
+	/* Figure out which connections have work to do
+	 */
+	collect_ready_connections (thd);
 
-			case ret_error:
-				close_active_connection (thd, conn, false);
-				continue;
+	/* Timeouts and traffic shaping wake-ups
+	 */
+	cherokee_timer_wheel_run (&thd->timers, cherokee_bogonow_msec,
+				  conn_timer_expired, thd);
 
-			default:
-				RET_UNKNOWN(ret);
-				goto shutdown;
-			}
-			break;
+	/* Take the ready list: connections with pending work after
+	 * being processed are enqueued for the next step.
+	 */
+	INIT_LIST_HEAD (&ready);
+	cherokee_list_reparent (&thd->ready_list, &ready);
+	INIT_LIST_HEAD (&thd->ready_list);
 
-		shutdown:
-			conn->phase = phase_shutdown;
+	while (! cherokee_list_empty (&ready)) {
+		conn = READY_CONN(ready.next);
+		conn_unset_ready (conn);
 
-		case phase_shutdown:
-			/* Perform a proper SSL/TLS shutdown
+		/* Thread's properties
+		 */
+		if (CONN_VSRV(conn)) {
+			/* Current connection
 			 */
-			if (conn->socket.is_tls == TLS) {
-				ret = conn->socket.cryptor->shutdown (conn->socket.cryptor);
-				switch (ret) {
-				case ret_ok:
-				case ret_eof:
-				case ret_error:
-					break;
-
-				case ret_eagain:
-					conn_set_mode (thd, conn, socket_reading);
-					return ret_eagain;
-
-				default:
-					RET_UNKNOWN (ret);
-					close_active_connection (thd, conn, false);
-					continue;
-				}
-			}
+			CHEROKEE_THREAD_PROP_SET (thread_connection_ptr, conn);
 
-			/* Shutdown socket for writing
+			/* Error writer
 			 */
-			ret = cherokee_connection_shutdown_wr (conn);
-			switch (ret) {
-			case ret_ok:
-				/* Extend the timeout
-				 */
-				conn->timeout = cherokee_bogonow_now + SECONDS_TO_LINGER;
-				TRACE (ENTRIES, "Lingering-close timeout = now + %d secs\n", SECONDS_TO_LINGER);
-
-				/* Wait for the socket to be readable:
-				 * FIN + ACK will have arrived by then
-				 */
-				conn_set_mode (thd, conn, socket_reading);
-				conn->phase = phase_lingering;
-
-				/* Go to polling..
-				 */
-				continue;
-			default:
-				/* Error, no linger and no last read,
-				 * just close the connection.
-				 */
-				close_active_connection (thd, conn, true);
-				continue;
+			if (CONN_VSRV(conn)->error_writer) {
+				CHEROKEE_THREAD_PROP_SET (thread_error_writer_ptr,
+							  CONN_VSRV(conn)->error_writer);
 			}
+		}
 
-			/* fall down */
-
-		case phase_lingering:
-			ret = cherokee_connection_linger_read (conn);
-			switch (ret) {
-			case ret_ok:
-			case ret_eagain:
-				continue;
-			case ret_eof:
-			case ret_error:
-				close_active_connection (thd, conn, false);
-				continue;
-			default:
-				RET_UNKNOWN(ret);
-				close_active_connection (thd, conn, false);
+		/* Polling connection: it might be moved back to the
+		 * active list, and processed right away.
+		 */
+		if (conn->polling_fd != -1) {
+			ret = process_polling_connection (thd, conn);
+			if (ret != ret_ok)
 				continue;
-			}
-			break;
-
-		default:
- 			SHOULDNT_HAPPEN;
 		}
 
-	} /* list */
-
-	list_for_each_safe (i, tmp, LIST(&thd->active_list)) {
-		conn = CONN(i);
+		/* Active connection
+		 */
+		ret = process_active_connection (thd, conn);
+		if (ret != ret_ok)
+			continue;
 
-		/* Check whether we have data sitting in SSL buffers that needs
-		* to be processed before we wait for file descriptors. */
-		if (conn->socket.cryptor &&
-		   cherokee_cryptor_socket_pending(conn->socket.cryptor)) {
-			thd->pending_read_num++;
-		}
-	} /* list */
+		check_pending_work (thd, conn);
+		conn_update_timer (thd, conn);
+	}
 
 	return ret_ok;
 }
 
 
+
 ret_t
 cherokee_thread_free (cherokee_thread_t *thd)
 {
 	cherokee_list_t *i, *tmp;
 
 	cherokee_buffer_mrproper (&thd->bogo_now_strgmt);
+	cherokee_buffer_mrproper (&thd->expires_strgmt);
+	cherokee_vserver_index_cache_mrproper (&thd->vserver_cache);
 	cherokee_buffer_mrproper (&thd->tmp_buf1);
 	cherokee_buffer_mrproper (&thd->tmp_buf2);
 
 	cherokee_fdpoll_free (thd->fdpoll);
 	thd->fdpoll = NULL;
 
+	cherokee_timer_wheel_mrproper (&thd->timers);
+
 	/* Free the connection
 	 */
 	list_for_each_safe (i, tmp, &thd->active_list) {
@@ -1518,6 +1780,13 @@ cherokee_thread_free (cherokee_thread_t *thd)
 		cherokee_connection_free (CONN(i));
 	}
 
+	/* Per-thread listeners
+	 */
+	list_for_each_safe (i, tmp, &thd->listeners) {
+		cherokee_list_del (i);
+		cherokee_bind_free (BIND(i));
+	}
+
 	cherokee_limiter_mrproper (&thd->limiter);
 
 	/* FastCGI
@@ -1649,11 +1918,16 @@ thread_add_connection (cherokee_thread_t *thd, cherokee_connection_t  *conn)
 {
 	ret_t ret;
 
-	ret = cherokee_fdpoll_add (thd->fdpoll, SOCKET_FD(&conn->socket), FDPOLL_MODE_READ);
+	ret = thread_poll_add (thd, SOCKET_FD(&conn->socket), FDPOLL_MODE_READ, conn);
 	if (unlikely (ret < ret_ok)) return ret;
 
 	conn_set_mode (thd, conn, socket_reading);
 	add_connection (thd, conn);
+	conn_update_timer (thd, conn);
+
+	/* The request might be there already
+	 */
+	conn_set_ready (thd, conn);
 
 	return ret_ok;
 }
@@ -1730,7 +2004,7 @@ accept_new_connection (cherokee_thread_t *thd,
 
 	/* Set the reference to the port
 	 */
-	new_conn->bind = bind;
+	new_conn->bind = BIND_MAIN(bind);
 
 	/* Lets add the new connection
 	 */
@@ -1806,10 +2080,6 @@ cherokee_thread_step_SINGLE_THREAD (cherokee_thread_t *thd)
 	 */
 	cherokee_bogotime_try_update();
 
-	/* May have to reactive connections
-	 */
-	cherokee_limiter_reactive (&thd->limiter, thd);
-
 	/* Be quick when there are pending work:
 	 * - pending_conns_num: Pipelined requests
 	 * - pending_read_num:  SSL pending reads
@@ -1824,10 +2094,9 @@ cherokee_thread_step_SINGLE_THREAD (cherokee_thread_t *thd)
 		thd->pending_read_num = 0;
 	}
 
-	/* Reactive sleeping connections
+	/* Wake up for the next timeout, or sleeping connection
 	 */
-	fdwatch_msecs = cherokee_limiter_get_time_limit (&thd->limiter,
-							 fdwatch_msecs);
+	fdwatch_msecs = thread_watch_msecs (thd, fdwatch_msecs);
 
 	/* Graceful restart
 	 */
@@ -1866,13 +2135,9 @@ cherokee_thread_step_SINGLE_THREAD (cherokee_thread_t *thd)
 out:
 	thread_update_bogo_now (thd);
 
-	/* Process polling connections
-	 */
-	process_polling_connections (thd);
-
-	/* Process active connections
+	/* Process the connections with work to do
 	 */
-	return process_active_connections (thd);
+	return process_connections (thd);
 }
 
 
@@ -1976,6 +2241,70 @@ out:
 }
 
 
+static void
+watch_accept_REUSEPORT (cherokee_thread_t  *thd,
+			int                 fdwatch_msecs)
+{
+	ret_t               ret;
+	cherokee_bind_t    *bind;
+	cherokee_list_t    *i;
+	cherokee_list_t    *listeners;
+	cherokee_boolean_t  yield      = false;
+	cherokee_server_t  *srv        = THREAD_SRV(thd);
+
+	/* The listeners stay in the fdpoll: there is no lock to take
+	 * and the kernel spreads the new connections among threads.
+	 * The main thread owns the original listener sockets.
+	 */
+	if (thd == srv->main_thread) {
+		listeners = &srv->listeners;
+	} else {
+		listeners = &thd->listeners;
+	}
+
+	/* Check file descriptors
+	 */
+	cherokee_fdpoll_watch (thd->fdpoll, fdwatch_msecs);
+	thread_update_bogo_now (thd);
+
+	if (unlikely ((srv->wanna_exit) ||
+		      (srv->wanna_reinit)))
+	{
+		return;
+	}
+
+	/* Accept new connections
+	 */
+	list_for_each (i, listeners) {
+		bind = BIND(i);
+
+		/* Is it full?
+		 */
+		if (unlikely (thd->conns_num >= thd->conns_max)) {
+			if (thd->is_full) {
+				thread_full_handler (thd, bind);
+				thd->is_full = false;
+			} else {
+				thd->is_full = true;
+			}
+
+			yield = true;
+			break;
+		} else {
+			thd->is_full = false;
+		}
+
+		do {
+			ret = accept_new_connection (thd, bind);
+		} while (should_accept_more (thd, bind, ret) == ret_ok);
+	}
+
+	if (yield) {
+		CHEROKEE_THREAD_YIELD;
+	}
+}
+
+
 ret_t
 cherokee_thread_step_MULTI_THREAD (cherokee_thread_t  *thd,
 				   cherokee_boolean_t  dont_block)
@@ -1991,10 +2320,6 @@ cherokee_thread_step_MULTI_THREAD (cherokee_thread_t  *thd,
 	ret = cherokee_bogotime_try_update();
 	time_updated = (ret == ret_ok);
 
-	/* May have to reactive connections
-	 */
-	cherokee_limiter_reactive (&thd->limiter, thd);
-
 	/* Be quick when there are pending work:
 	 * - pending_conns_num: Pipelined requests
 	 * - pending_read_num:  SSL pending reads
@@ -2009,10 +2334,9 @@ cherokee_thread_step_MULTI_THREAD (cherokee_thread_t  *thd,
 		thd->pending_read_num = 0;
 	}
 
-	/* Reactive sleeping connections
+	/* Wake up for the next timeout, or sleeping connection
 	 */
-	fdwatch_msecs = cherokee_limiter_get_time_limit (&thd->limiter,
-							 fdwatch_msecs);
+	fdwatch_msecs = thread_watch_msecs (thd, fdwatch_msecs);
 
 	/* Server wants to exit, and the thread has nothing to do
 	 */
@@ -2023,6 +2347,10 @@ cherokee_thread_step_MULTI_THREAD (cherokee_thread_t  *thd,
 
 	if (unlikely (srv->wanna_reinit))
 	{
+		/* Stop accepting on the own listeners
+		 */
+		cherokee_thread_close_listeners (thd);
+
 		if ((thd->active_list_num == 0) &&
 		    (thd->polling_list_num == 0))
 		{
@@ -2048,7 +2376,11 @@ cherokee_thread_step_MULTI_THREAD (cherokee_thread_t  *thd,
 		     (thd->polling_list_num == 0) &&
 		     (thd->limiter.conns_num == 0));
 
-	watch_accept_MULTI_THREAD (thd, can_block, fdwatch_msecs);
+	if (srv->reuseport) {
+		watch_accept_REUSEPORT (thd, fdwatch_msecs);
+	} else {
+		watch_accept_MULTI_THREAD (thd, can_block, fdwatch_msecs);
+	}
 
 out:
 	if ((can_block) ||
@@ -2061,13 +2393,9 @@ out:
 	 */
 	CHEROKEE_MUTEX_LOCK (&thd->ownership);
 
-	/* Process polling connections
-	 */
-	process_polling_connections (thd);
-
-	/* Process active connections
+	/* Process the connections with work to do
 	 */
-	ret = process_active_connections (thd);
+	ret = process_connections (thd);
 
 	/* Release the thread
 	 */
@@ -2085,6 +2413,55 @@ cherokee_thread_connection_num (cherokee_thread_t *thd)
 }
 
 
+ret_t
+cherokee_thread_add_listener (cherokee_thread_t *thd,
+			      cherokee_bind_t   *listener)
+{
+	ret_t ret;
+
+	/* It remains in the fdpoll for the whole life of the thread
+	 */
+	ret = cherokee_fdpoll_add (thd->fdpoll,
+				   S_SOCKET_FD(listener->socket),
+				   FDPOLL_MODE_READ);
+	if (unlikely (ret != ret_ok)) {
+		return ret_error;
+	}
+
+	cherokee_list_add_tail (&listener->listed, &thd->listeners);
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_thread_close_listeners (cherokee_thread_t *thd)
+{
+	ret_t            ret;
+	cherokee_list_t *i;
+
+	/* It must be called by the thread itself: nobody else can
+	 * touch its fdpoll.
+	 */
+	list_for_each (i, &thd->listeners) {
+		if (BIND(i)->socket.socket == -1) {
+			continue;
+		}
+
+		TRACE (ENTRIES, "Closing thread listener fd=%d\n", BIND(i)->socket.socket);
+
+		ret = cherokee_fdpoll_del (thd->fdpoll, BIND(i)->socket.socket);
+		if (ret != ret_ok) {
+			SHOULDNT_HAPPEN;
+		}
+
+		cherokee_fd_close (BIND(i)->socket.socket);
+		BIND(i)->socket.socket = -1;
+	}
+
+	return ret_ok;
+}
+
+
 ret_t
 cherokee_thread_close_polling_connections (cherokee_thread_t *thd, int fd, cuint_t *num)
 {
@@ -2150,7 +2527,7 @@ reactive_conn_from_polling (cherokee_thread_t *thd, cherokee_connection_t *conn)
 			SHOULDNT_HAPPEN;
 	}
 
-	ret = cherokee_fdpoll_add (thd->fdpoll, socket->socket, socket->status);
+	ret = thread_poll_add (thd, socket->socket, socket->status, conn);
 	if (ret != ret_ok) {
 		return ret_error;
 	}
@@ -2193,7 +2570,9 @@ cherokee_thread_deactive_to_polling (cherokee_thread_t     *thd,
 		SHOULDNT_HAPPEN;
 
 	if (add_fd) {
-		ret = cherokee_fdpoll_add (thd->fdpoll, fd, rw);
+		/* Shared fds wake every connection polling them
+		 */
+		ret = thread_poll_add (thd, fd, rw, (multiple) ? (void *)thd : (void *)conn);
 		if (unlikely (ret != ret_ok)) {
 			return ret_error;
 		}
@@ -2205,6 +2584,12 @@ cherokee_thread_deactive_to_polling (cherokee_thread_t     *thd,
 	conn->polling_mode     = rw;
 	conn->polling_multiple = multiple;
 
+	/* Is there information to be sent?
+	 */
+	if (conn->buffer.len > 0) {
+		conn_set_ready (thd, conn);
+	}
+
 	return move_connection_to_polling (thd, conn);
 }
 
@@ -2218,6 +2603,7 @@ cherokee_thread_retire_active_connection (cherokee_thread_t *thd, cherokee_conne
 	if (ret != ret_ok)
 		SHOULDNT_HAPPEN;
 
+	conn_unset_ready (conn);
 	del_connection (thd, conn);
 	return ret_ok;
 }
@@ -2228,11 +2614,12 @@ cherokee_thread_inject_active_connection (cherokee_thread_t *thd, cherokee_conne
 {
 	ret_t ret;
 
-	ret = cherokee_fdpoll_add (thd->fdpoll, SOCKET_FD(&conn->socket), FDPOLL_MODE_WRITE);
+	ret = thread_poll_add (thd, SOCKET_FD(&conn->socket), FDPOLL_MODE_WRITE, conn);
 	if (ret != ret_ok) {
 		return ret_error;
 	}
 
 	add_connection (thd, conn);
+	conn_set_ready (thd, conn);
 	return ret_ok;
 }
@@ -38,6 +38,9 @@
 #include "fdpoll.h"
 #include "avl.h"
 #include "limiter.h"
+#include "timer_wheel.h"
+#include "bind.h"
+#include "vserver_index.h"
 
 
 typedef enum {
@@ -63,6 +66,11 @@ typedef struct {
 	struct tm               bogo_now_tmloc;
 	cherokee_buffer_t       bogo_now_strgmt;
 
+	time_t                  expires_time;
+	cherokee_buffer_t       expires_strgmt;
+
+	cherokee_vserver_index_cache_t vserver_cache;
+
 	cherokee_buffer_t       tmp_buf1;
 	cherokee_buffer_t       tmp_buf2;
 
@@ -78,11 +86,15 @@ typedef struct {
 	cherokee_list_t         active_list;
 	int                     polling_list_num;    /* polling connections */
 	cherokee_list_t         polling_list;
+	cherokee_list_t         ready_list;          /* conns with work to do */
 	cherokee_list_t         reuse_list;
 	int                     reuse_list_num;      /* reusable connections objs */
 	cherokee_limiter_t      limiter;             /* Traffic shaping */
+	cherokee_timer_wheel_t  timers;              /* Timeouts and wake-ups */
 	cherokee_boolean_t      is_full;
 
+	cherokee_list_t         listeners;           /* Own SO_REUSEPORT listeners */
+
 	int                     pending_conns_num;   /* Waiting pipelining connections */
 	int                     pending_read_num;    /* Conns with SSL deping read */
 
@@ -126,6 +138,9 @@ int   cherokee_thread_connection_num             (cherokee_thread_t *thd);
 ret_t cherokee_thread_retire_active_connection   (cherokee_thread_t *thd, cherokee_connection_t *conn);
 ret_t cherokee_thread_inject_active_connection   (cherokee_thread_t *thd, cherokee_connection_t *conn);
 
+ret_t cherokee_thread_add_listener               (cherokee_thread_t *thd, cherokee_bind_t *listener);
+ret_t cherokee_thread_close_listeners            (cherokee_thread_t *thd);
+
 ret_t cherokee_thread_close_all_connections      (cherokee_thread_t *thd);
 ret_t cherokee_thread_close_polling_connections  (cherokee_thread_t *thd, int fd, cuint_t *num);
 
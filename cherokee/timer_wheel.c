@@ -0,0 +1,320 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/* Cherokee
+ *
+ * Authors:
+ *      Alvaro Lopez Ortega <alvaro@alobbs.com>
+ *
+ * Copyright (C) 2001-2011 Alvaro Lopez Ortega
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+
+#include "common-internal.h"
+#include "timer_wheel.h"
+
+#define ROOT_MASK   (TIMER_WHEEL_ROOT_SIZE  - 1)
+#define LEVEL_MASK  (TIMER_WHEEL_LEVEL_SIZE - 1)
+
+#define LEVEL_SHIFT(l)  (TIMER_WHEEL_ROOT_BITS + ((l) * TIMER_WHEEL_LEVEL_BITS))
+#define LEVEL_INDEX(t,l) (((t) >> LEVEL_SHIFT(l)) & LEVEL_MASK)
+
+/* Timers further than this are parked in the last level, and
+ * placed again once they are cascaded down.
+ */
+#define MAX_DELTA  ((1ULL << LEVEL_SHIFT(TIMER_WHEEL_LEVELS)) - 1)
+
+
+ret_t
+cherokee_timer_init (cherokee_timer_t *timer)
+{
+	INIT_LIST_HEAD (&timer->entry);
+	timer->expire = 0;
+
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_timer_wheel_init (cherokee_timer_wheel_t *wheel, cherokee_msec_t now)
+{
+	cuint_t i, j;
+
+	wheel->now        = now;
+	wheel->timers_num = 0;
+
+	for (i=0; i < TIMER_WHEEL_ROOT_SIZE; i++) {
+		INIT_LIST_HEAD (&wheel->root[i]);
+	}
+
+	for (i=0; i < TIMER_WHEEL_LEVELS; i++) {
+		for (j=0; j < TIMER_WHEEL_LEVEL_SIZE; j++) {
+			INIT_LIST_HEAD (&wheel->levels[i][j]);
+		}
+	}
+
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_timer_wheel_mrproper (cherokee_timer_wheel_t *wheel)
+{
+	/* The timers belong to their owners. Just in case, leave
+	 * them unarmed.
+	 */
+	cuint_t          i, j;
+	cherokee_list_t *k, *tmp;
+
+	for (i=0; i < TIMER_WHEEL_ROOT_SIZE; i++) {
+		list_for_each_safe (k, tmp, &wheel->root[i]) {
+			cherokee_list_del (k);
+			INIT_LIST_HEAD (k);
+		}
+	}
+
+	for (i=0; i < TIMER_WHEEL_LEVELS; i++) {
+		for (j=0; j < TIMER_WHEEL_LEVEL_SIZE; j++) {
+			list_for_each_safe (k, tmp, &wheel->levels[i][j]) {
+				cherokee_list_del (k);
+				INIT_LIST_HEAD (k);
+			}
+		}
+	}
+
+	wheel->timers_num = 0;
+	return ret_ok;
+}
+
+
+static void
+place (cherokee_timer_wheel_t *wheel, cherokee_timer_t *timer)
+{
+	cuint_t         l;
+	cherokee_msec_t delta;
+	cherokee_msec_t expire = timer->expire;
+
+	/* Already expired: it goes to the next slot to be run
+	 */
+	if (expire < wheel->now) {
+		expire = wheel->now;
+	}
+
+	delta = expire - wheel->now;
+
+	if (delta < TIMER_WHEEL_ROOT_SIZE) {
+		cherokee_list_add_tail (&timer->entry, &wheel->root[expire & ROOT_MASK]);
+		return;
+	}
+
+	if (delta > MAX_DELTA) {
+		expire = wheel->now + MAX_DELTA;
+		delta  = MAX_DELTA;
+	}
+
+	for (l=0; l < TIMER_WHEEL_LEVELS - 1; l++) {
+		if (delta < (1ULL << LEVEL_SHIFT(l+1)))
+			break;
+	}
+
+	cherokee_list_add_tail (&timer->entry, &wheel->levels[l][LEVEL_INDEX(expire,l)]);
+}
+
+
+ret_t
+cherokee_timer_wheel_add (cherokee_timer_wheel_t *wheel,
+			  cherokee_timer_t       *timer,
+			  cherokee_msec_t         expire)
+{
+	if (TIMER_IS_ARMED (timer)) {
+		cherokee_list_del (&timer->entry);
+	} else {
+		wheel->timers_num++;
+	}
+
+	timer->expire = expire;
+	place (wheel, timer);
+
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_timer_wheel_del (cherokee_timer_wheel_t *wheel,
+			  cherokee_timer_t       *timer)
+{
+	if (! TIMER_IS_ARMED (timer))
+		return ret_not_found;
+
+	cherokee_list_del (&timer->entry);
+	INIT_LIST_HEAD (&timer->entry);
+
+	wheel->timers_num--;
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_timer_wheel_next (cherokee_timer_wheel_t *wheel,
+			   cherokee_msec_t        *expire)
+{
+	cuint_t            i, l;
+	cuint_t            index;
+	cuint_t            distance;
+	cherokee_msec_t    when;
+	cherokee_msec_t    next  = 0;
+	cherokee_boolean_t found = false;
+
+	if (wheel->timers_num == 0)
+		return ret_not_found;
+
+	/* The current tick is about to cascade timers down
+	 */
+	if ((wheel->now & ROOT_MASK) == 0) {
+		for (l=0; l < TIMER_WHEEL_LEVELS; l++) {
+			index = LEVEL_INDEX (wheel->now, l);
+
+			if (! cherokee_list_empty (&wheel->levels[l][index])) {
+				*expire = wheel->now;
+				return ret_ok;
+			}
+
+			if (index != 0)
+				break;
+		}
+	}
+
+	/* Root: timers expiring in the next few milliseconds. It is
+	 * exact, every slot belongs to a single millisecond.
+	 */
+	for (i=0; i < TIMER_WHEEL_ROOT_SIZE; i++) {
+		if (! cherokee_list_empty (&wheel->root[(wheel->now + i) & ROOT_MASK])) {
+			next  = wheel->now + i;
+			found = true;
+			break;
+		}
+	}
+
+	/* Upper levels: the earliest time one of their slots gets
+	 * cascaded down. The thread will wake up there, and look
+	 * again.
+	 */
+	for (l=0; l < TIMER_WHEEL_LEVELS; l++) {
+		index = LEVEL_INDEX (wheel->now, l);
+
+		for (distance=1; distance <= TIMER_WHEEL_LEVEL_SIZE; distance++) {
+			if (cherokee_list_empty (&wheel->levels[l][(index + distance) & LEVEL_MASK]))
+				continue;
+
+			when = ((wheel->now >> LEVEL_SHIFT(l)) + distance) << LEVEL_SHIFT(l);
+			if ((! found) || (when < next)) {
+				next  = when;
+				found = true;
+			}
+			break;
+		}
+	}
+
+	if (! found)
+		return ret_not_found;
+
+	*expire = next;
+	return ret_ok;
+}
+
+
+static void
+cascade (cherokee_timer_wheel_t *wheel, cherokee_list_t *slot)
+{
+	cherokee_list_t  timers;
+	cherokee_list_t *i;
+
+	/* Parked timers might land on the very same slot
+	 */
+	INIT_LIST_HEAD (&timers);
+	cherokee_list_reparent (slot, &timers);
+	INIT_LIST_HEAD (slot);
+
+	while (! cherokee_list_empty (&timers)) {
+		i = timers.next;
+		cherokee_list_del (i);
+		place (wheel, TIMER(i));
+	}
+}
+
+
+ret_t
+cherokee_timer_wheel_run (cherokee_timer_wheel_t *wheel,
+			  cherokee_msec_t         now,
+			  cherokee_timer_func_t   func,
+			  void                   *param)
+{
+	cuint_t          l;
+	cherokee_msec_t  tick;
+	cherokee_list_t  expired;
+	cherokee_list_t *i;
+
+	while (wheel->now <= now) {
+		/* Nothing to expire: jump ahead
+		 */
+		if (wheel->timers_num == 0) {
+			wheel->now = now + 1;
+			break;
+		}
+
+		tick = wheel->now;
+
+		/* The root wheel wraps around: cascade the upper
+		 * levels down, as far as they wrap around as well.
+		 */
+		if ((tick & ROOT_MASK) == 0) {
+			for (l=0; l < TIMER_WHEEL_LEVELS; l++) {
+				cascade (wheel, &wheel->levels[l][LEVEL_INDEX(tick,l)]);
+
+				if (LEVEL_INDEX(tick,l) != 0)
+					break;
+			}
+		}
+
+		/* Take the expired timers out before calling back:
+		 * they might be armed again.
+		 */
+		INIT_LIST_HEAD (&expired);
+		cherokee_list_reparent (&wheel->root[tick & ROOT_MASK], &expired);
+		INIT_LIST_HEAD (&wheel->root[tick & ROOT_MASK]);
+
+		wheel->now = tick + 1;
+
+		while (! cherokee_list_empty (&expired)) {
+			i = expired.next;
+			cherokee_list_del (i);
+
+			/* It was parked too far away
+			 */
+			if (TIMER(i)->expire > tick) {
+				place (wheel, TIMER(i));
+				continue;
+			}
+
+			INIT_LIST_HEAD (i);
+			wheel->timers_num--;
+
+			func (TIMER(i), param);
+		}
+	}
+
+	return ret_ok;
+}
@@ -0,0 +1,75 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/* Cherokee
+ *
+ * Authors:
+ *      Alvaro Lopez Ortega <alvaro@alobbs.com>
+ *
+ * Copyright (C) 2001-2011 Alvaro Lopez Ortega
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+
+#ifndef CHEROKEE_TIMER_WHEEL_H
+#define CHEROKEE_TIMER_WHEEL_H
+
+#include "common.h"
+#include "list.h"
+#include "bogotime.h"
+
+/* Hierarchical timer wheel: The root wheel has one slot per
+ * millisecond. Each one of the upper levels covers the whole range
+ * of the previous one per slot, and its timers are cascaded down
+ * when the lower level wraps around.
+ */
+#define TIMER_WHEEL_ROOT_BITS   8
+#define TIMER_WHEEL_LEVEL_BITS  6
+#define TIMER_WHEEL_LEVELS      4
+
+#define TIMER_WHEEL_ROOT_SIZE   (1 << TIMER_WHEEL_ROOT_BITS)
+#define TIMER_WHEEL_LEVEL_SIZE  (1 << TIMER_WHEEL_LEVEL_BITS)
+
+typedef struct {
+	cherokee_list_t  entry;
+	cherokee_msec_t  expire;
+} cherokee_timer_t;
+
+typedef struct {
+	cherokee_msec_t  now;
+	cuint_t          timers_num;
+	cherokee_list_t  root   [TIMER_WHEEL_ROOT_SIZE];
+	cherokee_list_t  levels [TIMER_WHEEL_LEVELS][TIMER_WHEEL_LEVEL_SIZE];
+} cherokee_timer_wheel_t;
+
+typedef void (* cherokee_timer_func_t) (cherokee_timer_t *timer, void *param);
+
+#define TIMER(t)           ((cherokee_timer_t *)(t))
+#define TIMER_IS_ARMED(t)  (! cherokee_list_empty (&TIMER(t)->entry))
+
+ret_t cherokee_timer_init            (cherokee_timer_t *timer);
+
+ret_t cherokee_timer_wheel_init      (cherokee_timer_wheel_t *wheel, cherokee_msec_t now);
+ret_t cherokee_timer_wheel_mrproper  (cherokee_timer_wheel_t *wheel);
+
+ret_t cherokee_timer_wheel_add       (cherokee_timer_wheel_t *wheel, cherokee_timer_t *timer, cherokee_msec_t expire);
+ret_t cherokee_timer_wheel_del       (cherokee_timer_wheel_t *wheel, cherokee_timer_t *timer);
+ret_t cherokee_timer_wheel_next      (cherokee_timer_wheel_t *wheel, cherokee_msec_t *expire);
+ret_t cherokee_timer_wheel_run       (cherokee_timer_wheel_t *wheel,
+				      cherokee_msec_t         now,
+				      cherokee_timer_func_t   func,
+				      void                   *param);
+
+#endif /* CHEROKEE_TIMER_WHEEL_H */
@@ -27,6 +27,7 @@
 #include "logger.h"
 #include "bogotime.h"
 #include "socket.h"
+#include "header_scan.h"
 
 #include <signal.h>
 #include <stdlib.h>
@@ -959,6 +960,26 @@ cherokee_fd_set_reuseaddr (int fd)
 }
 
 
+ret_t
+cherokee_fd_set_reuseport (int fd)
+{
+#ifdef SO_REUSEPORT
+	int re;
+	int on = 1;
+
+	re = setsockopt (fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+	if (re != 0) {
+		return ret_error;
+	}
+
+	return ret_ok;
+#else
+	UNUSED (fd);
+	return ret_no_sys;
+#endif
+}
+
+
 
 ret_t
 cherokee_syslog (int priority, cherokee_buffer_t *buf)
@@ -2170,43 +2191,48 @@ cherokee_find_header_end_cstr (char      *c_str,
 	fin = c_str + MIN(c_len, MAX_HEADER_LEN);
 
 	while (p < fin) {
- 		if ((*p == CHR_CR) || (*p == CHR_LF)) {
-			cr_n  = 0;
-			lf_n  = 0;
-			begin = p;
-
-			/* Valid scenarios:
-			 * CR_n: [CRLF_CRLF] 0, 1, 1, 2, 2  | [LF_LF] 0, 0
-			 * LF_n:             0, 0, 1, 1, 2  |         1, 2
-			 *
-			 * so, the two forbidden situations are:
-			 * CR_n: 1, 2
-			 * LF_n: 2, 0
-			 */
-			while (p < fin) {
-				if (*p == CHR_LF) {
-					lf_n++;
-					if (lf_n == 2) {
-						*end     = begin;
-						*sep_len = (p - begin) + 1;
-						return ret_ok;
-					}
-
-				} else if (*p == CHR_CR) {
-					cr_n++;
-
-				} else {
-					break;
-				}
+		/* Jump to the next CR or LF
+		 */
+		p = cherokee_header_scan_eol (p, fin);
+		if (p == NULL) {
+			break;
+		}
 
-				if (unlikely (((cr_n == 1) && (lf_n == 2)) ||
-					      ((cr_n == 2) && (lf_n == 0))))
-				{
-					return ret_error;
+		cr_n  = 0;
+		lf_n  = 0;
+		begin = p;
+
+		/* Valid scenarios:
+		 * CR_n: [CRLF_CRLF] 0, 1, 1, 2, 2  | [LF_LF] 0, 0
+		 * LF_n:             0, 0, 1, 1, 2  |         1, 2
+		 *
+		 * so, the two forbidden situations are:
+		 * CR_n: 1, 2
+		 * LF_n: 2, 0
+		 */
+		while (p < fin) {
+			if (*p == CHR_LF) {
+				lf_n++;
+				if (lf_n == 2) {
+					*end     = begin;
+					*sep_len = (p - begin) + 1;
+					return ret_ok;
 				}
 
-				p++;
+			} else if (*p == CHR_CR) {
+				cr_n++;
+
+			} else {
+				break;
+			}
+
+			if (unlikely (((cr_n == 1) && (lf_n == 2)) ||
+				      ((cr_n == 2) && (lf_n == 0))))
+			{
+				return ret_error;
 			}
+
+			p++;
 		}
 
 		p++;
@@ -2591,6 +2617,36 @@ cherokee_reset_signals (void)
 }
 
 
+#ifdef HAVE_PTHREAD
+ret_t
+cherokee_thread_create_nosignals (pthread_t  *thread,
+				  void     *(*routine) (void *),
+				  void       *param)
+{
+	int      re;
+	sigset_t mask;
+	sigset_t mask_prev;
+
+	/* Signals are for the main thread: the new one inherits
+	 * the mask of its creator.
+	 */
+	sigfillset (&mask);
+	pthread_sigmask (SIG_SETMASK, &mask, &mask_prev);
+
+	re = pthread_create (thread, NULL, routine, param);
+
+	pthread_sigmask (SIG_SETMASK, &mask_prev, NULL);
+
+	if (re != 0) {
+		LOG_ERRNO (re, cherokee_err_error, CHEROKEE_ERROR_THREAD_CREATE, re);
+		return ret_error;
+	}
+
+	return ret_ok;
+}
+#endif
+
+
 int
 cherokee_unlink (const char *path)
 {
@@ -62,6 +62,10 @@
 #include <dirent.h>
 #include <errno.h>
 
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
+
 #include <cherokee/buffer.h>
 #include <cherokee/iocache.h>
 
@@ -190,6 +194,10 @@ ret_t cherokee_ntop          (int family, struct sockaddr *addr, char *dst, size
 ret_t cherokee_wait_pid      (int pid, int *retcode);
 ret_t cherokee_reset_signals (void);
 
+#ifdef HAVE_PTHREAD
+ret_t cherokee_thread_create_nosignals (pthread_t *thread, void *(*routine) (void *), void *param);
+#endif
+
 ret_t cherokee_io_stat       (cherokee_iocache_t        *iocache,
 			      cherokee_buffer_t         *path,
 			      cherokee_boolean_t         useit,
@@ -203,6 +211,7 @@ ret_t cherokee_fd_set_nonblocking (int fd, cherokee_boolean_t enable);
 ret_t cherokee_fd_set_nodelay     (int fd, cherokee_boolean_t enable);
 ret_t cherokee_fd_set_closexec    (int fd);
 ret_t cherokee_fd_set_reuseaddr   (int fd);
+ret_t cherokee_fd_set_reuseport   (int fd);
 ret_t cherokee_fd_close           (int fd);
 
 /* Misc
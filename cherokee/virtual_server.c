@@ -58,6 +58,7 @@ cherokee_virtual_server_new (cherokee_virtual_server_t **vserver, void *server)
 	n->priority        = 0;
 	n->keepalive       = true;
 	n->cryptor         = NULL;
+	n->tls_load_failed = 0;
 	n->post_max_len    = -1;
 	n->evhost          = NULL;
 	n->matching        = NULL;
@@ -1024,6 +1025,12 @@ configure_rules (cherokee_config_node_t    *config,
 	 */
 	cherokee_rule_list_sort (rule_list);
 
+	/* Build the index that lets requests skip the rules that
+	 * cannot match them
+	 */
+	ret = cherokee_rule_list_compile (rule_list);
+	if (ret != ret_ok) return ret;
+
 /* TODO: */
 /* 	if (! did_default) { */
 /* 		PRINT_ERROR ("ERROR: vserver '%s': A default rule is needed\n", vserver->name.buf); */
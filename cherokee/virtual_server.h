@@ -76,6 +76,7 @@ typedef struct {
 	cherokee_buffer_t            req_client_certs;
 	cherokee_buffer_t            ciphers;
 	cherokee_cryptor_vserver_t  *cryptor;
+	time_t                       tls_load_failed; /* Lazy cert.: last failure    */
 
 	struct {
 		cherokee_boolean_t   enabled;
@@ -38,6 +38,7 @@ cherokee_vrule_init_base (cherokee_vrule_t       *vrule,
 
 	vrule->virtual_server = NULL;
 	vrule->match          = NULL;
+	vrule->index_keys     = NULL;
 	vrule->priority       = CHEROKEE_VRULE_PRIO_NONE;
 
 	return ret_ok;
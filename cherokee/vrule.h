@@ -45,6 +45,7 @@ CHEROKEE_BEGIN_DECLS
 typedef ret_t (* vrule_func_new_t)       (void **vrule);
 typedef ret_t (* vrule_func_configure_t) (void  *vrule, cherokee_config_node_t *conf, void *vsrv);
 typedef ret_t (* vrule_func_match_t)     (void  *vrule, cherokee_buffer_t *host, void *conn);
+typedef ret_t (* vrule_func_index_t)     (void  *vrule, void *vserver_index);
 
 /* Data types
  */
@@ -59,6 +60,7 @@ typedef struct {
 	/* Virtual methods */
 	vrule_func_match_t       match;
 	vrule_func_configure_t   configure;
+	vrule_func_index_t       index_keys;
 } cherokee_vrule_t;
 
 #define VRULE(x) ((cherokee_vrule_t *)(x))
@@ -29,6 +29,7 @@
 #include "connection-protected.h"
 #include "match.h"
 #include "util.h"
+#include "vserver_index.h"
 
 #define ENTRIES "vrule,wildcard"
 
@@ -137,6 +138,30 @@ configure (cherokee_vrule_wildcard_t   *vrule,
 	return ret_ok;
 }
 
+static ret_t
+index_keys (cherokee_vrule_wildcard_t *vrule,
+	    cherokee_vserver_index_t  *index)
+{
+	ret_t            ret;
+	cherokee_list_t *i;
+
+	list_for_each (i, &vrule->entries) {
+		cherokee_wc_entry_t *entry = (cherokee_wc_entry_t *)i;
+
+		if (entry->is_wildcard) {
+			ret = cherokee_vserver_index_add_wildcard (index, &entry->domain);
+		} else {
+			ret = cherokee_vserver_index_add_domain (index, &entry->domain);
+		}
+
+		if (ret != ret_ok) {
+			return ret;
+		}
+	}
+
+	return ret_ok;
+}
+
 static ret_t
 _free (void *p)
 {
@@ -161,9 +186,10 @@ cherokee_vrule_wildcard_new (cherokee_vrule_t **vrule)
 
 	/* Virtual methods
 	 */
-	VRULE(n)->match     = (vrule_func_match_t) match;
-	VRULE(n)->configure = (vrule_func_configure_t) configure;
-	MODULE(n)->free     = (module_func_free_t) _free;
+	VRULE(n)->match      = (vrule_func_match_t) match;
+	VRULE(n)->configure  = (vrule_func_configure_t) configure;
+	VRULE(n)->index_keys = (vrule_func_index_t) index_keys;
+	MODULE(n)->free      = (module_func_free_t) _free;
 
 	/* Properties
 	 */
@@ -0,0 +1,483 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/* Cherokee
+ *
+ * Authors:
+ *      Alvaro Lopez Ortega <alvaro@alobbs.com>
+ *
+ * Copyright (C) 2001-2011 Alvaro Lopez Ortega
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "common-internal.h"
+#include "vserver_index.h"
+#include "virtual_server.h"
+#include "connection-protected.h"
+#include "match.h"
+#include "util.h"
+
+#define ENTRIES "vserver,index"
+#define NO_POS  ((cuint_t) -1)
+
+
+/* Wild-card trie
+ */
+
+struct cherokee_vserver_index_node {
+	cherokee_avl_t   children;
+	cherokee_list_t  patterns;
+};
+
+typedef struct {
+	cherokee_list_t    listed;
+	cherokee_buffer_t  pattern;
+	cuint_t            pos;
+} index_pattern_t;
+
+static ret_t
+node_new (cherokee_vserver_index_node_t **node)
+{
+	cherokee_vserver_index_node_t *n;
+
+	n = (cherokee_vserver_index_node_t *) malloc (sizeof(cherokee_vserver_index_node_t));
+	if (unlikely (n == NULL)) {
+		return ret_nomem;
+	}
+
+	cherokee_avl_init (&n->children);
+	INIT_LIST_HEAD (&n->patterns);
+
+	*node = n;
+	return ret_ok;
+}
+
+static void
+node_free (void *p)
+{
+	cherokee_list_t               *i, *tmp;
+	cherokee_vserver_index_node_t *node = p;
+
+	list_for_each_safe (i, tmp, &node->patterns) {
+		index_pattern_t *entry = (index_pattern_t *)i;
+
+		cherokee_buffer_mrproper (&entry->pattern);
+		free (entry);
+	}
+
+	cherokee_avl_mrproper (AVL_GENERIC(&node->children), node_free);
+	free (node);
+}
+
+
+ret_t
+cherokee_vserver_index_init (cherokee_vserver_index_t *index)
+{
+	cherokee_avl_init (&index->hosts);
+	cherokee_avl_init (&index->nicks);
+
+	index->wildcards    = NULL;
+	index->vservers     = NULL;
+	index->vservers_len = 0;
+	index->opaque       = NULL;
+	index->opaque_len   = 0;
+	index->current      = 0;
+
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_vserver_index_mrproper (cherokee_vserver_index_t *index)
+{
+	cherokee_avl_mrproper (AVL_GENERIC(&index->hosts), NULL);
+	cherokee_avl_mrproper (AVL_GENERIC(&index->nicks), NULL);
+
+	if (index->wildcards != NULL) {
+		node_free (index->wildcards);
+		index->wildcards = NULL;
+	}
+
+	if (index->vservers != NULL) {
+		free (index->vservers);
+		index->vservers = NULL;
+	}
+
+	if (index->opaque != NULL) {
+		free (index->opaque);
+		index->opaque = NULL;
+	}
+
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_vserver_index_add_domain (cherokee_vserver_index_t *index,
+				   cherokee_buffer_t        *domain)
+{
+	ret_t  ret;
+	void  *foo;
+
+	/* Keep the first vserver: it has the highest priority
+	 */
+	ret = cherokee_avl_get (&index->hosts, domain, &foo);
+	if (ret == ret_ok) {
+		return ret_ok;
+	}
+
+	TRACE (ENTRIES, "Domain '%s' -> pos=%d\n", domain->buf, index->current);
+	return cherokee_avl_add (&index->hosts, domain, INT_TO_POINTER(index->current + 1));
+}
+
+
+ret_t
+cherokee_vserver_index_add_wildcard (cherokee_vserver_index_t *index,
+				     cherokee_buffer_t        *pattern)
+{
+	ret_t                          ret;
+	char                          *p;
+	char                          *end;
+	char                          *tail;
+	char                          *label;
+	index_pattern_t               *entry;
+	cherokee_buffer_t              key;
+	cherokee_vserver_index_node_t *child;
+	cherokee_vserver_index_node_t *node;
+
+	if (index->wildcards == NULL) {
+		ret = node_new (&index->wildcards);
+		if (unlikely (ret != ret_ok)) return ret;
+	}
+
+	/* Whatever follows the last wild-card character must be the
+	 * end of the host. The complete labels in there are the path
+	 * of the pattern in the trie.
+	 */
+	end  = pattern->buf + pattern->len;
+	tail = pattern->buf;
+
+	for (p = pattern->buf; p < end; p++) {
+		if ((*p == '*') || (*p == '?')) {
+			tail = p + 1;
+		}
+	}
+
+	node = index->wildcards;
+	tail = memchr (tail, '.', end - tail);
+
+	while (tail != NULL) {
+		label = end;
+		while ((label > tail) && (label[-1] != '.')) {
+			label--;
+		}
+
+		cherokee_buffer_fake (&key, label, end - label);
+
+		ret = cherokee_avl_get (&node->children, &key, (void **)&child);
+		if (ret != ret_ok) {
+			ret = node_new (&child);
+			if (unlikely (ret != ret_ok)) return ret;
+
+			ret = cherokee_avl_add (&node->children, &key, child);
+			if (unlikely (ret != ret_ok)) {
+				node_free (child);
+				return ret;
+			}
+		}
+
+		node = child;
+
+		if (label - 1 <= tail) {
+			break;
+		}
+		end = label - 1;
+	}
+
+	/* Store the pattern
+	 */
+	entry = (index_pattern_t *) malloc (sizeof(index_pattern_t));
+	if (unlikely (entry == NULL)) {
+		return ret_nomem;
+	}
+
+	INIT_LIST_HEAD (&entry->listed);
+	cherokee_buffer_init (&entry->pattern);
+	cherokee_buffer_add_buffer (&entry->pattern, pattern);
+	entry->pos = index->current;
+
+	cherokee_list_add_tail (&entry->listed, &node->patterns);
+
+	TRACE (ENTRIES, "Wildcard '%s' -> pos=%d\n", pattern->buf, index->current);
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_vserver_index_build (cherokee_vserver_index_t *index,
+			      cherokee_list_t          *vservers)
+{
+	ret_t                      ret;
+	void                      *foo;
+	cherokee_list_t           *i;
+	cherokee_vrule_t          *vrule;
+	cherokee_virtual_server_t *vserver;
+	size_t                     len      = 0;
+
+	cherokee_list_get_len (vservers, &len);
+
+	index->vservers = (void **) calloc (len + 1, sizeof(void *));
+	index->opaque   = (cuint_t *) calloc (len + 1, sizeof(cuint_t));
+
+	if (unlikely ((index->vservers == NULL) || (index->opaque == NULL))) {
+		return ret_nomem;
+	}
+
+	list_for_each (i, vservers) {
+		vserver = VSERVER(i);
+
+		/* Nicknames: the first one wins as well
+		 */
+		if ((vserver->match_nick) &&
+		    (cherokee_avl_get (&index->nicks, &vserver->name, &foo) != ret_ok))
+		{
+			cherokee_avl_add (&index->nicks, &vserver->name, vserver);
+		}
+
+		/* Virtual server rules
+		 */
+		vrule = vserver->matching;
+		if (vrule == NULL) {
+			continue;
+		}
+
+		index->current = index->vservers_len;
+		index->vservers[index->vservers_len++] = vserver;
+
+		if (vrule->index_keys != NULL) {
+			ret = vrule->index_keys (vrule, index);
+			if (ret == ret_ok) {
+				continue;
+			} else if (ret != ret_not_found) {
+				return ret;
+			}
+		}
+
+		TRACE (ENTRIES, "Virtual server '%s' (pos=%d) cannot be indexed\n",
+		       vserver->name.buf, index->current);
+
+		index->opaque[index->opaque_len++] = index->current;
+	}
+
+	return ret_ok;
+}
+
+
+static void
+match_wildcards (cherokee_vserver_index_node_t *node,
+		 cherokee_buffer_t             *host,
+		 cuint_t                       *best)
+{
+	ret_t                          ret;
+	cherokee_list_t               *i;
+	char                          *end;
+	char                          *label;
+	cherokee_buffer_t              key;
+	cherokee_vserver_index_node_t *child;
+
+	end = host->buf + host->len;
+
+	while (node != NULL) {
+		/* Patterns reachable with the labels walked so far
+		 */
+		list_for_each (i, &node->patterns) {
+			index_pattern_t *entry = (index_pattern_t *)i;
+
+			if (entry->pos >= *best)
+				continue;
+
+			ret = cherokee_wildcard_match (entry->pattern.buf, host->buf);
+			if (ret == ret_ok) {
+				*best = entry->pos;
+			}
+		}
+
+		/* Next label, from right to left
+		 */
+		if (end == NULL) {
+			break;
+		}
+
+		label = end;
+		while ((label > host->buf) && (label[-1] != '.')) {
+			label--;
+		}
+
+		cherokee_buffer_fake (&key, label, end - label);
+
+		ret = cherokee_avl_get (&node->children, &key, (void **)&child);
+		if (ret != ret_ok) {
+			break;
+		}
+
+		node = child;
+		end  = (label > host->buf) ? label - 1 : NULL;
+	}
+}
+
+
+static cherokee_vserver_index_slot_t *
+cache_slot (cherokee_vserver_index_cache_t *cache,
+	    cherokee_buffer_t              *host)
+{
+	cuint_t  n;
+	cuint_t  hash = 2166136261u;
+
+	/* FNV-1a */
+	for (n = 0; n < host->len; n++) {
+		hash = (hash ^ (unsigned char) host->buf[n]) * 16777619u;
+	}
+
+	return &cache->slots[hash % CHEROKEE_VSERVER_INDEX_CACHE];
+}
+
+
+ret_t
+cherokee_vserver_index_get (cherokee_vserver_index_t       *index,
+			    cherokee_vserver_index_cache_t *cache,
+			    cherokee_buffer_t              *host,
+			    void                           *conn,
+			    void                          **vserver,
+			    cherokee_boolean_t             *cacheable)
+{
+	ret_t                          ret;
+	cuint_t                        n;
+	void                          *val;
+	cherokee_boolean_t             fixed     = true;
+	cherokee_vserver_index_slot_t *slot      = NULL;
+	cuint_t                        best      = NO_POS;
+
+	/* Whether the result depends on the host only
+	 */
+	if (cacheable == NULL) {
+		cacheable = &fixed;
+	}
+	*cacheable = true;
+
+	/* Recently seen hosts
+	 */
+	if (cache != NULL) {
+		slot = cache_slot (cache, host);
+
+		if ((slot->vserver != NULL) &&
+		    (cherokee_buffer_cmp_buf (&slot->host, host) == 0))
+		{
+			TRACE (ENTRIES, "Host '%s' found in the cache\n", host->buf);
+			*vserver = slot->vserver;
+			return ret_ok;
+		}
+	}
+
+	/* Exact domain
+	 */
+	ret = cherokee_avl_get (&index->hosts, host, &val);
+	if (ret == ret_ok) {
+		best = POINTER_TO_INT(val) - 1;
+	}
+
+	/* Wild-cards
+	 */
+	if (index->wildcards != NULL) {
+		match_wildcards (index->wildcards, host, &best);
+	}
+
+	/* The vrules that could not be indexed are evaluated in order,
+	 * as long as they have a higher priority than the best match.
+	 * Their result may depend on the connection, so it cannot be
+	 * cached.
+	 */
+	for (n = 0; n < index->opaque_len; n++) {
+		cherokee_virtual_server_t *vsrv = index->vservers[index->opaque[n]];
+
+		if (index->opaque[n] >= best) {
+			break;
+		}
+
+		*cacheable = false;
+
+		ret = cherokee_vrule_match (vsrv->matching, host, conn);
+		if (ret == ret_ok) {
+			TRACE (ENTRIES, "Virtual server '%s' matched vrule\n", vsrv->name.buf);
+			*vserver = vsrv;
+			return ret_ok;
+		}
+	}
+
+	if (best != NO_POS) {
+		*vserver = index->vservers[best];
+		TRACE (ENTRIES, "Virtual server '%s' matched the index\n", VSERVER(*vserver)->name.buf);
+		goto out;
+	}
+
+	/* In case there was no match, try with the nicknames
+	 */
+	ret = cherokee_avl_get (&index->nicks, host, vserver);
+	if (ret == ret_ok) {
+		TRACE (ENTRIES, "Virtual server '%s' matched by its nick\n", VSERVER(*vserver)->name.buf);
+		goto out;
+	}
+
+	return ret_not_found;
+
+out:
+	if ((slot != NULL) && (*cacheable)) {
+		cherokee_buffer_clean      (&slot->host);
+		cherokee_buffer_add_buffer (&slot->host, host);
+		slot->vserver = *vserver;
+	}
+
+	return ret_ok;
+}
+
+
+/* Cache
+ */
+
+ret_t
+cherokee_vserver_index_cache_init (cherokee_vserver_index_cache_t *cache)
+{
+	cuint_t n;
+
+	for (n = 0; n < CHEROKEE_VSERVER_INDEX_CACHE; n++) {
+		cherokee_buffer_init (&cache->slots[n].host);
+		cache->slots[n].vserver = NULL;
+	}
+
+	return ret_ok;
+}
+
+
+ret_t
+cherokee_vserver_index_cache_mrproper (cherokee_vserver_index_cache_t *cache)
+{
+	cuint_t n;
+
+	for (n = 0; n < CHEROKEE_VSERVER_INDEX_CACHE; n++) {
+		cherokee_buffer_mrproper (&cache->slots[n].host);
+		cache->slots[n].vserver = NULL;
+	}
+
+	return ret_ok;
+}
@@ -0,0 +1,95 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+
+/* Cherokee
+ *
+ * Authors:
+ *      Alvaro Lopez Ortega <alvaro@alobbs.com>
+ *
+ * Copyright (C) 2001-2011 Alvaro Lopez Ortega
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#if !defined (CHEROKEE_INSIDE_CHEROKEE_H) && !defined (CHEROKEE_COMPILATION)
+# error "Only <cherokee/cherokee.h> can be included directly, this file may disappear or change contents."
+#endif
+
+#ifndef CHEROKEE_VSERVER_INDEX_H
+#define CHEROKEE_VSERVER_INDEX_H
+
+#include <cherokee/common.h>
+#include <cherokee/avl.h>
+#include <cherokee/buffer.h>
+#include <cherokee/list.h>
+
+CHEROKEE_BEGIN_DECLS
+
+#define CHEROKEE_VSERVER_INDEX_CACHE 64
+
+/* Index of the virtual servers, by the Host they serve. Exact
+ * domains go to a table, wild-cards to a trie of reversed labels,
+ * and the vrules that cannot be indexed are evaluated in order.
+ */
+typedef struct cherokee_vserver_index_node cherokee_vserver_index_node_t;
+
+typedef struct {
+	cherokee_avl_t                  hosts;
+	cherokee_avl_t                  nicks;
+	cherokee_vserver_index_node_t  *wildcards;
+
+	void                          **vservers;
+	cuint_t                         vservers_len;
+	cuint_t                        *opaque;
+	cuint_t                         opaque_len;
+	cuint_t                         current;
+} cherokee_vserver_index_t;
+
+/* Per-thread cache of the latest Host lookups
+ */
+typedef struct {
+	cherokee_buffer_t  host;
+	void              *vserver;
+} cherokee_vserver_index_slot_t;
+
+typedef struct {
+	cherokee_vserver_index_slot_t slots[CHEROKEE_VSERVER_INDEX_CACHE];
+} cherokee_vserver_index_cache_t;
+
+#define VSERVER_INDEX(x) ((cherokee_vserver_index_t *)(x))
+
+ret_t cherokee_vserver_index_init     (cherokee_vserver_index_t *index);
+ret_t cherokee_vserver_index_mrproper (cherokee_vserver_index_t *index);
+ret_t cherokee_vserver_index_build    (cherokee_vserver_index_t *index, cherokee_list_t *vservers);
+
+ret_t cherokee_vserver_index_get      (cherokee_vserver_index_t       *index,
+				       cherokee_vserver_index_cache_t *cache,
+				       cherokee_buffer_t              *host,
+				       void                           *conn,
+				       void                          **vserver,
+				       cherokee_boolean_t             *cacheable);
+
+/* Index keys, reported by the vrules
+ */
+ret_t cherokee_vserver_index_add_domain   (cherokee_vserver_index_t *index, cherokee_buffer_t *domain);
+ret_t cherokee_vserver_index_add_wildcard (cherokee_vserver_index_t *index, cherokee_buffer_t *pattern);
+
+/* Cache
+ */
+ret_t cherokee_vserver_index_cache_init     (cherokee_vserver_index_cache_t *cache);
+ret_t cherokee_vserver_index_cache_mrproper (cherokee_vserver_index_cache_t *cache);
+
+CHEROKEE_END_DECLS
+
+#endif /* CHEROKEE_VSERVER_INDEX_H */
@@ -0,0 +1,27 @@
+from base import *
+
+DIR    = "299-Traffic-shaping"
+MAGIC  = "The last bytes of a traffic shaped response"
+LENGTH = 16 * 1024
+RATE   = 8 * 1024
+
+CONF = """
+vserver!1!rule!2990!match = directory
+vserver!1!rule!2990!match!directory = /%(DIR)s
+vserver!1!rule!2990!handler = file
+vserver!1!rule!2990!rate = %(RATE)d
+""" % (globals())
+
+class Test (TestBase):
+    def __init__ (self):
+        TestBase.__init__ (self, __file__)
+        self.name             = "Traffic shaping: wake-up"
+        self.request          = "GET /%s/file HTTP/1.0\r\n" % (DIR) + \
+                                "Connection: Close\r\n"
+        self.expected_error   = 200
+        self.expected_content = ["Content-Length: %d" % (LENGTH + len(MAGIC)), MAGIC]
+        self.conf             = CONF
+
+    def Prepare (self, www):
+        d = self.Mkdir (www, DIR)
+        self.WriteFile (d, "file", 0444, "x" * LENGTH + MAGIC)
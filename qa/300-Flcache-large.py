@@ -0,0 +1,61 @@
+import itertools
+from base import *
+
+DIR     = "flcache-large1"
+LENGTH  = 200 * 1024
+MAGIC   = "Large objects are sent from the cache file"
+CONTENT = (letters_random (LENGTH - len(MAGIC))) + MAGIC
+
+CONF = """
+vserver!1!rule!3000!match = directory
+vserver!1!rule!3000!match!directory = /%(DIR)s
+vserver!1!rule!3000!handler = file
+vserver!1!rule!3000!flcache = 1
+vserver!1!rule!3000!flcache!policy = all_but_forbidden
+""" %(globals())
+
+
+class TestEntry (TestBase):
+    def __init__ (self, filename):
+        TestBase.__init__ (self, __file__)
+        self.request        = "GET /%s/%s HTTP/1.0\r\n" %(DIR, filename) +\
+                              "Connection: close\r\n"
+        self.expected_error = 200
+
+
+class Test (TestCollection):
+    counter = itertools.count()
+
+    def __init__ (self):
+        TestCollection.__init__ (self, __file__)
+
+        self.name           = "Front-line cache: large object"
+        self.conf           = CONF
+        self.proxy_suitable = True
+        self.delay          = 1
+
+    def JustBefore (self, www):
+        test_num = Test.counter.next()
+        self.filename = "test300-id%s-test%s" %(id(self), test_num)
+
+        # Write the new file
+        self.WriteFile (self.local_dir, self.filename, 0444, CONTENT)
+
+        # Create sub-request objects
+        self.Empty()
+
+        obj = self.Add (TestEntry (self.filename))
+        obj.expected_content = ['X-Cache: MISS', MAGIC]
+
+        obj = self.Add (TestEntry (self.filename))
+        obj.expected_content = ['X-Cache: HIT', 'Content-Length: %d' %(LENGTH), CONTENT]
+
+    def JustAfter (self, www):
+        # Clean up the local file
+        fp = os.path.join (self.local_dir, self.filename)
+        os.unlink (fp)
+        self.filename = None
+
+    def Prepare (self, www):
+        # Create the directory
+        self.local_dir = self.Mkdir (www, DIR)
@@ -0,0 +1,128 @@
+import time
+import itertools
+import threading
+from base import *
+
+DIR    = "flcache-stale1"
+DOMAIN = "domain_301"
+
+CONF = """
+vserver!301!nick = %(DOMAIN)s
+vserver!301!document_root = %(droot)s
+vserver!301!flcache!stale_grace = 60
+
+vserver!301!rule!10!match = directory
+vserver!301!rule!10!match!directory = /%(DIR)s
+vserver!301!rule!10!handler = cgi
+vserver!301!rule!10!flcache = 1
+
+vserver!301!rule!1!match = default
+vserver!301!rule!1!handler = file
+"""
+
+# The first response expires right away, the revalidation is slow
+CGI_CODE = """#!/bin/sh
+
+echo "Content-Type: text/plain"
+
+if [ -f %(stamp)s ]; then
+    sleep 2
+    echo "Cache-Control: max-age=60"
+    echo
+    echo "Second version"
+else
+    touch %(stamp)s
+    echo "Cache-Control: max-age=1"
+    echo
+    echo "First version"
+fi
+"""
+
+class TestEntry (TestBase):
+    def __init__ (self, filename):
+        TestBase.__init__ (self, __file__)
+        self.request        = "GET /%s/%s HTTP/1.0\r\n" %(DIR, filename) +\
+                              "Host: %s\r\n" %(DOMAIN) +\
+                              "Connection: close\r\n"
+        self.expected_error = 200
+
+
+class Test (TestCollection):
+    counter = itertools.count()
+
+    def __init__ (self):
+        TestCollection.__init__ (self, __file__)
+
+        self.name           = "Front-line cache: stale while revalidate"
+        self.proxy_suitable = False
+
+    def Prepare (self, www):
+        droot = self.Mkdir (www, 'flcache_301')
+        self.local_dir = self.Mkdir (droot, DIR)
+
+        vars = globals()
+        vars['droot'] = droot
+        self.conf = CONF %(vars)
+
+    def JustBefore (self, www):
+        test_num = Test.counter.next()
+        self.filename = "test301-id%s-test%s" %(id(self), test_num)
+        self.stamp    = os.path.join (self.local_dir, self.filename + '.stamp')
+
+        # Write the new file
+        self.WriteFile (self.local_dir, self.filename, 0755, CGI_CODE %({'stamp': self.stamp}))
+
+        # Create sub-request objects
+        self.Empty()
+
+        obj = self.Add (TestEntry (self.filename))
+        obj.expected_content = ['X-Cache: MISS', 'First version']
+
+        obj = self.Add (TestEntry (self.filename))
+        obj.expected_content = ['X-Cache: MISS', 'Second version']
+
+        obj = self.Add (TestEntry (self.filename))
+        obj.expected_content = ['X-Cache: HIT', 'Warning: 110', 'First version']
+
+        obj = self.Add (TestEntry (self.filename))
+        obj.expected_content  = ['X-Cache: HIT', 'Second version']
+        obj.forbidden_content = ['Warning:']
+
+    def JustAfter (self, www):
+        # Clean up the local files
+        os.unlink (os.path.join (self.local_dir, self.filename))
+        os.unlink (self.stamp)
+        self.filename = None
+
+    def Run (self, host, port, ssl):
+        first, revalidation, stale, fresh = self.tests
+
+        # Cache it, and let it expire
+        self.current_test = first
+        if first.Run (host, port, ssl) == -1:
+            return -1
+
+        time.sleep (2.5)
+
+        # Revalidate it, while the stale copy is served
+        result = []
+        thread = threading.Thread (target = lambda: result.append (revalidation.Run (host, port, ssl)))
+        thread.start()
+        time.sleep (0.5)
+
+        self.current_test = stale
+        r = stale.Run (host, port, ssl)
+        thread.join()
+
+        if r == -1:
+            return -1
+
+        self.current_test = revalidation
+        if result != [0]:
+            return -1
+
+        # The new version replaced it
+        time.sleep (0.5)
+
+        self.current_test = fresh
+        return fresh.Run (host, port, ssl)
@@ -0,0 +1,107 @@
+import time
+import itertools
+import threading
+from base import *
+
+DIR    = "flcache-coalesce1"
+DOMAIN = "domain_302"
+
+CONF = """
+vserver!302!nick = %(DOMAIN)s
+vserver!302!document_root = %(droot)s
+
+vserver!302!rule!10!match = directory
+vserver!302!rule!10!match!directory = /%(DIR)s
+vserver!302!rule!10!handler = cgi
+vserver!302!rule!10!flcache = 1
+
+vserver!302!rule!1!match = default
+vserver!302!rule!1!handler = file
+"""
+
+# Slow back-end: it tells whether it was called more than once
+CGI_CODE = """#!/bin/sh
+
+echo "Content-Type: text/plain"
+echo "Cache-Control: max-age=60"
+echo
+
+if [ -f %(stamp)s ]; then
+    echo "Second back-end request"
+else
+    touch %(stamp)s
+    sleep 2
+    echo "First back-end request"
+fi
+"""
+
+class TestEntry (TestBase):
+    def __init__ (self, filename):
+        TestBase.__init__ (self, __file__)
+        self.request        = "GET /%s/%s HTTP/1.0\r\n" %(DIR, filename) +\
+                              "Host: %s\r\n" %(DOMAIN) +\
+                              "Connection: close\r\n"
+        self.expected_error = 200
+
+
+class Test (TestCollection):
+    counter = itertools.count()
+
+    def __init__ (self):
+        TestCollection.__init__ (self, __file__)
+
+        self.name           = "Front-line cache: request coalescing"
+        self.proxy_suitable = False
+
+    def Prepare (self, www):
+        droot = self.Mkdir (www, 'flcache_302')
+        self.local_dir = self.Mkdir (droot, DIR)
+
+        vars = globals()
+        vars['droot'] = droot
+        self.conf = CONF %(vars)
+
+    def JustBefore (self, www):
+        test_num = Test.counter.next()
+        self.filename = "test302-id%s-test%s" %(id(self), test_num)
+        self.stamp    = os.path.join (self.local_dir, self.filename + '.stamp')
+
+        # Write the new file
+        self.WriteFile (self.local_dir, self.filename, 0755, CGI_CODE %({'stamp': self.stamp}))
+
+        # Create sub-request objects
+        self.Empty()
+
+        obj = self.Add (TestEntry (self.filename))
+        obj.expected_content = ['X-Cache: MISS', 'First back-end request']
+
+        obj = self.Add (TestEntry (self.filename))
+        obj.expected_content = ['X-Cache: HIT', 'First back-end request']
+
+    def JustAfter (self, www):
+        # Clean up the local files
+        os.unlink (os.path.join (self.local_dir, self.filename))
+        os.unlink (self.stamp)
+        self.filename = None
+
+    def Run (self, host, port, ssl):
+        first, waiting = self.tests
+
+        # The second request arrives while the first one is cached
+        result = []
+        thread = threading.Thread (target = lambda: result.append (first.Run (host, port, ssl)))
+        thread.start()
+        time.sleep (0.5)
+
+        self.current_test = waiting
+        r = waiting.Run (host, port, ssl)
+        thread.join()
+
+        if r == -1:
+            return -1
+
+        self.current_test = first
+        if result != [0]:
+            return -1
+
+        return 0
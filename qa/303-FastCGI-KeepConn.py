@@ -0,0 +1,93 @@
+import re
+from base import *
+
+DIR    = "/FCGI-KeepConn/"
+MAGIC  = "FastCGI connections are kept alive"
+PORT   = get_free_port()
+PYTHON = look_for_python()
+
+REQUESTS = 5
+
+SCRIPT = """
+import threading
+from fcgi import *
+
+lock  = threading.Lock()
+local = threading.local()
+stats = {'conns': 0, 'reqs': 0}
+
+def app (environ, start_response):
+    # Requests are handled by the thread of their connection
+    lock.acquire()
+    if not hasattr (local, 'seen'):
+        local.seen = True
+        stats['conns'] += 1
+    stats['reqs'] += 1
+    lock.release()
+
+    start_response('200 OK', [("Content-Type", "text/plain")])
+    return ['%s conns=%%(conns)d reqs=%%(reqs)d' %% (stats)]
+
+WSGIServer(app, bindAddress=("localhost",%d)).run()
+""" % (MAGIC, PORT)
+
+source = get_next_source()
+
+CONF = """
+vserver!1!rule!3030!match = directory
+vserver!1!rule!3030!match!directory = %(DIR)s
+vserver!1!rule!3030!handler = fcgi
+vserver!1!rule!3030!handler!check_file = 0
+vserver!1!rule!3030!handler!reuse_max = 4
+vserver!1!rule!3030!handler!balancer = round_robin
+vserver!1!rule!3030!handler!balancer!source!1 = %(source)d
+
+source!%(source)d!type = interpreter
+source!%(source)d!host = localhost:%(PORT)d
+source!%(source)d!interpreter = %(PYTHON)s %(fcgi_file)s
+"""
+
+
+class TestEntry (TestBase):
+    def __init__ (self):
+        TestBase.__init__ (self, __file__)
+        self.request          = "GET %s HTTP/1.0\r\n" %(DIR)
+        self.expected_error   = 200
+        self.expected_content = [MAGIC]
+
+
+class TestReuse (TestEntry):
+    def CustomTest (self):
+        # Requests must have been served over fewer connections
+        tmp = re.findall (r'conns=(\d+) reqs=(\d+)', self.reply)
+        if not tmp:
+            return -1
+
+        conns, reqs = map (int, tmp[0])
+        if conns >= reqs:
+            return -1
+        return 0
+
+
+class Test (TestCollection):
+    def __init__ (self):
+        TestCollection.__init__ (self, __file__)
+        self.name = "FastCGI: Kept-alive connections"
+
+    def JustBefore (self, www):
+        self.Empty()
+
+        for n in range(REQUESTS):
+            self.Add (TestEntry())
+        self.Add (TestReuse())
+
+    def Prepare (self, www):
+        fcgi_file = self.WriteFile (www, "fcgi_test_keepconn.fcgi", 0444, SCRIPT)
+
+        fcgi = os.path.join (www, 'fcgi.py')
+        if not os.path.exists (fcgi):
+            self.CopyFile ('fcgi.py', fcgi)
+
+        vars = globals()
+        vars['fcgi_file'] = fcgi_file
+        self.conf = CONF % (vars)
@@ -0,0 +1,104 @@
+import os
+import time
+import random
+from base import *
+
+DIR     = "iocache_inotify_1"
+MAGIC1  = "First version of the file."
+MAGIC2  = "Second version of the file"
+DELAY   = 0.5
+
+class TestFirst (TestBase):
+    def __init__ (self):
+        TestBase.__init__ (self, __file__)
+        self.expected_error   = 200
+        self.expected_content = MAGIC1
+
+class TestModified (TestBase):
+    def __init__ (self):
+        TestBase.__init__ (self, __file__)
+        self.expected_error    = 200
+        self.expected_content  = MAGIC2
+        self.forbidden_content = MAGIC1
+
+    def Run (self, host, port, ssl):
+        f = open (self.path, 'w')
+        f.write (MAGIC2)
+        f.close()
+
+        time.sleep (DELAY)
+        return TestBase.Run (self, host, port, ssl)
+
+class TestRemoved (TestBase):
+    def __init__ (self):
+        TestBase.__init__ (self, __file__)
+        self.expected_error = 404
+
+    def Run (self, host, port, ssl):
+        os.unlink (self.path)
+
+        time.sleep (DELAY)
+        return TestBase.Run (self, host, port, ssl)
+
+
+class TestRepointed (TestBase):
+    def __init__ (self):
+        TestBase.__init__ (self, __file__)
+        self.expected_error    = 200
+        self.expected_content  = MAGIC2
+        self.forbidden_content = MAGIC1
+
+    def Run (self, host, port, ssl):
+        # Atomically re-point the symbolic link to the other directory
+        tmp = self.link + '.new'
+        os.symlink (self.target, tmp)
+        os.rename (tmp, self.link)
+
+        time.sleep (DELAY)
+        return TestBase.Run (self, host, port, ssl)
+
+
+class Test (TestCollection):
+    def __init__ (self):
+        TestCollection.__init__ (self, __file__)
+        self.name = "I/O cache: inotify invalidation"
+
+    def Precondition (self):
+        # Only when the suite runs with -i
+        if not self.inotify:
+            return False
+
+        return os.uname()[0] == 'Linux'
+
+    def Prepare (self, www):
+        self.Mkdir (www, DIR)
+
+        self.Add (TestFirst())
+        self.Add (TestModified())
+        self.Add (TestRemoved())
+
+        self.Add (TestFirst())
+        self.Add (TestRepointed())
+
+    def JustBefore (self, www):
+        # Every run works on a file of its own
+        name = "file_%d.txt" %(random.randint(0, 1<<30))
+        path = self.WriteFile (os.path.join (www, DIR), name, 0644, MAGIC1)
+
+        for t in self.tests[:3]:
+            t.path    = path
+            t.request = "GET /%s/%s HTTP/1.0\r\n" %(DIR, name)
+
+        # A link to a directory, re-pointed to another one
+        base = os.path.join (www, DIR, name[:-4])
+        for n, magic in enumerate ([MAGIC1, MAGIC2]):
+            os.mkdir (base + '_v%d' %(n))
+            self.WriteFile (base + '_v%d' %(n), 'file.txt', 0644, magic)
+
+        link = base + '_current'
+        os.symlink (base + '_v0', link)
+
+        for t in self.tests[3:]:
+            t.link    = link
+            t.target  = base + '_v1'
+            t.request = "GET /%s/%s/file.txt HTTP/1.0\r\n" %(DIR, os.path.basename(link))
@@ -0,0 +1,53 @@
+from base import *
+from util import *
+
+LENGTH = 300*1024
+FILE   = "SendfileCachedFd"
+
+CONF = """
+server!iocache!max_fds = 64
+"""
+
+RANGES = [(None, None),
+          (1000,  None),
+          (5000,  200000),
+          (None,  None)]
+
+class TestRange (TestBase):
+    def __init__ (self, content, start, end):
+        TestBase.__init__ (self, __file__)
+
+        if start == None:
+            self.request        = "GET /%s HTTP/1.0\r\n" %(FILE)
+            self.expected_error = 200
+            body = content
+        else:
+            if end == None:
+                rng  = "%d-" %(start)
+                body = content[start:]
+            else:
+                rng  = "%d-%d" %(start, end)
+                body = content[start:end+1]
+
+            self.request        = "GET /%s HTTP/1.0\r\n" %(FILE) +\
+                                  "Range: bytes=%s\r\n" %(rng)
+            self.expected_error = 206
+
+        self.body = body
+
+
+class Test (TestCollection):
+    def __init__ (self):
+        TestCollection.__init__ (self, __file__)
+        self.name = "Sendfile: shared cached descriptor"
+        self.conf = CONF
+
+    def Prepare (self, www):
+        content = letters_random (LENGTH)
+        self.WriteFile (www, FILE, 0444, content)
+
+        for start, end in RANGES:
+            t = self.Add (TestRange (content, start, end))
+
+            tmpfile = t.WriteTemp (t.body)
+            t.expected_content = ["file:"+tmpfile, "Content-Length: %d" %(len(t.body))]
@@ -0,0 +1,102 @@
+import time
+from base import *
+from util import *
+
+from cStringIO import StringIO
+from gzip import GzipFile
+
+DIR_STATIC = "gzip_variants_static"
+DIR_CACHE  = "gzip_variants_cache"
+MAGIC      = "Plain file: " + str_random (10 * 1024)
+MAGIC_GZ   = "Precompressed copy: " + str_random (1024)
+
+CONF = """
+vserver!1!rule!3060!match = directory
+vserver!1!rule!3060!match!directory = /%(DIR_STATIC)s
+vserver!1!rule!3060!handler = file
+vserver!1!rule!3060!handler!gzip_static = 1
+vserver!1!rule!3060!encoder!gzip = allow
+
+vserver!1!rule!3061!match = directory
+vserver!1!rule!3061!match!directory = /%(DIR_CACHE)s
+vserver!1!rule!3061!handler = file
+vserver!1!rule!3061!handler!gzip_cache = 1
+vserver!1!rule!3061!encoder!gzip = allow
+""" %(globals())
+
+
+def gzip_str (s):
+    out = StringIO()
+    f = GzipFile ('', 'w', 9, out)
+    f.write (s)
+    f.close()
+    return out.getvalue()
+
+
+class TestVariant (TestBase):
+    def __init__ (self, url, expected, streamed=False):
+        TestBase.__init__ (self, __file__)
+        self.request           = "GET %s HTTP/1.0\r\n" %(url) +\
+                                 "Accept-Encoding: gzip\r\n"
+        self.expected_error    = 200
+        self.expected_content  = ["Content-Encoding: gzip", "Content-Length: "]
+        self.forbidden_content = MAGIC
+        self.expected_body     = expected
+
+        # Compressed on the fly
+        if streamed:
+            self.expected_content  = ["Content-Encoding: gzip"]
+            self.forbidden_content = [MAGIC, "Content-Length: "]
+
+    def CustomTest (self):
+        body_gz = self.reply[self.reply.find("\r\n\r\n")+4:]
+        body = GzipFile('','r',0,StringIO(body_gz)).read()
+
+        if body != self.expected_body:
+            return -1
+        return 0
+
+
+class TestIdentity (TestBase):
+    def __init__ (self, url):
+        TestBase.__init__ (self, __file__)
+        self.request           = "GET %s HTTP/1.0\r\n" %(url)
+        self.expected_error    = 200
+        self.expected_content  = MAGIC
+        self.forbidden_content = "Content-Encoding"
+
+
+class TestWait (TestBase):
+    def __init__ (self, secs):
+        TestBase.__init__ (self, __file__)
+        self.secs = secs
+
+    def Run (self, host, port, ssl):
+        time.sleep (self.secs)
+        return 0
+
+
+class Test (TestCollection):
+    def __init__ (self):
+        TestCollection.__init__ (self, __file__)
+        self.name = "GZip: precompressed and cached variants"
+        self.conf = CONF
+
+    def Prepare (self, www):
+        d = self.Mkdir (www, DIR_STATIC)
+        self.WriteFile (d, "file.txt", 0444, MAGIC)
+        self.WriteFile (d, "file.txt.gz", 0444, gzip_str (MAGIC_GZ))
+
+        d = self.Mkdir (www, DIR_CACHE)
+        self.WriteFile (d, "file.txt", 0444, MAGIC)
+
+        # Sibling .gz file
+        self.Add (TestVariant  ("/%s/file.txt" %(DIR_STATIC), MAGIC_GZ))
+        self.Add (TestIdentity ("/%s/file.txt" %(DIR_STATIC)))
+
+        # Compressed on the fly while the copy is built, then reused
+        self.Add (TestVariant  ("/%s/file.txt" %(DIR_CACHE), MAGIC, streamed=True))
+        self.Add (TestWait     (1))
+        self.Add (TestVariant  ("/%s/file.txt" %(DIR_CACHE), MAGIC))
+        self.Add (TestVariant  ("/%s/file.txt" %(DIR_CACHE), MAGIC))
+        self.Add (TestIdentity ("/%s/file.txt" %(DIR_CACHE)))
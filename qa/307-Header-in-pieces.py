@@ -0,0 +1,38 @@
+from base import *
+from util import *
+
+DIR    = "header_pieces1"
+COOKIE = "session=%s; prefs=%s" %(letters_random (4000), letters_random (2000))
+AGENT  = "Mozilla/5.0 (X11; Linux x86_64) " + letters_random (100)
+
+CONF = """
+vserver!1!rule!3070!match = directory
+vserver!1!rule!3070!match!directory = /%s
+vserver!1!rule!3070!handler = cgi
+""" %(DIR)
+
+CGI_BASE = """#!/bin/sh
+echo "Content-Type: text/plain"
+echo
+echo "Cookie: $HTTP_COOKIE"
+echo "Agent: $HTTP_USER_AGENT"
+"""
+
+class Test (TestBase):
+    def __init__ (self):
+        TestBase.__init__ (self, __file__)
+        self.name = "Request header received in pieces"
+
+        self.request          = "GET /%s/test HTTP/1.0\r\n" %(DIR) +\
+                                "User-Agent: %s\r\n" %(AGENT) +\
+                                "Cookie: %s\r\n" %(COOKIE) +\
+                                "X-Custom: First part\r\n" +\
+                                " folded second part\n"
+        self.request_chunk    = 113
+        self.conf             = CONF
+        self.expected_error   = 200
+        self.expected_content = ["Cookie: "+COOKIE, "Agent: "+AGENT]
+
+    def Prepare (self, www):
+        self.Mkdir (www, DIR)
+        self.WriteFile (www, "%s/test"%(DIR), 0755, CGI_BASE)
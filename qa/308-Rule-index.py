@@ -0,0 +1,85 @@
+from base import *
+
+DOMAIN = "rule-index-308"
+
+CONF = """
+vserver!308!nick = %(DOMAIN)s
+vserver!308!document_root = /dev/null
+vserver!308!match = wildcard
+vserver!308!match!domain!1 = %(DOMAIN)s
+
+vserver!308!rule!1!match = default
+vserver!308!rule!1!handler = custom_error
+vserver!308!rule!1!handler!error = 406
+
+vserver!308!rule!4!match = directory
+vserver!308!rule!4!match!directory = /idx
+vserver!308!rule!4!handler = custom_error
+vserver!308!rule!4!handler!error = 405
+
+vserver!308!rule!5!match = extensions
+vserver!308!rule!5!match!extensions = idx1,idx2,tar.idx3
+vserver!308!rule!5!handler = custom_error
+vserver!308!rule!5!handler!error = 409
+
+vserver!308!rule!6!match = directory
+vserver!308!rule!6!match!directory = /idx/dir
+vserver!308!rule!6!match!final = 0
+vserver!308!rule!6!handler = custom_error
+vserver!308!rule!6!handler!error = 403
+
+vserver!308!rule!7!match = request
+vserver!308!rule!7!match!request = ^/idx/(re)/\\1$
+vserver!308!rule!7!handler = custom_error
+vserver!308!rule!7!handler!error = 412
+
+vserver!308!rule!8!match = request
+vserver!308!rule!8!match!request = ^/idx/re/.*\\?q=1$
+vserver!308!rule!8!handler = custom_error
+vserver!308!rule!8!handler!error = 411
+
+vserver!308!rule!9!match = request
+vserver!308!rule!9!match!request = ^/idx/re/(one|two)$
+vserver!308!rule!9!handler = custom_error
+vserver!308!rule!9!handler!error = 410
+"""
+
+REQUESTS = [
+    ("/idx/",              405),
+    ("/idx/sub/file",      405),
+    ("/idxfoo",            406),
+    ("/idx/dir/file",      403),
+    ("/idx/dir/a.idx1",    403),
+    ("/idx/dirfoo/a.idx1", 409),
+    ("/other/a.idx2",      409),
+    ("/other/a.idx2/info", 409),
+    ("/other/a.tar.idx1",  409),
+    ("/other/a.tar.idx3",  409),
+    ("/other/a.idx3",      406),
+    ("/idx/re/one",        410),
+    ("/idx/re/two",        410),
+    ("/idx/re/three",      405),
+    ("/idx/re/three?q=1",  411),
+    ("/idx/re/re",         412),
+]
+
+class TestEntry (TestBase):
+    def __init__ (self, url, error):
+        TestBase.__init__ (self, __file__)
+        self.request        = "GET %s HTTP/1.0\r\n" %(url) + \
+                              "Host: %s\r\n" %(DOMAIN)
+        self.expected_error = error
+
+class Test (TestCollection):
+    def __init__ (self):
+        TestCollection.__init__ (self, __file__)
+
+        self.name = "Rule index: same result as ordered evaluation"
+        self.conf = CONF %(globals())
+
+    def Prepare (self, www):
+        for url, error in REQUESTS:
+            self.Add (TestEntry (url, error))
+
+        obj = self.Add (TestEntry ("/idx", 301))
+        obj.expected_content = ["Location: http://%s/idx/" %(DOMAIN)]
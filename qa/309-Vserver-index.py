@@ -0,0 +1,78 @@
+from base import *
+
+CONF = """
+vserver!3096!nick = idx309-rehost
+vserver!3096!document_root = /dev/null
+vserver!3096!match = rehost
+vserver!3096!match!regex!1 = ^re\.b\.idx309$
+vserver!3096!rule!1!match = default
+vserver!3096!rule!1!handler = custom_error
+vserver!3096!rule!1!handler!error = 412
+
+vserver!3095!nick = idx309-wildcard-a
+vserver!3095!document_root = /dev/null
+vserver!3095!match = wildcard
+vserver!3095!match!domain!1 = *.a.idx309
+vserver!3095!rule!1!match = default
+vserver!3095!rule!1!handler = custom_error
+vserver!3095!rule!1!handler!error = 410
+
+vserver!3094!nick = idx309-exact
+vserver!3094!document_root = /dev/null
+vserver!3094!match = wildcard
+vserver!3094!match!domain!1 = www.a.idx309
+vserver!3094!match!domain!2 = exact.idx309
+vserver!3094!rule!1!match = default
+vserver!3094!rule!1!handler = custom_error
+vserver!3094!rule!1!handler!error = 411
+
+vserver!3092!nick = idx309-wildcard-b
+vserver!3092!document_root = /dev/null
+vserver!3092!match = wildcard
+vserver!3092!match!domain!1 = *.b.idx309
+vserver!3092!match!domain!2 = x?.idx309
+vserver!3092!rule!1!match = default
+vserver!3092!rule!1!handler = custom_error
+vserver!3092!rule!1!handler!error = 413
+
+vserver!3091!nick = nick.idx309
+vserver!3091!document_root = /dev/null
+vserver!3091!rule!1!match = default
+vserver!3091!rule!1!handler = custom_error
+vserver!3091!rule!1!handler!error = 414
+"""
+
+HOSTS = [
+    ("www.a.idx309",   410),
+    ("exact.idx309",   411),
+    ("re.b.idx309",    412),
+    ("other.b.idx309", 413),
+    ("xy.idx309",      413),
+    ("nick.idx309",    414),
+    ("www.a.idx309",   410),
+    ("re.b.idx309",    412),
+    ("nick.idx309",    414),
+]
+
+class TestEntry (TestBase):
+    def __init__ (self, host, error):
+        TestBase.__init__ (self, __file__)
+        self.request        = "GET / HTTP/1.0\r\n" + \
+                              "Host: %s\r\n" %(host)
+        self.expected_error = error
+
+class Test (TestCollection):
+    def __init__ (self):
+        TestCollection.__init__ (self, __file__)
+
+        self.name = "Virtual server index"
+        self.conf = CONF
+
+    def Prepare (self, www):
+        for host, error in HOSTS:
+            self.Add (TestEntry (host, error))
+
+        # No match: it falls back to the default virtual server
+        obj = self.Add (TestEntry ("none.idx309", 404))
+        obj.request = "GET /idx309-missing HTTP/1.0\r\n" + \
+                      "Host: none.idx309\r\n"
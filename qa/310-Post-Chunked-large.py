@@ -0,0 +1,39 @@
+import hashlib
+from base import *
+
+DIR   = "post_chunked_large_1"
+DATA1 = letters_random (200 * 1024)
+DATA2 = letters_random (50 * 1024)
+
+CONF = """
+vserver!1!rule!3100!match = directory
+vserver!1!rule!3100!match!directory = /%s
+vserver!1!rule!3100!handler = cgi
+""" % (DIR)
+
+CGI_CODE = """#!/bin/sh
+
+echo "Content-Type: text/plain"
+echo
+
+%s -c "import sys,hashlib; s=getattr(sys.stdin,'buffer',sys.stdin); sys.stdout.write('md5:'+hashlib.md5(s.read()).hexdigest())"
+""" % (look_for_python())
+
+class Test (TestBase):
+    def __init__ (self):
+        TestBase.__init__ (self, __file__)
+        self.name = "POST Chunked: large chunks"
+
+        self.request           = "POST /%s/test HTTP/1.0\r\n" % (DIR) +\
+                                 "Content-type: application/octet-stream\r\n" +\
+                                 "Transfer-Encoding: chunked\r\n"
+        self.post              = "%x\r\n%s\r\n" % (len(DATA1), DATA1) +\
+                                 "%x\r\n%s\r\n" % (len(DATA2), DATA2) +\
+                                 "0\r\n\r\n"
+        self.expected_error    = 200
+        self.expected_content  = "md5:" + hashlib.md5 (DATA1 + DATA2).hexdigest()
+        self.conf              = CONF
+
+    def Prepare (self, www):
+        d = self.Mkdir (www, DIR, 0777)
+        self.WriteFile (d, "test", 0555, CGI_CODE)
@@ -0,0 +1,24 @@
+from base import *
+
+DIR    = "/proxy_unresolvable/"
+source = get_next_source()
+
+CONF = """
+vserver!1!rule!3110!match = directory
+vserver!1!rule!3110!match!directory = %(DIR)s
+vserver!1!rule!3110!handler = proxy
+vserver!1!rule!3110!handler!balancer = round_robin
+vserver!1!rule!3110!handler!balancer!source!1 = %(source)d
+
+source!%(source)d!type = host
+source!%(source)d!host = cherokee-qa.invalid:80
+"""
+
+class Test (TestBase):
+    def __init__ (self):
+        TestBase.__init__ (self, __file__)
+        self.name = "Proxy: unresolvable host"
+
+        self.request        = "GET %s HTTP/1.0\r\n" % (DIR)
+        self.expected_error = 503
+        self.conf           = CONF % (globals())
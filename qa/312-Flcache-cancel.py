@@ -0,0 +1,122 @@
+import time
+import itertools
+import threading
+from base import *
+
+DIR    = "flcache-cancel1"
+DOMAIN = "domain_312"
+
+CONF = """
+vserver!312!nick = %(DOMAIN)s
+vserver!312!document_root = %(droot)s
+
+vserver!312!rule!10!match = directory
+vserver!312!rule!10!match!directory = /%(DIR)s
+vserver!312!rule!10!handler = cgi
+vserver!312!rule!10!flcache = 1
+
+vserver!312!rule!1!match = default
+vserver!312!rule!1!handler = file
+"""
+
+# Slow back-end: the first response cannot be cached, the rest can
+CGI_CODE = """#!/bin/sh
+
+echo "Content-Type: text/plain"
+
+if [ -f %(stamp)s.2 ]; then
+    echo "Cache-Control: max-age=60"
+    echo
+    echo "Third back-end request"
+elif [ -f %(stamp)s.1 ]; then
+    touch %(stamp)s.2
+    echo "Cache-Control: max-age=60"
+    echo
+    echo "Second back-end request"
+else
+    touch %(stamp)s.1
+    sleep 2
+    echo "Cache-Control: no-cache"
+    echo
+    echo "First back-end request"
+fi
+"""
+
+class TestEntry (TestBase):
+    def __init__ (self, filename):
+        TestBase.__init__ (self, __file__)
+        self.request        = "GET /%s/%s HTTP/1.0\r\n" %(DIR, filename) +\
+                              "Host: %s\r\n" %(DOMAIN) +\
+                              "Connection: close\r\n"
+        self.expected_error = 200
+
+
+class Test (TestCollection):
+    counter = itertools.count()
+
+    def __init__ (self):
+        TestCollection.__init__ (self, __file__)
+
+        self.name           = "Front-line cache: cancelled while coalescing"
+        self.proxy_suitable = False
+
+    def Prepare (self, www):
+        droot = self.Mkdir (www, 'flcache_312')
+        self.local_dir = self.Mkdir (droot, DIR)
+
+        vars = globals()
+        vars['droot'] = droot
+        self.conf = CONF %(vars)
+
+    def JustBefore (self, www):
+        test_num = Test.counter.next()
+        self.filename = "test312-id%s-test%s" %(id(self), test_num)
+        self.stamp    = os.path.join (self.local_dir, self.filename + '.stamp')
+
+        # Write the new file
+        self.WriteFile (self.local_dir, self.filename, 0755, CGI_CODE %({'stamp': self.stamp}))
+
+        # Create sub-request objects
+        self.Empty()
+
+        obj = self.Add (TestEntry (self.filename))
+        obj.expected_content = ['First back-end request']
+
+        obj = self.Add (TestEntry (self.filename))
+        obj.expected_content = ['X-Cache: MISS', 'Second back-end request']
+
+        obj = self.Add (TestEntry (self.filename))
+        obj.expected_content = ['X-Cache: HIT', 'Second back-end request']
+
+    def JustAfter (self, www):
+        # Clean up the local files
+        os.unlink (os.path.join (self.local_dir, self.filename))
+        for n in (1, 2):
+            if os.path.exists ('%s.%d' %(self.stamp, n)):
+                os.unlink ('%s.%d' %(self.stamp, n))
+        self.filename = None
+
+    def Run (self, host, port, ssl):
+        first, waiting, cached = self.tests
+
+        # The second request is parked on the entry the first one
+        # is storing, and the first response cannot be cached.
+        result = []
+        thread = threading.Thread (target = lambda: result.append (first.Run (host, port, ssl)))
+        thread.start()
+        time.sleep (0.5)
+
+        self.current_test = waiting
+        r = waiting.Run (host, port, ssl)
+        thread.join()
+
+        if r == -1:
+            return -1
+
+        self.current_test = first
+        if result != [0]:
+            return -1
+
+        # The request can be cached again
+        self.current_test = cached
+        return cached.Run (host, port, ssl)
@@ -0,0 +1,126 @@
+import os
+import time
+from base import *
+
+DOMAIN_DROP  = "domain_313_drop"
+DOMAIN_ERROR = "domain_313_error"
+BURST        = 80
+
+# Lines over half a ring wake the flusher up straight away
+PAD          = 'p' * 2100
+
+# The first writer is fed by a reader that takes a line per second
+# until the stamp file shows up, so the pipe and the rings fill up.
+# The second one exits after the first line: the rest of writes fail.
+CONF = """
+vserver!3130!nick = %(DOMAIN_DROP)s
+vserver!3130!document_root = %(droot)s
+vserver!3130!logger = combined
+vserver!3130!logger!access!type = exec
+vserver!3130!logger!access!command = while read -r line; do [ -f %(stamp)s ] || sleep 1; echo "$line"; done > %(log_drop)s
+vserver!3130!logger!access!ring_size = 4096
+vserver!3130!logger!access!overflow = drop
+vserver!3130!rule!1!match = default
+vserver!3130!rule!1!handler = file
+
+vserver!3131!nick = %(DOMAIN_ERROR)s
+vserver!3131!document_root = %(droot)s
+vserver!3131!logger = combined
+vserver!3131!logger!access!type = exec
+vserver!3131!logger!access!command = read -r line; echo "$line" > %(log_error)s
+vserver!3131!logger!access!ring_size = 4096
+vserver!3131!logger!access!overflow = block
+vserver!3131!rule!1!match = default
+vserver!3131!rule!1!handler = file
+"""
+
+class TestEntry (TestBase):
+    def __init__ (self, domain, agent):
+        TestBase.__init__ (self, __file__)
+        self.request        = "GET /file313 HTTP/1.0\r\n" +\
+                              "Host: %s\r\n" %(domain) +\
+                              "User-Agent: %s\r\n" %(agent) +\
+                              "Connection: close\r\n"
+        self.expected_error = 200
+
+
+class Test (TestCollection):
+    def __init__ (self):
+        TestCollection.__init__ (self, __file__)
+
+        self.name           = "Log rings: overflow and write errors"
+        self.proxy_suitable = False
+
+    def Prepare (self, www):
+        droot = self.Mkdir (www, 'log_ring_313')
+        self.WriteFile (droot, 'file313', 0444, 'Log me\n')
+
+        self.stamp     = os.path.join (droot, 'stamp')
+        self.log_drop  = os.path.join (droot, 'drop.log')
+        self.log_error = os.path.join (droot, 'error.log')
+
+        vars = globals()
+        vars['droot']     = droot
+        vars['stamp']     = self.stamp
+        vars['log_drop']  = self.log_drop
+        vars['log_error'] = self.log_error
+        self.conf = CONF %(vars)
+
+    def _request (self, host, port, ssl, domain, agent):
+        self.current_test = self.Add (TestEntry (domain, agent))
+        return self.current_test.Run (host, port, ssl)
+
+    def _wait_log (self, filename, marker):
+        for n in range(100):
+            if os.path.exists (filename):
+                log = open (filename).read()
+                if marker in log:
+                    return log
+            time.sleep (0.1)
+        return None
+
+    def Run (self, host, port, ssl):
+        self.Empty()
+
+        # Every request is answered while the writer cannot keep
+        # up: the lines that do not fit are dropped.
+        for n in range(BURST):
+            agent = "burst-%d-%s" %(n, PAD)
+            if self._request (host, port, ssl, DOMAIN_DROP, agent) == -1:
+                return -1
+
+        # Let the reader catch up. A line larger than a whole ring
+        # is always dropped, the next one has to be logged.
+        open (self.stamp, 'w').close()
+        time.sleep (2)
+
+        if self._request (host, port, ssl, DOMAIN_DROP, 'oversized-' + 'y' * 5000) == -1:
+            return -1
+        if self._request (host, port, ssl, DOMAIN_DROP, 'after-overflow-' + PAD) == -1:
+            return -1
+
+        log = self._wait_log (self.log_drop, 'after-overflow')
+        if log is None:
+            return -1
+
+        logged = log.count ('burst-')
+        if logged == 0 or logged >= BURST:
+            return -1
+
+        if 'oversized-' in log:
+            return -1
+
+        # The second writer fails after its first line. The 'block'
+        # policy must not stall the threads on a broken writer.
+        if self._request (host, port, ssl, DOMAIN_ERROR, 'first-line-' + PAD) == -1:
+            return -1
+
+        if self._wait_log (self.log_error, 'first-line') is None:
+            return -1
+
+        for n in range(BURST):
+            agent = "broken-%d-%s" %(n, PAD)
+            if self._request (host, port, ssl, DOMAIN_ERROR, agent) == -1:
+                return -1
+
+        return 0
@@ -0,0 +1,109 @@
+import re
+import time
+from base import *
+
+DIR    = "/Proxy-Reuse-min/"
+MAGIC  = "Proxy connections are pre-opened"
+PORT   = get_free_port()
+PYTHON = look_for_python()
+
+REQUESTS = 3
+
+SCRIPT = """
+import threading
+from BaseHTTPServer import HTTPServer, BaseHTTPRequestHandler
+from SocketServer import ThreadingMixIn
+
+lock  = threading.Lock()
+stats = {'accepted': 0, 'reqs': 0}
+
+class Handler (BaseHTTPRequestHandler):
+    def setup (self):
+        BaseHTTPRequestHandler.setup (self)
+        lock.acquire()
+        stats['accepted'] += 1
+        lock.release()
+
+    def do_GET (self):
+        lock.acquire()
+        stats['reqs'] += 1
+        body = '%s accepted=%%(accepted)d reqs=%%(reqs)d' %% (stats)
+        lock.release()
+
+        self.send_response (200)
+        self.send_header ('Content-Type', 'text/plain')
+        self.send_header ('Content-Length', str(len(body)))
+        self.end_headers()
+        self.wfile.write (body)
+
+    def log_message (self, *args):
+        pass
+
+class Server (ThreadingMixIn, HTTPServer):
+    daemon_threads = True
+
+Server (("localhost", %d), Handler).serve_forever()
+""" % (MAGIC, PORT)
+
+source = get_next_source()
+
+CONF = """
+vserver!1!rule!3140!match = directory
+vserver!1!rule!3140!match!directory = %(DIR)s
+vserver!1!rule!3140!handler = proxy
+vserver!1!rule!3140!handler!reuse_max = 4
+vserver!1!rule!3140!handler!reuse_min = 2
+vserver!1!rule!3140!handler!balancer = round_robin
+vserver!1!rule!3140!handler!balancer!source!1 = %(source)d
+
+source!%(source)d!type = interpreter
+source!%(source)d!host = localhost:%(PORT)d
+source!%(source)d!interpreter = %(PYTHON)s %(http_file)s
+"""
+
+
+class TestEntry (TestBase):
+    def __init__ (self):
+        TestBase.__init__ (self, __file__)
+        self.request          = "GET %s HTTP/1.0\r\n" %(DIR)
+        self.expected_error   = 200
+        self.expected_content = [MAGIC]
+
+
+class TestPreopen (TestEntry):
+    def Run (self, host, port, ssl):
+        # Let the back-end accept the pre-opened connections
+        time.sleep (1)
+        return TestEntry.Run (self, host, port, ssl)
+
+    def CustomTest (self):
+        # The back-end closes every connection after the reply,
+        # so idle connections can only have been pre-opened.
+        tmp = re.findall (r'accepted=(\d+) reqs=(\d+)', self.reply)
+        if not tmp:
+            return -1
+
+        accepted, reqs = map (int, tmp[0])
+        if accepted <= reqs:
+            return -1
+        return 0
+
+
+class Test (TestCollection):
+    def __init__ (self):
+        TestCollection.__init__ (self, __file__)
+        self.name = "Proxy: pre-opened connections"
+
+    def JustBefore (self, www):
+        self.Empty()
+
+        for n in range(REQUESTS):
+            self.Add (TestEntry())
+        self.Add (TestPreopen())
+
+    def Prepare (self, www):
+        http_file = self.WriteFile (www, "proxy_reuse_min.py", 0444, SCRIPT)
+
+        vars = globals()
+        vars['http_file'] = http_file
+        self.conf = CONF % (vars)
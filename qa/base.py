@@ -41,6 +41,7 @@ class TestBase:
         self.request                 = ""      # GET / HTTP/1.0
         self.proxy_suitable          = True
         self.post                    = None
+        self.request_chunk           = None    # Send it in pieces of N bytes
         self.expected_error          = None
         self.expected_content        = None
         self.forbidden_content       = None
@@ -97,7 +98,17 @@ class TestBase:
         if self.post is not None:
             request += self.post
 
-        if self.ssl:
+        if self.request_chunk:
+            n = 0
+            while n < len(request):
+                piece = request[n:n+self.request_chunk]
+                if self.ssl:
+                    self.ssl.write (piece)
+                else:
+                    s.sendall (piece)
+                n += len(piece)
+                time.sleep (0.005)
+        elif self.ssl:
             n = self.ssl.write (request)
         else:
             n = s.send (request)
@@ -408,6 +419,7 @@ class TestCollection (TestBase):
         test.tmp            = self.tmp
         test.nobody         = self.nobody
         test.php_conf       = self.php_conf
+        test.inotify        = self.inotify
         test.proxy_suitable = self.proxy_suitable
 
         self.tests.append (test)
@@ -11,6 +11,7 @@ Usage: %s [parameters] [tests]
   -b            Run server as nobody
   -l            Run server with a log file
   -a            Randomize tests
+  -i            Enable the I/O cache inotify invalidation
 
   -n<NUM>       Repetitions
   -p<NUM>       Server port
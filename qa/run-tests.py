@@ -56,6 +56,7 @@ help      = False
 memproc   = False
 randomize = False
 proxy     = None
+inotify   = False
 
 server    = CHEROKEE_PATH
 delay     = SERVER_DELAY
@@ -97,6 +98,7 @@ for p in param:
     elif p     == '-h': help      = True
     elif p     == '-o': memproc   = True
     elif p     == '-a': randomize = True
+    elif p     == '-i': inotify   = True
     elif p[:2] == '-n': num       = int(p[2:])
     elif p[:2] == '-t': thds      = int(p[2:])
     elif p[:2] == '-p': port      = int(p[2:])
@@ -223,6 +225,8 @@ server!pid_file = %(pid)s
 server!module_dir = %(CHEROKEE_MODS)s
 server!module_deps = %(CHEROKEE_DEPS)s
 server!fdlimit = 8192
+server!iocache = 1
+server!iocache!inotify = %(inotify)d
 server!themes_dir = %(CHEROKEE_THEMES)s
 
 vserver!1!nick = default
@@ -294,6 +298,7 @@ for m in mods:
     obj.tmp      = tmp
     obj.nobody   = nobody
     obj.php_conf = php_ext
+    obj.inotify  = inotify
     objs.append(obj)
 
 # Prepare www files